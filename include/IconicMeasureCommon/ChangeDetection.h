@@ -0,0 +1,106 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <wx/wx.h>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Cut and fill between the depth maps of two frames of the same site.
+	 *
+	 * The first frame is the reference. Each of its depth map pixels (or depth pyramid cells, for a fast preview) is transformed to object coordinates,
+	 * projected into the second frame through its camera matrix and compared with the Z found there. Since the pixel hit in the second frame depends on
+	 * the Z used for the projection, the projection is repeated with the Z found, which converges in a few iterations for oblique cameras.
+	 * The differences are weighted by the ground areas of the reference pixels (see VolumeIntegrator), and swept in bands of rows on all cores.
+	 *
+	 * Requires camera matrices of both frames, see Geometry::SetCameraMatrix.
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT ChangeDetection {
+	public:
+		/**
+		 * @brief Parameters of the comparison
+		*/
+		struct Options {
+			size_t cLevel;			//!< 0 compares the depth map pixels, otherwise the cell means of depth pyramid level \c cLevel-1, see VolumeIntegrator::Integrate
+			size_t cIterations;		//!< Number of projections into the second frame, at least 1
+			double cMinChange;		//!< Differences up to this magnitude are neither cut nor fill, e.g. the noise of the depth maps
+
+			/**
+			 * @brief Constructor. Depth map pixels, two projections and no minimum change.
+			*/
+			Options();
+		};
+
+		/**
+		 * @brief Cut, fill and statistics of the differences Z2-Z1 of a region
+		*/
+		struct Result {
+			size_t cCount;			//!< Number of pixels (or cells) with valid Z in both frames
+			size_t cInvalidCount;	//!< Number of pixels (or cells) without valid Z in either frame, or outside the second frame
+			double cArea;			//!< Ground area of the compared pixels
+			double cCutVolume;		//!< Volume where the second frame is below the first, positive
+			double cFillVolume;		//!< Volume where the second frame is above the first
+			double cCutArea;		//!< Ground area of the cut
+			double cFillArea;		//!< Ground area of the fill
+			float cMin;				//!< Smallest difference
+			float cMax;				//!< Largest difference
+			double cMean;			//!< Mean difference per pixel
+			double cStdDev;			//!< Standard deviation of the differences
+
+			/**
+			 * @brief Constructor. No pixels.
+			*/
+			Result();
+
+			/**
+			 * @brief Get the net change in volume
+			 * @return Fill minus cut
+			*/
+			double GetNetVolume() const;
+		};
+
+		/**
+		 * @brief Differences Z2-Z1 on the grid of the first frame
+		*/
+		struct Raster {
+			size_t cWidth;					//!< Number of columns, the width of the depth map or pyramid level
+			size_t cHeight;					//!< Number of rows
+			std::vector<float> cvValues;	//!< Differences row by row, NaN outside the region and where not compared
+
+			/**
+			 * @brief Constructor. Empty raster.
+			*/
+			Raster();
+
+			/**
+			 * @brief Write the raster as a raw depth map file, \c float[cWidth*cHeight], which can be opened with RawDepthMap
+			 * @param filename File name, e.g. with extension \c .dmp
+			 * @return True on success
+			*/
+			bool Write(const wxString& filename) const;
+		};
+
+		/**
+		 * @brief Compare the frames inside a polygon
+		 * @param first Depth map and camera matrix of the reference frame, and depth pyramid if \c options.cLevel is not 0
+		 * @param second Depth map and camera matrix of the other frame
+		 * @param imagePolygon Polygon in image/camera coordinates of the first frame, holes allowed
+		 * @param options Parameters of the comparison
+		 * @param result Gets cut, fill and statistics
+		 * @param pDifference Gets the differences, if not null
+		 * @return True on success, false if a frame has no depth map or camera matrix
+		*/
+		static bool Compute(const Geometry& first, const Geometry& second, const Geometry::Polygon& imagePolygon, const Options& options, Result& result, Raster* pDifference = nullptr);
+
+		/**
+		 * @brief Compare the frames over the whole overlap, i.e. every pixel of the first frame that is seen in the second
+		 * @param first Depth map and camera matrix of the reference frame, and depth pyramid if \c options.cLevel is not 0
+		 * @param second Depth map and camera matrix of the other frame
+		 * @param options Parameters of the comparison
+		 * @param result Gets cut, fill and statistics
+		 * @param pDifference Gets the differences, if not null
+		 * @return True on success, false if a frame has no depth map or camera matrix
+		*/
+		static bool Compute(const Geometry& first, const Geometry& second, const Options& options, Result& result, Raster* pDifference = nullptr);
+	};
+}
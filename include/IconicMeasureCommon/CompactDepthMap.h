@@ -0,0 +1,115 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/DepthMap.h>
+#include <boost/shared_ptr.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Depth map stored as 16 bit half floats, which halves the memory compared to RawDepthMap.
+	 *
+	 * The relative error is at most 2^-11, e.g. 5 cm at Z=100. Values above 65504 become infinity and stay invalid.
+	 * The values are converted from a source depth map once, with F16C instructions if compiled with AVX2 support.
+	 * @sa DepthMap::EStorage QuantizedDepthMap
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT HalfDepthMap : public DepthMap {
+	public:
+		/**
+		 * @brief Constructor
+		*/
+		HalfDepthMap();
+
+		/**
+		 * @brief Convert all values of a depth map to half floats.
+		 *
+		 * All tiles of a TiledDepthMap are decompressed, once.
+		 * @param source Depth map to convert
+		 * @return True on success
+		*/
+		bool Create(const DepthMap& source);
+
+		bool GetZ(const int x, const int y, float& Z) const override;
+		bool GetRow(const int y, float* pRow) const override;
+
+		/**
+		 * @brief Values are not stored as floats
+		 * @return nullptr
+		*/
+		const float* GetData() const override;
+		size_t GetMemoryUsage() const override;
+
+		/**
+		 * @brief Get largest absolute error of valid Z values compared to the source depth map
+		 * @return Max error
+		*/
+		float GetMaxError() const override;
+
+	private:
+		std::vector<uint16_t> cvData; //!< Half float values, row by row
+		float cMaxError; //!< Largest absolute error of valid values
+	};
+	typedef boost::shared_ptr<HalfDepthMap> HalfDepthMapPtr; //!< Smart pointer to a half float depth map
+
+	/**
+	 * @brief Depth map stored as 16 bit fixed point values, which halves the memory compared to RawDepthMap.
+	 *
+	 * Z = offset + scale * value, where offset and scale are chosen from the range of valid Z values of the depth map,
+	 * so the absolute error is at most half the scale, e.g. 0.8 mm for a 100 m Z range.
+	 * Invalid values (above DepthMap::cMaxValidZ or not finite) are stored as a reserved value and returned as the largest float.
+	 * @sa DepthMap::EStorage HalfDepthMap
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT QuantizedDepthMap : public DepthMap {
+	public:
+		/**
+		 * @brief Constructor
+		*/
+		QuantizedDepthMap();
+
+		/**
+		 * @brief Quantize all values of a depth map.
+		 *
+		 * All tiles of a TiledDepthMap are decompressed, once.
+		 * @param source Depth map to convert
+		 * @return True on success
+		*/
+		bool Create(const DepthMap& source);
+
+		bool GetZ(const int x, const int y, float& Z) const override;
+		bool GetRow(const int y, float* pRow) const override;
+
+		/**
+		 * @brief Values are not stored as floats
+		 * @return nullptr
+		*/
+		const float* GetData() const override;
+		size_t GetMemoryUsage() const override;
+
+		/**
+		 * @brief Get largest absolute error of valid Z values compared to the source depth map
+		 * @return Max error
+		*/
+		float GetMaxError() const override;
+
+		/**
+		 * @brief Get Z distance between two consecutive fixed point values
+		 * @return Scale
+		*/
+		float GetScale() const;
+
+		/**
+		 * @brief Get Z of fixed point value 0, i.e. the smallest valid Z
+		 * @return Offset
+		*/
+		float GetOffset() const;
+
+	private:
+		static const uint16_t cInvalid = 0xffff; //!< Stored for invalid values
+
+		std::vector<uint16_t> cvData; //!< Fixed point values, row by row
+		float cScale; //!< Z distance between consecutive values
+		float cOffset; //!< Z of value 0
+		float cMaxError; //!< Largest absolute error of valid values
+	};
+	typedef boost::shared_ptr<QuantizedDepthMap> QuantizedDepthMapPtr; //!< Smart pointer to a fixed point depth map
+}
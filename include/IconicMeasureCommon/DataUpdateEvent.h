@@ -3,6 +3,7 @@
 #include <IconicMeasureCommon/exports.h>
 #include <IconicMeasureCommon/Geometry.h>
 #include <IconicMeasureCommon/Shape.h>
+#include <IconicMeasureCommon/ShapeSlotMap.h>
 
 /**
  * @brief An event that holds data regarding a shape that should be presented.
@@ -20,15 +21,15 @@ public:
 	/**
 	 * @brief Constructor specifically for when deleting a shape
 	 * @param winid Window id
-	 * @param index Index of shape to delete
+	 * @param handle Handle of shape to delete, the null handle to delete all shapes
 	*/
-	DataUpdateEvent(int winid, int index);
+	DataUpdateEvent(int winid, const iconic::ShapeHandle& handle);
 	/**
 	 * @brief Initializer for updating data for a point
-	 * @param index The index of the shape
+	 * @param handle The handle of the shape
 	 * @param shape A pointer to the shape
 	*/
-	void Initialize(const int index, const iconic::ShapePtr shape);
+	void Initialize(const iconic::ShapeHandle& handle, const iconic::ShapePtr shape);
 
 	/**
 	 * @brief Returns the associated shape
@@ -47,10 +48,10 @@ public:
 	void GetPoint(float& x, float& y, float& z) const;
 
 	/**
-	 * @brief Get the shape index
-	 * @return The shape index
+	 * @brief Get the shape handle
+	 * @return The shape handle, null when deleting all shapes
 	*/
-	int GetIndex() const;
+	const iconic::ShapeHandle& GetHandle() const;
 	
 	/**
 	 * @brief Says if the event notifies that a shape has been deleted
@@ -59,16 +60,29 @@ public:
 	bool IsDeletionEvent() const;
 
 
+	/**
+	 * @brief Set how refined the measurements of the shape are
+	 * @param level 0 for final values, otherwise the values are provisional (computed at a coarser depth resolution) and a refined event follows
+	*/
+	void SetRefinementLevel(size_t level);
+
+	/**
+	 * @brief Get how refined the measurements of the shape are
+	 * @return 0 for final values, larger for coarser provisional values
+	*/
+	size_t GetRefinementLevel() const;
+
 	/**
 	 * @brief Deep copy of parameters
 	 * @return Cloned copy
 	*/
 	virtual wxEvent* Clone() const;
 private:
-	int cShapeIndex;
+	iconic::ShapeHandle cShapeHandle;
 	iconic::ShapePtr cpShape;
 
 	bool cDeleteEvent;
+	size_t cRefinementLevel;
 };
 
 wxDECLARE_EXPORTED_EVENT(ICONIC_MEASURE_COMMON_EXPORT, DATA_UPDATE, DataUpdateEvent);
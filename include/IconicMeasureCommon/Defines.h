@@ -21,6 +21,7 @@ namespace iconic {
 			ID_CONTRAST_MAX_MINUS,		//!< Contrast max value
 			ID_VIDEO_USE_TIMER,			//!< Toggle use of timer
 			ID_VIDEO_TIMER,				//!< Timer for correct frame rate
+			ID_REFINE_TIMER,			//!< Timer for refining provisional measurements
 			ID_VIDEO_SET_FPS,			//!< Set frames per second, frame rate
 			ID_VIDEO_SHOW_LOG,			//!< Show log window
 			ID_VIDEO_DECODER,			//!< Which decoder to use
@@ -40,7 +41,8 @@ namespace iconic {
 			ID_TESSELATE_DUMMY_EXAMPLE,	//!< \todo Remove!
 			ID_CLEAR_ALL_SHAPES,		//!< Clear all shapes
 			ID_TOOLBAR_SIDEPANEL,
-			ID_LOAD_WKT
+			ID_LOAD_WKT,
+			ID_CONVERT_DEPTH_MAPS		//!< Convert raw depth maps to tiled depth maps
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/DepthMap.h>
+#include <boost/shared_ptr.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Summed-area tables (integral images) of Z, Z squared and valid count of a depth map.
+	 *
+	 * Gives sum, mean and variance of the valid Z values of any axis aligned pixel rectangle in constant time.
+	 * The sums are double precision and relative to an offset (e.g. the mean Z of the depth map), which keeps the variance accurate.
+	 * Uses 20 bytes per pixel, i.e. five times a float depth map, so it is only built on request.
+	 * @sa Geometry::GetDepthStatistics MeasureHandler::SetBuildDepthIntegral
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT DepthIntegral {
+	public:
+		/**
+		 * @brief Statistics of the valid Z values of a rectangle
+		*/
+		struct Statistics {
+			double cSum;		//!< Sum of Z
+			double cMean;		//!< Mean Z
+			double cVariance;	//!< Population variance of Z
+			size_t cCount;		//!< Number of valid pixels
+		};
+
+		/**
+		 * @brief Constructor
+		*/
+		DepthIntegral();
+
+		/**
+		 * @brief Build the tables from a depth map. Uses all cores.
+		 * @param depthMap Depth map
+		 * @param offset Subtracted from Z before summing. Use a typical Z of the depth map.
+		 * @return True on success
+		*/
+		bool Build(const DepthMap& depthMap, double offset = 0.0);
+
+		/**
+		 * @brief Get statistics of a pixel rectangle in constant time. The rectangle is clipped to the depth map.
+		 * @param x0 First pixel column
+		 * @param y0 First pixel row
+		 * @param x1 One past the last pixel column
+		 * @param y1 One past the last pixel row
+		 * @param statistics Statistics of the valid Z values
+		 * @return True if the rectangle has valid Z values
+		*/
+		bool GetStatistics(int x0, int y0, int x1, int y1, Statistics& statistics) const;
+
+		/**
+		 * @brief Get number of bytes used by the tables
+		 * @return Number of bytes
+		*/
+		size_t GetMemoryUsage() const;
+
+	private:
+		size_t cSize[2];				//!< Table size, one more than the depth map in each direction
+		double cOffset;					//!< Subtracted from Z before summing
+		std::vector<double> cvSum;		//!< Sum of Z-offset above and left of each position
+		std::vector<double> cvSum2;		//!< Sum of (Z-offset)^2 above and left of each position
+		std::vector<uint32_t> cvCount;	//!< Number of valid values above and left of each position
+	};
+	typedef boost::shared_ptr<DepthIntegral> DepthIntegralPtr; //!< Smart pointer to depth summed-area tables
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <wx/wx.h>
+#include <limits>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Read only access to a depth map with one Z value per image pixel.
+	 *
+	 * The Z value of pixel (x,y) is found at index \c y*width+x, i.e. the values are stored row by row.
+	 * Implementations decide how (and when) the values are brought into memory.
+	 * @sa RawDepthMap
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT DepthMap {
+	public:
+		/**
+		 * @brief How the Z values are stored in memory
+		 * @sa HalfDepthMap QuantizedDepthMap
+		*/
+		enum class EStorage {
+			FLOAT32 = 0,	//!< 32 bit floats as read from file
+			FLOAT16 = 1,	//!< 16 bit half floats. Relative error at most 2^-11.
+			FIXED16 = 2		//!< 16 bit fixed point with per depth map scale and offset. Absolute error at most half the scale.
+		};
+
+		/**
+		 * @brief Z values above this are invalid, e.g. no data or sky
+		*/
+		static const float cMaxValidZ;
+
+		/**
+		 * @brief Check if a Z value is valid
+		 * @param Z Z value
+		 * @return False for values above cMaxValidZ, infinity and NaN
+		*/
+		static bool IsValid(float Z) {
+			return Z <= cMaxValidZ && Z >= -std::numeric_limits<float>::max();
+		}
+
+		/**
+		 * @brief Destructor
+		*/
+		virtual ~DepthMap();
+
+		/**
+		 * @brief Get width of depth map
+		 * @return Number of columns
+		*/
+		size_t GetWidth() const;
+
+		/**
+		 * @brief Get height of depth map
+		 * @return Number of rows
+		*/
+		size_t GetHeight() const;
+
+		/**
+		 * @brief Get Z value of a pixel
+		 * @param x Pixel x/column coordinate
+		 * @param y Pixel y/row coordinate
+		 * @param Z The Z value
+		 * @return True if (x,y) is inside the depth map, false otherwise
+		*/
+		virtual bool GetZ(const int x, const int y, float& Z) const = 0;
+
+		/**
+		 * @brief Get all Z values of a row.
+		 *
+		 * Much faster than calling GetZ for each pixel. The default implementation copies from GetData or, if not contiguous, calls GetZ.
+		 * @param y Pixel y/row coordinate
+		 * @param pRow Gets the \c width values of the row
+		 * @return True if y is inside the depth map, false otherwise
+		*/
+		virtual bool GetRow(const int y, float* pRow) const;
+
+		/**
+		 * @brief Get all Z values as one contiguous array
+		 * @return Pointer to \c width*height values, or nullptr if the depth map is not stored contiguously
+		*/
+		virtual const float* GetData() const = 0;
+
+		/**
+		 * @brief Get number of bytes of depth values held in memory (or mapped) by the depth map
+		 * @return Number of bytes
+		*/
+		virtual size_t GetMemoryUsage() const = 0;
+
+		/**
+		 * @brief Get largest absolute error of the valid Z values compared to the file they were read from
+		 * @return 0 unless the values are stored with less precision (see EStorage)
+		*/
+		virtual float GetMaxError() const;
+
+	protected:
+		/**
+		 * @brief Constructor
+		 * @param width Width of depth map
+		 * @param height Height of depth map
+		*/
+		DepthMap(size_t width = 0, size_t height = 0);
+
+		size_t cSize[2]; //!< Depth map size (width,height)
+	};
+	typedef boost::shared_ptr<DepthMap> DepthMapPtr; //!< Smart pointer to a depth map
+
+	/**
+	 * @brief Depth map read from a raw \c .dmp file with \c float[width*height] values.
+	 *
+	 * The file is memory mapped, so opening is done in constant time and the values are paged in by the OS when they are read.
+	 * Pages are shared through the OS page cache when the same file is opened again.
+	 * If the file cannot be mapped the values are copied to memory instead.
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT RawDepthMap : public DepthMap {
+	public:
+		/**
+		 * @brief Constructor
+		*/
+		RawDepthMap();
+
+		/**
+		 * @brief Destructor. Unmaps the file if mapped.
+		*/
+		~RawDepthMap();
+
+		/**
+		 * @brief Open depth map file
+		 * @param filename Depth map file name
+		 * @param width Width of depth map (same as image width)
+		 * @param height Height of depth map (same as image height)
+		 * @param bAllowMapping Try to memory map the file before falling back to copying it
+		 * @return True on success, false if the file could not be read or has too few values
+		*/
+		bool Open(const wxString& filename, size_t width, size_t height, bool bAllowMapping = true);
+
+		/**
+		 * @brief Says if the values are memory mapped from file or copied to memory
+		 * @return True if memory mapped
+		*/
+		bool IsMapped() const;
+
+		bool GetZ(const int x, const int y, float& Z) const override;
+		const float* GetData() const override;
+		size_t GetMemoryUsage() const override;
+
+	private:
+		/**
+		 * @brief Memory map the whole depth map file
+		 * @param filename Depth map file name
+		 * @return True on success
+		*/
+		bool Map(const wxString& filename);
+
+		/**
+		 * @brief Copy the depth map file to memory
+		 * @param filename Depth map file name
+		 * @param nPixels Number of values to read
+		 * @return True on success
+		*/
+		bool Copy(const wxString& filename, size_t nPixels);
+
+		boost::iostreams::mapped_file_source cMappedFile; //!< Memory mapped depth map file
+		std::vector<float> cvData; //!< Copied values when the file could not be mapped
+		const float* cpData; //!< Points at the mapped or copied values
+	};
+	typedef boost::shared_ptr<RawDepthMap> RawDepthMapPtr; //!< Smart pointer to a raw depth map
+}
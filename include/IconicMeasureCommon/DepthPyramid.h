@@ -0,0 +1,156 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/DepthMap.h>
+#include <boost/shared_ptr.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Min, max and mean of the valid Z values of a depth map at successively coarser resolutions.
+	 *
+	 * A cell of level 0 covers \c blockSize x \c blockSize pixels and each following level halves the resolution, down to a single cell.
+	 * Level 0 starts at a block size of 4 by default so that the pyramid uses about a third of the memory of a float depth map.
+	 * Invalid values (see DepthMap::IsValid) are not counted. Cells without valid values have count 0.
+	 *
+	 * The region queries are conservative: every cell touching the region is used, so the range contains the range of the region.
+	 * @sa Geometry::GetDepthRange Geometry::GetHeightRange
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT DepthPyramid {
+	public:
+		/**
+		 * @brief Z statistics of a cell or region
+		*/
+		struct Range {
+			float cMin;		//!< Smallest valid Z
+			float cMax;		//!< Largest valid Z
+			float cMean;	//!< Mean of valid Z
+			size_t cCount;	//!< Number of valid pixels
+		};
+
+		/**
+		 * @brief Constructor
+		*/
+		DepthPyramid();
+
+		/**
+		 * @brief Build all levels from a depth map. Uses all cores.
+		 * @param depthMap Depth map
+		 * @param blockSize Width and height in pixels of a level 0 cell
+		 * @return True on success
+		*/
+		bool Build(const DepthMap& depthMap, size_t blockSize = 4);
+
+		/**
+		 * @brief Write all levels to a buffer in native byte order, e.g. to store the pyramid with a tiled depth map
+		 * @param vBuffer Gets the levels
+		 * @sa Read TiledDepthMap::Convert
+		*/
+		void Write(std::vector<char>& vBuffer) const;
+
+		/**
+		 * @brief Read levels written by Write
+		 * @param pData The written levels
+		 * @param size Number of bytes
+		 * @param width Width of the depth map the pyramid was built from
+		 * @param height Height of the depth map the pyramid was built from
+		 * @return True on success, false if the data is not a pyramid of a depth map of that size
+		*/
+		bool Read(const char* pData, size_t size, size_t width, size_t height);
+
+		/**
+		 * @brief Get number of levels
+		 * @return Number of levels, 0 if not built
+		*/
+		size_t GetNumberOfLevels() const;
+
+		/**
+		 * @brief Get width and height in pixels of a cell of a level
+		 * @param level Level
+		 * @return Cell size in pixels
+		*/
+		size_t GetCellSize(size_t level) const;
+
+		/**
+		 * @brief Get number of cells of a level
+		 * @param level Level
+		 * @param width Number of columns
+		 * @param height Number of rows
+		*/
+		void GetSize(size_t level, size_t& width, size_t& height) const;
+
+		/**
+		 * @brief Get statistics of a cell
+		 * @param level Level
+		 * @param x Cell column
+		 * @param y Cell row
+		 * @param range Cell statistics
+		 * @return True if the cell exists
+		*/
+		bool GetCell(size_t level, size_t x, size_t y, Range& range) const;
+
+		/**
+		 * @brief Get the mean Z of the cells of a row, e.g. to use a level as a coarse depth map
+		 * @param level Level
+		 * @param y Cell row
+		 * @param pRow Gets one value per cell column, NaN for cells without valid values
+		 * @return True if the row exists
+		*/
+		bool GetMeanRow(size_t level, size_t y, float* pRow) const;
+
+		/**
+		 * @brief Get Z range of a pixel rectangle.
+		 *
+		 * Uses the finest level where the rectangle spans at most \c maxCells cells in each direction.
+		 * @param x0 First pixel column
+		 * @param y0 First pixel row
+		 * @param x1 One past the last pixel column
+		 * @param y1 One past the last pixel row
+		 * @param range Range of the cells touching the rectangle
+		 * @param maxCells Max number of cells to visit in each direction
+		 * @return True if the rectangle overlaps the depth map and has valid values
+		*/
+		bool GetRange(int x0, int y0, int x1, int y1, Range& range, size_t maxCells = 16) const;
+
+		/**
+		 * @brief Choose the finest level where a pixel rectangle spans at most \c maxCells cells in each direction
+		 * @param width Rectangle width in pixels
+		 * @param height Rectangle height in pixels
+		 * @param maxCells Max number of cells in each direction
+		 * @return Level
+		*/
+		size_t GetLevel(size_t width, size_t height, size_t maxCells) const;
+
+		/**
+		 * @brief Get number of bytes used by all levels
+		 * @return Number of bytes
+		*/
+		size_t GetMemoryUsage() const;
+
+	private:
+		/**
+		 * @brief One resolution of the pyramid, stored as separate arrays so the build loops vectorize
+		*/
+		struct Level {
+			size_t cSize[2];				//!< Number of cells (width,height)
+			std::vector<float> cvMin;		//!< Min Z per cell
+			std::vector<float> cvMax;		//!< Max Z per cell
+			std::vector<float> cvMean;		//!< Mean Z per cell
+			std::vector<uint32_t> cvCount;	//!< Number of valid pixels per cell
+		};
+
+		/**
+		 * @brief Build level 0 from the depth map
+		*/
+		bool BuildBase(const DepthMap& depthMap);
+
+		/**
+		 * @brief Build a level from the level below
+		*/
+		void BuildLevel(const Level& below, Level& level);
+
+		std::vector<Level> cvLevels; //!< Levels, finest first
+		size_t cBlockSize; //!< Cell size of level 0 in pixels
+	};
+	typedef boost::shared_ptr<DepthPyramid> DepthPyramidPtr; //!< Smart pointer to a depth pyramid
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <boost/shared_ptr.hpp>
+#include <wx/wx.h>
+#include <wx/datetime.h>
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace iconic {
+	/**
+	 * @brief Least recently used cache of parsed frames, i.e. the depth map and camera of a frame.
+	 *
+	 * Frames are identified by depth map file name. The modification times of the depth map and camera files are stored with the frame,
+	 * and a cached frame whose files have changed since it was read is treated as a miss. The times are taken before the files are read (see GetFileTimes),
+	 * so a file rewritten while it is read makes the frame a miss instead of keeping the old data with the new time.
+	 * Frames are evicted, least recently used first, when the memory used by the cached depth maps exceeds the memory budget.
+	 * The most recently added frame is always kept, even if it alone exceeds the budget.
+	 *
+	 * All methods are thread safe.
+	 * @sa MeasureHandler::Parse
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT FrameCache {
+	public:
+		/**
+		 * @brief Modification times of the files of a frame
+		*/
+		struct FileTimes {
+			wxDateTime cDepthMapTime; //!< Modification time of the depth map file
+			wxDateTime cCameraTime; //!< Modification time of the camera file
+		};
+
+		/**
+		 * @brief Get the modification times of the files of a frame. Call before reading the files and pass the times to Put.
+		 * @param depthMapFileName Depth map file name of the frame
+		 * @param cameraFileName Camera file name of the frame
+		 * @return The modification times, invalid for missing files
+		*/
+		static FileTimes GetFileTimes(const wxString& depthMapFileName, const wxString& cameraFileName);
+
+		/**
+		 * @brief Constructor
+		 * @param memoryBudget Maximum number of bytes used by cached frames
+		*/
+		FrameCache(size_t memoryBudget = 1024 * 1024 * 1024);
+
+		/**
+		 * @brief Get a cached frame
+		 * @param depthMapFileName Depth map file name of the frame
+		 * @param cameraFileName Camera file name of the frame
+		 * @param geometry Set to the cached depth map, camera and image size of the frame on success
+		 * @return True if the frame was cached and its files have not changed, false otherwise
+		*/
+		bool Get(const wxString& depthMapFileName, const wxString& cameraFileName, Geometry& geometry);
+
+		/**
+		 * @brief Add a parsed frame to the cache, replacing any cached frame with the same depth map file name
+		 * @param depthMapFileName Depth map file name of the frame
+		 * @param times Modification times of the depth map and camera files from GetFileTimes before they were read
+		 * @param geometry Geometry with depth map and camera of the frame. The depth map and camera must not be modified afterwards since they are shared with the cache.
+		*/
+		void Put(const wxString& depthMapFileName, const FileTimes& times, const Geometry& geometry);
+
+		/**
+		 * @brief Check if a frame is cached and up to date without counting it as a hit or miss
+		 * @param depthMapFileName Depth map file name of the frame
+		 * @param cameraFileName Camera file name of the frame
+		 * @return True if cached
+		*/
+		bool Contains(const wxString& depthMapFileName, const wxString& cameraFileName) const;
+
+		/**
+		 * @brief Remove all frames and reset hit and miss counters
+		*/
+		void Clear();
+
+		/**
+		 * @brief Set memory budget. Evicts frames if the new budget is exceeded.
+		 * @param memoryBudget Maximum number of bytes used by cached frames
+		*/
+		void SetMemoryBudget(size_t memoryBudget);
+
+		/**
+		 * @brief Get memory budget
+		 * @return Maximum number of bytes used by cached frames
+		*/
+		size_t GetMemoryBudget() const;
+
+		/**
+		 * @brief Get number of bytes currently used by cached frames
+		 * @return Number of bytes
+		*/
+		size_t GetMemoryUsage() const;
+
+		/**
+		 * @brief Get number of cached frames
+		 * @return Number of frames
+		*/
+		size_t GetNumberOfFrames() const;
+
+		/**
+		 * @brief Get number of successful Get calls
+		 * @return Number of hits
+		*/
+		size_t GetHits() const;
+
+		/**
+		 * @brief Get number of failed Get calls
+		 * @return Number of misses
+		*/
+		size_t GetMisses() const;
+
+	private:
+		/**
+		 * @brief A cached frame
+		*/
+		struct Frame {
+			Geometry cGeometry; //!< Depth map, camera and image size
+			FileTimes cTimes; //!< Modification times of the files before they were read
+			std::list<wxString>::iterator cLru; //!< Position in the least recently used list
+		};
+
+		/**
+		 * @brief Check that the files of a cached frame have not been modified. Must be called with cMutex locked.
+		*/
+		bool IsUpToDate(const Frame& frame, const wxString& depthMapFileName, const wxString& cameraFileName) const;
+
+		/**
+		 * @brief Remove a frame. Must be called with cMutex locked.
+		*/
+		void Erase(std::map<wxString, Frame>::iterator it);
+
+		/**
+		 * @brief Evict least recently used frames until the memory budget is met. Must be called with cMutex locked.
+		*/
+		void Evict();
+
+		/**
+		 * @brief Sum memory used by all cached frames. Must be called with cMutex locked.
+		 *
+		 * The sum is recomputed since tiled depth maps use more memory as tiles are decompressed.
+		*/
+		size_t SumMemoryUsage() const;
+
+		std::map<wxString, Frame> cmFrames; //!< Cached frames by depth map file name
+		std::list<wxString> cLru; //!< Depth map file names, most recently used first
+		size_t cMemoryBudget; //!< Maximum number of bytes used by cached frames
+		size_t cHits; //!< Number of successful Get calls
+		size_t cMisses; //!< Number of failed Get calls
+		mutable std::mutex cMutex; //!< Protects the cache
+	};
+	typedef boost::shared_ptr<FrameCache> FrameCachePtr; //!< Smart pointer to a frame cache
+}
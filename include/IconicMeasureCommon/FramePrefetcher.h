@@ -0,0 +1,90 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/FrameCache.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <boost/shared_ptr.hpp>
+#include <wx/wx.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Reads depth maps and cameras of upcoming frames on worker threads and puts them in a FrameCache.
+	 *
+	 * When the user steps to a prefetched frame, MeasureHandler::Parse only has to take the frame from the cache.
+	 * Errors while prefetching are not logged, since the frame may never be shown. They are reported by Parse if the frame is shown.
+	 * @sa MeasureHandler::SetPrefetchCount
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT FramePrefetcher {
+	public:
+		/**
+		 * @brief A frame to prefetch
+		*/
+		struct Request {
+			wxString cDepthMapFileName; //!< Depth map file name
+			wxString cCameraFileName; //!< Camera file name
+			size_t cImageSize[2]; //!< Image size (width,height)
+			DepthMap::EStorage cStorage; //!< How to store the depth map in memory
+			bool cbDepthIntegral; //!< Build summed-area tables of the depth map
+		};
+
+		/**
+		 * @brief Function reading the depth map and camera of a frame into a Geometry. Called on worker threads, so it must be thread safe.
+		*/
+		typedef std::function<bool(const Request&, Geometry&)> Loader;
+
+		/**
+		 * @brief Constructor. Starts the worker threads.
+		 * @param cache Cache to put prefetched frames in. Must outlive the prefetcher.
+		 * @param loader Reads a frame
+		 * @param nThreads Number of worker threads
+		*/
+		FramePrefetcher(FrameCache& cache, Loader loader, size_t nThreads = 2);
+
+		/**
+		 * @brief Destructor. Drops queued frames and waits for frames being read.
+		*/
+		~FramePrefetcher();
+
+		/**
+		 * @brief Prefetch frames in the given order. Replaces frames queued by earlier calls that have not started yet.
+		 * @param vRequests Frames to prefetch, most urgent first
+		*/
+		void Prefetch(const std::vector<Request>& vRequests);
+
+		/**
+		 * @brief Drop a queued frame and wait until it is no longer being read.
+		 *
+		 * Called before reading a frame synchronously so that the same frame is not read twice.
+		 * @param depthMapFileName Depth map file name of the frame
+		*/
+		void Wait(const wxString& depthMapFileName);
+
+		/**
+		 * @brief Drop all queued frames and wait until frames being read have been put in the cache
+		*/
+		void Cancel();
+
+	private:
+		/**
+		 * @brief Worker thread loop
+		*/
+		void Run();
+
+		FrameCache& cCache; //!< Where prefetched frames are put
+		Loader cLoader; //!< Reads a frame
+		std::deque<Request> cQueue; //!< Frames waiting to be read
+		std::set<wxString> csInFlight; //!< Depth map file names of frames being read
+		bool cbStop; //!< Tells workers to quit
+		std::mutex cMutex; //!< Protects queue, in flight frames and stop flag
+		std::condition_variable cWork; //!< Signalled when frames are queued or on stop
+		std::condition_variable cDone; //!< Signalled when a frame has been read
+		std::vector<std::thread> cvThreads; //!< Worker threads
+	};
+	typedef boost::shared_ptr<FramePrefetcher> FramePrefetcherPtr; //!< Smart pointer to a frame prefetcher
+}
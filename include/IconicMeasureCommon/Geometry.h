@@ -1,12 +1,18 @@
 #pragma once
 #include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/DepthMap.h>
+#include <IconicMeasureCommon/DepthPyramid.h>
+#include <IconicMeasureCommon/DepthIntegral.h>
 #include <IconicSensor/Camera.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/point.hpp>
 #include <boost/geometry/geometries/polygon.hpp>
+#include <boost/geometry/geometries/box.hpp>
 #include <wx/wx.h>
 #include <wx/colour.h>
+#include <cstdint>
+#include <vector>
 
 namespace iconic {
 	/**
@@ -26,6 +32,10 @@ namespace iconic {
 
 		typedef boost::shared_ptr<Point> PointPtr; //!< Smart pointer to a 2D point
 
+		typedef boost::geometry::model::box<Point> Box; //!< 2D axis aligned box
+
+		typedef Eigen::Matrix<double, 3, 4, Eigen::RowMajor | Eigen::DontAlign> CameraMatrix; //!< 3x4 camera matrix. Not aligned, so that Geometry can be allocated anywhere.
+
 		typedef boost::geometry::model::linestring<Point> VectorTrain; //!< 2D vector train
 		typedef boost::shared_ptr<VectorTrain> VectorTrainPtr; //!< Smart pointer to a 2D vector train
 
@@ -33,9 +43,51 @@ namespace iconic {
 		typedef boost::shared_ptr<VectorTrain3D> VectorTrain3DPtr; //!< Smart pointer to a 3D vector train
 
 		/**
-		 * @brief Unimplemented type for storing data regarding heightprofile of line
+		 * @brief Height profile of a vector train, sampled at the depth map resolution.
+		 *
+		 * The samples are stored in one contiguous buffer: cSize distances (double), then cSize heights (float), then cSize validity flags (uint8_t).
+		 * @sa Geometry::GetHeightProfile
 		*/
-		struct HeightProfile {};
+		struct HeightProfile {
+			size_t cSize;						//!< Number of samples
+			std::vector<size_t> cvSegments;		//!< Index of the first sample of each segment, followed by cSize
+			std::vector<unsigned char> cvBuffer;	//!< Distances, heights and validity flags
+
+			/**
+			 * @brief Constructor. Empty profile.
+			*/
+			HeightProfile() : cSize(0) {}
+
+			/**
+			 * @brief Set number of samples. The contents are undefined after resizing.
+			 * @param n Number of samples
+			*/
+			void Resize(size_t n) {
+				cSize = n;
+				cvBuffer.resize(n * (sizeof(double) + sizeof(float) + sizeof(uint8_t)));
+			}
+
+			/**
+			 * @brief Get horizontal object distance of each sample from the start of the line, along the line
+			 * @return cSize distances
+			*/
+			double* GetDistances() { return reinterpret_cast<double*>(cvBuffer.data()); }
+			const double* GetDistances() const { return reinterpret_cast<const double*>(cvBuffer.data()); }
+
+			/**
+			 * @brief Get height (Z) of each sample
+			 * @return cSize heights, NaN where not valid
+			*/
+			float* GetHeights() { return reinterpret_cast<float*>(cvBuffer.data() + cSize * sizeof(double)); }
+			const float* GetHeights() const { return reinterpret_cast<const float*>(cvBuffer.data() + cSize * sizeof(double)); }
+
+			/**
+			 * @brief Get validity of each sample
+			 * @return cSize flags, 1 where the depth map has a valid height, 0 where not
+			*/
+			uint8_t* GetValid() { return cvBuffer.data() + cSize * (sizeof(double) + sizeof(float)); }
+			const uint8_t* GetValid() const { return cvBuffer.data() + cSize * (sizeof(double) + sizeof(float)); }
+		};
 		typedef boost::shared_ptr<HeightProfile> HeightProfilePtr; //!< Smart pointer to heightprofile data
 
 		/**
@@ -45,6 +97,25 @@ namespace iconic {
 			RED = 0, GREEN = 1, CYAN = 2, MAGENTA = 3, YELLOW = 4, CERISE = 5
 		};
 
+		/**
+		 * @brief Result for each point of the batch ImageToObject
+		*/
+		enum class EPointStatus : uint8_t {
+			OK = 0,				//!< Transformed to object coordinates
+			OUTSIDE = 1,		//!< Outside the depth map
+			INVALID_Z = 2,		//!< No valid Z in the depth map, e.g. sky
+			CAMERA_FAILED = 3	//!< The camera could not transform the point
+		};
+
+		/**
+		 * @brief Kind of camera matrix. Selects the image to object kernel, see SetCameraMatrix.
+		*/
+		enum class EProjection {
+			NONE = 0,		//!< No camera matrix, Camera::Image2Object is called for each point
+			PROJECTIVE = 1,	//!< Full projective camera. A 2x2 system is solved for each point.
+			NADIR = 2		//!< Image plane parallel to the XY plane, i.e. vertical or affine cameras where the third row of the matrix is (0,0,*,*). One 2x2 inverse for all points.
+		};
+
 
 		/**
 		 * @brief Constructor
@@ -103,6 +174,47 @@ namespace iconic {
 		*/
 		bool ImageToObject(const std::vector<iconic::Geometry::Point>& vIn, std::vector<iconic::Geometry::Point3D>& vOut);
 
+		/**
+		 * @brief Transform many image coordinates to object coordinates.
+		 *
+		 * Much faster than transforming the points one by one, e.g. when densifying lines and polygons.
+		 * The points are transformed in blocks where the image to pixel transformation and depth lookup are vectorized.
+		 * Failed points are not logged one by one, check the status instead.
+		 * With a camera matrix (see SetCameraMatrix) the object coordinates are computed by a kernel specialized for the projection, otherwise by Camera::Image2Object.
+		 * @param x Image x coordinates
+		 * @param y Image y coordinates
+		 * @param n Number of points
+		 * @param X Output object X coordinates. Undefined where status is not \c EPointStatus::OK.
+		 * @param Y Output object Y coordinates. Undefined where status is not \c EPointStatus::OK.
+		 * @param Z Output object Z coordinates. Undefined where status is not \c EPointStatus::OK.
+		 * @param status Output status of each point
+		 * @return Number of points transformed
+		*/
+		size_t ImageToObject(const double* x, const double* y, size_t n, double* X, double* Y, double* Z, EPointStatus* status) const;
+
+		/**
+		 * @brief Transform many image coordinates with known heights to object coordinates, e.g. the centres of coarse depth cells.
+		 * @param x Image x coordinates
+		 * @param y Image y coordinates
+		 * @param z Heights of the points. Invalid heights (see DepthMap::IsValid) give \c EPointStatus::INVALID_Z.
+		 * @param n Number of points
+		 * @param X Output object X coordinates. Undefined where status is not \c EPointStatus::OK.
+		 * @param Y Output object Y coordinates. Undefined where status is not \c EPointStatus::OK.
+		 * @param Z Output object Z coordinates. Undefined where status is not \c EPointStatus::OK.
+		 * @param status Output status of each point
+		 * @return Number of points transformed
+		*/
+		size_t ImageToObject(const double* x, const double* y, const float* z, size_t n, double* X, double* Y, double* Z, EPointStatus* status) const;
+
+		/**
+		 * @brief Set the 3x4 matrix projecting object points to image/camera coordinates and classify it.
+		 *
+		 * Image to object transformations are then done by kernels specialized for the projection instead of Camera::Image2Object. Called when a camera is read.
+		 * @param pMatrix The 12 values of the matrix row by row, as in GpuCamera. Null to remove the camera matrix.
+		 * @return The projection, \c EProjection::NONE if the matrix is null or degenerate
+		*/
+		EProjection SetCameraMatrix(const double* pMatrix);
+
 		/**
 		 * @brief Transform from image/camera system to pixel coordinate system
 		 * @param imagePt Image/camera point
@@ -116,6 +228,70 @@ namespace iconic {
 		*/
 		void ImageToPixel(const Eigen::Vector2d& imagePt, Geometry::Point& pixelPt) const;
 
+		/**
+		 * @brief Transform a polygon from image/camera system to pixel coordinate system
+		 * @param imagePolygon Image/camera polygon
+		 * @param pixelPolygon Pixel polygon
+		*/
+		void ImageToPixel(const Geometry::Polygon& imagePolygon, Geometry::Polygon& pixelPolygon) const;
+
+		/**
+		 * @brief Get the pixels covered by a box in image/camera coordinates
+		 * @param imageBox Image/camera box
+		 * @param x0 First pixel column
+		 * @param y0 First pixel row
+		 * @param x1 One past the last pixel column
+		 * @param y1 One past the last pixel row
+		*/
+		void ImageToPixel(const Geometry::Box& imageBox, int& x0, int& y0, int& x1, int& y1) const;
+
+		/**
+		 * @brief Get a coarse Z range of a box from the depth pyramid.
+		 *
+		 * Fast for any size of box since at most \c maxCells x \c maxCells pyramid cells are visited. The range contains the true range of the box.
+		 * @param imageBox Box in image/camera coordinates
+		 * @param range Min, max and mean Z and number of valid pixels
+		 * @param maxCells Max number of pyramid cells to visit in each direction
+		 * @return True if the box has valid Z values, false if not or if there is no depth pyramid
+		 * @sa DepthPyramid::GetRange
+		*/
+		bool GetDepthRange(const Geometry::Box& imageBox, DepthPyramid::Range& range, size_t maxCells = 16) const;
+
+		/**
+		 * @brief Get a quick Z (height) range under a polygon from the depth pyramid.
+		 *
+		 * Pyramid cells that intersect the polygon are used, so the range contains the true range under the polygon.
+		 * Holes are respected, but cells that overlap both a hole and the polygon are counted.
+		 * @param imagePolygon Polygon in image/camera coordinates
+		 * @param range Min, max and mean Z and number of valid pixels
+		 * @param maxCells Max number of pyramid cells to visit in each direction. Higher is more accurate but slower.
+		 * @return True if there are valid Z values under the polygon, false if not or if there is no depth pyramid
+		*/
+		bool GetHeightRange(const Geometry::Polygon& imagePolygon, DepthPyramid::Range& range, size_t maxCells = 64) const;
+
+		/**
+		 * @brief Sample the heights along a vector train.
+		 *
+		 * Each segment is walked in pixel space one pixel step along its major axis (DDA), so every depth map pixel crossed is sampled.
+		 * The samples are computed in parallel blocks, so long lines with few segments are split too.
+		 * Distances are horizontal object distances between consecutive samples. Samples without valid height are placed at the height interpolated between the vertices.
+		 * @param imageLine Vector train in image/camera coordinates
+		 * @param profile Gets the samples. The last sample of a segment is the first of the next.
+		 * @return True on success, false if there is no depth map or camera, or less than two points
+		*/
+		bool GetHeightProfile(const Geometry::VectorTrain& imageLine, Geometry::HeightProfile& profile) const;
+
+		/**
+		 * @brief Get exact sum, mean and variance of the Z values of a box in constant time.
+		 *
+		 * Requires the depth integral (see BuildDepthIntegral). Approximate volume above a height Z0 is \c (cSum-cCount*Z0) times the ground area of a pixel.
+		 * @param imageBox Box in image/camera coordinates
+		 * @param statistics Statistics of the valid Z values
+		 * @return True if the box has valid Z values, false if not or if there is no depth integral
+		 * @sa DepthIntegral
+		*/
+		bool GetDepthStatistics(const Geometry::Box& imageBox, DepthIntegral::Statistics& statistics) const;
+
 		/**
 		 * @brief Get height from depth map
 		 * @param x Pixel x/column coordinate
@@ -125,6 +301,28 @@ namespace iconic {
 		*/
 		bool GetZ(const int x, const int y, double& Z) const;
 
+		/**
+		 * @brief Get memory used by the per frame data, i.e. the depth map, depth pyramid and depth integral
+		 * @return Number of bytes
+		*/
+		size_t GetMemoryUsage() const;
+
+		/**
+		 * @brief Build depth pyramid of the depth map. Called when a frame is read, unless the pyramid is stored with a tiled depth map (see TiledDepthMap::ReadDepthPyramid).
+		 * @return True on success
+		 * @sa DepthPyramid
+		*/
+		bool BuildDepthPyramid();
+
+		/**
+		 * @brief Build summed-area tables of the depth map. Optional since it uses five times the memory of the depth map.
+		 *
+		 * Build the depth pyramid first, its mean Z is used as offset.
+		 * @return True on success
+		 * @sa DepthIntegral MeasureHandler::SetBuildDepthIntegral
+		*/
+		bool BuildDepthIntegral();
+
 		/**
 		 * @brief Contains a defined list of colours that have been tested to look good in the program which can be used for the shapes
 		 * @param c The requested colour
@@ -132,9 +330,13 @@ namespace iconic {
 		*/
 		wxColour GetColour(Colours c) const;
 
-		std::vector<float> cDepthMap;				//!< Depth map with Z values. Size is cImageSize[0]*cImageSize[1] 
+		DepthMapPtr cpDepthMap;						//!< Depth map with Z values. Size is cImageSize[0]*cImageSize[1]
+		DepthPyramidPtr cpDepthPyramid;				//!< Min, max and mean Z of the depth map at coarser resolutions
+		DepthIntegralPtr cpDepthIntegral;			//!< Summed-area tables of the depth map, null unless requested
 		iconic::CameraPtr cpCamera;					//!< Camera transforming 3D object points to 2D image/camera coordinates to 
 		iconic::Camera::ECameraType cCameraType;	//!< Camera classification to enable faster transformations when possible
+		CameraMatrix cCameraMatrix;					//!< Matrix projecting object points to image/camera coordinates, valid unless cProjection is \c EProjection::NONE
+		EProjection cProjection;					//!< Kind of cCameraMatrix, selects the image to object kernel
 		size_t cImageSize[2];						//!< Image size (width,height)
 		Eigen::Matrix3d cCameraToPixelTransform;	//!< Matrix transforming from image/camera system to pixel system in homogeneous coordinates
 	};
@@ -3,11 +3,20 @@
 #include <IconicGpu/MetaDataHandler.h>
 #include <IconicSensor/Camera.h>
 #include <IconicMeasureCommon/Geometry.h>
+#include <IconicMeasureCommon/ChangeDetection.h>
+#include <IconicMeasureCommon/FrameCache.h>
+#include <IconicMeasureCommon/FramePrefetcher.h>
 #include <IconicMeasureCommon/SidePanel.h>
 #include <IconicMeasureCommon/Shape.h>
+#include <IconicMeasureCommon/ShapeSlotMap.h>
 #include <IconicMeasureCommon/MeasureEvent.h>
 #include <IconicMeasureCommon/DrawEvent.h>
+#include <IconicMeasureCommon/DataUpdateEvent.h>
 #include <wx/wx.h>
+#include <boost/geometry/index/rtree.hpp>
+#include <atomic>
+#include <unordered_map>
+#include <utility>
 
 namespace iconic {
 
@@ -50,10 +59,145 @@ namespace iconic {
 
 		/**
 		 * @brief Read depth map and camera file.
-		 * @sa ReadDepthMap ReadCamera
+		 *
+		 * Frames that have been parsed or prefetched before are taken from the frame cache, so stepping back and forth between frames does not read the files again.
+		 * @sa ReadFrame GetFrameCache SetPrefetchCount
 		*/
 		virtual bool Parse();
 
+		/**
+		 * @brief Read depth map and camera of a frame and build the depth pyramid (and optionally the depth integral). Thread safe.
+		 *
+		 * The depth pyramid of a tiled depth map is read from its file, so reading a tiled frame decompresses no tiles.
+		 * @param depthMapFileName Depth map file name (\c .tdm or \c .dmp)
+		 * @param cameraFileName Camera file name
+		 * @param geometry Gets depth map and camera. The image size must be set before call.
+		 * @param storage How to store the depth map in memory
+		 * @param bDepthIntegral Build summed-area tables of the depth map
+		 * @return True on success
+		 * @sa ReadDepthMap ReadCamera
+		*/
+		static bool ReadFrame(const wxString& depthMapFileName, const wxString& cameraFileName, Geometry& geometry, DepthMap::EStorage storage = DepthMap::EStorage::FLOAT32, bool bDepthIntegral = false);
+
+		/**
+		 * @brief Set number of frames to prefetch.
+		 *
+		 * When playing a folder of images, the depth maps and cameras of the next frames are read on worker threads while the user looks at the current frame.
+		 * The images of the folder are assumed to be played in alphabetical order. Frames are prefetched backwards if the user steps backwards.
+		 * @param n Number of frames to read ahead, 0 disables prefetching
+		*/
+		void SetPrefetchCount(size_t n);
+
+		/**
+		 * @brief Get number of frames to prefetch
+		 * @return Number of frames read ahead
+		 * @sa SetPrefetchCount
+		*/
+		size_t GetPrefetchCount() const;
+
+		/**
+		 * @brief Set how depth maps are stored in memory.
+		 *
+		 * 16 bit storage halves the memory and memory bandwidth of depth lookups and lets the frame cache hold twice as many frames,
+		 * at the cost of converting the depth map when it is read. The max error compared to 32 bit floats is logged when a parsed frame has a larger error than the frames before it.
+		 * Cached frames are dropped and the current frame is read again on next Parse.
+		 * @param storage Storage mode
+		 * @sa HalfDepthMap QuantizedDepthMap DepthMap::GetMaxError
+		*/
+		void SetDepthStorage(DepthMap::EStorage storage);
+
+		/**
+		 * @brief Get how depth maps are stored in memory
+		 * @return Storage mode
+		*/
+		DepthMap::EStorage GetDepthStorage() const;
+
+		/**
+		 * @brief Build summed-area tables for each frame, for constant time statistics of rectangles.
+		 *
+		 * Off by default since the tables use five times the memory of a float depth map (which also means fewer cached frames).
+		 * Cached frames are dropped and the current frame is read again on next Parse.
+		 * @param bBuild Build the tables
+		 * @sa Geometry::GetDepthStatistics
+		*/
+		void SetBuildDepthIntegral(bool bBuild);
+
+		/**
+		 * @brief Check if summed-area tables are built for each frame
+		 * @return True if built
+		*/
+		bool GetBuildDepthIntegral() const;
+
+		/**
+		 * @brief Set the refinement level of provisional measurements while a shape is edited.
+		 *
+		 * While a polygon is dragged, the volume is integrated on the depth pyramid so the values are shown at once.
+		 * When the mouse stops, RefineShapes integrates the depth map pixels on a worker thread and GetRefinedShape delivers the final values.
+		 * @param level Refinement level, see VolumeIntegrator::Integrate. 0 computes final values on the calling thread while editing.
+		 * Loaded shapes and shapes of a changed frame are always refined on worker threads, see LoadWKT and RefineShapes.
+		*/
+		void SetProvisionalLevel(size_t level);
+
+		/**
+		 * @brief Get the refinement level of provisional measurements
+		 * @return Refinement level, 0 if disabled
+		*/
+		size_t GetProvisionalLevel() const;
+
+		/**
+		 * @brief Choose the reference plane of the volumes of polygons created or loaded from now on
+		 * @param bBoundary True to fit the plane to the depth map along the polygon boundary with RANSAC, false for the least squares plane through the vertices (default)
+		 * @param options Parameters of the boundary fit
+		 * @sa PolygonShape::SetReferencePlane
+		*/
+		void SetReferencePlane(bool bBoundary, const PlaneFitter::Options& options = PlaneFitter::Options());
+
+		/**
+		 * @brief Get the reference plane of the volumes of new polygons
+		 * @param options Gets the parameters of the boundary fit
+		 * @return True if the plane is fitted along the boundary
+		*/
+		bool GetReferencePlane(PlaneFitter::Options& options) const;
+
+		/**
+		 * @brief Start computing the final measurements of shapes with provisional measurements on worker threads.
+		 *
+		 * Shapes whose provisional measurements are of another frame are first calculated provisionally again on the calling thread.
+		 * @return True while any refinement is running or waiting to be collected with GetRefinedShape
+		*/
+		bool RefineShapes();
+
+		/**
+		 * @brief Apply a finished refinement to its shape.
+		 *
+		 * Refinements of shapes that have changed since RefineShapes are dropped.
+		 * @param e Gets the shape and refinement level 0 if a shape was refined
+		 * @return True if a shape was refined, call again until false
+		*/
+		bool GetRefinedShape(DataUpdateEvent& e);
+
+		/**
+		 * @brief Compute height statistics of all completed polygon shapes on the current frame in one sweep over the depth map, e.g. for the regions of a WKT file
+		 * @param vShapes Gets the polygon shapes
+		 * @param vStatistics Gets the statistics of each shape
+		 * @param bins Number of histogram bins
+		 * @return True on success, false if there is no depth map
+		 * @sa ZonalStatistics
+		*/
+		bool GetZonalStatistics(std::vector<ShapePtr>& vShapes, std::vector<ZonalStatistics::Statistics>& vStatistics, size_t bins = 64);
+
+		/**
+		 * @brief Compare the current frame with another frame of the same site, e.g. cut and fill between two surveys
+		 * @param imageFileName Image file name of the other frame. Its depth map and camera are read through the frame cache, like those of the current frame.
+		 * @param pShape Polygon shape on the current frame to compare inside, or null to compare the whole overlap
+		 * @param options Parameters of the comparison, e.g. a depth pyramid level for a fast preview
+		 * @param result Gets cut, fill and statistics of the differences, the other frame minus the current
+		 * @param pDifference Gets the differences on the grid of the current frame, if not null. See ChangeDetection::Raster::Write.
+		 * @return True on success, false if a frame could not be read or the shape is not a polygon
+		 * @sa ChangeDetection
+		*/
+		bool DetectChange(const wxString& imageFileName, const ShapePtr& pShape, const ChangeDetection::Options& options, ChangeDetection::Result& result, ChangeDetection::Raster* pDifference = nullptr);
+
 		/**
 		 * @brief Append the polygon to aggregated polygons
 		 * @param pPolygon Image polygon
@@ -71,12 +215,18 @@ namespace iconic {
 		/**
 		 * @brief Returns depth map.
 		 *
-		 * The vector has \c width*height floating point Z values,
+		 * The depth map has \c width*height floating point Z values,
 		 * where \c width*height is the size of the original image.
-		 * @return depth map
+		 * @return depth map, null if no depth map has been read
 		 * @sa ReadDepthMap GetImageSize
 		*/
-		std::vector<float>& GetDepthMap();
+		DepthMapPtr GetDepthMap();
+
+		/**
+		 * @brief Get cache of parsed frames, e.g. to change its memory budget or read hit and miss counters
+		 * @return The frame cache
+		*/
+		FrameCache& GetFrameCache();
 
 		/**
 		 * @brief Returns image size.
@@ -149,10 +299,10 @@ namespace iconic {
 		iconic::ShapeType SelectShapeFromCoordinates(Geometry::Point p);
 
 		/**
-		 * @brief Deletes the shape specified by selectedShapeIndex
-		 * @return The index of the deleted shape, -1 if nothing was deleted
+		 * @brief Deletes the selected shape
+		 * @return The handle of the deleted shape, null if nothing was deleted
 		*/
-		int DeleteSelectedShape();
+		ShapeHandle DeleteSelectedShape();
 
 		/**
 		 * @brief Method to clear all shapes, called before program exit
@@ -175,7 +325,9 @@ namespace iconic {
 		bool GetWKT(std::string& wkt);
 
 		/**
-		 * @brief Creates a shape from a WKT string
+		 * @brief Creates a shape from a WKT string.
+		 *
+		 * Polygons get provisional measurements, call RefineShapes to compute the final ones on worker threads.
 		 * @param wkt The WKT representation of a shape
 		 * @param e The event to raise if a shape was loaded
 		 * @return True if a shape was loaded, false otherwise	
@@ -192,26 +344,95 @@ namespace iconic {
 	private:
 
 		/**
-		 * @brief Read depth map from file.
+		 * @brief Get depth map and camera file names of an image.
+		 *
+		 * A tiled depth map (\c .tdm) is used if there is one, otherwise the raw depth map (\c .dmp). ReadDepthMap falls back to the raw depth map if the tiled one is invalid.
+		 * @param imageFileName Image file name
+		 * @param depthMapFileName Depth map file name
+		 * @param cameraFileName Camera file name
+		*/
+		static void GetFrameFileNames(const wxString& imageFileName, wxString& depthMapFileName, wxString& cameraFileName);
+
+		/**
+		 * @brief Log the storage error of the depth map of the current frame if it is the largest since the storage mode was set.
 		 *
 		 * Called by Parse
+		 * @sa SetDepthStorage
 		*/
-		bool ReadDepthMap();
+		void ReportDepthError();
+
+		/**
+		 * @brief Queue the frames following the current frame for prefetching.
+		 *
+		 * Called by OnNextFrame
+		 * @sa SetPrefetchCount
+		*/
+		void PrefetchFrames();
+
+		/**
+		 * @brief Read depth map from file.
+		 *
+		 * Raw depth maps are memory mapped when possible, otherwise copied to memory. Converted to 16 bit values if requested.
+		 * If a tiled depth map cannot be read, the raw depth map next to it is read instead.
+		 * Called by ReadFrame
+		 * @param filename Depth map file name
+		 * @param geometry Gets the depth map. The image size must be set before call.
+		 * @param storage How to store the depth map in memory
+		 * @sa TiledDepthMap RawDepthMap HalfDepthMap QuantizedDepthMap
+		*/
+		static bool ReadDepthMap(const wxString& filename, Geometry& geometry, DepthMap::EStorage storage);
 
 		/**
 		 * @brief Read camera from file.
 		 *
-		 * Called by Parse. Calls CheckCamera
+		 * Called by ReadFrame. Calls CheckCamera
+		 * @param filename Camera file name
+		 * @param geometry Gets the camera
 		*/
-		bool ReadCamera();
+		static bool ReadCamera(const wxString& filename, Geometry& geometry);
 
 		/**
 		 * @brief Determine camera type.
 		 *
 		 * Used to make image to object transformation as fast as possible.
-		 * Called by Parse
+		 * Called by ReadCamera
+		*/
+		static void CheckCamera(Geometry& geometry);
+
+		/**
+		 * @brief Apply the reference plane settings to a new shape
+		 * @param pShape The shape, nothing is done unless it is a polygon
+		*/
+		void ApplyReferencePlane(const ShapePtr& pShape);
+
+		/**
+		 * @brief Insert or move a shape in cShapeIndex after its points changed
+		 * @param handle Handle of the shape. Removed from the index if it has no points.
+		*/
+		void IndexShape(const ShapeHandle& handle);
+
+		/**
+		 * @brief Remove a shape from cShapeIndex
+		 * @param handle Handle of the shape
+		*/
+		void UnindexShape(const ShapeHandle& handle);
+
+		/**
+		 * @brief Final volume moments of a polygon, integrated on a worker thread
 		*/
-		void CheckCamera();
+		struct Refinement {
+			ShapePtr cpShape;							//!< Refined shape
+			ShapeHandle cShape;							//!< Handle of the refined shape
+			Geometry cGeometry;							//!< Copy of the geometry of the frame
+			Geometry::Polygon cPolygon;					//!< Copy of the polygon
+			Eigen::Vector3d cOrigin;					//!< Origin of the moments
+			VolumeIntegrator::Moments cMoments;			//!< Moments, valid if cbSuccess
+			bool cbSuccess;								//!< True if the moments were integrated
+			bool cbCalculated;							//!< True if the shape has nothing to integrate, as its calculation again on a changed frame failed
+			std::atomic<bool> cbDone;					//!< Set by the worker thread when finished
+		};
+		typedef boost::shared_ptr<Refinement> RefinementPtr;
+		typedef std::pair<Geometry::Box, ShapeHandle> ShapeBox; //!< Bounding box of a shape in cShapeIndex
 
 		SidePanel* sidePanel;
 		wxString cImageFileName;
@@ -221,10 +442,26 @@ namespace iconic {
 		bool cbIsParsed;
 		std::vector<iconic::Geometry::PolygonPtr> cvImagePolygon; // Vector of polygons in camera coordinates (not screen coordinates)
 		std::vector<iconic::Geometry::Polygon3DPtr> cvObjectPolygon; // Vector of polygons with 3D object coordinates (XYZ)
-		std::vector <ShapePtr> cvShapes;
+		ShapeSlotMap cShapes; // The shapes, addressed by handles that stay valid when other shapes are deleted
+		boost::geometry::index::rtree<ShapeBox, boost::geometry::index::quadratic<16>> cShapeIndex; // Bounding boxes of the shapes with points, for SelectShapeFromCoordinates
+		std::unordered_map<uint32_t, Geometry::Box> cIndexedBoxes; // Box of each shape in cShapeIndex by ShapeHandle::cIndex, needed to remove it
 		ShapePtr cpSelectedShape;
-		int cSelectedShapeIndex;
+		ShapeHandle cSelectedShape; // Handle of cpSelectedShape
 		Geometry cGeometry;
+		FrameCache cFrameCache; // Depth maps and cameras of recently parsed frames
+		FramePrefetcherPtr cpPrefetcher; // Reads upcoming frames into cFrameCache. Declared after the cache so it is destroyed first.
+		wxString cFolder; // Folder of listed images
+		std::vector<wxString> cvFolderImages; // Sorted image file names of cFolder
+		bool cbFolderMissed; // The current image was not found in cvFolderImages after listing cFolder, which is not listed again until the folder changes
+		int cFrameIndex; // Index of current image in cvFolderImages, -1 if unknown
+		size_t cPrefetchCount; // Number of frames to prefetch
+		DepthMap::EStorage cDepthStorage; // How depth maps are stored in memory
+		float cReportedDepthError; // Largest depth map storage error logged since cDepthStorage was set
+		bool cbBuildDepthIntegral; // Build summed-area tables of each depth map
+		size_t cProvisionalLevel; // Refinement level of measurements while editing, 0 if disabled
+		bool cbBoundaryPlane; // Fit the reference plane of new polygons along the boundary
+		PlaneFitter::Options cPlaneOptions; // Parameters of the boundary fit
+		std::vector<RefinementPtr> cvRefinements; // Running and finished refinements
 	};
 
 	typedef boost::shared_ptr<MeasureHandler> MeasureHandlerPtr; //!< Smart pointer to MeasureHandler
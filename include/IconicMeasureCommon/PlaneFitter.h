@@ -0,0 +1,75 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <Eigen/Core>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Robust reference planes for volumes, fitted to the depth map along the boundary of a polygon.
+	 *
+	 * The boundary is sampled at the depth map resolution, optionally in a band across it, and a plane \c Z=A*X+B*Y+C is fitted with RANSAC:
+	 * random hypotheses through three samples are scored in parallel by their number of inliers, four samples per AVX2 instruction,
+	 * and the best hypothesis is refined by least squares over its inliers. Hypotheses are drawn from a seeded generator, so fits are repeatable.
+	 * @sa VolumeIntegrator::GetVolume
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT PlaneFitter {
+	public:
+		/**
+		 * @brief Parameters of the fit
+		*/
+		struct Options {
+			size_t cIterations;		//!< Number of RANSAC hypotheses, 0 for a least squares fit to all samples
+			double cThreshold;		//!< Max vertical distance of an inlier from the plane, in object units
+			size_t cBandWidth;		//!< Width in pixels of the band across the boundary that is sampled, 0 or 1 for the boundary only
+			unsigned int cSeed;		//!< Seed of the hypotheses
+
+			/**
+			 * @brief Constructor. 256 hypotheses, threshold 0.05 and the boundary only.
+			*/
+			Options();
+		};
+
+		/**
+		 * @brief Object points as separate coordinate arrays
+		*/
+		struct Samples {
+			std::vector<double> cvX; //!< X coordinates
+			std::vector<double> cvY; //!< Y coordinates
+			std::vector<double> cvZ; //!< Z coordinates
+		};
+
+		/**
+		 * @brief Sample the depth map along the outer boundary of a polygon, one sample per pixel step
+		 * @param geometry Depth map and camera
+		 * @param imagePolygon Polygon in image/camera coordinates
+		 * @param bandWidth Width in pixels of the band across the boundary, 0 or 1 for the boundary only
+		 * @param samples Gets the object points of the samples with valid Z
+		 * @return True if there are at least three samples
+		*/
+		static bool SampleBoundary(const Geometry& geometry, const Geometry::Polygon& imagePolygon, size_t bandWidth, Samples& samples);
+
+		/**
+		 * @brief Fit a plane to samples
+		 * @param samples Object points
+		 * @param origin Subtracted from the points before fitting
+		 * @param options Parameters of the fit
+		 * @param plane Gets (A,B,C) of \c Z=A*X+B*Y+C relative to the origin
+		 * @param pInliers Gets the number of inliers of the plane, if not null
+		 * @return True on success, false if there are less than three samples
+		*/
+		static bool Fit(const Samples& samples, const Eigen::Vector3d& origin, const Options& options, Eigen::Vector3d& plane, size_t* pInliers = nullptr);
+
+		/**
+		 * @brief Count the points within a vertical distance of a plane
+		 * @param pX X coordinates relative to the origin of the plane
+		 * @param pY Y coordinates relative to the origin of the plane
+		 * @param pZ Z coordinates relative to the origin of the plane
+		 * @param n Number of points
+		 * @param plane (A,B,C) of \c Z=A*X+B*Y+C
+		 * @param threshold Max distance
+		 * @return Number of inliers
+		*/
+		static size_t CountInliers(const double* pX, const double* pY, const double* pZ, size_t n, const Eigen::Vector3d& plane, double threshold);
+	};
+}
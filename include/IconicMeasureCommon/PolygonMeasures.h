@@ -0,0 +1,83 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <Eigen/Core>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Length and area of object (3D) polygons and lines, computed over vertex arrays.
+	 *
+	 * The vertices are given as separate X, Y and Z arrays, so four edges are processed per AVX2 instruction.
+	 * All sums are taken relative to the first vertex, which keeps them accurate for map coordinates with large offsets.
+	 * The area is the area of the polygon projected onto its best fitting plane, whose normal is found with Newell's method.
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT PolygonMeasures {
+	public:
+		/**
+		 * @brief Vertices as separate coordinate arrays
+		*/
+		struct Vertices {
+			std::vector<double> cvX; //!< X coordinates
+			std::vector<double> cvY; //!< Y coordinates
+			std::vector<double> cvZ; //!< Z coordinates
+
+			/**
+			 * @brief Copy points into the arrays
+			 * @param vPoints Object points, e.g. the outer ring of a Geometry::Polygon3D
+			*/
+			void Set(const std::vector<Geometry::Point3D>& vPoints);
+			/**
+			 * @brief Get the number of vertices
+			 * @return Number of vertices
+			*/
+			size_t Size() const { return cvX.size(); }
+		};
+
+		/**
+		 * @brief Sum of the 3D edge lengths
+		 * @param pX X coordinates
+		 * @param pY Y coordinates
+		 * @param pZ Z coordinates
+		 * @param n Number of vertices
+		 * @param bClosed True to include the edge from the last vertex back to the first one, e.g. the perimeter of a ring. A closing duplicate vertex adds nothing.
+		 * @return Length, 0 if there are less than two vertices
+		*/
+		static double GetLength(const double* pX, const double* pY, const double* pZ, size_t n, bool bClosed);
+		/**
+		 * @brief Newell normal of a ring, the sum of the cross products of its edges relative to the first vertex.
+		 *
+		 * Its direction is the normal of the best fitting plane and its length is twice the area of the ring projected onto that plane.
+		 * The ring is closed implicitly, a closing duplicate vertex adds nothing.
+		 * @param pX X coordinates
+		 * @param pY Y coordinates
+		 * @param pZ Z coordinates
+		 * @param n Number of vertices
+		 * @return The normal, zero if there are less than three vertices
+		*/
+		static Eigen::Vector3d GetNormal(const double* pX, const double* pY, const double* pZ, size_t n);
+		/**
+		 * @brief Area of a ring projected onto its best fitting plane, see GetNormal
+		 * @param pX X coordinates
+		 * @param pY Y coordinates
+		 * @param pZ Z coordinates
+		 * @param n Number of vertices
+		 * @return Area, 0 if there are less than three vertices
+		*/
+		static double GetArea(const double* pX, const double* pY, const double* pZ, size_t n);
+
+		/**
+		 * @brief Sum of the 3D edge lengths
+		 * @param vertices Vertices
+		 * @param bClosed True to include the closing edge
+		 * @return Length
+		*/
+		static double GetLength(const Vertices& vertices, bool bClosed);
+		/**
+		 * @brief Area of a ring projected onto its best fitting plane
+		 * @param vertices Vertices of the ring
+		 * @return Area
+		*/
+		static double GetArea(const Vertices& vertices);
+	};
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Scanline rasterization of a polygon, holes included, onto the pixel grid of a depth map.
+	 *
+	 * A pixel is inside if its centre is inside the polygon (even-odd rule over the outer boundary and the holes).
+	 * Pixel (x,y) covers [x-0.5,x+0.5), so pixel centres are at integer pixel coordinates.
+	 * The spans of any band of rows can be computed independently, so bands can be rasterized in parallel.
+	 * @sa VolumeIntegrator
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT PolygonRasterizer {
+	public:
+		/**
+		 * @brief Pixels [cX0,cX1) of row cY
+		*/
+		struct Span {
+			int cY;		//!< Pixel row
+			int cX0;	//!< First pixel column
+			int cX1;	//!< One past the last pixel column
+		};
+
+		/**
+		 * @brief Constructor
+		*/
+		PolygonRasterizer();
+
+		/**
+		 * @brief Set up the edges of a polygon in pixel coordinates
+		 * @param pixelPolygon Polygon in pixel coordinates
+		 * @param width Width of the pixel grid. Spans are clipped to it.
+		 * @param height Height of the pixel grid. Spans are clipped to it.
+		 * @return True if the polygon covers any row of the grid
+		*/
+		bool Create(const Geometry::Polygon& pixelPolygon, size_t width, size_t height);
+
+		/**
+		 * @brief Get the rows that may have spans
+		 * @param y0 First row
+		 * @param y1 One past the last row
+		*/
+		void GetRows(int& y0, int& y1) const;
+
+		/**
+		 * @brief Get the spans of a band of rows. Thread safe.
+		 * @param y0 First row
+		 * @param y1 One past the last row
+		 * @param vSpans Gets the spans, row by row and left to right. Cleared first.
+		*/
+		void GetSpans(int y0, int y1, std::vector<Span>& vSpans) const;
+
+	private:
+		/**
+		 * @brief A non horizontal edge, with cY0 < cY1
+		*/
+		struct Edge {
+			double cY0;		//!< Smaller y
+			double cY1;		//!< Larger y
+			double cX0;		//!< x at cY0
+			double cDxDy;	//!< Change of x per row
+		};
+
+		/**
+		 * @brief Add the edges of a ring
+		 * @param ring Closed or open ring
+		*/
+		void AddRing(const std::vector<Geometry::Point>& ring);
+
+		std::vector<Edge> cvEdges;	//!< Edges sorted by cY0
+		int cSize[2];				//!< Size of the pixel grid
+		int cRows[2];				//!< First and one past the last row with spans
+	};
+}
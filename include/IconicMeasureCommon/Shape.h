@@ -1,7 +1,15 @@
 #pragma once
 #include <IconicMeasureCommon/exports.h>
 #include <IconicMeasureCommon/Geometry.h>
+#include <IconicMeasureCommon/PlaneFitter.h>
+#include <IconicMeasureCommon/PolygonMeasures.h>
+#include <IconicMeasureCommon/ShapeAlgorithms.h>
+#include <IconicMeasureCommon/Uncertainty.h>
+#include <IconicMeasureCommon/VertexIndex.h>
+#include <IconicMeasureCommon/VolumeIntegrator.h>
+#include <IconicMeasureCommon/ZonalStatistics.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/geometry.hpp>
 #include <wx/wx.h>
 #include <wx/colour.h>
@@ -47,6 +55,21 @@ namespace iconic {
 		*/
 		virtual double GetLength() = 0;
 		/**
+		* @brief Gets the area of the shape in object space, i.e. from the object coordinates. Is negative if the shape lacks an area
+		* @return The object area of the shape
+		*/
+		virtual double GetObjectArea() = 0;
+		/**
+		* @brief Gets the length of the shape in object space, i.e. from the object coordinates. Is negative if the shape lacks a length
+		* @return The object length of the shape
+		*/
+		virtual double GetObjectLength() = 0;
+		/**
+		* @brief Gets the draped surface area of the depth map inside the shape. Is negative if the shape lacks an area
+		* @return The surface area of the shape
+		*/
+		virtual double GetSurfaceArea() = 0;
+		/**
 		* @brief Gets the volume of the shape. Is negative if the shape lacks a volume
 		* @return The volume of the shape
 		*/
@@ -63,6 +86,12 @@ namespace iconic {
 		*/
 		virtual bool Select(Geometry::Point mouseClick) = 0;
 		/**
+		* @brief Get the bounding box of the rendering coordinates, e.g. for a spatial index of the shapes
+		* @param box Gets the box in image/camera coordinates
+		* @return True if the shape has points, false otherwise
+		*/
+		virtual bool GetBoundingBox(Geometry::Box& box) = 0;
+		/**
 		* @brief Used for selecting a point within a shape. If the mouseclick is not close to a point, a point is created on that location.
 		* @param mouseClick The user input indicating what point to select
 		* @return True if a point could be selected, false otherwise
@@ -89,6 +118,21 @@ namespace iconic {
 		*/
 		virtual void UpdateCalculations(Geometry& g) = 0;
 		/**
+		* @brief Recalculate the measurements, provisionally at a coarser depth resolution where the final calculation is slow.
+		*
+		* The default implementation calls UpdateCalculations(Geometry&), i.e. computes final measurements.
+		* Polygons on a frame without depth pyramid leave the volume and surface area at 0 until the final moments are set, see PolygonShape::SetRefinedMoments.
+		* @param g A geometry object that allows for making coordinate changes
+		* @param level Refinement level of provisional measurements, 0 for final measurements, see VolumeIntegrator::Integrate
+		* @sa GetRefinementLevel
+		*/
+		virtual void UpdateCalculations(Geometry& g, size_t level);
+		/**
+		* @brief Get the refinement level of the measurements
+		* @return 0 if the measurements are final, larger if they are provisional
+		*/
+		virtual size_t GetRefinementLevel();
+		/**
 		* @brief Gives access to the number of points in a shape
 		* @return The number of points in the shape
 		*/
@@ -200,9 +244,13 @@ namespace iconic {
 		void GetCoordinate(Geometry::Point3D& coordinate) override;
 		double GetArea() override;
 		double GetLength() override;
+		double GetObjectArea() override;
+		double GetObjectLength() override;
+		double GetSurfaceArea() override;
 		double GetVolume() override;
 		Geometry::HeightProfilePtr GetHeightProfile() override;
 		bool Select(Geometry::Point mouseClick) override;
+		bool GetBoundingBox(Geometry::Box& box) override;
 		bool GetPoint(Geometry::Point mouseClick) override;
 		Geometry::Point GetRenderingPoint(int index) override;
 		bool AddPoint(Geometry::Point newPoint, int index) override;
@@ -224,8 +272,9 @@ namespace iconic {
 	 * @brief An implementation of shape that represents a vector of line segments.
 	 *
 	 * This shape has length but lacks area and volume.
+	 * The height profile is sampled at the depth map resolution (see Geometry::GetHeightProfile) and kept until the line or the frame changes.
 	 * 
-	 * @todo Implment heightprofile generation and rendering
+	 * @todo Implement heightprofile rendering
 	*/
 	class LineShape : public Shape {
 	public:
@@ -244,9 +293,13 @@ namespace iconic {
 		void GetCoordinate(Geometry::Point3D& coordinate) override;
 		double GetArea() override;
 		double GetLength() override;
+		double GetObjectArea() override;
+		double GetObjectLength() override;
+		double GetSurfaceArea() override;
 		double GetVolume() override;
 		Geometry::HeightProfilePtr GetHeightProfile() override;
 		bool Select(Geometry::Point mouseClick) override;
+		bool GetBoundingBox(Geometry::Box& box) override;
 		bool GetPoint(Geometry::Point mouseClick) override;
 		Geometry::Point GetRenderingPoint(int index) override;
 		bool AddPoint(Geometry::Point newPoint, int index) override;
@@ -258,19 +311,40 @@ namespace iconic {
 		void Draw(bool selected, bool isMeasuring, Geometry::Point mousePoint) override;
 		int GetPossibleIndex(Geometry::Point mousePoint) override;
 		bool GetWKT(std::string& wkt) override;
+		/**
+		* @brief Estimate the uncertainty of the length by Monte Carlo draws
+		* @param g The geometry of the frame
+		* @param options Error model and number of draws
+		* @param result Gets the distribution of the length
+		* @return True on success, false if there is no depth map or camera matrix, or a vertex has no valid Z
+		* @sa Uncertainty
+		*/
+		bool GetUncertainty(const Geometry& g, const Uncertainty::Options& options, Uncertainty::Result& result) const;
 
 	private:
+		/**
+		 * @brief Build cVertexIndex again if the line changed other than by AddPoint and MoveSelectedPoint
+		*/
+		void UpdateVertexIndex();
 		double cLength; //!< The length of the line
 		Geometry::VectorTrain3DPtr cCoordinates; //!< The object line
 		Geometry::VectorTrainPtr cRenderCoordinates; //!< The render line
-		Geometry::HeightProfilePtr cProfile; //!< The heightprofile of the line. Currently unimplemented
+		Geometry::HeightProfilePtr cProfile; //!< The heightprofile of the line, null if it could not be computed
+		Geometry::VectorTrain cProfileLine; //!< Render line of cProfile
+		boost::weak_ptr<DepthMap> cpProfileDepthMap; //!< Depth map of cProfile
+		Geometry::CameraMatrix cProfileCameraMatrix; //!< Camera matrix of cProfile
+		VertexIndex cVertexIndex; //!< Vertices and segments of cRenderCoordinates
 	};
 	/**
 	 * @brief An implementation of shape that represents a polygon.
 	 *
-	 * This shape has length (its perimeter), area, and volume. Note that all these measurements are based on the render-coordinates and not object coordinates.
-	 * 
-	 * @todo Make calculations depend on object calculations.
+	 * This shape has length (its perimeter), area, and volume. Length and area are based on the render-coordinates.
+	 * Object length and area are based on the object coordinates: the 3D perimeter and the area projected onto the best fitting plane of the vertices, see PolygonMeasures.
+	 * The volume is in object space, between the depth map and a reference plane, see VolumeIntegrator. By default the plane is the least squares plane
+	 * through the vertices. With SetReferencePlane it is fitted to the depth map along the boundary instead, see PlaneFitter.
+	 * The surface area is the draped 3D area of the depth map inside the polygon, integrated together with the volume.
+	 * Area and volume are kept as sums. When only one vertex has moved since the last calculation on the same frame, e.g. while it is dragged,
+	 * the sums are updated by the difference instead of integrating the whole polygon again.
 	*/
 	class PolygonShape : public Shape {
 	public:
@@ -295,19 +369,77 @@ namespace iconic {
 		void GetCoordinate(Geometry::Point3D& coordinate) override;
 		double GetArea() override;
 		double GetLength() override;
+		double GetObjectArea() override;
+		double GetObjectLength() override;
+		double GetSurfaceArea() override;
 		double GetVolume() override;
 		Geometry::HeightProfilePtr GetHeightProfile() override;
 		bool Select(Geometry::Point mouseClick) override;
+		bool GetBoundingBox(Geometry::Box& box) override;
 		bool GetPoint(Geometry::Point mouseClick) override;
 		Geometry::Point GetRenderingPoint(int index) override;
 		bool AddPoint(Geometry::Point newPoint, int index) override;
 		void UpdateCalculations(Geometry& g) override;
+		void UpdateCalculations(Geometry& g, size_t level) override;
+		size_t GetRefinementLevel() override;
 		bool IsCompleted() override;
 		void DeselectPoint() override;
 		void MoveSelectedPoint(Geometry::Point mousePoint) override;
 		int GetNumberOfPoints() override;
 		bool GetWKT(std::string& wkt) override;
 
+		/**
+		* @brief Get what is needed to integrate the final volume moments, e.g. on a worker thread while the provisional measurements are shown
+		* @param polygon Gets a copy of the render polygon
+		* @param origin Gets the origin of the moments
+		* @sa SetRefinedMoments
+		*/
+		void GetRefinementInput(Geometry::Polygon& polygon, Eigen::Vector3d& origin) const;
+		/**
+		* @brief Set volume moments integrated at full resolution and make the measurements final
+		* @param g The geometry the moments were integrated with
+		* @param polygon The polygon from GetRefinementInput
+		* @param moments Moments from VolumeIntegrator::Integrate at level 0
+		* @return False if the polygon or the frame has changed since GetRefinementInput, then the moments are not used
+		*/
+		bool SetRefinedMoments(const Geometry& g, const Geometry::Polygon& polygon, const VolumeIntegrator::Moments& moments);
+		/**
+		* @brief Check whether the measurements were calculated on the frame of a geometry
+		* @param g The geometry
+		* @return False if the depth map or the camera has changed since the last calculation, e.g. after a frame change
+		*/
+		bool IsCalculatedOn(const Geometry& g) const;
+
+		/**
+		* @brief Choose the reference plane of the volume. Takes effect at the next calculation.
+		* @param bBoundary True to fit the plane to the depth map along the boundary, false for the least squares plane through the vertices
+		* @param options Parameters of the boundary fit
+		*/
+		void SetReferencePlane(bool bBoundary, const PlaneFitter::Options& options = PlaneFitter::Options());
+		/**
+		* @brief Get the render polygon
+		* @param polygon Gets a copy of the polygon in image/camera coordinates
+		*/
+		void GetRenderPolygon(Geometry::Polygon& polygon) const;
+		/**
+		* @brief Compute height statistics of the depth map pixels inside the polygon
+		* @param g The geometry of the frame
+		* @param statistics Gets the statistics
+		* @param bins Number of histogram bins
+		* @return True on success, false if there is no depth map
+		* @sa ZonalStatistics, MeasureHandler::GetZonalStatistics for many polygons at once
+		*/
+		bool GetZonalStatistics(const Geometry& g, ZonalStatistics::Statistics& statistics, size_t bins = 64) const;
+		/**
+		* @brief Estimate the uncertainty of the perimeter, area and volume by Monte Carlo draws, with the reference plane chosen by SetReferencePlane
+		* @param g The geometry of the frame
+		* @param options Error model and number of draws
+		* @param result Gets the distributions of the measurements
+		* @return True on success, false if there is no depth map or camera matrix, or a vertex has no valid Z
+		* @sa Uncertainty
+		*/
+		bool GetUncertainty(const Geometry& g, const Uncertainty::Options& options, Uncertainty::Result& result) const;
+
 		/**
 		* @brief Define what to draw
 		* @param bPolygon Draw filled polygon (with transparency if set)
@@ -326,11 +458,49 @@ namespace iconic {
 		 * Handles concave polygons and also interior holes in polygons
 		*/
 		void Tesselate();
+		/**
+		 * @brief Find the vertex that moved since the last final calculation
+		 * @param g The geometry of the calculation
+		 * @param moved Gets the index of the vertex, or -1 if the polygon is unchanged
+		 * @return False if more than one vertex moved, the frame changed or there is no final calculation to update
+		*/
+		bool GetMovedVertex(const Geometry& g, int& moved) const;
+		/**
+		 * @brief Remember the state of a calculation, for updates by difference
+		 * @param g The geometry of the calculation
+		 * @param bMoments True if cMoments are valid and final
+		*/
+		void SetCalculated(const Geometry& g, bool bMoments);
+		/**
+		 * @brief Fit cPlane relative to cOrigin as chosen by SetReferencePlane. Falls back to the vertices if the boundary has too few valid samples.
+		 * @param g The geometry of the calculation
+		 * @return True on success
+		*/
+		bool FitReferencePlane(const Geometry& g);
+		/**
+		 * @brief Build cVertexIndex again if the outer ring changed other than by MoveSelectedPoint. The closing vertex is not indexed.
+		*/
+		void UpdateVertexIndex();
 		double cLength; //!< The perimeter length of the polygon
 		double cArea; //!< The area of the polygon
+		double cObjectLength; //!< The 3D perimeter length of the object polygon
+		double cObjectArea; //!< The area of the object polygon
+		PolygonMeasures::Vertices cObjectVertices; //!< Outer ring of the object polygon as coordinate arrays
 		double cVolume; //!< The volume of the polygon
+		double cSurfaceArea; //!< The draped surface area of the depth map inside the polygon
+		VolumeIntegrator::Moments cMoments; //!< Moments of the depth map pixels inside the polygon, relative to cOrigin
+		Eigen::Vector3d cOrigin; //!< Object coordinates of the first vertex
+		Eigen::Vector3d cPlane; //!< Reference plane of the volume relative to cOrigin
+		bool cbBoundaryPlane; //!< True if cPlane is fitted along the boundary, false if through the vertices
+		PlaneFitter::Options cPlaneOptions; //!< Parameters of the boundary fit
+		bool cbMoments; //!< True if cMoments are valid for cCalculatedRing
+		size_t cRefinementLevel; //!< Level cMoments were integrated at, 0 if final. The requested level if there was no depth pyramid and cMoments are left to SetRefinedMoments.
+		Geometry::Polygon::ring_type cCalculatedRing; //!< Outer render ring of the last calculation
+		boost::weak_ptr<DepthMap> cpCalculatedDepthMap; //!< Depth map of the last calculation
+		Geometry::CameraMatrix cCalculatedCameraMatrix; //!< Camera matrix of the last calculation
 		Geometry::Polygon3DPtr cCoordinates; //!< The object polygon of the polygon
 		Geometry::PolygonPtr cRenderCoordinates; //!< The render polygon of the polygon
+		VertexIndex cVertexIndex; //!< Vertices and edges of the outer render ring
 		TESStesselator* cpTesselator; //!< The tesselator
 		bool cbDrawPolygon, cbDrawLines, cbDrawPoints; //!< Rendering flags
 	};
@@ -0,0 +1,43 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <string>
+
+namespace iconic {
+	/**
+	 * @brief The shape algorithms on the image/camera coordinates of a point, a line or a polygon, one overload per type.
+	 *
+	 * The Shape classes forward to these, so the per type code is in one place and can be called on bare geometries.
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT ShapeAlgorithms {
+	public:
+		/**
+		 * @brief Check whether a point hits a shape: within 0.005 of a point, within 0.001 of a line or inside a polygon
+		 * @param shape The shape
+		 * @param pt Point in image/camera coordinates
+		 * @return True if the shape is hit
+		*/
+		static bool Select(const Geometry::Point& shape, const Geometry::Point& pt);
+		static bool Select(const Geometry::VectorTrain& shape, const Geometry::Point& pt); //!< @copydoc Select(const Geometry::Point&, const Geometry::Point&)
+		static bool Select(const Geometry::Polygon& shape, const Geometry::Point& pt); //!< @copydoc Select(const Geometry::Point&, const Geometry::Point&)
+
+		/**
+		 * @brief Get the bounding box of a shape, of the outer ring for polygons
+		 * @param shape The shape
+		 * @param box Gets the box
+		 * @return False if the shape has no vertices
+		*/
+		static bool GetBoundingBox(const Geometry::Point& shape, Geometry::Box& box);
+		static bool GetBoundingBox(const Geometry::VectorTrain& shape, Geometry::Box& box); //!< @copydoc GetBoundingBox(const Geometry::Point&, Geometry::Box&)
+		static bool GetBoundingBox(const Geometry::Polygon& shape, Geometry::Box& box); //!< @copydoc GetBoundingBox(const Geometry::Point&, Geometry::Box&)
+
+		/**
+		 * @brief Represent a shape as WKT
+		 * @param shape The shape
+		 * @param wkt Gets the WKT
+		*/
+		static void GetWKT(const Geometry::Point& shape, std::string& wkt);
+		static void GetWKT(const Geometry::VectorTrain& shape, std::string& wkt); //!< @copydoc GetWKT(const Geometry::Point&, std::string&)
+		static void GetWKT(const Geometry::Polygon& shape, std::string& wkt); //!< @copydoc GetWKT(const Geometry::Point&, std::string&)
+	};
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Shape.h>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Stable reference to a shape in a ShapeSlotMap.
+	 *
+	 * A handle stays valid until its shape is erased, whatever else is inserted or erased. The generation tells a handle of an erased shape
+	 * from the handle of a later shape in the same slot, so a stale handle finds nothing instead of the wrong shape.
+	*/
+	struct ICONIC_MEASURE_COMMON_EXPORT ShapeHandle {
+		uint32_t cIndex;		//!< Slot of the shape
+		uint32_t cGeneration;	//!< Generation of the slot when the shape was inserted, 0 for the null handle
+
+		/**
+		 * @brief Constructor. The null handle, which refers to no shape.
+		*/
+		ShapeHandle();
+		/**
+		 * @brief Constructor
+		 * @param index Slot of the shape
+		 * @param generation Generation of the slot
+		*/
+		ShapeHandle(uint32_t index, uint32_t generation);
+		/**
+		 * @brief Check whether this is the null handle
+		 * @return True if the handle refers to no shape
+		*/
+		bool IsNull() const;
+		bool operator==(const ShapeHandle& other) const; //!< Same slot and generation
+		bool operator!=(const ShapeHandle& other) const; //!< Other slot or generation
+	};
+
+	/**
+	 * @brief Shapes addressed by generation checked handles, with constant time insert, erase and lookup.
+	 *
+	 * The shapes are kept in a vector in the order of insertion for fast iteration, and each handle refers to a slot that holds the position of its shape.
+	 * Erase leaves a hole, and the holes are removed in one pass by the next call that needs the positions (GetPosition, GetHandle, GetShapes),
+	 * so erasing many shapes is linear in the number of shapes. No handle changes. Erased slots are reused by later inserts with a new generation.
+	 * The map is not thread safe, not even the const methods, as they remove the holes.
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT ShapeSlotMap {
+	public:
+		static const size_t npos = std::numeric_limits<size_t>::max(); //!< Returned for no position
+
+		/**
+		 * @brief Constructor. No shapes.
+		*/
+		ShapeSlotMap();
+
+		/**
+		 * @brief Insert a shape last
+		 * @param pShape The shape
+		 * @return Handle of the shape
+		*/
+		ShapeHandle Insert(const ShapePtr& pShape);
+
+		/**
+		 * @brief Erase a shape. The shapes after it move one position down when the hole is removed.
+		 * @param handle Handle of the shape
+		 * @return False if the handle is null or stale
+		*/
+		bool Erase(const ShapeHandle& handle);
+
+		/**
+		 * @brief Erase all shapes. All handles become stale.
+		*/
+		void Clear();
+
+		/**
+		 * @brief Get a shape
+		 * @param handle Handle of the shape
+		 * @return The shape, null if the handle is null or stale
+		*/
+		ShapePtr Get(const ShapeHandle& handle) const;
+
+		/**
+		 * @brief Check whether a handle refers to a shape
+		 * @param handle The handle
+		 * @return True if the shape has not been erased
+		*/
+		bool Contains(const ShapeHandle& handle) const;
+
+		/**
+		 * @brief Get the position of a shape among the shapes
+		 * @param handle Handle of the shape
+		 * @return Position, npos if the handle is null or stale
+		*/
+		size_t GetPosition(const ShapeHandle& handle) const;
+
+		/**
+		 * @brief Get the handle of the shape at a position
+		 * @param position Position, less than Size
+		 * @return Handle of the shape
+		*/
+		ShapeHandle GetHandle(size_t position) const;
+
+		/**
+		 * @brief Get the number of shapes
+		 * @return Number of shapes
+		*/
+		size_t Size() const;
+
+		/**
+		 * @brief Get all shapes, e.g. to draw them
+		 * @return The shapes, in the order of their positions
+		*/
+		const std::vector<ShapePtr>& GetShapes() const;
+
+	private:
+		/**
+		 * @brief Remove the holes left by Erase, keeping the order of the shapes
+		*/
+		void Compact() const;
+
+		/**
+		 * @brief Position of a shape, or the next free slot
+		*/
+		struct Slot {
+			uint32_t cPosition;		//!< Position of the shape, or index of the next free slot if the slot is free
+			uint32_t cGeneration;	//!< Increased when the shape of the slot is erased
+		};
+
+		static const uint32_t cHole = std::numeric_limits<uint32_t>::max(); //!< Slot of an erased position
+
+		mutable std::vector<Slot> cvSlots;				//!< Slots of all handles
+		mutable std::vector<ShapePtr> cvShapes;			//!< The shapes in order of insertion, null at holes
+		mutable std::vector<uint32_t> cvPositionSlots;	//!< Slot of the shape at each position, cHole at holes
+		mutable size_t cHoles;							//!< Number of holes
+		uint32_t cFreeSlot;								//!< First free slot, the number of slots if none
+	};
+}
@@ -4,6 +4,7 @@
 #include <boost/shared_ptr.hpp>
 #include <IconicMeasureCommon/Geometry.h>
 #include <IconicMeasureCommon/DataUpdateEvent.h>
+#include <utility>
 #include <vector>
 
 
@@ -33,24 +34,36 @@ namespace iconic {
 	private:
 		/**
 		 * @brief Intermediary method for creating new panel
-		 * @param e Event data
+		 * @param handle Handle of the shape, replaces a panel of an erased shape in the same slot
+		 * @param shape The shape
+		 * @param bProvisional The measurements are provisional, see UpdatePolygonPanel
+		*/
+		void CreatePanel(const ShapeHandle& handle, ShapePtr shape, bool bProvisional = false);
+		/**
+		 * @brief Find the panel of a shape
+		 * @param handle Handle of the shape
+		 * @return The panel, null if there is none
 		*/
-		void CreatePanel(ShapePtr shape);
+		wxPanel* GetPanel(const ShapeHandle& handle) const;
 		/**
 		 * @brief Method for creating a point panel
 		 * @param e Event data
+		 * @return The panel
 		*/
-		void CreatePointPanel(ShapePtr shape);
+		wxPanel* CreatePointPanel(ShapePtr shape);
 		/**
 		 * @brief Method for creating a line panel
 		 * @param e Event data
+		 * @return The panel
 		*/
-		void CreateLinePanel(ShapePtr shape);
+		wxPanel* CreateLinePanel(ShapePtr shape);
 		/**
 		 * @brief Method for creating a polygon panel
 		 * @param e Event data
+		 * @param bProvisional The volume is provisional and is marked with a ~ until the refined value arrives
+		 * @return The panel
 		*/
-		void CreatePolygonPanel(ShapePtr shape);
+		wxPanel* CreatePolygonPanel(ShapePtr shape, bool bProvisional = false);
 		/**
 		 * @brief Method for updating a point panel
 		 * @param panel The panel to update
@@ -67,10 +80,11 @@ namespace iconic {
 		* @brief Method for updating a polygon panel
 		* @param panel The panel to update
 		* @param e Event data
+		* @param bProvisional The volume is provisional and is marked with a ~ until the refined value arrives
 		*/
-		void UpdatePolygonPanel(wxPanel* panel, ShapePtr shape);
+		void UpdatePolygonPanel(wxPanel* panel, ShapePtr shape, bool bProvisional = false);
 
 		wxBoxSizer* cSizer;
-		std::vector<wxPanel*> cvPanels;
+		std::vector<std::pair<ShapeHandle, wxPanel*>> cvPanels; // Panel of each shape slot, with the handle it was created for
 	};
 }
\ No newline at end of file
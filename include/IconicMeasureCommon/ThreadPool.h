@@ -0,0 +1,71 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief A fixed set of worker threads that run submitted tasks.
+	 *
+	 * Use GetInstance for the pool shared by the library, which has one thread less than the number of cores since the calling thread also works in ParallelFor.
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT ThreadPool {
+	public:
+		/**
+		 * @brief Constructor. Starts the worker threads.
+		 * @param nThreads Number of worker threads
+		*/
+		ThreadPool(size_t nThreads);
+
+		/**
+		 * @brief Destructor. Finishes queued tasks and joins the worker threads.
+		*/
+		~ThreadPool();
+
+		/**
+		 * @brief Get the pool shared by the library
+		 * @return The thread pool
+		*/
+		static ThreadPool& GetInstance();
+
+		/**
+		 * @brief Get number of worker threads
+		 * @return Number of threads
+		*/
+		size_t GetNumberOfThreads() const;
+
+		/**
+		 * @brief Run a task on a worker thread
+		 * @param task The task
+		*/
+		void Submit(std::function<void()> task);
+
+		/**
+		 * @brief Split [begin,end) into chunks and run the chunks in parallel. Returns when all chunks are done.
+		 *
+		 * The calling thread works on chunks too, so it is safe to call ParallelFor from within a task or another ParallelFor.
+		 * An exception thrown by body is rethrown to the caller.
+		 * @param begin First index
+		 * @param end One past the last index
+		 * @param body Called as body(chunkBegin, chunkEnd) for each chunk
+		 * @param grainSize Smallest number of indexes in a chunk
+		*/
+		void ParallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t grainSize = 1);
+
+	private:
+		/**
+		 * @brief Worker thread loop
+		*/
+		void Run();
+
+		std::deque<std::function<void()>> cQueue; //!< Tasks waiting to run
+		bool cbStop; //!< Tells workers to quit when the queue is empty
+		std::mutex cMutex; //!< Protects queue and stop flag
+		std::condition_variable cWork; //!< Signalled when tasks are queued or on stop
+		std::vector<std::thread> cvThreads; //!< Worker threads
+	};
+}
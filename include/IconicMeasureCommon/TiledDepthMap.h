@@ -0,0 +1,162 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/DepthMap.h>
+#include <IconicMeasureCommon/DepthPyramid.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <wx/wx.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Depth map stored as individually compressed tiles in a \c .tdm file.
+	 *
+	 * Only the tiles that are touched by GetZ are decompressed. Decompressed tiles are kept in a bounded least recently used cache.
+	 *
+	 * File layout (native byte order, like raw \c .dmp files, so a file is only read on hosts with the byte order it was written with):
+	 * - Header: \c "ITDM", version, width, height, tile size and compression (6 x 32 bit)
+	 * - Tile table: byte offset and compressed size (2 x 64 bit) for each tile, row by row, followed by the same for the depth pyramid
+	 * - Tile data: the float values of a tile with the bytes of the floats shuffled into four planes before compression, which makes depth values compress much better
+	 * - Depth pyramid: see DepthPyramid::Write, compressed like the tiles
+	 *
+	 * Tiles at the right and bottom border are smaller when the size of the depth map is not a multiple of the tile size.
+	 * Use Convert to create a \c .tdm file from a raw \c .dmp file.
+	 * @sa RawDepthMap
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT TiledDepthMap : public DepthMap {
+	public:
+		/**
+		 * @brief Compression of the tiles
+		*/
+		enum class ECompression {
+			NONE = 0,	//!< Uncompressed tiles
+			ZLIB = 1,	//!< zlib (deflate) compressed tiles. Fast decompression.
+			BZIP2 = 2	//!< bzip2 compressed tiles. Smaller but slower than zlib.
+		};
+
+		/**
+		 * @brief Constructor
+		 * @param maxCachedTiles Maximum number of decompressed tiles kept in memory
+		*/
+		TiledDepthMap(size_t maxCachedTiles = 128);
+
+		/**
+		 * @brief Destructor. Unmaps the file.
+		*/
+		~TiledDepthMap();
+
+		/**
+		 * @brief Open tiled depth map file.
+		 *
+		 * Only the header and tile table are read. Tiles are decompressed on demand.
+		 * @param filename Tiled depth map file name (\c .tdm)
+		 * @param width Expected width of depth map (same as image width)
+		 * @param height Expected height of depth map (same as image height)
+		 * @return True on success, false if the file could not be read or does not match the expected size
+		*/
+		bool Open(const wxString& filename, size_t width, size_t height);
+
+		bool GetZ(const int x, const int y, float& Z) const override;
+
+		/**
+		 * @brief Get all Z values of a row. Decompresses the tiles crossed by the row if not cached.
+		 * @param y Pixel y/row coordinate
+		 * @param pRow Gets the \c width values of the row
+		 * @return True on success
+		*/
+		bool GetRow(const int y, float* pRow) const override;
+
+		/**
+		 * @brief Tiles are not stored contiguously
+		 * @return nullptr
+		*/
+		const float* GetData() const override;
+
+		/**
+		 * @brief Memory used by the tile table and the decompressed tiles currently cached
+		 * @return Number of bytes
+		*/
+		size_t GetMemoryUsage() const override;
+
+		/**
+		 * @brief Read the depth pyramid stored by Convert, so that no tiles have to be decompressed to build it
+		 * @return The depth pyramid, null if it could not be read
+		*/
+		DepthPyramidPtr ReadDepthPyramid() const;
+
+		/**
+		 * @brief Get the tile size
+		 * @return Width and height of a tile in pixels
+		*/
+		size_t GetTileSize() const;
+
+		/**
+		 * @brief Get number of tiles currently decompressed and cached
+		 * @return Number of cached tiles
+		*/
+		size_t GetNumberOfCachedTiles() const;
+
+		/**
+		 * @brief Convert a raw depth map file to a tiled depth map file. Also builds and stores the depth pyramid.
+		 * @param rawFileName Raw depth map file name (\c .dmp)
+		 * @param width Width of depth map (same as image width)
+		 * @param height Height of depth map (same as image height)
+		 * @param tiledFileName Tiled depth map file name to write (\c .tdm)
+		 * @param compression Tile compression
+		 * @param tileSize Width and height of a tile in pixels
+		 * @return True on success
+		*/
+		static bool Convert(const wxString& rawFileName, size_t width, size_t height, const wxString& tiledFileName, ECompression compression = ECompression::ZLIB, size_t tileSize = 256);
+
+	private:
+		/**
+		 * @brief A decompressed tile
+		*/
+		struct Tile {
+			std::vector<float> cvData; //!< Tile values, row by row
+			size_t cWidth; //!< Tile width (smaller than tile size at right border)
+			std::list<size_t>::iterator cLru; //!< Position in the least recently used list
+		};
+
+		/**
+		 * @brief Get a decompressed tile, decompress it if not cached.
+		 *
+		 * Must be called with cMutex locked.
+		 * @param tileIndex Index of tile (row by row)
+		 * @return The tile, or nullptr if it could not be decompressed
+		*/
+		const Tile* GetTile(size_t tileIndex) const;
+
+		/**
+		 * @brief Decompress a tile from the mapped file
+		 * @param tileIndex Index of tile (row by row)
+		 * @param tile Output tile
+		 * @return True on success
+		*/
+		bool DecompressTile(size_t tileIndex, Tile& tile) const;
+
+		/**
+		 * @brief Offset and compressed size of a tile in the file
+		*/
+		struct TileEntry {
+			uint64_t cOffset; //!< Byte offset from start of file
+			uint64_t cSize; //!< Compressed size in bytes
+		};
+
+		boost::iostreams::mapped_file_source cMappedFile; //!< Memory mapped tiled depth map file
+		std::vector<TileEntry> cvTileTable; //!< Where to find each tile in the file
+		TileEntry cPyramidEntry; //!< Where to find the depth pyramid in the file
+		ECompression cCompression; //!< Tile compression
+		size_t cTileSize; //!< Width and height of a tile
+		size_t cNumberOfTiles[2]; //!< Number of tiles horizontally and vertically
+		size_t cMaxCachedTiles; //!< Maximum number of decompressed tiles kept in memory
+
+		mutable std::unordered_map<size_t, Tile> cmTiles; //!< Decompressed tiles by tile index
+		mutable std::list<size_t> cLru; //!< Tile indexes, most recently used first
+		mutable std::mutex cMutex; //!< Protects the tile cache
+	};
+	typedef boost::shared_ptr<TiledDepthMap> TiledDepthMapPtr; //!< Smart pointer to a tiled depth map
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <Eigen/Core>
+
+namespace iconic {
+	/**
+	 * @brief Monte Carlo uncertainty of lengths, areas and volumes, from the depth noise and the placement error of the vertices.
+	 *
+	 * Each draw moves the vertices by a normal error in pixels, looks up their Z at the new positions, adds a normal depth error,
+	 * and computes the measurements again. The volume is not integrated again for each draw: the moments of the nominal polygon are updated
+	 * by the triangles swept by the vertices (see VolumeIntegrator::MoveVertex), and the depth noise of the integrated pixels, which is independent
+	 * from pixel to pixel, is added as its normal sum. The draws run in parallel, each with its own generator seeded by the draw index,
+	 * so the results do not depend on the scheduling, and the buffers are reused by the draws of a chunk.
+	 * Draws where a vertex falls outside the depth map or on an invalid Z are rejected.
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT Uncertainty {
+	public:
+		/**
+		 * @brief Error model and number of draws
+		*/
+		struct Options {
+			size_t cSamples;		//!< Number of draws
+			double cVertexSigma;	//!< Standard deviation of the vertex placement along each pixel axis, in pixels
+			double cDepthSigma;		//!< Standard deviation of the depth map Z, in object units
+			double cConfidence;		//!< Probability of the confidence interval, e.g. 0.95
+			unsigned int cSeed;		//!< Seed of the draws
+
+
+			/**
+			 * @brief Constructor. 1000 draws, half a pixel placement error, no depth noise and a 95% interval.
+			*/
+			Options();
+		};
+
+		/**
+		 * @brief Distribution of a measurement over the draws
+		*/
+		struct Interval {
+			double cValue;		//!< Measurement without errors
+			double cMean;		//!< Mean of the draws
+			double cStdDev;		//!< Standard deviation of the draws
+			double cLower;		//!< Lower bound of the confidence interval, a percentile of the draws
+			double cUpper;		//!< Upper bound of the confidence interval
+
+			/**
+			 * @brief Constructor. All zero.
+			*/
+			Interval();
+		};
+
+		/**
+		 * @brief Uncertainty of the measurements of a shape
+		*/
+		struct Result {
+			Interval cLength;	//!< 3D length of a line, or perimeter of a polygon
+			Interval cArea;		//!< Area of the object polygon, zero for lines
+			Interval cVolume;	//!< Volume above the reference plane, zero for lines
+			size_t cSamples;	//!< Number of accepted draws
+			size_t cRejected;	//!< Number of rejected draws
+
+			/**
+			 * @brief Constructor. No draws.
+			*/
+			Result();
+		};
+
+		/**
+		 * @brief Estimate the uncertainty of the length of a line
+		 * @param geometry Depth map and camera matrix
+		 * @param imageLine Line in image/camera coordinates
+		 * @param options Error model and number of draws
+		 * @param result Gets the distribution of the length
+		 * @return True on success, false if there is no depth map or camera matrix, or a vertex has no valid Z
+		*/
+		static bool Estimate(const Geometry& geometry, const Geometry::VectorTrain& imageLine, const Options& options, Result& result);
+
+		/**
+		 * @brief Estimate the uncertainty of the perimeter, area and volume of a polygon. Only the vertices of the outer ring are moved.
+		 * @param geometry Depth map and camera matrix
+		 * @param imagePolygon Polygon in image/camera coordinates, holes allowed
+		 * @param options Error model and number of draws
+		 * @param result Gets the distributions of the measurements
+		 * @param pPlane Reference plane (A,B,C) relative to the first vertex, e.g. fitted along the boundary, which is kept for all draws.
+		 *        If null, the plane is fitted to the vertices of each draw.
+		 * @return True on success, false if there is no depth map or camera matrix, or a vertex has no valid Z
+		*/
+		static bool Estimate(const Geometry& geometry, const Geometry::Polygon& imagePolygon, const Options& options, Result& result, const Eigen::Vector3d* pPlane = nullptr);
+	};
+}
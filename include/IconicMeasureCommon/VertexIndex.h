@@ -0,0 +1,98 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <boost/geometry/geometries/segment.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <utility>
+
+namespace iconic {
+	/**
+	 * @brief Spatial index of the vertices and segments of a line or ring, for picking and inserting vertices of large shapes.
+	 *
+	 * The vertices and the segments between consecutive vertices are kept in two R-trees, so the nearest vertex and the nearest segment are found in logarithmic time.
+	 * Appending a vertex and moving a vertex update the trees. Other edits change the vertex count or are marked by Invalidate, and the owner builds the index again
+	 * (see IsValid), which packs the trees in O(n log n).
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT VertexIndex {
+	public:
+		typedef boost::geometry::model::segment<Geometry::Point> Segment; //!< Segment between two vertices
+
+		/**
+		 * @brief Constructor. Empty and not valid for any vertices.
+		*/
+		VertexIndex();
+
+		/**
+		 * @brief Index vertices
+		 * @param pPoints Vertices
+		 * @param n Number of vertices
+		 * @param bClosed True if the last vertex connects to the first, e.g. the vertices of a ring without its closing vertex
+		*/
+		void Build(const Geometry::Point* pPoints, size_t n, bool bClosed);
+
+		/**
+		 * @brief Check whether the index is up to date
+		 * @param n Number of vertices
+		 * @param bClosed True if the last vertex connects to the first
+		 * @return True if the index was built or updated for \c n vertices with the same connection and not invalidated since
+		*/
+		bool IsValid(size_t n, bool bClosed) const;
+
+		/**
+		 * @brief Mark the index as out of date, e.g. after the vertices were reordered
+		*/
+		void Invalidate();
+
+		/**
+		 * @brief Add the last vertex of an open line. Nothing is done unless the index is valid for the vertices before it.
+		 * @param pPoints Vertices, with the new one last
+		 * @param n Number of vertices, including the new one
+		*/
+		void Append(const Geometry::Point* pPoints, size_t n);
+
+		/**
+		 * @brief Update a moved vertex and its segments. Nothing is done unless the index is valid.
+		 * @param pPoints Vertices after the move
+		 * @param n Number of vertices
+		 * @param index Index of the moved vertex
+		 * @param previousPt Position of the vertex before the move
+		*/
+		void Move(const Geometry::Point* pPoints, size_t n, size_t index, const Geometry::Point& previousPt);
+
+		/**
+		 * @brief Find the vertex nearest to a point
+		 * @param pt Point
+		 * @param index Gets the index of the vertex
+		 * @param distance Gets the distance to the vertex
+		 * @return False if there are no vertices
+		*/
+		bool GetNearestVertex(const Geometry::Point& pt, size_t& index, double& distance) const;
+
+		/**
+		 * @brief Find the segment nearest to a point
+		 * @param pt Point
+		 * @param index Gets the index of the first vertex of the segment, the segment ends at vertex \c index+1, or at vertex 0 if it is the closing segment
+		 * @param distance Gets the distance to the segment
+		 * @return False if there are no segments
+		*/
+		bool GetNearestSegment(const Geometry::Point& pt, size_t& index, double& distance) const;
+
+	private:
+		typedef std::pair<Geometry::Point, size_t> VertexValue; //!< Vertex and its index
+		typedef std::pair<Segment, size_t> SegmentValue; //!< Segment and the index of its first vertex
+
+		/**
+		 * @brief Get the segment starting at a vertex
+		 * @param pPoints Vertices
+		 * @param index Index of the first vertex of the segment
+		 * @return The segment
+		*/
+		SegmentValue GetSegment(const Geometry::Point* pPoints, size_t index) const;
+
+		boost::geometry::index::rtree<VertexValue, boost::geometry::index::quadratic<16>> cVertices; //!< Indexed vertices
+		boost::geometry::index::rtree<SegmentValue, boost::geometry::index::quadratic<16>> cSegments; //!< Indexed segments
+		size_t cSize; //!< Number of indexed vertices
+		bool cbClosed; //!< True if the closing segment is indexed
+		bool cbValid; //!< False until built, and after Invalidate
+	};
+}
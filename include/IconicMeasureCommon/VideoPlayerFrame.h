@@ -167,6 +167,14 @@ namespace iconic {
 			 * @brief Loads measurements from the WKT format
 			*/
 			void OnLoadMeasurements(wxCommandEvent& WXUNUSED(e));
+
+			/**
+			 * @brief Converts all raw depth maps (\c .dmp) in a folder to compressed tiled depth maps (\c .tdm).
+			 *
+			 * The depth maps must have the same size as the images of the opened folder.
+			 * @sa TiledDepthMap::Convert
+			*/
+			void OnConvertDepthMaps(wxCommandEvent& WXUNUSED(e));
 		protected:
 
 			/**
@@ -189,6 +197,12 @@ namespace iconic {
 			//! Called by timer if normal speed is selected
 			void OnTimer(wxTimerEvent& WXUNUSED(e));
 
+			/**
+			 * @brief Called when the mouse has stopped after a provisional measurement, and then until the final measurements have arrived
+			 * @sa MeasureHandler::RefineShapes MeasureHandler::GetRefinedShape
+			*/
+			void OnRefineTimer(wxTimerEvent& WXUNUSED(e));
+
 			//! Toggle playing video at normal or maximum speed
 			void OnUseTimer(wxCommandEvent& e);
 
@@ -267,6 +281,7 @@ namespace iconic {
 			bool cbPause;
 
 			wxTimer cTimer;
+			wxTimer cRefineTimer; // Refines provisional measurements when the mouse stops
 			bool cbUseTimer;
 			double cFrameRate, cOriginalFrameRate;
 			wxString cFileName;
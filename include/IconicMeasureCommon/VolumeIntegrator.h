@@ -0,0 +1,134 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <Eigen/Core>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Volume of a polygon above a reference plane, integrated over the depth map pixels under the polygon.
+	 *
+	 * The polygon is rasterized onto the depth map (see PolygonRasterizer) in bands of rows on all cores. For each pixel inside,
+	 * the ground area of the pixel at its Z and its object X and Y are computed from the camera matrix, which is a few multiplications per pixel with AVX2.
+	 * The result is kept as area weighted moments, so the volume above any plane is found without integrating again:
+	 * \c V = Sum(a*(Z-(A*X+B*Y+C))) = cZ - A*cX - B*cY - C*cArea.
+	 * Moments of regions can be added and subtracted, which allows incremental updates when a polygon changes.
+	 *
+	 * Requires a camera matrix, see Geometry::SetCameraMatrix.
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT VolumeIntegrator {
+	public:
+		/**
+		 * @brief Area weighted moments of the valid pixels of a region, relative to an origin
+		*/
+		struct Moments {
+			double cArea;			//!< Sum of the ground areas a of the pixels
+			double cX;				//!< Sum of a*X
+			double cY;				//!< Sum of a*Y
+			double cZ;				//!< Sum of a*Z
+			double cSurface;		//!< Draped 3D area of the depth map inside the region, see Integrate
+			size_t cCount;			//!< Number of valid pixels, or cells if integrated on the depth pyramid
+			size_t cInvalidCount;	//!< Number of pixels (or cells) without valid Z. Not included in the sums.
+
+			/**
+			 * @brief Constructor. Sets all moments to zero.
+			*/
+			Moments();
+
+			/**
+			 * @brief Add the moments of another region
+			 * @param other Moments relative to the same origin
+			 * @return This
+			*/
+			Moments& operator+=(const Moments& other);
+
+			/**
+			 * @brief Subtract the moments of another region
+			 * @param other Moments relative to the same origin
+			 * @return This
+			*/
+			Moments& operator-=(const Moments& other);
+		};
+
+		/**
+		 * @brief Integrate the moments of the pixels inside a polygon.
+		 *
+		 * The draped surface area is integrated over the cells between four neighbouring pixels, which are inside if their centres are.
+		 * Each cell is split into two 3D triangles. Cells with an invalid corner are not included.
+		 * @param geometry Depth map and camera matrix
+		 * @param imagePolygon Polygon in image/camera coordinates, holes allowed
+		 * @param origin Subtracted from the object coordinates, e.g. a vertex of the polygon, which keeps the sums accurate
+		 * @param moments Moments of the valid pixels inside the polygon
+		 * @param level 0 integrates the depth map pixels. Otherwise the cell means of depth pyramid level \c level-1 are integrated,
+		 * which is much faster and gives a provisional result, e.g. while a polygon is edited. Clamped to the coarsest level, and 0 is used if there is no depth pyramid.
+		 * @return True on success, false if there is no depth map or camera matrix
+		*/
+		static bool Integrate(const Geometry& geometry, const Geometry::Polygon& imagePolygon, const Eigen::Vector3d& origin, Moments& moments, size_t level = 0);
+
+		/**
+		 * @brief Get the level Integrate uses for a requested level
+		 * @param geometry Depth map and depth pyramid
+		 * @param level Requested level
+		 * @return The level clamped to the depth pyramid, 0 if there is no depth pyramid
+		*/
+		static size_t GetLevel(const Geometry& geometry, size_t level);
+
+		/**
+		 * @brief Get the grid Integrate uses at a level: the depth map pixels, or the cells of a depth pyramid level
+		 * @param geometry Depth map and depth pyramid
+		 * @param level Requested level, see Integrate
+		 * @param pixelToGrid Gets the transformation from pixel to grid coordinates. Cell (x,y) is centred at pixel \c (s*x+(s-1)/2,s*y+(s-1)/2) for cell size s.
+		 * @param width Gets the number of grid columns
+		 * @param height Gets the number of grid rows
+		*/
+		static void GetGrid(const Geometry& geometry, size_t level, Eigen::Matrix3d& pixelToGrid, size_t& width, size_t& height);
+
+		/**
+		 * @brief Get object coordinates and ground areas of the grid points [x0,x1) of a row, as Integrate computes them
+		 * @param geometry Camera matrix
+		 * @param cameraToGrid Image/camera to grid transformation, e.g. the pixelToGrid of GetGrid times Geometry::cCameraToPixelTransform
+		 * @param y Grid row
+		 * @param pRow Z values of the row
+		 * @param x0 First grid column
+		 * @param x1 One past the last grid column
+		 * @param pX Gets X of the points, starting at x0. NaN where Z is invalid.
+		 * @param pY Gets Y of the points, NaN where Z is invalid
+		 * @param pArea Gets the ground area of the points, 0 where Z is invalid
+		 * @return True on success, false if there is no camera matrix
+		*/
+		static bool GetObjectRow(const Geometry& geometry, const Eigen::Matrix3d& cameraToGrid, int y, const float* pRow, int x0, int x1, double* pX, double* pY, double* pArea);
+
+		/**
+		 * @brief Update the moments of a polygon after one of its vertices moved, without integrating the whole polygon again.
+		 *
+		 * Moving vertex p to p' between the neighbours a and b changes the polygon by the triangles (a,p',p) and (p,p',b),
+		 * counted with their orientation relative to the ring. Only these triangles are integrated, so the cost scales with the area swept by the move.
+		 * Exact as long as the polygon does not intersect itself.
+		 * @param geometry Depth map and camera matrix, the same as when the moments were integrated
+		 * @param imageRing Outer ring in image/camera coordinates after the move, closed or open
+		 * @param index Index of the moved vertex
+		 * @param previousPt Position of the vertex before the move
+		 * @param origin Origin of the moments
+		 * @param moments Moments of the polygon before the move. Gets the moments after the move.
+		 * @return True on success, false if there is no depth map or camera matrix, or the ring has less than three vertices
+		*/
+		static bool MoveVertex(const Geometry& geometry, const Geometry::Polygon::ring_type& imageRing, size_t index, const Geometry::Point& previousPt, const Eigen::Vector3d& origin, Moments& moments);
+
+		/**
+		 * @brief Fit a plane \c Z=A*X+B*Y+C to object points in the least squares sense
+		 * @param vPoints Object points, e.g. the vertices of a polygon
+		 * @param origin Subtracted from the points before fitting
+		 * @param plane Gets (A,B,C) relative to the origin. A horizontal plane at the mean Z if the points are (nearly) collinear.
+		 * @return True on success, false if there are no points
+		*/
+		static bool FitPlane(const std::vector<Geometry::Point3D>& vPoints, const Eigen::Vector3d& origin, Eigen::Vector3d& plane);
+
+		/**
+		 * @brief Get the volume between the pixels and a plane, negative where the pixels are below the plane
+		 * @param moments Moments relative to an origin
+		 * @param plane (A,B,C) of \c Z=A*X+B*Y+C relative to the same origin
+		 * @return Volume
+		*/
+		static double GetVolume(const Moments& moments, const Eigen::Vector3d& plane);
+	};
+}
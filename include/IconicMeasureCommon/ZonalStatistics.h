@@ -0,0 +1,65 @@
+#pragma once
+#include <IconicMeasureCommon/exports.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <vector>
+
+namespace iconic {
+	/**
+	 * @brief Height statistics of the depth map pixels inside polygons.
+	 *
+	 * The polygons are rasterized (see PolygonRasterizer) and the depth map is swept once in bands of rows on all cores,
+	 * so a batch of polygons, e.g. all regions of a WKT file, costs one read of each depth map row.
+	 * Count, min, max, mean and standard deviation are exact. Percentiles are interpolated in the histogram.
+	 * The histogram spans the Z range of the polygon from the depth pyramid (see Geometry::GetHeightRange).
+	 * Without a depth pyramid the range is found by a first sweep.
+	*/
+	class ICONIC_MEASURE_COMMON_EXPORT ZonalStatistics {
+	public:
+		/**
+		 * @brief Statistics of the Z values of the pixels inside a polygon
+		*/
+		struct Statistics {
+			size_t cCount;						//!< Number of valid pixels
+			size_t cInvalidCount;				//!< Number of pixels without valid Z
+			float cMin;							//!< Smallest Z
+			float cMax;							//!< Largest Z
+			double cMean;						//!< Mean Z
+			double cStdDev;						//!< Standard deviation of Z
+			double cHistogramMin;				//!< Lower edge of the first bin
+			double cBinWidth;					//!< Width of the bins
+			std::vector<size_t> cvHistogram;	//!< Number of valid pixels per bin
+
+			/**
+			 * @brief Constructor. No pixels.
+			*/
+			Statistics();
+
+			/**
+			 * @brief Get a percentile, interpolated within its histogram bin
+			 * @param percent Percentile in [0,100], e.g. 50 for the median
+			 * @return Z of the percentile, clamped to [cMin,cMax]. NaN if there are no valid pixels.
+			*/
+			double GetPercentile(double percent) const;
+		};
+
+		/**
+		 * @brief Compute the statistics of a polygon
+		 * @param geometry Depth map, and depth pyramid if available
+		 * @param imagePolygon Polygon in image/camera coordinates, holes allowed
+		 * @param statistics Gets the statistics
+		 * @param bins Number of histogram bins
+		 * @return True on success, false if there is no depth map or no bins
+		*/
+		static bool Compute(const Geometry& geometry, const Geometry::Polygon& imagePolygon, Statistics& statistics, size_t bins = 64);
+
+		/**
+		 * @brief Compute the statistics of a batch of polygons in one sweep over the depth map
+		 * @param geometry Depth map, and depth pyramid if available
+		 * @param vImagePolygons Polygons in image/camera coordinates, holes allowed. They may overlap.
+		 * @param vStatistics Gets the statistics of each polygon
+		 * @param bins Number of histogram bins
+		 * @return True on success, false if there is no depth map or no bins
+		*/
+		static bool Compute(const Geometry& geometry, const std::vector<Geometry::Polygon>& vImagePolygons, std::vector<Statistics>& vStatistics, size_t bins = 64);
+	};
+}
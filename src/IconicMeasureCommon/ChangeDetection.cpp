@@ -0,0 +1,300 @@
+#include <IconicMeasureCommon/ChangeDetection.h>
+#include <IconicMeasureCommon/PolygonRasterizer.h>
+#include <IconicMeasureCommon/ThreadPool.h>
+#include <IconicMeasureCommon/VolumeIntegrator.h>
+#include <wx/ffile.h>
+#include <wx/log.h>
+#include <wx/intl.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace iconic;
+
+namespace {
+	const int cBandRows = 16; //!< Rows per parallel band
+
+	/**
+	 * @brief Sums of the differences of a band
+	*/
+	struct Accumulator {
+		size_t cCount;			//!< Number of compared pixels
+		size_t cInvalidCount;	//!< Number of pixels not compared
+		double cArea;			//!< Ground area of the compared pixels
+		double cCut;			//!< Cut volume, positive
+		double cFill;			//!< Fill volume
+		double cCutArea;		//!< Ground area of the cut
+		double cFillArea;		//!< Ground area of the fill
+		double cSum;			//!< Sum of the differences
+		double cSumSq;			//!< Sum of the squared differences
+		float cMin;				//!< Smallest difference
+		float cMax;				//!< Largest difference
+
+		Accumulator() : cCount(0), cInvalidCount(0), cArea(0.0), cCut(0.0), cFill(0.0), cCutArea(0.0), cFillArea(0.0), cSum(0.0), cSumSq(0.0),
+			cMin(std::numeric_limits<float>::max()), cMax(-std::numeric_limits<float>::max()) {}
+
+		Accumulator& operator+=(const Accumulator& other) {
+			cCount += other.cCount;
+			cInvalidCount += other.cInvalidCount;
+			cArea += other.cArea;
+			cCut += other.cCut;
+			cFill += other.cFill;
+			cCutArea += other.cCutArea;
+			cFillArea += other.cFillArea;
+			cSum += other.cSum;
+			cSumSq += other.cSumSq;
+			cMin = std::min(cMin, other.cMin);
+			cMax = std::max(cMax, other.cMax);
+			return *this;
+		}
+	};
+
+	/**
+	 * @brief Finds the Z of the second frame under object points by projecting them through its camera matrix
+	*/
+	class Projector {
+	public:
+		/**
+		 * @brief Constructor
+		 * @param geometry Depth map, camera matrix and depth pyramid of the frame
+		 * @param level 0 for the depth map pixels, otherwise depth pyramid level \c level-1
+		*/
+		Projector(const Geometry& geometry, size_t level) :
+			cpDepthMap(geometry.cpDepthMap.get()),
+			cpData(nullptr),
+			cpPyramid(nullptr),
+			cLevel(VolumeIntegrator::GetLevel(geometry, level))
+		{
+			Eigen::Matrix3d pixelToGrid;
+			size_t width = 0, height = 0;
+			VolumeIntegrator::GetGrid(geometry, cLevel, pixelToGrid, width, height);
+			cObjectToGrid = pixelToGrid * geometry.cCameraToPixelTransform * geometry.cCameraMatrix;
+			cSize[0] = static_cast<int>(width);
+			cSize[1] = static_cast<int>(height);
+			if (cLevel > 0) {
+				cpPyramid = geometry.cpDepthPyramid.get();
+			} else {
+				cpData = cpDepthMap->GetData();
+			}
+		}
+
+		/**
+		 * @brief Get the Z of the frame under an object point
+		 * @param X Object X
+		 * @param Y Object Y
+		 * @param Z First guess of the object Z, used for the first projection
+		 * @param iterations Number of projections, each with the Z found by the previous
+		 * @return Z of the grid point hit by the last projection, NaN if outside the frame or invalid
+		*/
+		float GetZ(double X, double Y, float Z, size_t iterations) const {
+			const float nan = std::numeric_limits<float>::quiet_NaN();
+			for (size_t i = 0; i < iterations; ++i) {
+				const Eigen::Vector3d pt = cObjectToGrid * Eigen::Vector4d(X, Y, Z, 1.0);
+				const double gx = pt[0] / pt[2], gy = pt[1] / pt[2];
+				// Grid point (x,y) covers [x-0.5,x+0.5). False for NaN.
+				if (!(gx >= -0.5 && gx < cSize[0] - 0.5 && gy >= -0.5 && gy < cSize[1] - 0.5)) {
+					return nan;
+				}
+				const int x = static_cast<int>(std::floor(gx + 0.5)), y = static_cast<int>(std::floor(gy + 0.5));
+				float z = nan;
+				if (cpPyramid) {
+					DepthPyramid::Range range;
+					if (cpPyramid->GetCell(cLevel - 1, x, y, range) && range.cCount) {
+						z = range.cMean;
+					}
+				} else if (cpData) {
+					z = cpData[static_cast<size_t>(y) * cSize[0] + x];
+				} else if (!cpDepthMap->GetZ(x, y, z)) {
+					z = nan;
+				}
+				if (!DepthMap::IsValid(z)) {
+					return nan;
+				}
+				Z = z;
+			}
+			return Z;
+		}
+
+	private:
+		Geometry::CameraMatrix cObjectToGrid;		//!< Projects object points to grid coordinates
+		const DepthMap* cpDepthMap;					//!< Depth map of the frame
+		const float* cpData;						//!< Contiguous depth values, or null
+		const DepthPyramid* cpPyramid;				//!< Depth pyramid if the level is not 0
+		size_t cLevel;								//!< Level of the grid
+		int cSize[2];								//!< Grid size (width,height)
+	};
+
+	/**
+	 * @brief Compare the frames inside a polygon
+	 * @param first Reference frame
+	 * @param second Other frame
+	 * @param pixelPolygon Polygon in pixel coordinates of the first frame
+	 * @param options Parameters of the comparison
+	 * @param result Gets cut, fill and statistics
+	 * @param pDifference Gets the differences, if not null
+	 * @return True on success
+	*/
+	bool Compare(const Geometry& first, const Geometry& second, const Geometry::Polygon& pixelPolygon, const ChangeDetection::Options& options, ChangeDetection::Result& result, ChangeDetection::Raster* pDifference) {
+		result = ChangeDetection::Result();
+		if (!first.cpDepthMap || !second.cpDepthMap || first.cProjection == Geometry::EProjection::NONE || second.cProjection == Geometry::EProjection::NONE) {
+			wxLogError(_("Change detection requires the depth maps and camera matrices of both frames"));
+			return false;
+		}
+		const DepthMap& depthMap = *first.cpDepthMap;
+		const size_t level = VolumeIntegrator::GetLevel(first, options.cLevel);
+		const DepthPyramid* pPyramid = level > 0 ? first.cpDepthPyramid.get() : nullptr;
+		size_t width = 0, height = 0;
+		Eigen::Matrix3d pixelToGrid;
+		VolumeIntegrator::GetGrid(first, level, pixelToGrid, width, height);
+		const Eigen::Matrix3d cameraToGrid = pixelToGrid * first.cCameraToPixelTransform;
+		Geometry::Polygon gridPolygon = pixelPolygon;
+		auto toGrid = [&](Geometry::Point& pt) {
+			pt.set<0>(pixelToGrid(0, 0) * pt.get<0>() + pixelToGrid(0, 2));
+			pt.set<1>(pixelToGrid(1, 1) * pt.get<1>() + pixelToGrid(1, 2));
+		};
+		std::for_each(gridPolygon.outer().begin(), gridPolygon.outer().end(), toGrid);
+		for (Geometry::Polygon::ring_type& inner : gridPolygon.inners()) {
+			std::for_each(inner.begin(), inner.end(), toGrid);
+		}
+		if (pDifference) {
+			pDifference->cWidth = width;
+			pDifference->cHeight = height;
+			pDifference->cvValues.assign(width * height, std::numeric_limits<float>::quiet_NaN());
+		}
+
+		const Projector projector(second, level);
+		const size_t iterations = std::max<size_t>(options.cIterations, 1);
+		const double minChange = options.cMinChange;
+		const float* pData = level == 0 ? depthMap.GetData() : nullptr;
+		PolygonRasterizer rasterizer;
+		int y0 = 0, y1 = 0;
+		if (rasterizer.Create(gridPolygon, width, height)) {
+			rasterizer.GetRows(y0, y1);
+		}
+		const size_t nBands = (y1 - y0 + cBandRows - 1) / cBandRows;
+		std::vector<Accumulator> vBands(nBands);
+		ThreadPool::GetInstance().ParallelFor(0, nBands, [&](size_t bandBegin, size_t bandEnd) {
+			std::vector<PolygonRasterizer::Span> vSpans;
+			std::vector<float> vRow(pData ? 0 : width);
+			std::vector<double> vPoints(3 * width);
+			double* pX = vPoints.data(), *pY = pX + width, *pArea = pY + width;
+			for (size_t band = bandBegin; band < bandEnd; ++band) {
+				const int by0 = y0 + static_cast<int>(band) * cBandRows;
+				rasterizer.GetSpans(by0, std::min(y1, by0 + cBandRows), vSpans);
+				Accumulator& accumulator = vBands[band];
+				int rowY = -1;
+				bool bRow = false;
+				for (const PolygonRasterizer::Span& span : vSpans) {
+					if (!pData && span.cY != rowY) {
+						rowY = span.cY;
+						bRow = level == 0 ? depthMap.GetRow(rowY, vRow.data()) : pPyramid->GetMeanRow(level - 1, rowY, vRow.data());
+					}
+					if (!pData && !bRow) {
+						accumulator.cInvalidCount += span.cX1 - span.cX0;
+						continue;
+					}
+					const float* pRow = pData ? pData + span.cY * width : vRow.data();
+					VolumeIntegrator::GetObjectRow(first, cameraToGrid, span.cY, pRow, span.cX0, span.cX1, pX, pY, pArea);
+					float* pOut = pDifference ? pDifference->cvValues.data() + span.cY * width : nullptr;
+					for (int x = span.cX0; x < span.cX1; ++x) {
+						const size_t i = x - span.cX0;
+						const float z = pRow[x];
+						const float z2 = DepthMap::IsValid(z) ? projector.GetZ(pX[i], pY[i], z, iterations) : std::numeric_limits<float>::quiet_NaN();
+						if (!DepthMap::IsValid(z2)) {
+							++accumulator.cInvalidCount;
+							continue;
+						}
+						const float d = z2 - z;
+						const double a = pArea[i];
+						++accumulator.cCount;
+						accumulator.cArea += a;
+						accumulator.cSum += d;
+						accumulator.cSumSq += static_cast<double>(d) * d;
+						accumulator.cMin = std::min(accumulator.cMin, d);
+						accumulator.cMax = std::max(accumulator.cMax, d);
+						if (d > minChange) {
+							accumulator.cFill += a * d;
+							accumulator.cFillArea += a;
+						} else if (d < -minChange) {
+							accumulator.cCut -= a * d;
+							accumulator.cCutArea += a;
+						}
+						if (pOut) {
+							pOut[x] = d;
+						}
+					}
+				}
+			}
+		});
+
+		// Same order every time, so the result does not depend on the scheduling
+		Accumulator total;
+		for (const Accumulator& band : vBands) {
+			total += band;
+		}
+		result.cCount = total.cCount;
+		result.cInvalidCount = total.cInvalidCount;
+		result.cArea = total.cArea;
+		result.cCutVolume = total.cCut;
+		result.cFillVolume = total.cFill;
+		result.cCutArea = total.cCutArea;
+		result.cFillArea = total.cFillArea;
+		result.cMin = total.cMin;
+		result.cMax = total.cMax;
+		if (total.cCount) {
+			result.cMean = total.cSum / total.cCount;
+			result.cStdDev = std::sqrt(std::max(0.0, total.cSumSq / total.cCount - result.cMean * result.cMean));
+		}
+		return true;
+	}
+}
+
+ChangeDetection::Options::Options() : cLevel(0), cIterations(2), cMinChange(0.0) {}
+
+ChangeDetection::Result::Result() :
+	cCount(0),
+	cInvalidCount(0),
+	cArea(0.0),
+	cCutVolume(0.0),
+	cFillVolume(0.0),
+	cCutArea(0.0),
+	cFillArea(0.0),
+	cMin(std::numeric_limits<float>::max()),
+	cMax(-std::numeric_limits<float>::max()),
+	cMean(0.0),
+	cStdDev(0.0)
+{}
+
+double ChangeDetection::Result::GetNetVolume() const {
+	return cFillVolume - cCutVolume;
+}
+
+ChangeDetection::Raster::Raster() : cWidth(0), cHeight(0) {}
+
+bool ChangeDetection::Raster::Write(const wxString& filename) const {
+	wxFFile file(filename, "wb");
+	if (!file.IsOpened() || file.Write(cvValues.data(), cvValues.size() * sizeof(float)) != cvValues.size() * sizeof(float)) {
+		wxLogError(_("Could not write difference raster %s"), filename);
+		return false;
+	}
+	return true;
+}
+
+bool ChangeDetection::Compute(const Geometry& first, const Geometry& second, const Geometry::Polygon& imagePolygon, const ChangeDetection::Options& options, ChangeDetection::Result& result, ChangeDetection::Raster* pDifference) {
+	Geometry::Polygon pixelPolygon;
+	first.ImageToPixel(imagePolygon, pixelPolygon);
+	return Compare(first, second, pixelPolygon, options, result, pDifference);
+}
+
+bool ChangeDetection::Compute(const Geometry& first, const Geometry& second, const ChangeDetection::Options& options, ChangeDetection::Result& result, ChangeDetection::Raster* pDifference) {
+	// All pixels of the first frame. Pixels not seen in the second are not compared.
+	const double width = first.cpDepthMap ? static_cast<double>(first.cpDepthMap->GetWidth()) : 0.0;
+	const double height = first.cpDepthMap ? static_cast<double>(first.cpDepthMap->GetHeight()) : 0.0;
+	Geometry::Polygon pixelPolygon;
+	pixelPolygon.outer().push_back(Geometry::Point(-0.5, -0.5));
+	pixelPolygon.outer().push_back(Geometry::Point(-0.5, height - 0.5));
+	pixelPolygon.outer().push_back(Geometry::Point(width - 0.5, height - 0.5));
+	pixelPolygon.outer().push_back(Geometry::Point(width - 0.5, -0.5));
+	pixelPolygon.outer().push_back(Geometry::Point(-0.5, -0.5));
+	return Compare(first, second, pixelPolygon, options, result, pDifference);
+}
@@ -0,0 +1,281 @@
+#include <IconicMeasureCommon/CompactDepthMap.h>
+#include <wx/log.h>
+#include <wx/intl.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+using namespace iconic;
+
+namespace {
+	uint32_t AsUint(float f) {
+		uint32_t u;
+		std::memcpy(&u, &f, sizeof(u));
+		return u;
+	}
+
+	float AsFloat(uint32_t u) {
+		float f;
+		std::memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	// Float to half float with round to nearest even. Overflow gives infinity, NaN stays NaN.
+	uint16_t FloatToHalf(float f) {
+		uint32_t x = AsUint(f);
+		const uint32_t sign = x & 0x80000000u;
+		x ^= sign;
+		uint32_t h;
+		if (x >= 0x47800000u) { // Infinity or NaN after conversion
+			h = (x > 0x7f800000u) ? 0x7e00u : 0x7c00u;
+		} else if (x < 0x38800000u) { // Subnormal half or zero. Let float addition do the rounding.
+			const uint32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+			h = AsUint(AsFloat(x) + AsFloat(denormMagic)) - denormMagic;
+		} else {
+			const uint32_t mantissaOdd = (x >> 13) & 1;
+			x += (static_cast<uint32_t>(15 - 127) << 23) + 0xfffu;
+			x += mantissaOdd;
+			h = x >> 13;
+		}
+		return static_cast<uint16_t>((sign >> 16) | h);
+	}
+
+	float HalfToFloat(uint16_t h) {
+		const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+		const uint32_t exponent = (h >> 10) & 0x1fu;
+		const uint32_t mantissa = h & 0x3ffu;
+		if (exponent == 0x1f) {
+			return AsFloat(sign | 0x7f800000u | (mantissa << 13));
+		}
+		if (exponent == 0) {
+			const float f = mantissa * (1.0f / 16777216.0f); // Subnormal, mantissa * 2^-24
+			return AsFloat(AsUint(f) | sign);
+		}
+		return AsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+	}
+
+	// Invalid values are stored as +inf, since invalid values just above DepthMap::cMaxValidZ could otherwise round to valid ones
+	void FloatToHalfRow(const float* pIn, size_t n, uint16_t* pOut) {
+		size_t i = 0;
+#if defined(__AVX2__) || defined(__F16C__)
+		const __m256 vMaxValid = _mm256_set1_ps(DepthMap::cMaxValidZ), vMin = _mm256_set1_ps(-std::numeric_limits<float>::max());
+		const __m256 vInfinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+		for (; i + 8 <= n; i += 8) {
+			const __m256 z = _mm256_loadu_ps(pIn + i);
+			const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(z, vMaxValid, _CMP_LE_OQ), _mm256_cmp_ps(z, vMin, _CMP_GE_OQ));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), _mm256_cvtps_ph(_mm256_blendv_ps(vInfinity, z, valid), _MM_FROUND_TO_NEAREST_INT));
+		}
+#endif
+		for (; i < n; ++i) {
+			pOut[i] = FloatToHalf(DepthMap::IsValid(pIn[i]) ? pIn[i] : std::numeric_limits<float>::infinity());
+		}
+	}
+
+	void HalfToFloatRow(const uint16_t* pIn, size_t n, float* pOut) {
+		size_t i = 0;
+#if defined(__AVX2__) || defined(__F16C__)
+		for (; i + 8 <= n; i += 8) {
+			_mm256_storeu_ps(pOut + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i))));
+		}
+#endif
+		for (; i < n; ++i) {
+			pOut[i] = HalfToFloat(pIn[i]);
+		}
+	}
+
+	void QuantizeRow(const float* pIn, size_t n, float offset, float invScale, uint16_t invalid, uint16_t* pOut) {
+		size_t i = 0;
+#if defined(__AVX2__)
+		const __m256 vMaxValid = _mm256_set1_ps(DepthMap::cMaxValidZ), vMin = _mm256_set1_ps(-std::numeric_limits<float>::max());
+		const __m256 vOffset = _mm256_set1_ps(offset), vInvScale = _mm256_set1_ps(invScale), vHalf = _mm256_set1_ps(0.5f);
+		const __m256i vZero = _mm256_setzero_si256(), vMaxValue = _mm256_set1_epi32(invalid - 1), vInvalid = _mm256_set1_epi32(invalid);
+		for (; i + 8 <= n; i += 8) {
+			const __m256 z = _mm256_loadu_ps(pIn + i);
+			const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(z, vMaxValid, _CMP_LE_OQ), _mm256_cmp_ps(z, vMin, _CMP_GE_OQ));
+			__m256i q = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(z, vOffset), vInvScale), vHalf));
+			q = _mm256_min_epi32(_mm256_max_epi32(q, vZero), vMaxValue);
+			q = _mm256_blendv_epi8(vInvalid, q, _mm256_castps_si256(valid));
+			// Pack to 16 bit within each 128 bit lane, then move the two lower halves together
+			const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(q, q), 0x08);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), _mm256_castsi256_si128(packed));
+		}
+#endif
+		for (; i < n; ++i) {
+			if (!DepthMap::IsValid(pIn[i])) {
+				pOut[i] = invalid;
+				continue;
+			}
+			const int q = static_cast<int>((pIn[i] - offset) * invScale + 0.5f);
+			pOut[i] = static_cast<uint16_t>(std::min(std::max(q, 0), invalid - 1));
+		}
+	}
+
+	void DequantizeRow(const uint16_t* pIn, size_t n, float offset, float scale, uint16_t invalid, float* pOut) {
+		size_t i = 0;
+#if defined(__AVX2__)
+		const __m256 vOffset = _mm256_set1_ps(offset), vScale = _mm256_set1_ps(scale), vInvalidZ = _mm256_set1_ps(std::numeric_limits<float>::max());
+		const __m256i vInvalid = _mm256_set1_epi32(invalid);
+		for (; i + 8 <= n; i += 8) {
+			const __m256i q = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i)));
+			const __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(q), vScale), vOffset);
+			_mm256_storeu_ps(pOut + i, _mm256_blendv_ps(z, vInvalidZ, _mm256_castsi256_ps(_mm256_cmpeq_epi32(q, vInvalid))));
+		}
+#endif
+		for (; i < n; ++i) {
+			pOut[i] = (pIn[i] == invalid) ? std::numeric_limits<float>::max() : offset + scale * pIn[i];
+		}
+	}
+
+	// Largest absolute difference between valid source values and the converted values
+	float MaxError(const float* pSource, const float* pConverted, size_t n) {
+		float maxError = 0.0f;
+		for (size_t i = 0; i < n; ++i) {
+			if (DepthMap::IsValid(pSource[i])) {
+				maxError = std::max(maxError, std::abs(pSource[i] - pConverted[i]));
+			}
+		}
+		return maxError;
+	}
+}
+
+// HalfDepthMap --------------------------------------------------------------------------
+HalfDepthMap::HalfDepthMap() : cMaxError(0.0f) {}
+
+bool HalfDepthMap::Create(const DepthMap& source) {
+	const size_t width = source.GetWidth(), height = source.GetHeight();
+	cvData.resize(width * height);
+	cMaxError = 0.0f;
+	std::vector<float> vRow(width), vConverted(width);
+	for (size_t y = 0; y < height; ++y) {
+		if (!source.GetRow(static_cast<int>(y), vRow.data())) {
+			wxLogError(_("Could not read row %zu of depth map"), y);
+			cvData.clear();
+			cSize[0] = cSize[1] = 0;
+			return false;
+		}
+		uint16_t* pOut = cvData.data() + y * width;
+		FloatToHalfRow(vRow.data(), width, pOut);
+		HalfToFloatRow(pOut, width, vConverted.data());
+		cMaxError = std::max(cMaxError, MaxError(vRow.data(), vConverted.data(), width));
+	}
+	cSize[0] = width;
+	cSize[1] = height;
+	return true;
+}
+
+bool HalfDepthMap::GetZ(const int x, const int y, float& Z) const {
+	if (x < 0 || y < 0 || static_cast<size_t>(x) >= cSize[0] || static_cast<size_t>(y) >= cSize[1]) {
+		return false;
+	}
+	Z = HalfToFloat(cvData[y * cSize[0] + x]);
+	return true;
+}
+
+bool HalfDepthMap::GetRow(const int y, float* pRow) const {
+	if (y < 0 || static_cast<size_t>(y) >= cSize[1]) {
+		return false;
+	}
+	HalfToFloatRow(cvData.data() + y * cSize[0], cSize[0], pRow);
+	return true;
+}
+
+const float* HalfDepthMap::GetData() const {
+	return nullptr;
+}
+
+size_t HalfDepthMap::GetMemoryUsage() const {
+	return cvData.size() * sizeof(uint16_t);
+}
+
+float HalfDepthMap::GetMaxError() const {
+	return cMaxError;
+}
+
+// QuantizedDepthMap ---------------------------------------------------------------------
+QuantizedDepthMap::QuantizedDepthMap() : cScale(1.0f), cOffset(0.0f), cMaxError(0.0f) {}
+
+bool QuantizedDepthMap::Create(const DepthMap& source) {
+	const size_t width = source.GetWidth(), height = source.GetHeight();
+	cvData.clear();
+	cSize[0] = cSize[1] = 0;
+	cMaxError = 0.0f;
+
+	// Range of valid values gives scale and offset
+	std::vector<float> vRow(width), vConverted(width);
+	float minZ = std::numeric_limits<float>::max(), maxZ = -std::numeric_limits<float>::max();
+	for (size_t y = 0; y < height; ++y) {
+		if (!source.GetRow(static_cast<int>(y), vRow.data())) {
+			wxLogError(_("Could not read row %zu of depth map"), y);
+			return false;
+		}
+		for (size_t x = 0; x < width; ++x) {
+			if (DepthMap::IsValid(vRow[x])) {
+				minZ = std::min(minZ, vRow[x]);
+				maxZ = std::max(maxZ, vRow[x]);
+			}
+		}
+	}
+	if (minZ > maxZ) { // No valid values
+		minZ = maxZ = 0.0f;
+	}
+	cOffset = minZ;
+	cScale = (maxZ > minZ) ? (maxZ - minZ) / (cInvalid - 1) : 1.0f;
+	const float invScale = 1.0f / cScale;
+
+	cvData.resize(width * height);
+	for (size_t y = 0; y < height; ++y) {
+		if (!source.GetRow(static_cast<int>(y), vRow.data())) {
+			wxLogError(_("Could not read row %zu of depth map"), y);
+			cvData.clear();
+			return false;
+		}
+		uint16_t* pOut = cvData.data() + y * width;
+		QuantizeRow(vRow.data(), width, cOffset, invScale, cInvalid, pOut);
+		DequantizeRow(pOut, width, cOffset, cScale, cInvalid, vConverted.data());
+		cMaxError = std::max(cMaxError, MaxError(vRow.data(), vConverted.data(), width));
+	}
+	cSize[0] = width;
+	cSize[1] = height;
+	return true;
+}
+
+bool QuantizedDepthMap::GetZ(const int x, const int y, float& Z) const {
+	if (x < 0 || y < 0 || static_cast<size_t>(x) >= cSize[0] || static_cast<size_t>(y) >= cSize[1]) {
+		return false;
+	}
+	const uint16_t q = cvData[y * cSize[0] + x];
+	Z = (q == cInvalid) ? std::numeric_limits<float>::max() : cOffset + cScale * q;
+	return true;
+}
+
+bool QuantizedDepthMap::GetRow(const int y, float* pRow) const {
+	if (y < 0 || static_cast<size_t>(y) >= cSize[1]) {
+		return false;
+	}
+	DequantizeRow(cvData.data() + y * cSize[0], cSize[0], cOffset, cScale, cInvalid, pRow);
+	return true;
+}
+
+const float* QuantizedDepthMap::GetData() const {
+	return nullptr;
+}
+
+size_t QuantizedDepthMap::GetMemoryUsage() const {
+	return cvData.size() * sizeof(uint16_t);
+}
+
+float QuantizedDepthMap::GetMaxError() const {
+	return cMaxError;
+}
+
+float QuantizedDepthMap::GetScale() const {
+	return cScale;
+}
+
+float QuantizedDepthMap::GetOffset() const {
+	return cOffset;
+}
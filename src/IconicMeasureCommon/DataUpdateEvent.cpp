@@ -7,16 +7,18 @@ wxDEFINE_EVENT(DATA_UPDATE, DataUpdateEvent);
 DataUpdateEvent::DataUpdateEvent(int winid)
 	: wxCommandEvent(DATA_UPDATE, winid) {
 	cDeleteEvent = false;
+	cRefinementLevel = 0;
 }
 
-DataUpdateEvent::DataUpdateEvent(int winid, int index)
+DataUpdateEvent::DataUpdateEvent(int winid, const iconic::ShapeHandle& handle)
 	: wxCommandEvent(DATA_UPDATE, winid) {
-	cShapeIndex = index;
+	cShapeHandle = handle;
 	cDeleteEvent = true;
+	cRefinementLevel = 0;
 }
 
-void DataUpdateEvent::Initialize(const int index, const iconic::ShapePtr shape) {
-	cShapeIndex = index;
+void DataUpdateEvent::Initialize(const iconic::ShapeHandle& handle, const iconic::ShapePtr shape) {
+	cShapeHandle = handle;
 	cpShape = shape;
 }
 
@@ -24,8 +26,10 @@ void DataUpdateEvent::Initialize(const int index, const iconic::ShapePtr shape)
 iconic::ShapePtr DataUpdateEvent::GetShape() { return cpShape; }
 
 
-int DataUpdateEvent::GetIndex() const { return cShapeIndex; }
+const iconic::ShapeHandle& DataUpdateEvent::GetHandle() const { return cShapeHandle; }
 bool DataUpdateEvent::IsDeletionEvent() const { return cDeleteEvent; }
+void DataUpdateEvent::SetRefinementLevel(size_t level) { cRefinementLevel = level; }
+size_t DataUpdateEvent::GetRefinementLevel() const { return cRefinementLevel; }
 
 
 
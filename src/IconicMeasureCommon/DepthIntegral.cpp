@@ -0,0 +1,109 @@
+#include <IconicMeasureCommon/DepthIntegral.h>
+#include <IconicMeasureCommon/ThreadPool.h>
+#include <wx/log.h>
+#include <wx/intl.h>
+#include <algorithm>
+#include <atomic>
+
+using namespace iconic;
+
+DepthIntegral::DepthIntegral() : cOffset(0.0) {
+	cSize[0] = cSize[1] = 0;
+}
+
+bool DepthIntegral::Build(const DepthMap& depthMap, double offset) {
+	const size_t width = depthMap.GetWidth(), height = depthMap.GetHeight();
+	cOffset = offset;
+	cSize[0] = width + 1;
+	cSize[1] = height + 1;
+	// First row and column are zero so that rectangles at the border need no special case
+	cvSum.assign(cSize[0] * cSize[1], 0.0);
+	cvSum2.assign(cSize[0] * cSize[1], 0.0);
+	cvCount.assign(cSize[0] * cSize[1], 0);
+
+	// Running sums along each row. Rows are independent.
+	std::atomic<bool> bOk(true);
+	ThreadPool::GetInstance().ParallelFor(0, height, [&](size_t yBegin, size_t yEnd) {
+		std::vector<float> vRow(width);
+		for (size_t y = yBegin; y < yEnd; ++y) {
+			if (!depthMap.GetRow(static_cast<int>(y), vRow.data())) {
+				bOk = false;
+				return;
+			}
+			const size_t i0 = (y + 1) * cSize[0] + 1;
+			double sum = 0.0, sum2 = 0.0;
+			uint32_t count = 0;
+			for (size_t x = 0; x < width; ++x) {
+				if (DepthMap::IsValid(vRow[x])) {
+					const double Z = vRow[x] - offset;
+					sum += Z;
+					sum2 += Z * Z;
+					++count;
+				}
+				cvSum[i0 + x] = sum;
+				cvSum2[i0 + x] = sum2;
+				cvCount[i0 + x] = count;
+			}
+		}
+	}, 16);
+	if (!bOk) {
+		wxLogError(_("Could not read depth map when building depth integral"));
+		cvSum.clear();
+		cvSum2.clear();
+		cvCount.clear();
+		cSize[0] = cSize[1] = 0;
+		return false;
+	}
+
+	// Add the row above, in strips of columns. The inner loop runs along a row, so it vectorizes.
+	const size_t stripWidth = 512;
+	ThreadPool::GetInstance().ParallelFor(0, (cSize[0] + stripWidth - 1) / stripWidth, [&](size_t sBegin, size_t sEnd) {
+		const size_t x0 = sBegin * stripWidth, x1 = std::min(cSize[0], sEnd * stripWidth);
+		for (size_t y = 2; y < cSize[1]; ++y) {
+			double* pSum = cvSum.data() + y * cSize[0];
+			double* pSum2 = cvSum2.data() + y * cSize[0];
+			uint32_t* pCount = cvCount.data() + y * cSize[0];
+			const double* pSumAbove = pSum - cSize[0];
+			const double* pSum2Above = pSum2 - cSize[0];
+			const uint32_t* pCountAbove = pCount - cSize[0];
+			for (size_t x = x0; x < x1; ++x) {
+				pSum[x] += pSumAbove[x];
+				pSum2[x] += pSum2Above[x];
+				pCount[x] += pCountAbove[x];
+			}
+		}
+	});
+	return true;
+}
+
+bool DepthIntegral::GetStatistics(int x0, int y0, int x1, int y1, Statistics& statistics) const {
+	statistics.cSum = statistics.cMean = statistics.cVariance = 0.0;
+	statistics.cCount = 0;
+	if (cvSum.empty()) {
+		return false;
+	}
+	// Clip to the depth map. Table index i corresponds to the border before pixel i.
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, static_cast<int>(cSize[0]) - 1);
+	y1 = std::min(y1, static_cast<int>(cSize[1]) - 1);
+	if (x1 <= x0 || y1 <= y0) {
+		return false;
+	}
+	const size_t i00 = y0 * cSize[0] + x0, i01 = y0 * cSize[0] + x1, i10 = y1 * cSize[0] + x0, i11 = y1 * cSize[0] + x1;
+	statistics.cCount = cvCount[i11] - cvCount[i01] - cvCount[i10] + cvCount[i00];
+	if (!statistics.cCount) {
+		return false;
+	}
+	const double sum = cvSum[i11] - cvSum[i01] - cvSum[i10] + cvSum[i00];
+	const double sum2 = cvSum2[i11] - cvSum2[i01] - cvSum2[i10] + cvSum2[i00];
+	const double meanOffset = sum / statistics.cCount; // Mean of Z-offset
+	statistics.cMean = meanOffset + cOffset;
+	statistics.cSum = sum + cOffset * statistics.cCount;
+	statistics.cVariance = std::max(0.0, sum2 / statistics.cCount - meanOffset * meanOffset);
+	return true;
+}
+
+size_t DepthIntegral::GetMemoryUsage() const {
+	return cvSum.size() * sizeof(double) + cvSum2.size() * sizeof(double) + cvCount.size() * sizeof(uint32_t);
+}
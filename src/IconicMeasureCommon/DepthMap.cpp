@@ -0,0 +1,134 @@
+#include <IconicMeasureCommon/DepthMap.h>
+#include <wx/log.h>
+#include <wx/intl.h>
+#include <wx/ffile.h>
+#include <cstring>
+
+using namespace iconic;
+
+// DepthMap ------------------------------------------------------------------------------
+const float DepthMap::cMaxValidZ = 1000.0f;
+
+DepthMap::DepthMap(size_t width, size_t height) {
+	cSize[0] = width;
+	cSize[1] = height;
+}
+
+DepthMap::~DepthMap() {}
+
+size_t DepthMap::GetWidth() const {
+	return cSize[0];
+}
+
+size_t DepthMap::GetHeight() const {
+	return cSize[1];
+}
+
+bool DepthMap::GetRow(const int y, float* pRow) const {
+	if (y < 0 || static_cast<size_t>(y) >= cSize[1]) {
+		return false;
+	}
+	const float* pData = GetData();
+	if (pData) {
+		std::memcpy(pRow, pData + y * cSize[0], cSize[0] * sizeof(float));
+		return true;
+	}
+	for (size_t x = 0; x < cSize[0]; ++x) {
+		if (!GetZ(static_cast<int>(x), y, pRow[x])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+float DepthMap::GetMaxError() const {
+	return 0.0f;
+}
+
+// RawDepthMap ---------------------------------------------------------------------------
+RawDepthMap::RawDepthMap() : cpData(nullptr) {}
+
+RawDepthMap::~RawDepthMap() {
+	if (cMappedFile.is_open()) {
+		cMappedFile.close();
+	}
+}
+
+bool RawDepthMap::Open(const wxString& filename, size_t width, size_t height, bool bAllowMapping) {
+	cpData = nullptr;
+	cvData.clear();
+	if (cMappedFile.is_open()) {
+		cMappedFile.close();
+	}
+	cSize[0] = cSize[1] = 0;
+
+	const size_t nPixels = width * height;
+	if (!nPixels) {
+		wxLogError(_("Invalid depth map size %zux%zu"), width, height);
+		return false;
+	}
+
+	if (bAllowMapping && Map(filename)) {
+		if (cMappedFile.size() < sizeof(float) * nPixels) {
+			wxLogError(_("Not enough data in %s"), filename);
+			cMappedFile.close();
+			return false;
+		}
+		cpData = reinterpret_cast<const float*>(cMappedFile.data()); // Mapped views are page aligned
+	} else if (!Copy(filename, nPixels)) {
+		return false;
+	}
+	cSize[0] = width;
+	cSize[1] = height;
+	return true;
+}
+
+bool RawDepthMap::Map(const wxString& filename) {
+	try {
+		cMappedFile.open(filename.ToStdString()); // Map the whole file, mapping beyond end of file is not allowed
+	} catch (const std::exception& e) {
+		wxLogVerbose(_("Could not memory map %s (%s), copying it instead"), filename, e.what());
+		return false;
+	}
+	if (!cMappedFile.is_open()) {
+		wxLogVerbose(_("Could not memory map %s, copying it instead"), filename);
+		return false;
+	}
+	return true;
+}
+
+bool RawDepthMap::Copy(const wxString& filename, size_t nPixels) {
+	wxFFile file(filename, "rb");
+	if (!file.IsOpened()) {
+		wxLogError(_("Could not open %s"), filename);
+		return false;
+	}
+	cvData.resize(nPixels);
+	if (file.Read(cvData.data(), sizeof(float) * nPixels) != sizeof(float) * nPixels) {
+		wxLogError(_("Not enough data in %s"), filename);
+		cvData.clear();
+		return false;
+	}
+	cpData = cvData.data();
+	return true;
+}
+
+bool RawDepthMap::IsMapped() const {
+	return cMappedFile.is_open();
+}
+
+bool RawDepthMap::GetZ(const int x, const int y, float& Z) const {
+	if (!cpData || x < 0 || y < 0 || static_cast<size_t>(x) >= cSize[0] || static_cast<size_t>(y) >= cSize[1]) {
+		return false;
+	}
+	Z = cpData[y * cSize[0] + x];
+	return true;
+}
+
+const float* RawDepthMap::GetData() const {
+	return cpData;
+}
+
+size_t RawDepthMap::GetMemoryUsage() const {
+	return sizeof(float) * cSize[0] * cSize[1];
+}
@@ -0,0 +1,343 @@
+#include <IconicMeasureCommon/DepthPyramid.h>
+#include <IconicMeasureCommon/ThreadPool.h>
+#include <wx/log.h>
+#include <wx/intl.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace iconic;
+
+namespace {
+	// Cells without valid values
+	const float cEmptyMin = std::numeric_limits<float>::max();
+	const float cEmptyMax = -std::numeric_limits<float>::max();
+
+	void ResizeLevel(size_t width, size_t height, std::vector<float>& vMin, std::vector<float>& vMax, std::vector<float>& vMean, std::vector<uint32_t>& vCount) {
+		vMin.assign(width * height, cEmptyMin);
+		vMax.assign(width * height, cEmptyMax);
+		vMean.assign(width * height, 0.0f);
+		vCount.assign(width * height, 0);
+	}
+
+	// Append the bytes of n values to a buffer
+	template<typename T>
+	void Append(std::vector<char>& vBuffer, const T* pValues, size_t n) {
+		const char* pBytes = reinterpret_cast<const char*>(pValues);
+		vBuffer.insert(vBuffer.end(), pBytes, pBytes + n * sizeof(T));
+	}
+
+	// Take n values from the front of a buffer. False if there are not enough bytes left.
+	template<typename T>
+	bool Take(const char*& pData, size_t& size, T* pValues, size_t n) {
+		if (size < n * sizeof(T)) {
+			return false;
+		}
+		std::memcpy(pValues, pData, n * sizeof(T));
+		pData += n * sizeof(T);
+		size -= n * sizeof(T);
+		return true;
+	}
+}
+
+DepthPyramid::DepthPyramid() : cBlockSize(4) {}
+
+bool DepthPyramid::Build(const DepthMap& depthMap, size_t blockSize) {
+	cvLevels.clear();
+	cBlockSize = std::max<size_t>(blockSize, 1);
+	if (!depthMap.GetWidth() || !depthMap.GetHeight()) {
+		return false;
+	}
+	if (!BuildBase(depthMap)) {
+		cvLevels.clear();
+		return false;
+	}
+	while (cvLevels.back().cSize[0] > 1 || cvLevels.back().cSize[1] > 1) {
+		cvLevels.emplace_back();
+		BuildLevel(cvLevels[cvLevels.size() - 2], cvLevels.back());
+	}
+	return true;
+}
+
+bool DepthPyramid::BuildBase(const DepthMap& depthMap) {
+	const size_t width = depthMap.GetWidth(), height = depthMap.GetHeight();
+	cvLevels.emplace_back();
+	Level& level = cvLevels.back();
+	level.cSize[0] = (width + cBlockSize - 1) / cBlockSize;
+	level.cSize[1] = (height + cBlockSize - 1) / cBlockSize;
+	ResizeLevel(level.cSize[0], level.cSize[1], level.cvMin, level.cvMax, level.cvMean, level.cvCount);
+
+	const float maxValid = DepthMap::cMaxValidZ;
+	const size_t stripWidth = 64 * cBlockSize; // Columns per strip, so that the column statistics stay in L1 cache
+	std::atomic<bool> bOk(true);
+	ThreadPool::GetInstance().ParallelFor(0, level.cSize[1], [&](size_t cyBegin, size_t cyEnd) {
+		// Rows of a cell row, and per column statistics of a strip. Contiguous and branch free, so the compiler can vectorize.
+		std::vector<float> vRows(cBlockSize * width), vColMin(stripWidth), vColMax(stripWidth), vColSum(stripWidth);
+		std::vector<uint32_t> vColCount(stripWidth);
+		float* pMin = vColMin.data();
+		float* pMax = vColMax.data();
+		float* pSum = vColSum.data();
+		uint32_t* pCount = vColCount.data();
+		for (size_t cy = cyBegin; cy < cyEnd; ++cy) {
+			const size_t nRows = std::min(height - cy * cBlockSize, cBlockSize);
+			for (size_t r = 0; r < nRows; ++r) {
+				if (!depthMap.GetRow(static_cast<int>(cy * cBlockSize + r), vRows.data() + r * width)) {
+					bOk = false;
+					return;
+				}
+			}
+
+			for (size_t x0 = 0; x0 < width; x0 += stripWidth) {
+				const size_t n = std::min(stripWidth, width - x0);
+				std::fill(pMin, pMin + n, cEmptyMin);
+				std::fill(pMax, pMax + n, cEmptyMax);
+				std::fill(pSum, pSum + n, 0.0f);
+				std::fill(pCount, pCount + n, 0);
+				for (size_t r = 0; r < nRows; ++r) {
+					const float* pRow = vRows.data() + r * width + x0;
+					size_t x = 0;
+#if defined(__AVX2__)
+					const __m256 vMaxValid = _mm256_set1_ps(maxValid), vEmptyMin = _mm256_set1_ps(cEmptyMin), vEmptyMax = _mm256_set1_ps(cEmptyMax);
+					for (; x + 8 <= n; x += 8) {
+						const __m256 Z = _mm256_loadu_ps(pRow + x);
+						const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(Z, vMaxValid, _CMP_LE_OQ), _mm256_cmp_ps(Z, vEmptyMax, _CMP_GE_OQ));
+						_mm256_storeu_ps(pMin + x, _mm256_min_ps(_mm256_loadu_ps(pMin + x), _mm256_blendv_ps(vEmptyMin, Z, valid)));
+						_mm256_storeu_ps(pMax + x, _mm256_max_ps(_mm256_loadu_ps(pMax + x), _mm256_blendv_ps(vEmptyMax, Z, valid)));
+						_mm256_storeu_ps(pSum + x, _mm256_add_ps(_mm256_loadu_ps(pSum + x), _mm256_and_ps(Z, valid)));
+						// Valid lanes are all ones, i.e. -1
+						__m256i* pCount8 = reinterpret_cast<__m256i*>(pCount + x);
+						_mm256_storeu_si256(pCount8, _mm256_sub_epi32(_mm256_loadu_si256(pCount8), _mm256_castps_si256(valid)));
+					}
+#endif
+					for (; x < n; ++x) {
+						const float Z = pRow[x];
+						const bool bValid = (Z <= maxValid) & (Z >= cEmptyMax); // Same as DepthMap::IsValid, without branches
+						pMin[x] = (bValid & (Z < pMin[x])) ? Z : pMin[x];
+						pMax[x] = (bValid & (Z > pMax[x])) ? Z : pMax[x];
+						pSum[x] += bValid ? Z : 0.0f;
+						pCount[x] += bValid;
+					}
+				}
+
+				// Combine the columns of each cell of the strip
+				const size_t i0 = cy * level.cSize[0] + x0 / cBlockSize;
+				float* pCellMin = level.cvMin.data() + i0;
+				float* pCellMax = level.cvMax.data() + i0;
+				float* pCellMean = level.cvMean.data() + i0;
+				uint32_t* pCellCount = level.cvCount.data() + i0;
+				for (size_t cx = 0; cx * cBlockSize < n; ++cx) {
+					const size_t xEnd = std::min(n, (cx + 1) * cBlockSize);
+					float minZ = cEmptyMin, maxZ = cEmptyMax, sum = 0.0f;
+					uint32_t count = 0;
+					for (size_t x = cx * cBlockSize; x < xEnd; ++x) {
+						minZ = std::min(minZ, pMin[x]);
+						maxZ = std::max(maxZ, pMax[x]);
+						sum += pSum[x];
+						count += pCount[x];
+					}
+					pCellMin[cx] = minZ;
+					pCellMax[cx] = maxZ;
+					pCellMean[cx] = count ? sum / count : 0.0f;
+					pCellCount[cx] = count;
+				}
+			}
+		}
+	});
+	if (!bOk) {
+		wxLogError(_("Could not read depth map when building depth pyramid"));
+	}
+	return bOk;
+}
+
+void DepthPyramid::BuildLevel(const Level& below, Level& level) {
+	level.cSize[0] = (below.cSize[0] + 1) / 2;
+	level.cSize[1] = (below.cSize[1] + 1) / 2;
+	ResizeLevel(level.cSize[0], level.cSize[1], level.cvMin, level.cvMax, level.cvMean, level.cvCount);
+
+	// Small levels are not worth splitting
+	const size_t grainSize = std::max<size_t>(1, 4096 / std::max<size_t>(level.cSize[0], 1));
+	ThreadPool::GetInstance().ParallelFor(0, level.cSize[1], [&](size_t yBegin, size_t yEnd) {
+		const size_t belowWidth = below.cSize[0];
+		const float* pBelowMin = below.cvMin.data();
+		const float* pBelowMax = below.cvMax.data();
+		const float* pBelowMean = below.cvMean.data();
+		const uint32_t* pBelowCount = below.cvCount.data();
+		for (size_t y = yBegin; y < yEnd; ++y) {
+			// The last row and column of the level below may not have a neighbour
+			const size_t nRows = std::min<size_t>(2, below.cSize[1] - 2 * y);
+			for (size_t x = 0; x < level.cSize[0]; ++x) {
+				const size_t nCols = std::min<size_t>(2, belowWidth - 2 * x);
+				float minZ = cEmptyMin, maxZ = cEmptyMax;
+				double sum = 0.0;
+				uint32_t count = 0;
+				for (size_t r = 0; r < nRows; ++r) {
+					const size_t i0 = (2 * y + r) * belowWidth + 2 * x;
+					for (size_t i = i0; i < i0 + nCols; ++i) {
+						minZ = std::min(minZ, pBelowMin[i]);
+						maxZ = std::max(maxZ, pBelowMax[i]);
+						sum += static_cast<double>(pBelowMean[i]) * pBelowCount[i];
+						count += pBelowCount[i];
+					}
+				}
+				const size_t i = y * level.cSize[0] + x;
+				level.cvMin[i] = minZ;
+				level.cvMax[i] = maxZ;
+				level.cvMean[i] = count ? static_cast<float>(sum / count) : 0.0f;
+				level.cvCount[i] = count;
+			}
+		}
+	}, grainSize);
+}
+
+void DepthPyramid::Write(std::vector<char>& vBuffer) const {
+	// Block size and number of levels, then the arrays of each level. The level sizes follow from the depth map size.
+	vBuffer.clear();
+	const uint32_t header[2] = { static_cast<uint32_t>(cBlockSize), static_cast<uint32_t>(cvLevels.size()) };
+	Append(vBuffer, header, 2);
+	for (const Level& level : cvLevels) {
+		Append(vBuffer, level.cvMin.data(), level.cvMin.size());
+		Append(vBuffer, level.cvMax.data(), level.cvMax.size());
+		Append(vBuffer, level.cvMean.data(), level.cvMean.size());
+		Append(vBuffer, level.cvCount.data(), level.cvCount.size());
+	}
+}
+
+bool DepthPyramid::Read(const char* pData, size_t size, size_t width, size_t height) {
+	cvLevels.clear();
+	uint32_t header[2];
+	if (!width || !height || !Take(pData, size, header, 2) || !header[0] || !header[1]) {
+		return false;
+	}
+	cBlockSize = header[0];
+	size_t levelWidth = (width + cBlockSize - 1) / cBlockSize, levelHeight = (height + cBlockSize - 1) / cBlockSize;
+	for (uint32_t i = 0; i < header[1]; ++i) {
+		if (i > 0) {
+			if (levelWidth == 1 && levelHeight == 1) {
+				cvLevels.clear();
+				return false; // More levels than Build makes
+			}
+			levelWidth = (levelWidth + 1) / 2;
+			levelHeight = (levelHeight + 1) / 2;
+		}
+		cvLevels.emplace_back();
+		Level& level = cvLevels.back();
+		level.cSize[0] = levelWidth;
+		level.cSize[1] = levelHeight;
+		const size_t n = levelWidth * levelHeight;
+		level.cvMin.resize(n);
+		level.cvMax.resize(n);
+		level.cvMean.resize(n);
+		level.cvCount.resize(n);
+		if (!Take(pData, size, level.cvMin.data(), n) || !Take(pData, size, level.cvMax.data(), n)
+			|| !Take(pData, size, level.cvMean.data(), n) || !Take(pData, size, level.cvCount.data(), n)) {
+			cvLevels.clear();
+			return false;
+		}
+	}
+	if (size || levelWidth != 1 || levelHeight != 1) {
+		cvLevels.clear();
+		return false;
+	}
+	return true;
+}
+
+size_t DepthPyramid::GetNumberOfLevels() const {
+	return cvLevels.size();
+}
+
+size_t DepthPyramid::GetCellSize(size_t level) const {
+	return cBlockSize << level;
+}
+
+void DepthPyramid::GetSize(size_t level, size_t& width, size_t& height) const {
+	if (level >= cvLevels.size()) {
+		width = height = 0;
+		return;
+	}
+	width = cvLevels[level].cSize[0];
+	height = cvLevels[level].cSize[1];
+}
+
+bool DepthPyramid::GetCell(size_t level, size_t x, size_t y, Range& range) const {
+	if (level >= cvLevels.size() || x >= cvLevels[level].cSize[0] || y >= cvLevels[level].cSize[1]) {
+		return false;
+	}
+	const Level& l = cvLevels[level];
+	const size_t i = y * l.cSize[0] + x;
+	range.cMin = l.cvMin[i];
+	range.cMax = l.cvMax[i];
+	range.cMean = l.cvMean[i];
+	range.cCount = l.cvCount[i];
+	return true;
+}
+
+bool DepthPyramid::GetMeanRow(size_t level, size_t y, float* pRow) const {
+	if (level >= cvLevels.size() || y >= cvLevels[level].cSize[1]) {
+		return false;
+	}
+	const Level& l = cvLevels[level];
+	const size_t i0 = y * l.cSize[0];
+	for (size_t x = 0; x < l.cSize[0]; ++x) {
+		pRow[x] = l.cvCount[i0 + x] > 0 ? l.cvMean[i0 + x] : std::numeric_limits<float>::quiet_NaN();
+	}
+	return true;
+}
+
+size_t DepthPyramid::GetLevel(size_t width, size_t height, size_t maxCells) const {
+	maxCells = std::max<size_t>(maxCells, 1);
+	const size_t extent = std::max(width, height);
+	size_t level = 0;
+	// A span of n pixels touches at most n/cellSize+1 cells
+	while (level + 1 < cvLevels.size() && extent / GetCellSize(level) + 1 > maxCells) {
+		++level;
+	}
+	return level;
+}
+
+bool DepthPyramid::GetRange(int x0, int y0, int x1, int y1, Range& range, size_t maxCells) const {
+	range.cMin = cEmptyMin;
+	range.cMax = cEmptyMax;
+	range.cMean = 0.0f;
+	range.cCount = 0;
+	if (cvLevels.empty() || x1 <= x0 || y1 <= y0) {
+		return false;
+	}
+	const size_t level = GetLevel(x1 - x0, y1 - y0, maxCells);
+	const Level& l = cvLevels[level];
+	const int cellSize = static_cast<int>(GetCellSize(level));
+	// Clamp to the cells of the level
+	const int cx0 = std::max(x0, 0) / cellSize, cy0 = std::max(y0, 0) / cellSize;
+	const int cx1 = std::min((x1 - 1) / cellSize, static_cast<int>(l.cSize[0]) - 1);
+	const int cy1 = std::min((y1 - 1) / cellSize, static_cast<int>(l.cSize[1]) - 1);
+	if (x1 <= 0 || y1 <= 0 || cx0 > cx1 || cy0 > cy1) {
+		return false;
+	}
+
+	double sum = 0.0;
+	for (int cy = cy0; cy <= cy1; ++cy) {
+		for (int cx = cx0; cx <= cx1; ++cx) {
+			const size_t i = cy * l.cSize[0] + cx;
+			range.cMin = std::min(range.cMin, l.cvMin[i]);
+			range.cMax = std::max(range.cMax, l.cvMax[i]);
+			sum += static_cast<double>(l.cvMean[i]) * l.cvCount[i];
+			range.cCount += l.cvCount[i];
+		}
+	}
+	if (!range.cCount) {
+		return false;
+	}
+	range.cMean = static_cast<float>(sum / range.cCount);
+	return true;
+}
+
+size_t DepthPyramid::GetMemoryUsage() const {
+	size_t nBytes = 0;
+	for (const Level& level : cvLevels) {
+		nBytes += level.cvMin.size() * (3 * sizeof(float) + sizeof(uint32_t));
+	}
+	return nBytes;
+}
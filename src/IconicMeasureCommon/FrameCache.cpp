@@ -0,0 +1,120 @@
+#include <IconicMeasureCommon/FrameCache.h>
+#include <wx/filename.h>
+
+using namespace iconic;
+
+FrameCache::FileTimes FrameCache::GetFileTimes(const wxString& depthMapFileName, const wxString& cameraFileName) {
+	FileTimes times;
+	times.cDepthMapTime = wxFileName(depthMapFileName).GetModificationTime();
+	times.cCameraTime = wxFileName(cameraFileName).GetModificationTime();
+	return times;
+}
+
+FrameCache::FrameCache(size_t memoryBudget) :
+	cMemoryBudget(memoryBudget),
+	cHits(0),
+	cMisses(0) {
+}
+
+bool FrameCache::Get(const wxString& depthMapFileName, const wxString& cameraFileName, Geometry& geometry) {
+	std::lock_guard<std::mutex> lock(cMutex);
+	std::map<wxString, Frame>::iterator it = cmFrames.find(depthMapFileName);
+	if (it == cmFrames.end()) {
+		++cMisses;
+		return false;
+	}
+	if (!IsUpToDate(it->second, depthMapFileName, cameraFileName)) {
+		Erase(it);
+		++cMisses;
+		return false;
+	}
+	// Move to front of least recently used list
+	cLru.splice(cLru.begin(), cLru, it->second.cLru);
+	geometry = it->second.cGeometry;
+	++cHits;
+	return true;
+}
+
+void FrameCache::Put(const wxString& depthMapFileName, const FileTimes& times, const Geometry& geometry) {
+	Frame frame;
+	frame.cGeometry = geometry;
+	frame.cTimes = times;
+
+	std::lock_guard<std::mutex> lock(cMutex);
+	std::map<wxString, Frame>::iterator it = cmFrames.find(depthMapFileName);
+	if (it != cmFrames.end()) {
+		Erase(it);
+	}
+	cLru.push_front(depthMapFileName);
+	frame.cLru = cLru.begin();
+	cmFrames[depthMapFileName] = frame;
+	Evict();
+}
+
+bool FrameCache::Contains(const wxString& depthMapFileName, const wxString& cameraFileName) const {
+	std::lock_guard<std::mutex> lock(cMutex);
+	std::map<wxString, Frame>::const_iterator it = cmFrames.find(depthMapFileName);
+	return it != cmFrames.end() && IsUpToDate(it->second, depthMapFileName, cameraFileName);
+}
+
+void FrameCache::Clear() {
+	std::lock_guard<std::mutex> lock(cMutex);
+	cmFrames.clear();
+	cLru.clear();
+	cHits = cMisses = 0;
+}
+
+void FrameCache::SetMemoryBudget(size_t memoryBudget) {
+	std::lock_guard<std::mutex> lock(cMutex);
+	cMemoryBudget = memoryBudget;
+	Evict();
+}
+
+size_t FrameCache::GetMemoryBudget() const {
+	std::lock_guard<std::mutex> lock(cMutex);
+	return cMemoryBudget;
+}
+
+size_t FrameCache::GetMemoryUsage() const {
+	std::lock_guard<std::mutex> lock(cMutex);
+	return SumMemoryUsage();
+}
+
+size_t FrameCache::GetNumberOfFrames() const {
+	std::lock_guard<std::mutex> lock(cMutex);
+	return cmFrames.size();
+}
+
+size_t FrameCache::GetHits() const {
+	std::lock_guard<std::mutex> lock(cMutex);
+	return cHits;
+}
+
+size_t FrameCache::GetMisses() const {
+	std::lock_guard<std::mutex> lock(cMutex);
+	return cMisses;
+}
+
+bool FrameCache::IsUpToDate(const Frame& frame, const wxString& depthMapFileName, const wxString& cameraFileName) const {
+	const FileTimes times = GetFileTimes(depthMapFileName, cameraFileName);
+	return times.cDepthMapTime == frame.cTimes.cDepthMapTime && times.cCameraTime == frame.cTimes.cCameraTime;
+}
+
+void FrameCache::Erase(std::map<wxString, Frame>::iterator it) {
+	cLru.erase(it->second.cLru);
+	cmFrames.erase(it);
+}
+
+void FrameCache::Evict() {
+	while (cmFrames.size() > 1 && SumMemoryUsage() > cMemoryBudget) {
+		Erase(cmFrames.find(cLru.back()));
+	}
+}
+
+size_t FrameCache::SumMemoryUsage() const {
+	size_t nBytes = 0;
+	for (const std::pair<const wxString, Frame>& frame : cmFrames) {
+		nBytes += frame.second.cGeometry.GetMemoryUsage();
+	}
+	return nBytes;
+}
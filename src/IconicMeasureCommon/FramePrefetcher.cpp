@@ -0,0 +1,82 @@
+#include <IconicMeasureCommon/FramePrefetcher.h>
+#include <wx/log.h>
+#include <algorithm>
+
+using namespace iconic;
+
+FramePrefetcher::FramePrefetcher(FrameCache& cache, Loader loader, size_t nThreads) :
+	cCache(cache),
+	cLoader(loader),
+	cbStop(false) {
+	for (size_t i = 0; i < std::max<size_t>(nThreads, 1); ++i) {
+		cvThreads.emplace_back(&FramePrefetcher::Run, this);
+	}
+}
+
+FramePrefetcher::~FramePrefetcher() {
+	{
+		std::lock_guard<std::mutex> lock(cMutex);
+		cbStop = true;
+		cQueue.clear();
+	}
+	cWork.notify_all();
+	for (std::thread& thread : cvThreads) {
+		thread.join();
+	}
+}
+
+void FramePrefetcher::Prefetch(const std::vector<Request>& vRequests) {
+	{
+		std::lock_guard<std::mutex> lock(cMutex);
+		cQueue.assign(vRequests.begin(), vRequests.end());
+	}
+	cWork.notify_all();
+}
+
+void FramePrefetcher::Wait(const wxString& depthMapFileName) {
+	std::unique_lock<std::mutex> lock(cMutex);
+	cQueue.erase(std::remove_if(cQueue.begin(), cQueue.end(), [&](const Request& request) { return request.cDepthMapFileName == depthMapFileName; }), cQueue.end());
+	cDone.wait(lock, [&]() { return csInFlight.find(depthMapFileName) == csInFlight.end(); });
+}
+
+void FramePrefetcher::Cancel() {
+	std::unique_lock<std::mutex> lock(cMutex);
+	cQueue.clear();
+	cDone.wait(lock, [this]() { return csInFlight.empty(); });
+}
+
+void FramePrefetcher::Run() {
+	// Logging is per thread, so this only silences errors of frames that may never be shown
+	wxLogNull noLog;
+	for (;;) {
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(cMutex);
+			cWork.wait(lock, [this]() { return cbStop || !cQueue.empty(); });
+			if (cbStop) {
+				return;
+			}
+			request = cQueue.front();
+			cQueue.pop_front();
+			if (!csInFlight.insert(request.cDepthMapFileName).second) {
+				continue; // Already being read by another worker
+			}
+		}
+
+		if (!cCache.Contains(request.cDepthMapFileName, request.cCameraFileName)) {
+			Geometry geometry;
+			geometry.cImageSize[0] = request.cImageSize[0];
+			geometry.cImageSize[1] = request.cImageSize[1];
+			const FrameCache::FileTimes times = FrameCache::GetFileTimes(request.cDepthMapFileName, request.cCameraFileName);
+			if (cLoader(request, geometry)) {
+				cCache.Put(request.cDepthMapFileName, times, geometry);
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(cMutex);
+			csInFlight.erase(request.cDepthMapFileName);
+		}
+		cDone.notify_all();
+	}
+}
@@ -1,14 +1,198 @@
 #include <IconicMeasureCommon/Geometry.h>
+#include <IconicMeasureCommon/ThreadPool.h>
 #include <wx/log.h>
 #include <wx/intl.h>
 #include <Eigen/Core>
+#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 using namespace iconic;
 
+namespace {
+	const size_t cBatchSize = 256; //!< Points per block in the batch ImageToObject, keeps the temporaries in L1
 
-Geometry::Geometry() : cCameraType(Camera::ECameraType::FULL) {
+	/**
+	 * @brief Transform image points to pixels and get the index of the pixel in the depth map
+	 * @param T Image/camera to pixel transformation
+	 * @param x Image x coordinates
+	 * @param y Image y coordinates
+	 * @param n Number of points
+	 * @param width Depth map width
+	 * @param height Depth map height
+	 * @param index Output pixel index \c y*width+x, or -1 if outside the depth map
+	*/
+	void GetPixelIndexes(const Eigen::Matrix3d& T, const double* x, const double* y, size_t n, int width, int height, int* index) {
+		size_t i = 0;
+#if defined(__AVX2__)
+		const __m256d t00 = _mm256_set1_pd(T(0, 0)), t01 = _mm256_set1_pd(T(0, 1)), t02 = _mm256_set1_pd(T(0, 2));
+		const __m256d t10 = _mm256_set1_pd(T(1, 0)), t11 = _mm256_set1_pd(T(1, 1)), t12 = _mm256_set1_pd(T(1, 2));
+		const __m256d t20 = _mm256_set1_pd(T(2, 0)), t21 = _mm256_set1_pd(T(2, 1)), t22 = _mm256_set1_pd(T(2, 2));
+		const __m256d half = _mm256_set1_pd(0.5), minusOne = _mm256_set1_pd(-1.0);
+		const __m256d w = _mm256_set1_pd(width), h = _mm256_set1_pd(height);
+		for (; i + 4 <= n; i += 4) {
+			const __m256d xi = _mm256_loadu_pd(x + i);
+			const __m256d yi = _mm256_loadu_pd(y + i);
+			const __m256d s = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(t20, xi), _mm256_mul_pd(t21, yi)), t22);
+			const __m256d u = _mm256_add_pd(_mm256_div_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(t00, xi), _mm256_mul_pd(t01, yi)), t02), s), half);
+			const __m256d v = _mm256_add_pd(_mm256_div_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(t10, xi), _mm256_mul_pd(t11, yi)), t12), s), half);
+			// Ordered compares are false for NaN
+			const __m256d inside = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(u, minusOne, _CMP_GT_OQ), _mm256_cmp_pd(u, w, _CMP_LT_OQ)),
+				_mm256_and_pd(_mm256_cmp_pd(v, minusOne, _CMP_GT_OQ), _mm256_cmp_pd(v, h, _CMP_LT_OQ)));
+			const __m256d px = _mm256_round_pd(u, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+			const __m256d py = _mm256_round_pd(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+			const __m256d linear = _mm256_blendv_pd(minusOne, _mm256_add_pd(_mm256_mul_pd(py, w), px), inside);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(index + i), _mm256_cvttpd_epi32(linear));
+		}
+#endif
+		for (; i < n; ++i) {
+			const double s = T(2, 0) * x[i] + T(2, 1) * y[i] + T(2, 2);
+			// Round to integers the same way as the single point ImageToObject, i.e. truncate after adding 0.5
+			const double u = (T(0, 0) * x[i] + T(0, 1) * y[i] + T(0, 2)) / s + 0.5;
+			const double v = (T(1, 0) * x[i] + T(1, 1) * y[i] + T(1, 2)) / s + 0.5;
+			if (u > -1.0 && u < width && v > -1.0 && v < height) {
+				index[i] = static_cast<int>(v) * width + static_cast<int>(u);
+			} else {
+				index[i] = -1;
+			}
+		}
+	}
+
+	/**
+	 * @brief Gather Z values from a contiguous depth map
+	 * @param pData Depth map values
+	 * @param index Pixel indexes, -1 if outside the depth map
+	 * @param n Number of points
+	 * @param Z Output Z values, FLT_MAX (invalid) where outside
+	*/
+	void GatherZ(const float* pData, const int* index, size_t n, float* Z) {
+		size_t i = 0;
+#if defined(__AVX2__)
+		const __m256 invalid = _mm256_set1_ps(std::numeric_limits<float>::max());
+		const __m256i minusOne = _mm256_set1_epi32(-1);
+		for (; i + 8 <= n; i += 8) {
+			const __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index + i));
+			const __m256 inside = _mm256_castsi256_ps(_mm256_cmpgt_epi32(idx, minusOne));
+			_mm256_storeu_ps(Z + i, _mm256_mask_i32gather_ps(invalid, pData, idx, inside, sizeof(float)));
+		}
+#endif
+		for (; i < n; ++i) {
+			Z[i] = index[i] < 0 ? std::numeric_limits<float>::max() : pData[index[i]];
+		}
+	}
+
+	/**
+	 * @brief Image to object kernel specialized for the projection of the camera matrix.
+	 *
+	 * Computes all points without branching, which lets the compiler inline and vectorize the loop. Points that have not got status OK give garbage.
+	 * Object X and Y of image point (x,y) at height Z solve \c s*(x,y,1) = P*(X,Y,Z,1), i.e. after eliminating s
+	 * \c (P00-x*P20)*X + (P01-x*P21)*Y = x*(P22*Z+P23) - P02*Z - P03 and similar for y.
+	 * @param P Camera matrix
+	 * @param x Image x coordinates
+	 * @param y Image y coordinates
+	 * @param z Z from the depth map
+	 * @param n Number of points
+	 * @param X Output object X coordinates
+	 * @param Y Output object Y coordinates
+	 * @param Z Output object Z coordinates
+	*/
+	template <Geometry::EProjection projection>
+	void ImageToObjectKernel(const Geometry::CameraMatrix& P, const double* x, const double* y, const float* z, size_t n, double* X, double* Y, double* Z);
+
+	template <>
+	void ImageToObjectKernel<Geometry::EProjection::PROJECTIVE>(const Geometry::CameraMatrix& P, const double* x, const double* y, const float* z, size_t n, double* X, double* Y, double* Z) {
+		// Copies, since the output could alias the matrix as far as the compiler knows
+		const double p00 = P(0, 0), p01 = P(0, 1), p02 = P(0, 2), p03 = P(0, 3);
+		const double p10 = P(1, 0), p11 = P(1, 1), p12 = P(1, 2), p13 = P(1, 3);
+		const double p20 = P(2, 0), p21 = P(2, 1), p22 = P(2, 2), p23 = P(2, 3);
+		for (size_t i = 0; i < n; ++i) {
+			const double zi = z[i];
+			const double a = p00 - x[i] * p20, b = p01 - x[i] * p21;
+			const double c = p10 - y[i] * p20, d = p11 - y[i] * p21;
+			const double s = p22 * zi + p23;
+			const double e = x[i] * s - p02 * zi - p03;
+			const double f = y[i] * s - p12 * zi - p13;
+			const double invDet = 1.0 / (a * d - b * c);
+			X[i] = (e * d - b * f) * invDet;
+			Y[i] = (a * f - e * c) * invDet;
+			Z[i] = zi;
+		}
+	}
+
+	template <>
+	void ImageToObjectKernel<Geometry::EProjection::NADIR>(const Geometry::CameraMatrix& P, const double* x, const double* y, const float* z, size_t n, double* X, double* Y, double* Z) {
+		// P20 and P21 are zero, so the 2x2 system is the same for all points
+		const double invDet = 1.0 / (P(0, 0) * P(1, 1) - P(0, 1) * P(1, 0));
+		const double i00 = P(1, 1) * invDet, i01 = -P(0, 1) * invDet;
+		const double i10 = -P(1, 0) * invDet, i11 = P(0, 0) * invDet;
+		const double p02 = P(0, 2), p03 = P(0, 3), p12 = P(1, 2), p13 = P(1, 3), p22 = P(2, 2), p23 = P(2, 3);
+		for (size_t i = 0; i < n; ++i) {
+			const double zi = z[i];
+			const double s = p22 * zi + p23;
+			const double e = x[i] * s - p02 * zi - p03;
+			const double f = y[i] * s - p12 * zi - p13;
+			X[i] = i00 * e + i01 * f;
+			Y[i] = i10 * e + i11 * f;
+			Z[i] = zi;
+		}
+	}
+
+	/**
+	 * @brief Transform image points with valid Z to object coordinates. The kernel is selected once for all points.
+	 * @param geometry Camera and camera matrix
+	 * @param x Image x coordinates
+	 * @param y Image y coordinates
+	 * @param z Z from the depth map
+	 * @param n Number of points
+	 * @param X Output object X coordinates
+	 * @param Y Output object Y coordinates
+	 * @param Z Output object Z coordinates
+	 * @param status Status of each point. Points with status OK get status CAMERA_FAILED if they could not be transformed.
+	*/
+	void ImageToObjectPoints(const Geometry& geometry, const double* x, const double* y, const float* z, size_t n, double* X, double* Y, double* Z, Geometry::EPointStatus* status) {
+		switch (geometry.cProjection) {
+		case Geometry::EProjection::PROJECTIVE:
+			ImageToObjectKernel<Geometry::EProjection::PROJECTIVE>(geometry.cCameraMatrix, x, y, z, n, X, Y, Z);
+			break;
+		case Geometry::EProjection::NADIR:
+			ImageToObjectKernel<Geometry::EProjection::NADIR>(geometry.cCameraMatrix, x, y, z, n, X, Y, Z);
+			break;
+		default:
+			{
+				Eigen::Vector4d objectPt;
+				for (size_t i = 0; i < n; ++i) {
+					if (status[i] != Geometry::EPointStatus::OK) {
+						continue;
+					}
+					if (!geometry.cpCamera->Image2Object(Eigen::Vector2d(x[i], y[i]), z[i], objectPt, geometry.cCameraType)) {
+						status[i] = Geometry::EPointStatus::CAMERA_FAILED;
+						continue;
+					}
+					X[i] = objectPt[0];
+					Y[i] = objectPt[1];
+					Z[i] = objectPt[2];
+				}
+			}
+			return;
+		}
+		// Image rays parallel to the XY plane give no intersection
+		for (size_t i = 0; i < n; ++i) {
+			if (status[i] == Geometry::EPointStatus::OK && !(std::isfinite(X[i]) && std::isfinite(Y[i]))) {
+				status[i] = Geometry::EPointStatus::CAMERA_FAILED;
+			}
+		}
+	}
+}
+
+
+Geometry::Geometry() : cCameraType(Camera::ECameraType::FULL), cProjection(EProjection::NONE) {
 	cImageSize[0] = cImageSize[1] = 0;
 	cCameraToPixelTransform.setIdentity();
+	cCameraMatrix.setZero();
 }
 
 Geometry::PolygonPtr Geometry::CreatePolygon(size_t n) {
@@ -100,15 +284,80 @@ bool Geometry::ImageToObject(Geometry::PolygonPtr pImage, Geometry::Polygon3DPtr
 }
 
 bool Geometry::ImageToObject(const std::vector<Geometry::Point>& vIn, std::vector<Geometry::Point3D>& vOut) {
-	for (int i = 0; i < vIn.size(); ++i) {
-		if (!ImageToObject(vIn[i], vOut[i])) {
-			wxLogError("Could not transform image point to object");
-			return false;
-		}
+	const size_t n = vIn.size();
+	std::vector<double> vCoordinates(5 * n); // x, y, X, Y and Z after each other
+	std::vector<EPointStatus> vStatus(n);
+	double* x = vCoordinates.data();
+	double* y = x + n;
+	double* X = y + n;
+	double* Y = X + n;
+	double* Z = Y + n;
+	for (size_t i = 0; i < n; ++i) {
+		x[i] = vIn[i].get<0>();
+		y[i] = vIn[i].get<1>();
+	}
+	if (ImageToObject(x, y, n, X, Y, Z, vStatus.data()) != n) {
+		wxLogError("Could not transform image point to object");
+		return false;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		vOut[i].set<0>(X[i]);
+		vOut[i].set<1>(Y[i]);
+		vOut[i].set<2>(Z[i]);
 	}
 	return true;
 }
 
+size_t Geometry::ImageToObject(const double* x, const double* y, size_t n, double* X, double* Y, double* Z, EPointStatus* status) const {
+	if (!cpDepthMap || !cpCamera) {
+		std::fill(status, status + n, cpDepthMap ? EPointStatus::CAMERA_FAILED : EPointStatus::OUTSIDE);
+		wxLogError(_("No depth map or camera"));
+		return 0;
+	}
+	const int width = static_cast<int>(cpDepthMap->GetWidth());
+	const int height = static_cast<int>(cpDepthMap->GetHeight());
+	const float* pData = cpDepthMap->GetData();
+
+	int index[cBatchSize];
+	float pixelZ[cBatchSize];
+	size_t counts[4] = { 0, 0, 0, 0 }; // Number of points by status
+	for (size_t begin = 0; begin < n; begin += cBatchSize) {
+		const size_t m = std::min(cBatchSize, n - begin);
+		GetPixelIndexes(cCameraToPixelTransform, x + begin, y + begin, m, width, height, index);
+		if (pData) {
+			GatherZ(pData, index, m, pixelZ);
+		} else {
+			// Tiled and compact depth maps are not contiguous
+			for (size_t i = 0; i < m; ++i) {
+				if (index[i] < 0 || !cpDepthMap->GetZ(index[i] % width, index[i] / width, pixelZ[i])) {
+					pixelZ[i] = std::numeric_limits<float>::max();
+				}
+			}
+		}
+
+		for (size_t i = 0; i < m; ++i) {
+			if (index[i] < 0) {
+				status[begin + i] = EPointStatus::OUTSIDE;
+			} else if (!DepthMap::IsValid(pixelZ[i])) {
+				status[begin + i] = EPointStatus::INVALID_Z;
+			} else {
+				status[begin + i] = EPointStatus::OK;
+			}
+		}
+		ImageToObjectPoints(*this, x + begin, y + begin, pixelZ, m, X + begin, Y + begin, Z + begin, status + begin);
+		for (size_t i = 0; i < m; ++i) {
+			++counts[static_cast<int>(status[begin + i])];
+		}
+	}
+
+	const size_t nFailed = n - counts[static_cast<int>(EPointStatus::OK)];
+	if (nFailed) {
+		wxLogVerbose(_("Could not transform %zu of %zu image points to object (%zu outside depth map, %zu invalid height, %zu camera failures)"), nFailed, n,
+			counts[static_cast<int>(EPointStatus::OUTSIDE)], counts[static_cast<int>(EPointStatus::INVALID_Z)], counts[static_cast<int>(EPointStatus::CAMERA_FAILED)]);
+	}
+	return n - nFailed;
+}
+
 void Geometry::ImageToPixel(const Eigen::Vector2d& imagePt, Geometry::Point& pixelPt) const {
 	Eigen::Vector3d pixelPoint(imagePt[0], imagePt[1], 1.0); // image point in homogeneous coordinates
 	pixelPoint = cCameraToPixelTransform * pixelPoint;		 // Transform from camera to pixel system
@@ -122,12 +371,12 @@ void Geometry::ImageToPixel(const Geometry::Point& imagePt, Geometry::Point& pix
 }
 
 bool Geometry::GetZ(const int x, const int y, double& Z) const {
-	const size_t index = y * cImageSize[0] + x; // = index in 1D depth map vector for 2D coordinate (x,y)
-	if (cDepthMap.size() <= index) {
+	float z = 0.0f;
+	if (!cpDepthMap || !cpDepthMap->GetZ(x, y, z)) {
 		wxLogError(_("Image point (%d,%d) is out of range of depth map"), x, y);
 		return false;
 	}
-	Z = cDepthMap[index];
+	Z = z;
 	return true;
 }
 
@@ -141,12 +390,16 @@ bool Geometry::ImageToObject(const Geometry::Point& pImage, Geometry::Point3D& p
 		wxLogError(_("Could not get height from depth map at (%d,%d)"), pixelCoord[0], pixelCoord[1]);
 		return false;
 	}
-	if (Z > 1000.0) {
+	if (Z > DepthMap::cMaxValidZ) {
 		wxLogError(_("Invalid height at (%d,%d)"), pixelCoord[0], pixelCoord[1]);
 		return false;
 	}
-	Eigen::Vector4d X;
-	if (!cpCamera->Image2Object(cameraPt, Z, X, cCameraType)) {
+	// Same kernels as the batch ImageToObject, so that single points agree with the batch
+	const float z = static_cast<float>(Z);
+	double X[3];
+	EPointStatus status = EPointStatus::OK;
+	ImageToObjectPoints(*this, &cameraPt[0], &cameraPt[1], &z, 1, &X[0], &X[1], &X[2], &status);
+	if (status != EPointStatus::OK) {
 		wxLogError(_("Could not compute image-to-object coordinates"));
 		return false;
 	}
@@ -156,6 +409,278 @@ bool Geometry::ImageToObject(const Geometry::Point& pImage, Geometry::Point3D& p
 	return true;
 }
 
+Geometry::EProjection Geometry::SetCameraMatrix(const double* pMatrix) {
+	cProjection = EProjection::NONE;
+	if (!pMatrix) {
+		cCameraMatrix.setZero();
+		return cProjection;
+	}
+	for (int r = 0; r < 3; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			cCameraMatrix(r, c) = pMatrix[4 * r + c];
+		}
+	}
+	if (!cCameraMatrix.allFinite()) {
+		return cProjection;
+	}
+	if (cCameraMatrix(2, 0) == 0.0 && cCameraMatrix(2, 1) == 0.0) {
+		// Image plane parallel to XY plane. Degenerate if X and Y do not both map to the image.
+		if (cCameraMatrix(0, 0) * cCameraMatrix(1, 1) - cCameraMatrix(0, 1) * cCameraMatrix(1, 0) != 0.0) {
+			cProjection = EProjection::NADIR;
+		}
+	} else {
+		cProjection = EProjection::PROJECTIVE;
+	}
+	return cProjection;
+}
+
+size_t Geometry::ImageToObject(const double* x, const double* y, const float* z, size_t n, double* X, double* Y, double* Z, EPointStatus* status) const {
+	if (!cpCamera && cProjection == EProjection::NONE) {
+		std::fill(status, status + n, EPointStatus::CAMERA_FAILED);
+		return 0;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		status[i] = DepthMap::IsValid(z[i]) ? EPointStatus::OK : EPointStatus::INVALID_Z;
+	}
+	ImageToObjectPoints(*this, x, y, z, n, X, Y, Z, status);
+	return static_cast<size_t>(std::count(status, status + n, EPointStatus::OK));
+}
+
+size_t Geometry::GetMemoryUsage() const {
+	return (cpDepthMap ? cpDepthMap->GetMemoryUsage() : 0) + (cpDepthPyramid ? cpDepthPyramid->GetMemoryUsage() : 0) +
+		(cpDepthIntegral ? cpDepthIntegral->GetMemoryUsage() : 0);
+}
+
+bool Geometry::BuildDepthPyramid() {
+	if (!cpDepthMap) {
+		cpDepthPyramid.reset();
+		return false;
+	}
+	DepthPyramidPtr pDepthPyramid = boost::make_shared<DepthPyramid>();
+	if (!pDepthPyramid->Build(*cpDepthMap)) {
+		cpDepthPyramid.reset();
+		return false;
+	}
+	cpDepthPyramid = pDepthPyramid;
+	return true;
+}
+
+bool Geometry::BuildDepthIntegral() {
+	if (!cpDepthMap) {
+		cpDepthIntegral.reset();
+		return false;
+	}
+	// Summing relative to the mean keeps the variance accurate
+	double offset = 0.0;
+	DepthPyramid::Range range;
+	if (cpDepthPyramid && cpDepthPyramid->GetCell(cpDepthPyramid->GetNumberOfLevels() - 1, 0, 0, range) && range.cCount) {
+		offset = range.cMean;
+	}
+	DepthIntegralPtr pDepthIntegral = boost::make_shared<DepthIntegral>();
+	if (!pDepthIntegral->Build(*cpDepthMap, offset)) {
+		cpDepthIntegral.reset();
+		return false;
+	}
+	cpDepthIntegral = pDepthIntegral;
+	return true;
+}
+
+void Geometry::ImageToPixel(const Geometry::Polygon& imagePolygon, Geometry::Polygon& pixelPolygon) const {
+	pixelPolygon.clear();
+	Geometry::Point pixelPt;
+	for (const Geometry::Point& pt : imagePolygon.outer()) {
+		ImageToPixel(pt, pixelPt);
+		pixelPolygon.outer().push_back(pixelPt);
+	}
+	pixelPolygon.inners().resize(imagePolygon.inners().size());
+	for (size_t i = 0; i < imagePolygon.inners().size(); ++i) {
+		for (const Geometry::Point& pt : imagePolygon.inners()[i]) {
+			ImageToPixel(pt, pixelPt);
+			pixelPolygon.inners()[i].push_back(pixelPt);
+		}
+	}
+	// Orientation changes if the transformation flips an axis
+	boost::geometry::correct(pixelPolygon);
+}
+
+void Geometry::ImageToPixel(const Geometry::Box& imageBox, int& x0, int& y0, int& x1, int& y1) const {
+	// The transformation may flip axes, so transform all corners
+	Geometry::Box pixelBox;
+	boost::geometry::assign_inverse(pixelBox);
+	const double xs[] = { imageBox.min_corner().get<0>(), imageBox.max_corner().get<0>() };
+	const double ys[] = { imageBox.min_corner().get<1>(), imageBox.max_corner().get<1>() };
+	for (double x : xs) {
+		for (double y : ys) {
+			Geometry::Point pixelPt;
+			ImageToPixel(Eigen::Vector2d(x, y), pixelPt);
+			boost::geometry::expand(pixelBox, pixelPt);
+		}
+	}
+	// Pixel (x,y) covers [x-0.5,x+0.5)
+	x0 = static_cast<int>(std::floor(pixelBox.min_corner().get<0>() + 0.5));
+	y0 = static_cast<int>(std::floor(pixelBox.min_corner().get<1>() + 0.5));
+	x1 = static_cast<int>(std::floor(pixelBox.max_corner().get<0>() + 0.5)) + 1;
+	y1 = static_cast<int>(std::floor(pixelBox.max_corner().get<1>() + 0.5)) + 1;
+}
+
+bool Geometry::GetDepthRange(const Geometry::Box& imageBox, DepthPyramid::Range& range, size_t maxCells) const {
+	if (!cpDepthPyramid) {
+		return false;
+	}
+	int x0, y0, x1, y1;
+	ImageToPixel(imageBox, x0, y0, x1, y1);
+	return cpDepthPyramid->GetRange(x0, y0, x1, y1, range, maxCells);
+}
+
+bool Geometry::GetDepthStatistics(const Geometry::Box& imageBox, DepthIntegral::Statistics& statistics) const {
+	if (!cpDepthIntegral) {
+		return false;
+	}
+	int x0, y0, x1, y1;
+	ImageToPixel(imageBox, x0, y0, x1, y1);
+	return cpDepthIntegral->GetStatistics(x0, y0, x1, y1, statistics);
+}
+
+bool Geometry::GetHeightRange(const Geometry::Polygon& imagePolygon, DepthPyramid::Range& range, size_t maxCells) const {
+	range.cMin = std::numeric_limits<float>::max();
+	range.cMax = -std::numeric_limits<float>::max();
+	range.cMean = 0.0f;
+	range.cCount = 0;
+	if (!cpDepthPyramid || imagePolygon.outer().size() < 3) {
+		return false;
+	}
+	Geometry::Polygon pixelPolygon;
+	ImageToPixel(imagePolygon, pixelPolygon);
+	Geometry::Box pixelBox;
+	boost::geometry::envelope(pixelPolygon, pixelBox);
+
+	const size_t level = cpDepthPyramid->GetLevel(static_cast<size_t>(pixelBox.max_corner().get<0>() - pixelBox.min_corner().get<0>()) + 1,
+		static_cast<size_t>(pixelBox.max_corner().get<1>() - pixelBox.min_corner().get<1>()) + 1, maxCells);
+	size_t width = 0, height = 0;
+	cpDepthPyramid->GetSize(level, width, height);
+	const double cellSize = static_cast<double>(cpDepthPyramid->GetCellSize(level));
+	const int cx0 = std::max(0, static_cast<int>(std::floor((pixelBox.min_corner().get<0>() + 0.5) / cellSize)));
+	const int cy0 = std::max(0, static_cast<int>(std::floor((pixelBox.min_corner().get<1>() + 0.5) / cellSize)));
+	const int cx1 = std::min(static_cast<int>(width) - 1, static_cast<int>(std::floor((pixelBox.max_corner().get<0>() + 0.5) / cellSize)));
+	const int cy1 = std::min(static_cast<int>(height) - 1, static_cast<int>(std::floor((pixelBox.max_corner().get<1>() + 0.5) / cellSize)));
+
+	double sum = 0.0;
+	DepthPyramid::Range cell;
+	for (int cy = cy0; cy <= cy1; ++cy) {
+		for (int cx = cx0; cx <= cx1; ++cx) {
+			if (!cpDepthPyramid->GetCell(level, cx, cy, cell) || !cell.cCount) {
+				continue;
+			}
+			// Cell covers pixels [cx*cellSize,(cx+1)*cellSize), i.e. from the left edge of the first pixel to the right edge of the last
+			const Geometry::Box cellBox(Geometry::Point(cx * cellSize - 0.5, cy * cellSize - 0.5), Geometry::Point((cx + 1) * cellSize - 0.5, (cy + 1) * cellSize - 0.5));
+			if (!boost::geometry::intersects(cellBox, pixelPolygon)) {
+				continue;
+			}
+			range.cMin = std::min(range.cMin, cell.cMin);
+			range.cMax = std::max(range.cMax, cell.cMax);
+			sum += static_cast<double>(cell.cMean) * cell.cCount;
+			range.cCount += cell.cCount;
+		}
+	}
+	if (!range.cCount) {
+		return false;
+	}
+	range.cMean = static_cast<float>(sum / range.cCount);
+	return true;
+}
+
+bool Geometry::GetHeightProfile(const Geometry::VectorTrain& imageLine, Geometry::HeightProfile& profile) const {
+	profile.Resize(0);
+	profile.cvSegments.clear();
+	if (!cpDepthMap || (!cpCamera && cProjection == EProjection::NONE) || imageLine.size() < 2) {
+		return false;
+	}
+	const DepthMap& depthMap = *cpDepthMap;
+	const int width = static_cast<int>(depthMap.GetWidth()), height = static_cast<int>(depthMap.GetHeight());
+	const float* pData = depthMap.GetData();
+	auto getZ = [&](const Geometry::Point& pixelPt) {
+		// Pixel (x,y) covers [x-0.5,x+0.5)
+		const double px = std::floor(pixelPt.get<0>() + 0.5), py = std::floor(pixelPt.get<1>() + 0.5);
+		float z = std::numeric_limits<float>::quiet_NaN();
+		if (px >= 0.0 && py >= 0.0 && px < width && py < height) {
+			if (pData) {
+				z = pData[static_cast<size_t>(py) * width + static_cast<size_t>(px)];
+			} else if (!depthMap.GetZ(static_cast<int>(px), static_cast<int>(py), z)) {
+				z = std::numeric_limits<float>::quiet_NaN();
+			}
+		}
+		return DepthMap::IsValid(z) ? z : std::numeric_limits<float>::quiet_NaN();
+	};
+
+	// One sample per pixel step along the major axis of each segment. Segments after the first start one step in, their first point is the last of the previous segment.
+	const size_t nSegments = imageLine.size() - 1;
+	std::vector<Geometry::Point> vPixels(imageLine.size());
+	std::vector<float> vVertexZ(imageLine.size());
+	for (size_t i = 0; i < imageLine.size(); ++i) {
+		ImageToPixel(imageLine[i], vPixels[i]);
+		vVertexZ[i] = getZ(vPixels[i]);
+	}
+	std::vector<size_t> vSteps(nSegments);
+	profile.cvSegments.resize(nSegments + 1);
+	size_t n = 0;
+	for (size_t s = 0; s < nSegments; ++s) {
+		const double extent = std::max(std::abs(vPixels[s + 1].get<0>() - vPixels[s].get<0>()), std::abs(vPixels[s + 1].get<1>() - vPixels[s].get<1>()));
+		vSteps[s] = std::isfinite(extent) ? std::max<size_t>(1, static_cast<size_t>(std::ceil(extent))) : 1;
+		profile.cvSegments[s] = n;
+		n += vSteps[s] + (s == 0 ? 1 : 0);
+	}
+	profile.cvSegments[nSegments] = n;
+	profile.Resize(n);
+	float* pHeights = profile.GetHeights();
+	uint8_t* pValid = profile.GetValid();
+
+	const Eigen::Matrix3d pixelToCamera = cCameraToPixelTransform.inverse();
+	std::vector<double> vX(n), vY(n);
+	ThreadPool::GetInstance().ParallelFor(0, n, [&](size_t begin, size_t end) {
+		const size_t m = end - begin;
+		std::vector<double> x(m), y(m), Z(m);
+		std::vector<float> z(m);
+		std::vector<EPointStatus> status(m);
+		size_t s = std::upper_bound(profile.cvSegments.begin(), profile.cvSegments.end(), begin) - profile.cvSegments.begin() - 1;
+		for (size_t i = begin; i < end; ++i) {
+			while (i >= profile.cvSegments[s + 1]) {
+				++s;
+			}
+			const double t = static_cast<double>(i - profile.cvSegments[s] + (s == 0 ? 0 : 1)) / vSteps[s];
+			const Geometry::Point& p0 = vPixels[s];
+			const Geometry::Point& p1 = vPixels[s + 1];
+			const Eigen::Vector3d pixelPt(p0.get<0>() + t * (p1.get<0>() - p0.get<0>()), p0.get<1>() + t * (p1.get<1>() - p0.get<1>()), 1.0);
+			const float height = getZ(Geometry::Point(pixelPt[0], pixelPt[1]));
+			const bool bValid = DepthMap::IsValid(height);
+			pHeights[i] = height;
+			pValid[i] = bValid ? 1 : 0;
+
+			// Invalid samples are placed between the vertices, or at the valid vertex
+			const float z0 = DepthMap::IsValid(vVertexZ[s]) ? vVertexZ[s] : vVertexZ[s + 1];
+			const float z1 = DepthMap::IsValid(vVertexZ[s + 1]) ? vVertexZ[s + 1] : z0;
+			z[i - begin] = bValid ? height : DepthMap::IsValid(z0) ? static_cast<float>(z0 + t * (z1 - z0)) : 0.0f;
+			const Eigen::Vector3d imagePt = pixelToCamera * pixelPt;
+			x[i - begin] = imagePt[0] / imagePt[2];
+			y[i - begin] = imagePt[1] / imagePt[2];
+		}
+		ImageToObject(x.data(), y.data(), z.data(), m, vX.data() + begin, vY.data() + begin, Z.data(), status.data());
+		for (size_t i = 0; i < m; ++i) {
+			if (status[i] != EPointStatus::OK) {
+				vX[begin + i] = vY[begin + i] = std::numeric_limits<double>::quiet_NaN();
+			}
+		}
+	}, 4096);
+
+	// Failed points add no distance
+	double* pDistances = profile.GetDistances();
+	pDistances[0] = 0.0;
+	for (size_t i = 1; i < n; ++i) {
+		const double d = std::hypot(vX[i] - vX[i - 1], vY[i] - vY[i - 1]);
+		pDistances[i] = pDistances[i - 1] + (std::isfinite(d) ? d : 0.0);
+	}
+	return true;
+}
+
 wxColour Geometry::GetColour(Colours c) const {
 	//RED, GREEN, CYAN, MAGENTA, YELLOW, CERISE
 	wxColour const cols[] = { wxColor(255, 10, 10, 150), wxColor(10, 255, 10, 150), wxColor(10, 255, 255, 150), wxColor(255, 10, 255, 150), wxColor(255, 255, 10, 150), wxColor(238, 42, 123, 155) };
@@ -1,29 +1,42 @@
 #include <IconicMeasureCommon/MeasureHandler.h>
+#include <IconicMeasureCommon/TiledDepthMap.h>
+#include <IconicMeasureCommon/CompactDepthMap.h>
+#include <IconicMeasureCommon/ThreadPool.h>
 #include <IconicSensor/Camera.h>
 #include <wx/filename.h>
+#include <wx/dir.h>
 #include <wx/log.h>
 #include <wx/ffile.h>
 #include <wx/wx.h>
+#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <iterator>
 
 
 using namespace iconic;
 
-MeasureHandler::MeasureHandler() : cbIsParsed(false) {
+namespace {
+	const double cSelectDistance = 0.005; //!< Largest distance from a point or line at which Shape::Select hits it
+}
+
+MeasureHandler::MeasureHandler() : cbIsParsed(false), cbFolderMissed(false), cFrameIndex(-1), cPrefetchCount(3), cDepthStorage(DepthMap::EStorage::FLOAT32), cReportedDepthError(0.0f), cbBuildDepthIntegral(false), cProvisionalLevel(3), cbBoundaryPlane(false) {
+	cpPrefetcher = boost::make_shared<FramePrefetcher>(cFrameCache, [](const FramePrefetcher::Request& request, Geometry& geometry) {
+		return ReadFrame(request.cDepthMapFileName, request.cCameraFileName, geometry, request.cStorage, request.cbDepthIntegral);
+	});
 }
 
 MeasureHandler::~MeasureHandler()  
 {
+	// Stop reading frames into the cache before it is destroyed
+	cpPrefetcher.reset();
 }
 
 bool MeasureHandler::OnNextFrame(gpu::ImagePropertyPtr pProperties, wxString const& filename, int const& frameNumber, float const& time, boost::compute::uint2_ const& imSize, bool bDoParse) {
 	cpProperties = pProperties;
 	cImageFileName = filename;
-	wxFileName fn(cImageFileName);
-	fn.SetExt("dmp");
-	cDepthMapFileName = fn.GetFullPath();
-	fn.SetExt("cam");
-	cCameraFileName = fn.GetFullPath();
+	GetFrameFileNames(cImageFileName, cDepthMapFileName, cCameraFileName);
 	cbIsParsed = false;
+	PrefetchFrames();
 	if (bDoParse) {
 		if (!Parse()) {
 			wxLogError("Could not parse meta data");
@@ -41,83 +54,424 @@ bool MeasureHandler::Parse() {
 	if (cbIsParsed) {
 		return true;
 	}
-	if (!ReadDepthMap()) {
+	if (cpPrefetcher) {
+		// The frame may be being read by a worker right now
+		cpPrefetcher->Wait(cDepthMapFileName);
+	}
+	if (cFrameCache.Get(cDepthMapFileName, cCameraFileName, cGeometry)) {
+		wxLogVerbose(_("Frame cache hit for %s (%zu hits, %zu misses)"), cDepthMapFileName, cFrameCache.GetHits(), cFrameCache.GetMisses());
+		ReportDepthError();
+		cbIsParsed = true;
+		return true;
+	}
+
+	if (!cpProperties) {
+		wxLogError(_("Could not get image properties"));
+		return false;
+	}
+	cpProperties->GetImageSize(cGeometry.cImageSize[0], cGeometry.cImageSize[1]);
+	const FrameCache::FileTimes times = FrameCache::GetFileTimes(cDepthMapFileName, cCameraFileName);
+	if (!ReadFrame(cDepthMapFileName, cCameraFileName, cGeometry, cDepthStorage, cbBuildDepthIntegral)) {
+		return false;
+	}
+
+	cFrameCache.Put(cDepthMapFileName, times, cGeometry);
+	ReportDepthError();
+	cbIsParsed = true;
+	return true;
+}
+
+bool MeasureHandler::ReadFrame(const wxString& depthMapFileName, const wxString& cameraFileName, Geometry& geometry, DepthMap::EStorage storage, bool bDepthIntegral) {
+	if (!ReadDepthMap(depthMapFileName, geometry, storage)) {
 		wxLogError(_("Could not read depth map"));
 		return false;
 	}
 
-	if (!ReadCamera()) {
+	if (!ReadCamera(cameraFileName, geometry)) {
 		wxLogError(_("Could not read camera"));
 		return false;
 	}
 
+	// Not fatal, region queries are just not available. Building it would decompress every tile of a tiled depth map, so the stored pyramid is read.
+	// Depth maps converted to 16 bits are not tiled any more and get a pyramid of their own values.
+	const TiledDepthMap* pTiledDepthMap = dynamic_cast<const TiledDepthMap*>(geometry.cpDepthMap.get());
+	if (pTiledDepthMap) {
+		geometry.cpDepthPyramid = pTiledDepthMap->ReadDepthPyramid();
+		if (!geometry.cpDepthPyramid) {
+			wxLogWarning(_("Could not read depth pyramid of %s"), depthMapFileName);
+		}
+	} else if (!geometry.BuildDepthPyramid()) {
+		wxLogWarning(_("Could not build depth pyramid of %s"), depthMapFileName);
+	}
+	if (!bDepthIntegral) {
+		geometry.cpDepthIntegral.reset();
+	} else if (!geometry.BuildDepthIntegral()) {
+		wxLogWarning(_("Could not build depth integral of %s"), depthMapFileName);
+	}
 	return true;
 }
 
-bool MeasureHandler::ReadDepthMap() {
-	if (!wxFileName::FileExists(cDepthMapFileName)) {
-		wxLogError("Depth map is missing (%s)", cDepthMapFileName);
-		return false;
+void MeasureHandler::ReportDepthError() {
+	// Not every frame, the error of a storage mode varies little between the frames of a sequence
+	const float maxError = cGeometry.cpDepthMap ? cGeometry.cpDepthMap->GetMaxError() : 0.0f;
+	if (maxError > cReportedDepthError) {
+		cReportedDepthError = maxError;
+		wxLogMessage(_("Depth maps are stored with 16 bits, max error so far %g"), maxError);
 	}
+}
 
-	if (!cpProperties) {
-		wxLogError(_("Could not get image properties"));
+void MeasureHandler::SetPrefetchCount(size_t n) {
+	cPrefetchCount = n;
+	if (!cPrefetchCount && cpPrefetcher) {
+		cpPrefetcher->Cancel();
+	}
+}
+
+size_t MeasureHandler::GetPrefetchCount() const {
+	return cPrefetchCount;
+}
+
+void MeasureHandler::SetDepthStorage(DepthMap::EStorage storage) {
+	if (storage == cDepthStorage) {
+		return;
+	}
+	cDepthStorage = storage;
+	cReportedDepthError = 0.0f;
+	// Cached and prefetched frames use the old storage, so read them again
+	if (cpPrefetcher) {
+		cpPrefetcher->Cancel();
+	}
+	cFrameCache.Clear();
+	cbIsParsed = false;
+}
+
+DepthMap::EStorage MeasureHandler::GetDepthStorage() const {
+	return cDepthStorage;
+}
+
+void MeasureHandler::SetBuildDepthIntegral(bool bBuild) {
+	if (bBuild == cbBuildDepthIntegral) {
+		return;
+	}
+	cbBuildDepthIntegral = bBuild;
+	// Cached and prefetched frames have or lack the depth integral, so read them again
+	if (cpPrefetcher) {
+		cpPrefetcher->Cancel();
+	}
+	cFrameCache.Clear();
+	cbIsParsed = false;
+}
+
+bool MeasureHandler::GetBuildDepthIntegral() const {
+	return cbBuildDepthIntegral;
+}
+
+void MeasureHandler::SetProvisionalLevel(size_t level) {
+	cProvisionalLevel = level;
+}
+
+size_t MeasureHandler::GetProvisionalLevel() const {
+	return cProvisionalLevel;
+}
+
+void MeasureHandler::SetReferencePlane(bool bBoundary, const PlaneFitter::Options& options) {
+	cbBoundaryPlane = bBoundary;
+	cPlaneOptions = options;
+}
+
+bool MeasureHandler::GetReferencePlane(PlaneFitter::Options& options) const {
+	options = cPlaneOptions;
+	return cbBoundaryPlane;
+}
+
+void MeasureHandler::ApplyReferencePlane(const ShapePtr& pShape) {
+	boost::shared_ptr<PolygonShape> pPolygonShape = boost::dynamic_pointer_cast<PolygonShape>(pShape);
+	if (pPolygonShape) {
+		pPolygonShape->SetReferencePlane(cbBoundaryPlane, cPlaneOptions);
+	}
+}
+
+void MeasureHandler::IndexShape(const ShapeHandle& handle) {
+	const ShapePtr pShape = cShapes.Get(handle);
+	Geometry::Box box;
+	if (!pShape || !pShape->GetBoundingBox(box)) {
+		UnindexShape(handle);
+		return;
+	}
+	const std::unordered_map<uint32_t, Geometry::Box>::iterator it = cIndexedBoxes.find(handle.cIndex);
+	if (it != cIndexedBoxes.end()) {
+		if (boost::geometry::equals(it->second.min_corner(), box.min_corner()) && boost::geometry::equals(it->second.max_corner(), box.max_corner())) {
+			return;
+		}
+		cShapeIndex.remove(ShapeBox(it->second, handle));
+		it->second = box;
+	} else {
+		cIndexedBoxes.emplace(handle.cIndex, box);
+	}
+	cShapeIndex.insert(ShapeBox(box, handle));
+}
+
+void MeasureHandler::UnindexShape(const ShapeHandle& handle) {
+	const std::unordered_map<uint32_t, Geometry::Box>::iterator it = cIndexedBoxes.find(handle.cIndex);
+	if (it != cIndexedBoxes.end()) {
+		cShapeIndex.remove(ShapeBox(it->second, handle));
+		cIndexedBoxes.erase(it);
+	}
+}
+
+bool MeasureHandler::RefineShapes() {
+	for (size_t i = 0; i < cShapes.Size(); ++i) {
+		const ShapePtr& pShape = cShapes.GetShapes()[i];
+		if (pShape->GetRefinementLevel() == 0) {
+			continue;
+		}
+		boost::shared_ptr<PolygonShape> pPolygonShape = boost::dynamic_pointer_cast<PolygonShape>(pShape);
+		if (!pPolygonShape || std::any_of(cvRefinements.begin(), cvRefinements.end(), [&](const RefinementPtr& pRefinement) { return pRefinement->cpShape == pShape && !pRefinement->cbDone; })) {
+			continue;
+		}
+		RefinementPtr pRefinement = boost::make_shared<Refinement>();
+		pRefinement->cpShape = pShape;
+		pRefinement->cShape = cShapes.GetHandle(i);
+		if (!pPolygonShape->IsCalculatedOn(cGeometry)) {
+			// The frame has changed since the provisional calculation, so its moments and plane do not apply and refined moments would be rejected.
+			// Calculate provisionally on this frame, the pixels are integrated on a worker thread below.
+			pShape->UpdateCalculations(cGeometry, std::max<size_t>(cProvisionalLevel, 1));
+			if (pShape->GetRefinementLevel() == 0) {
+				pRefinement->cbSuccess = true;
+				pRefinement->cbCalculated = true;
+				pRefinement->cbDone = true;
+				cvRefinements.push_back(pRefinement);
+				continue;
+			}
+		}
+		// The worker only uses copies, the shape may be edited or deleted meanwhile
+		pRefinement->cGeometry = cGeometry;
+		pPolygonShape->GetRefinementInput(pRefinement->cPolygon, pRefinement->cOrigin);
+		pRefinement->cbSuccess = false;
+		pRefinement->cbCalculated = false;
+		pRefinement->cbDone = false;
+		cvRefinements.push_back(pRefinement);
+		ThreadPool::GetInstance().Submit([pRefinement]() {
+			pRefinement->cbSuccess = VolumeIntegrator::Integrate(pRefinement->cGeometry, pRefinement->cPolygon, pRefinement->cOrigin, pRefinement->cMoments);
+			pRefinement->cbDone = true;
+		});
+	}
+	return !cvRefinements.empty();
+}
+
+bool MeasureHandler::GetRefinedShape(DataUpdateEvent& e) {
+	for (size_t i = 0; i < cvRefinements.size(); ++i) {
+		RefinementPtr pRefinement = cvRefinements[i];
+		if (!pRefinement->cbDone) {
+			continue;
+		}
+		cvRefinements.erase(cvRefinements.begin() + i--);
+		if (!pRefinement->cbSuccess || !cShapes.Contains(pRefinement->cShape)) {
+			continue;
+		}
+		boost::shared_ptr<PolygonShape> pPolygonShape = boost::dynamic_pointer_cast<PolygonShape>(pRefinement->cpShape);
+		if (pRefinement->cbCalculated || pPolygonShape->SetRefinedMoments(pRefinement->cGeometry, pRefinement->cPolygon, pRefinement->cMoments)) {
+			e.Initialize(pRefinement->cShape, pRefinement->cpShape);
+			e.SetRefinementLevel(0);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool MeasureHandler::GetZonalStatistics(std::vector<ShapePtr>& vShapes, std::vector<ZonalStatistics::Statistics>& vStatistics, size_t bins) {
+	vShapes.clear();
+	std::vector<Geometry::Polygon> vPolygons;
+	for (const ShapePtr& pShape : cShapes.GetShapes()) {
+		boost::shared_ptr<PolygonShape> pPolygonShape = boost::dynamic_pointer_cast<PolygonShape>(pShape);
+		if (!pPolygonShape || !pPolygonShape->IsCompleted()) {
+			continue;
+		}
+		vPolygons.emplace_back();
+		pPolygonShape->GetRenderPolygon(vPolygons.back());
+		vShapes.push_back(pShape);
+	}
+	return ZonalStatistics::Compute(cGeometry, vPolygons, vStatistics, bins);
+}
+
+bool MeasureHandler::DetectChange(const wxString& imageFileName, const ShapePtr& pShape, const ChangeDetection::Options& options, ChangeDetection::Result& result, ChangeDetection::Raster* pDifference) {
+	wxString depthMapFileName, cameraFileName;
+	GetFrameFileNames(imageFileName, depthMapFileName, cameraFileName);
+	Geometry other;
+	if (!cFrameCache.Get(depthMapFileName, cameraFileName, other)) {
+		// Frames of a sequence have the same image size
+		other.cImageSize[0] = cGeometry.cImageSize[0];
+		other.cImageSize[1] = cGeometry.cImageSize[1];
+		const FrameCache::FileTimes times = FrameCache::GetFileTimes(depthMapFileName, cameraFileName);
+		if (!ReadFrame(depthMapFileName, cameraFileName, other, cDepthStorage, cbBuildDepthIntegral)) {
+			wxLogError(_("Could not read frame %s"), imageFileName);
+			return false;
+		}
+		cFrameCache.Put(depthMapFileName, times, other);
+	}
+	if (!pShape) {
+		return ChangeDetection::Compute(cGeometry, other, options, result, pDifference);
+	}
+	boost::shared_ptr<PolygonShape> pPolygonShape = boost::dynamic_pointer_cast<PolygonShape>(pShape);
+	if (!pPolygonShape) {
+		wxLogError(_("Change detection requires a polygon"));
 		return false;
 	}
-	cpProperties->GetImageSize(cGeometry.cImageSize[0], cGeometry.cImageSize[1]);
+	Geometry::Polygon polygon;
+	pPolygonShape->GetRenderPolygon(polygon);
+	return ChangeDetection::Compute(cGeometry, other, polygon, options, result, pDifference);
+}
 
-	const size_t nPixels = cGeometry.cImageSize[0] * cGeometry.cImageSize[1];
-	if (cGeometry.cDepthMap.size() != nPixels) {
-		cGeometry.cDepthMap.resize(nPixels);
+void MeasureHandler::GetFrameFileNames(const wxString& imageFileName, wxString& depthMapFileName, wxString& cameraFileName) {
+	wxFileName fn(imageFileName);
+	fn.SetExt("tdm"); // Prefer tiled depth map if it has been converted
+	depthMapFileName = fn.GetFullPath();
+	if (!wxFileName::FileExists(depthMapFileName)) {
+		fn.SetExt("dmp");
+		depthMapFileName = fn.GetFullPath();
 	}
-	wxFFile file(cDepthMapFileName, "rb");
-	if (!file.IsOpened()) {
-		wxLogError(_("Could not open %s"), cDepthMapFileName);
+	fn.SetExt("cam");
+	cameraFileName = fn.GetFullPath();
+}
+
+void MeasureHandler::PrefetchFrames() {
+	if (!cPrefetchCount || !cpPrefetcher || !cpProperties) {
+		return;
+	}
+
+	// List the images of the folder again if it is a new folder or the image is not found (e.g. added after listing).
+	// A folder where an image was not found even after listing is not listed again until the folder changes, e.g. the frames of a video.
+	wxFileName fn(cImageFileName);
+	if (fn.GetPath() == cFolder && cbFolderMissed) {
+		return;
+	}
+	std::vector<wxString>::const_iterator it = std::lower_bound(cvFolderImages.begin(), cvFolderImages.end(), fn.GetFullPath());
+	if (fn.GetPath() != cFolder || it == cvFolderImages.end() || *it != fn.GetFullPath()) {
+		cFolder = fn.GetPath();
+		wxArrayString files;
+		wxDir::GetAllFiles(cFolder, &files, "*." + fn.GetExt(), wxDIR_FILES);
+		cvFolderImages.assign(files.begin(), files.end());
+		std::sort(cvFolderImages.begin(), cvFolderImages.end());
+		cFrameIndex = -1;
+		it = std::lower_bound(cvFolderImages.begin(), cvFolderImages.end(), fn.GetFullPath());
+		cbFolderMissed = it == cvFolderImages.end() || *it != fn.GetFullPath();
+		if (cbFolderMissed) {
+			return; // Not a folder of images, e.g. a video
+		}
+	}
+
+	// Predict the next frames in the direction the user is stepping
+	const int index = static_cast<int>(it - cvFolderImages.begin());
+	const int direction = (cFrameIndex >= 0 && index < cFrameIndex) ? -1 : 1;
+	cFrameIndex = index;
+
+	size_t width = 0, height = 0;
+	cpProperties->GetImageSize(width, height);
+	std::vector<FramePrefetcher::Request> vRequests;
+	for (int i = index + direction; i >= 0 && i < static_cast<int>(cvFolderImages.size()) && vRequests.size() < cPrefetchCount; i += direction) {
+		FramePrefetcher::Request request;
+		GetFrameFileNames(cvFolderImages[i], request.cDepthMapFileName, request.cCameraFileName);
+		request.cImageSize[0] = width;
+		request.cImageSize[1] = height;
+		request.cStorage = cDepthStorage;
+		request.cbDepthIntegral = cbBuildDepthIntegral;
+		vRequests.push_back(request);
+	}
+	cpPrefetcher->Prefetch(vRequests);
+}
+
+bool MeasureHandler::ReadDepthMap(const wxString& filename, Geometry& geometry, DepthMap::EStorage storage) {
+	if (!wxFileName::FileExists(filename)) {
+		wxLogError("Depth map is missing (%s)", filename);
 		return false;
 	}
-	if (file.Read(cGeometry.cDepthMap.data(), sizeof(float) * nPixels) != sizeof(float) * nPixels) {
-		wxLogError(_("Not enough data in %s"), cDepthMapFileName);
+
+	const size_t width = geometry.cImageSize[0], height = geometry.cImageSize[1];
+	bool bOpened = false;
+	wxString rawFileName = filename;
+	if (wxFileName(filename).GetExt().IsSameAs("tdm", false)) {
+		TiledDepthMapPtr pDepthMap = boost::make_shared<TiledDepthMap>();
+		bOpened = pDepthMap->Open(filename, width, height);
+		geometry.cpDepthMap = pDepthMap;
+		// Read the raw depth map the tiled one was converted from instead, e.g. if the conversion was incomplete
+		wxFileName fn(filename);
+		fn.SetExt("dmp");
+		rawFileName = fn.GetFullPath();
+		if (!bOpened && wxFileName::FileExists(rawFileName)) {
+			wxLogWarning(_("Could not read %s, reading %s instead"), filename, rawFileName);
+		}
+	}
+	if (!bOpened && wxFileName::FileExists(rawFileName)) {
+		RawDepthMapPtr pDepthMap = boost::make_shared<RawDepthMap>();
+		bOpened = pDepthMap->Open(rawFileName, width, height);
+		geometry.cpDepthMap = pDepthMap;
+	}
+	if (!bOpened) {
+		wxLogError(_("Could not read %s"), filename);
+		geometry.cpDepthMap.reset();
 		return false;
 	}
+
+	// Convert to 16 bit values. The file is unmapped when the float depth map is released.
+	if (storage == DepthMap::EStorage::FLOAT16) {
+		HalfDepthMapPtr pDepthMap = boost::make_shared<HalfDepthMap>();
+		if (!pDepthMap->Create(*geometry.cpDepthMap)) {
+			wxLogError(_("Could not convert %s to half floats"), filename);
+			geometry.cpDepthMap.reset();
+			return false;
+		}
+		wxLogVerbose(_("Depth map %s stored as half floats, max error %g"), filename, pDepthMap->GetMaxError());
+		geometry.cpDepthMap = pDepthMap;
+	} else if (storage == DepthMap::EStorage::FIXED16) {
+		QuantizedDepthMapPtr pDepthMap = boost::make_shared<QuantizedDepthMap>();
+		if (!pDepthMap->Create(*geometry.cpDepthMap)) {
+			wxLogError(_("Could not convert %s to fixed point"), filename);
+			geometry.cpDepthMap.reset();
+			return false;
+		}
+		wxLogVerbose(_("Depth map %s stored as fixed point with scale %g and offset %g, max error %g"), filename, pDepthMap->GetScale(), pDepthMap->GetOffset(), pDepthMap->GetMaxError());
+		geometry.cpDepthMap = pDepthMap;
+	}
 	return true;
 }
 
-bool MeasureHandler::ReadCamera() {
-	if (!wxFileName::FileExists(cCameraFileName)) {
-		wxLogError("Camera file is missing (%s)", cCameraFileName);
+bool MeasureHandler::ReadCamera(const wxString& filename, Geometry& geometry) {
+	if (!wxFileName::FileExists(filename)) {
+		wxLogError("Camera file is missing (%s)", filename);
 		return false;
 	}
-	wxFFile file(cCameraFileName, "rb");
+	wxFFile file(filename, "rb");
 	if (!file.IsOpened()) {
-		wxLogError(_("Could not read camera file %s"), cCameraFileName);
+		wxLogError(_("Could not read camera file %s"), filename);
 		return false;
 	}
 
 	// The written camera is a 3x4 matrix with doubles, which is how the GpuCamera is defined
 	GpuCamera gpuCamera;
 	if (file.Read(&gpuCamera, sizeof(GpuCamera)) != sizeof(GpuCamera)) {
-		wxLogError(_("Not enough data in %s"), cCameraFileName);
+		wxLogError(_("Not enough data in %s"), filename);
 		return false;
 	}
 
-	// A more useful camera class is the Camera pointed to by CameraPtr so we copy the read GpuCamera to a Camera
-	CameraPtr pCamera = GetCamera();
-	*pCamera = gpuCamera;
-
-	Camera::Camera2PixelMatrix(cGeometry.cImageSize[0], cGeometry.cImageSize[1], cGeometry.cCameraToPixelTransform);
+	// A more useful camera class is the Camera pointed to by CameraPtr so we copy the read GpuCamera to a Camera.
+	// Always a new camera, since the camera of the previous frame may be shared with the frame cache.
+	geometry.cpCamera = boost::make_shared<Camera>();
+	*geometry.cpCamera = gpuCamera;
+	// The matrix also selects the specialized image to object kernels
+	geometry.SetCameraMatrix(reinterpret_cast<const double*>(&gpuCamera));
 
-	CheckCamera();
+	Camera::Camera2PixelMatrix(geometry.cImageSize[0], geometry.cImageSize[1], geometry.cCameraToPixelTransform);
 
-	cbIsParsed = true;
+	CheckCamera(geometry);
 	return true;
 }
 
-void MeasureHandler::CheckCamera() {
-	if (!cGeometry.cpCamera) {
-		cGeometry.cCameraType = Camera::ECameraType::FULL;
+void MeasureHandler::CheckCamera(Geometry& geometry) {
+	if (!geometry.cpCamera) {
+		geometry.cCameraType = Camera::ECameraType::FULL;
 		return;
 	}
-	cGeometry.cCameraType = cGeometry.cpCamera->ClassifyCamera();
+	geometry.cCameraType = geometry.cpCamera->ClassifyCamera();
 }
 
 bool MeasureHandler::ImageToObject(iconic::Geometry::PolygonPtr pImage, iconic::Geometry::Polygon3DPtr pObject) {
@@ -139,8 +493,12 @@ CameraPtr MeasureHandler::GetCamera() {
 	return cGeometry.cpCamera;
 }
 
-std::vector<float>& MeasureHandler::GetDepthMap() {
-	return cGeometry.cDepthMap;
+FrameCache& MeasureHandler::GetFrameCache() {
+	return cFrameCache;
+}
+
+DepthMapPtr MeasureHandler::GetDepthMap() {
+	return cGeometry.cpDepthMap;
 }
 
 void MeasureHandler::GetImageSize(size_t& width, size_t& height) {
@@ -166,12 +524,12 @@ bool MeasureHandler::InstantiateNewShape(iconic::ShapeType type) {
 		break;
 	case iconic::ShapeType::PolygonType:
 		cpSelectedShape = iconic::ShapePtr(new iconic::PolygonShape(col));
+		ApplyReferencePlane(cpSelectedShape);
 		break;
 	}
 
-	cvShapes.push_back(cpSelectedShape);
-	cSelectedShapeIndex = cvShapes.size() - 1;
-	wxLogVerbose(_("There are currently " + std::to_string(cvShapes.size()) + " number of shapes"));
+	cSelectedShape = cShapes.Insert(cpSelectedShape);
+	wxLogVerbose(_("There are currently " + std::to_string(cShapes.Size()) + " number of shapes"));
 	return true;
 }
 
@@ -181,8 +539,9 @@ void MeasureHandler::AddImagePolygon(iconic::Geometry::PolygonPtr pPolygon) {
 	c = (c + 1) % 6;
 
 	cpSelectedShape = iconic::ShapePtr(new iconic::PolygonShape(pPolygon, col));
-	cvShapes.push_back(cpSelectedShape);
-	cSelectedShapeIndex = cvShapes.size() - 1;
+	ApplyReferencePlane(cpSelectedShape);
+	cSelectedShape = cShapes.Insert(cpSelectedShape);
+	IndexShape(cSelectedShape);
 }
 
 bool MeasureHandler::ModifySelectedShape(Geometry::Point imgP, MeasureEvent::EAction modification, DataUpdateEvent& e) {
@@ -193,15 +552,17 @@ bool MeasureHandler::ModifySelectedShape(Geometry::Point imgP, MeasureEvent::EAc
 	switch (modification) {
 	case MeasureEvent::EAction::SELECTED:
 		cpSelectedShape->AddPoint(imgP, -1);
+		IndexShape(cSelectedShape);
 		// Invalidate data presentation of shape
 		break;
 	case MeasureEvent::EAction::ADDED:
 		cpSelectedShape->DeselectPoint();
 
 		if (cpSelectedShape->IsCompleted()) {
-			cpSelectedShape->UpdateCalculations(cGeometry);
+			cpSelectedShape->UpdateCalculations(cGeometry, cProvisionalLevel);
 
-			e.Initialize(cSelectedShapeIndex, cpSelectedShape);
+			e.Initialize(cSelectedShape, cpSelectedShape);
+			e.SetRefinementLevel(cpSelectedShape->GetRefinementLevel());
 			if (cpSelectedShape->GetType() == iconic::ShapeType::PointType)
 				HandleFinishedMeasurement();
 
@@ -212,6 +573,15 @@ bool MeasureHandler::ModifySelectedShape(Geometry::Point imgP, MeasureEvent::EAc
 	case MeasureEvent::EAction::MOVED:
 		if (cpSelectedShape) {
 			cpSelectedShape->MoveSelectedPoint(imgP);
+			IndexShape(cSelectedShape);
+			// Keep the measurements up to date while dragging. Polygons only integrate the area swept by the move,
+			// or the depth pyramid if there are no final values to update. Without depth pyramid the volume is left to RefineShapes.
+			if (cpSelectedShape->GetType() == iconic::ShapeType::PolygonType && cpSelectedShape->IsCompleted()) {
+				cpSelectedShape->UpdateCalculations(cGeometry, cProvisionalLevel);
+				e.Initialize(cSelectedShape, cpSelectedShape);
+				e.SetRefinementLevel(cpSelectedShape->GetRefinementLevel());
+				r = true;
+			}
 		}
 		break;
 	}
@@ -223,14 +593,14 @@ void MeasureHandler::HandleFinishedMeasurement(bool instantiate_new) {
 		return;
 	}
 	cpSelectedShape->Finish();
-	cpSelectedShape->UpdateCalculations(cGeometry);
+	cpSelectedShape->UpdateCalculations(cGeometry, cProvisionalLevel);
 
 	iconic::ShapeType previousShapeType = cpSelectedShape->GetType();
 
 	DeleteSelectedShapeIfIncomplete();
 
 	cpSelectedShape = nullptr;
-	cSelectedShapeIndex = -1;
+	cSelectedShape = ShapeHandle();
 
 
 	if (instantiate_new) {
@@ -238,47 +608,63 @@ void MeasureHandler::HandleFinishedMeasurement(bool instantiate_new) {
 	}
 }
 
-//Risky to just "pop_back", might go wrong in possible edge cases
 void MeasureHandler::DeleteSelectedShapeIfIncomplete() {
 
-	if (!cpSelectedShape->IsCompleted()) cvShapes.pop_back();
+	if (!cpSelectedShape->IsCompleted()) {
+		UnindexShape(cSelectedShape);
+		cShapes.Erase(cSelectedShape);
+	}
 
 	cpSelectedShape = nullptr;
-	wxLogVerbose(_("There are currently " + std::to_string(cvShapes.size()) + " number of shapes"));
+	cSelectedShape = ShapeHandle();
+	wxLogVerbose(_("There are currently " + std::to_string(cShapes.Size()) + " number of shapes"));
 }
 
 void MeasureHandler::ClearShapes() {
 	cpSelectedShape = nullptr;
-	cvShapes.clear();
+	cSelectedShape = ShapeHandle();
+	cShapes.Clear();
+	cShapeIndex.clear();
+	cIndexedBoxes.clear();
 }
 
 ShapeType MeasureHandler::SelectShapeFromCoordinates(Geometry::Point point) {
-	// Loop over the the currently existing shapes
-	for (int i = 0; i < cvShapes.size(); i++) {
-		if (cvShapes[i]->Select(point)) {
-			cpSelectedShape = cvShapes[i];
-			cSelectedShapeIndex = i;
+	// Only the shapes with boxes near the point are tested, in the order of cShapes so that the first hit wins
+	const Geometry::Box reach(Geometry::Point(point.get<0>() - cSelectDistance, point.get<1>() - cSelectDistance), Geometry::Point(point.get<0>() + cSelectDistance, point.get<1>() + cSelectDistance));
+	std::vector<ShapeBox> vCandidates;
+	cShapeIndex.query(boost::geometry::index::intersects(reach), std::back_inserter(vCandidates));
+	std::vector<size_t> vPositions;
+	for (const ShapeBox& candidate : vCandidates) {
+		const size_t position = cShapes.GetPosition(candidate.second);
+		if (position != ShapeSlotMap::npos) {
+			vPositions.push_back(position);
+		}
+	}
+	std::sort(vPositions.begin(), vPositions.end());
+	for (size_t position : vPositions) {
+		const ShapePtr& pShape = cShapes.GetShapes()[position];
+		if (pShape->Select(point)) {
+			cpSelectedShape = pShape;
+			cSelectedShape = cShapes.GetHandle(position);
 			return cpSelectedShape->GetType();
 		}
 	}
 	// If no shape is clicked then make sure no shape is selected
 	cpSelectedShape = nullptr;
-	cSelectedShapeIndex = -1;
+	cSelectedShape = ShapeHandle();
 	return ShapeType::None;
 }
 
-int MeasureHandler::DeleteSelectedShape() {
-	if (cpSelectedShape == nullptr
-		|| cSelectedShapeIndex < 0
-		|| cSelectedShapeIndex >= cvShapes.size()
-	) {
-		return -1;
+ShapeHandle MeasureHandler::DeleteSelectedShape() {
+	if (cpSelectedShape == nullptr || !cShapes.Contains(cSelectedShape)) {
+		return ShapeHandle();
 	}
-	int index = cSelectedShapeIndex;
-	cvShapes.erase(cvShapes.begin() + cSelectedShapeIndex);
+	const ShapeHandle handle = cSelectedShape;
+	UnindexShape(handle);
+	cShapes.Erase(handle);
 	cpSelectedShape = nullptr;
-	cSelectedShapeIndex = -1;
-	return index;
+	cSelectedShape = ShapeHandle();
+	return handle;
 }
 
 bool MeasureHandler::GetWKT(std::string& wkt) {
@@ -286,7 +672,7 @@ bool MeasureHandler::GetWKT(std::string& wkt) {
 	const std::string srid = "SRID = 4326;";
 	std::string s;
 	bool temp, overall = false;
-	for (ShapePtr shape : cvShapes) {
+	for (const ShapePtr& shape : cShapes.GetShapes()) {
 		temp = shape->GetWKT(s);
 		if (!temp) continue;
 		overall = true;
@@ -321,17 +707,20 @@ bool MeasureHandler::LoadWKT(wxString& wkt, DataUpdateEvent& e) {
 		wxLogWarning(_("Incorrect line in WKT file: " + wkt));
 		return false;
 	}
-	shape->UpdateCalculations(cGeometry);
-	e.Initialize(cvShapes.size(), shape);
-
-	cvShapes.push_back(shape);
-
-	wxLogVerbose(_("There are currently " + std::to_string(cvShapes.size()) + " number of shapes"));
+	ApplyReferencePlane(shape);
+	// Many shapes may be loaded, so polygons are calculated provisionally and refined on worker threads by RefineShapes
+	shape->UpdateCalculations(cGeometry, std::max<size_t>(cProvisionalLevel, 1));
+	const ShapeHandle handle = cShapes.Insert(shape);
+	e.Initialize(handle, shape);
+	e.SetRefinementLevel(shape->GetRefinementLevel());
+	IndexShape(handle);
+
+	wxLogVerbose(_("There are currently " + std::to_string(cShapes.Size()) + " number of shapes"));
 	return true;
 }
 
 void MeasureHandler::OnDrawShapes(DrawEvent& e) {
-	for (const ShapePtr shape : cvShapes) {
+	for (const ShapePtr& shape : cShapes.GetShapes()) {
 		shape->Draw();
 	}
 
@@ -345,6 +734,9 @@ void MeasureHandler::OnDrawShapes(DrawEvent& e) {
 }
 
 void MeasureHandler::DeleteAllShapes() {
-	cvShapes.clear();
+	cShapes.Clear();
+	cShapeIndex.clear();
+	cIndexedBoxes.clear();
 	cpSelectedShape = nullptr;
+	cSelectedShape = ShapeHandle();
 }
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include <IconicMeasureCommon/PlaneFitter.h>
+#include <IconicMeasureCommon/ThreadPool.h>
+#include <IconicMeasureCommon/VolumeIntegrator.h>
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace iconic;
+
+namespace {
+	const size_t cSampleGrain = 4096; //!< Samples per parallel block of image to object transformations
+}
+
+PlaneFitter::Options::Options() : cIterations(256), cThreshold(0.05), cBandWidth(0), cSeed(1) {}
+
+bool PlaneFitter::SampleBoundary(const Geometry& geometry, const Geometry::Polygon& imagePolygon, size_t bandWidth, PlaneFitter::Samples& samples) {
+	samples.cvX.clear();
+	samples.cvY.clear();
+	samples.cvZ.clear();
+	Geometry::Polygon pixelPolygon;
+	geometry.ImageToPixel(imagePolygon, pixelPolygon);
+	const Geometry::Polygon::ring_type& ring = pixelPolygon.outer();
+	if (!geometry.cpDepthMap || ring.size() < 3) {
+		return false;
+	}
+	const DepthMap& depthMap = *geometry.cpDepthMap;
+	const int width = static_cast<int>(depthMap.GetWidth()), height = static_cast<int>(depthMap.GetHeight());
+
+	// One sample per pixel step along the major axis of each edge, repeated at one pixel offsets across the band
+	const int lanes = static_cast<int>(std::max<size_t>(bandWidth, 1));
+	const Eigen::Matrix3d pixelToCamera = geometry.cCameraToPixelTransform.inverse();
+	std::vector<double> vx, vy;
+	std::vector<float> vz;
+	for (size_t i = 0; i < ring.size(); ++i) {
+		const Geometry::Point& a = ring[i];
+		const Geometry::Point& b = ring[(i + 1) % ring.size()];
+		const double dx = b.get<0>() - a.get<0>(), dy = b.get<1>() - a.get<1>();
+		const double length = std::sqrt(dx * dx + dy * dy);
+		if (!(length > 0.0)) {
+			continue; // Closing vertex
+		}
+		const size_t steps = static_cast<size_t>(std::ceil(std::max(std::abs(dx), std::abs(dy))));
+		const double nx = -dy / length, ny = dx / length;
+		for (size_t step = 0; step < steps; ++step) {
+			const double t = static_cast<double>(step) / steps;
+			for (int lane = 0; lane < lanes; ++lane) {
+				const double offset = lane - (lanes - 1) / 2.0;
+				const double px = a.get<0>() + t * dx + offset * nx, py = a.get<1>() + t * dy + offset * ny;
+				// Z of the pixel containing the sample, looked up here since the samples are already in pixels
+				const int ix = static_cast<int>(std::floor(px + 0.5)), iy = static_cast<int>(std::floor(py + 0.5));
+				float z = std::numeric_limits<float>::max();
+				if (ix < 0 || iy < 0 || ix >= width || iy >= height || !depthMap.GetZ(ix, iy, z) || !DepthMap::IsValid(z)) {
+					continue;
+				}
+				const Eigen::Vector3d pt = pixelToCamera * Eigen::Vector3d(px, py, 1.0);
+				vx.push_back(pt[0] / pt[2]);
+				vy.push_back(pt[1] / pt[2]);
+				vz.push_back(z);
+			}
+		}
+	}
+
+	const size_t n = vx.size();
+	std::vector<double> vX(n), vY(n), vZ(n);
+	std::vector<Geometry::EPointStatus> vStatus(n);
+	ThreadPool::GetInstance().ParallelFor(0, n, [&](size_t begin, size_t end) {
+		geometry.ImageToObject(vx.data() + begin, vy.data() + begin, vz.data() + begin, end - begin, vX.data() + begin, vY.data() + begin, vZ.data() + begin, vStatus.data() + begin);
+	}, cSampleGrain);
+	for (size_t i = 0; i < n; ++i) {
+		if (vStatus[i] == Geometry::EPointStatus::OK) {
+			samples.cvX.push_back(vX[i]);
+			samples.cvY.push_back(vY[i]);
+			samples.cvZ.push_back(vZ[i]);
+		}
+	}
+	return samples.cvX.size() >= 3;
+}
+
+bool PlaneFitter::Fit(const PlaneFitter::Samples& samples, const Eigen::Vector3d& origin, const PlaneFitter::Options& options, Eigen::Vector3d& plane, size_t* pInliers) {
+	const size_t n = samples.cvX.size();
+	if (n < 3 || samples.cvY.size() != n || samples.cvZ.size() != n) {
+		return false;
+	}
+	std::vector<double> vX(n), vY(n), vZ(n);
+	for (size_t i = 0; i < n; ++i) {
+		vX[i] = samples.cvX[i] - origin[0];
+		vY[i] = samples.cvY[i] - origin[1];
+		vZ[i] = samples.cvZ[i] - origin[2];
+	}
+
+	std::vector<Geometry::Point3D> vInliers;
+	if (options.cIterations == 0) {
+		vInliers.reserve(n);
+		for (size_t i = 0; i < n; ++i) {
+			vInliers.push_back(Geometry::Point3D(samples.cvX[i], samples.cvY[i], samples.cvZ[i]));
+		}
+	} else {
+		// Hypotheses are drawn up front, so they do not depend on the scheduling
+		std::mt19937 generator(options.cSeed);
+		std::uniform_int_distribution<size_t> distribution(0, n - 1);
+		std::vector<Eigen::Vector3d> vPlanes;
+		vPlanes.reserve(options.cIterations);
+		for (size_t i = 0; i < options.cIterations; ++i) {
+			const size_t i0 = distribution(generator), i1 = distribution(generator), i2 = distribution(generator);
+			const Eigen::Vector3d p0(vX[i0], vY[i0], vZ[i0]);
+			const Eigen::Vector3d normal = (Eigen::Vector3d(vX[i1], vY[i1], vZ[i1]) - p0).cross(Eigen::Vector3d(vX[i2], vY[i2], vZ[i2]) - p0);
+			// Skip repeated, collinear and near vertical samples
+			if (std::abs(normal[2]) <= 1.0e-6 * normal.norm()) {
+				continue;
+			}
+			const double A = -normal[0] / normal[2], B = -normal[1] / normal[2];
+			vPlanes.push_back(Eigen::Vector3d(A, B, p0[2] - A * p0[0] - B * p0[1]));
+		}
+		if (vPlanes.empty()) {
+			vPlanes.push_back(Eigen::Vector3d(0.0, 0.0, 0.0));
+		}
+
+		std::vector<size_t> vCounts(vPlanes.size());
+		ThreadPool::GetInstance().ParallelFor(0, vPlanes.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				vCounts[i] = CountInliers(vX.data(), vY.data(), vZ.data(), n, vPlanes[i], options.cThreshold);
+			}
+		});
+		// First of the best, so the result does not depend on the scheduling
+		const Eigen::Vector3d& best = vPlanes[std::max_element(vCounts.begin(), vCounts.end()) - vCounts.begin()];
+		for (size_t i = 0; i < n; ++i) {
+			if (std::abs(vZ[i] - (best[0] * vX[i] + best[1] * vY[i] + best[2])) <= options.cThreshold) {
+				vInliers.push_back(Geometry::Point3D(samples.cvX[i], samples.cvY[i], samples.cvZ[i]));
+			}
+		}
+		if (vInliers.size() < 3) {
+			plane = best;
+			if (pInliers) {
+				*pInliers = vInliers.size();
+			}
+			return true;
+		}
+	}
+
+	if (!VolumeIntegrator::FitPlane(vInliers, origin, plane)) {
+		return false;
+	}
+	if (pInliers) {
+		*pInliers = CountInliers(vX.data(), vY.data(), vZ.data(), n, plane, options.cThreshold);
+	}
+	return true;
+}
+
+size_t PlaneFitter::CountInliers(const double* pX, const double* pY, const double* pZ, size_t n, const Eigen::Vector3d& plane, double threshold) {
+	const double A = plane[0], B = plane[1], C = plane[2];
+	size_t count = 0;
+	size_t i = 0;
+#if defined(__AVX2__)
+	const __m256d vA = _mm256_set1_pd(A), vB = _mm256_set1_pd(B), vC = _mm256_set1_pd(C);
+	const __m256d vThreshold = _mm256_set1_pd(threshold), signMask = _mm256_set1_pd(-0.0);
+	for (; i + 4 <= n; i += 4) {
+		const __m256d z = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vA, _mm256_loadu_pd(pX + i)), _mm256_mul_pd(vB, _mm256_loadu_pd(pY + i))), vC);
+		const __m256d distance = _mm256_andnot_pd(signMask, _mm256_sub_pd(_mm256_loadu_pd(pZ + i), z));
+		count += _mm_popcnt_u32(static_cast<unsigned int>(_mm256_movemask_pd(_mm256_cmp_pd(distance, vThreshold, _CMP_LE_OQ))));
+	}
+#endif
+	for (; i < n; ++i) {
+		count += std::abs(pZ[i] - (A * pX[i] + B * pY[i] + C)) <= threshold;
+	}
+	return count;
+}
@@ -0,0 +1,102 @@
+#include <IconicMeasureCommon/PolygonMeasures.h>
+#include <Eigen/Geometry>
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace iconic;
+
+namespace {
+#if defined(__AVX2__)
+	/**
+	 * @brief Horizontal sum of the four lanes
+	 * @param v Lanes
+	 * @return Sum
+	*/
+	double Sum(__m256d v) {
+		const __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	}
+#endif
+}
+
+void PolygonMeasures::Vertices::Set(const std::vector<Geometry::Point3D>& vPoints) {
+	cvX.resize(vPoints.size());
+	cvY.resize(vPoints.size());
+	cvZ.resize(vPoints.size());
+	for (size_t i = 0; i < vPoints.size(); ++i) {
+		cvX[i] = vPoints[i].get<0>();
+		cvY[i] = vPoints[i].get<1>();
+		cvZ[i] = vPoints[i].get<2>();
+	}
+}
+
+double PolygonMeasures::GetLength(const double* pX, const double* pY, const double* pZ, size_t n, bool bClosed) {
+	if (n < 2) {
+		return 0.0;
+	}
+	double length = 0.0;
+	size_t i = 0;
+#if defined(__AVX2__)
+	__m256d sum = _mm256_setzero_pd();
+	// Edges i..i+3 need vertex i+4
+	for (; i + 4 < n; i += 4) {
+		const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(pX + i + 1), _mm256_loadu_pd(pX + i));
+		const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(pY + i + 1), _mm256_loadu_pd(pY + i));
+		const __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(pZ + i + 1), _mm256_loadu_pd(pZ + i));
+		sum = _mm256_add_pd(sum, _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz))));
+	}
+	length = Sum(sum);
+#endif
+	for (; i + 1 < n; ++i) {
+		const double dx = pX[i + 1] - pX[i], dy = pY[i + 1] - pY[i], dz = pZ[i + 1] - pZ[i];
+		length += std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
+	if (bClosed) {
+		const double dx = pX[0] - pX[n - 1], dy = pY[0] - pY[n - 1], dz = pZ[0] - pZ[n - 1];
+		length += std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
+	return length;
+}
+
+Eigen::Vector3d PolygonMeasures::GetNormal(const double* pX, const double* pY, const double* pZ, size_t n) {
+	Eigen::Vector3d normal(0.0, 0.0, 0.0);
+	if (n < 3) {
+		return normal;
+	}
+	// Relative to the first vertex the edges from and to it add nothing, so only the edges (i,i+1) for 0 < i < n-1 remain
+	const double x0 = pX[0], y0 = pY[0], z0 = pZ[0];
+	size_t i = 1;
+#if defined(__AVX2__)
+	const __m256d vx0 = _mm256_set1_pd(x0), vy0 = _mm256_set1_pd(y0), vz0 = _mm256_set1_pd(z0);
+	__m256d nx = _mm256_setzero_pd(), ny = _mm256_setzero_pd(), nz = _mm256_setzero_pd();
+	for (; i + 4 < n; i += 4) {
+		const __m256d ax = _mm256_sub_pd(_mm256_loadu_pd(pX + i), vx0), bx = _mm256_sub_pd(_mm256_loadu_pd(pX + i + 1), vx0);
+		const __m256d ay = _mm256_sub_pd(_mm256_loadu_pd(pY + i), vy0), by = _mm256_sub_pd(_mm256_loadu_pd(pY + i + 1), vy0);
+		const __m256d az = _mm256_sub_pd(_mm256_loadu_pd(pZ + i), vz0), bz = _mm256_sub_pd(_mm256_loadu_pd(pZ + i + 1), vz0);
+		nx = _mm256_add_pd(nx, _mm256_sub_pd(_mm256_mul_pd(ay, bz), _mm256_mul_pd(az, by)));
+		ny = _mm256_add_pd(ny, _mm256_sub_pd(_mm256_mul_pd(az, bx), _mm256_mul_pd(ax, bz)));
+		nz = _mm256_add_pd(nz, _mm256_sub_pd(_mm256_mul_pd(ax, by), _mm256_mul_pd(ay, bx)));
+	}
+	normal = Eigen::Vector3d(Sum(nx), Sum(ny), Sum(nz));
+#endif
+	for (; i + 1 < n; ++i) {
+		const Eigen::Vector3d a(pX[i] - x0, pY[i] - y0, pZ[i] - z0);
+		const Eigen::Vector3d b(pX[i + 1] - x0, pY[i + 1] - y0, pZ[i + 1] - z0);
+		normal += a.cross(b);
+	}
+	return normal;
+}
+
+double PolygonMeasures::GetArea(const double* pX, const double* pY, const double* pZ, size_t n) {
+	return GetNormal(pX, pY, pZ, n).norm() / 2.0;
+}
+
+double PolygonMeasures::GetLength(const Vertices& vertices, bool bClosed) {
+	return GetLength(vertices.cvX.data(), vertices.cvY.data(), vertices.cvZ.data(), vertices.Size(), bClosed);
+}
+
+double PolygonMeasures::GetArea(const Vertices& vertices) {
+	return GetArea(vertices.cvX.data(), vertices.cvY.data(), vertices.cvZ.data(), vertices.Size());
+}
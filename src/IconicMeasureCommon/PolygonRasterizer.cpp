@@ -0,0 +1,109 @@
+#include <IconicMeasureCommon/PolygonRasterizer.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace iconic;
+
+PolygonRasterizer::PolygonRasterizer() {
+	cSize[0] = cSize[1] = 0;
+	cRows[0] = cRows[1] = 0;
+}
+
+bool PolygonRasterizer::Create(const Geometry::Polygon& pixelPolygon, size_t width, size_t height) {
+	cvEdges.clear();
+	cSize[0] = static_cast<int>(width);
+	cSize[1] = static_cast<int>(height);
+	AddRing(pixelPolygon.outer());
+	for (const Geometry::Polygon::ring_type& inner : pixelPolygon.inners()) {
+		AddRing(inner);
+	}
+	std::sort(cvEdges.begin(), cvEdges.end(), [](const Edge& a, const Edge& b) { return a.cY0 < b.cY0; });
+
+	// Row y is crossed by an edge if cY0 <= y < cY1
+	double yMin = std::numeric_limits<double>::max(), yMax = -std::numeric_limits<double>::max();
+	for (const Edge& edge : cvEdges) {
+		yMin = std::min(yMin, edge.cY0);
+		yMax = std::max(yMax, edge.cY1);
+	}
+	if (cvEdges.empty() || !(yMin < cSize[1]) || !(yMax > 0.0)) {
+		cRows[0] = cRows[1] = 0;
+		return false;
+	}
+	cRows[0] = std::max(0, static_cast<int>(std::ceil(yMin)));
+	cRows[1] = std::min(cSize[1], static_cast<int>(std::ceil(yMax)));
+	return cRows[0] < cRows[1];
+}
+
+void PolygonRasterizer::GetRows(int& y0, int& y1) const {
+	y0 = cRows[0];
+	y1 = cRows[1];
+}
+
+void PolygonRasterizer::GetSpans(int y0, int y1, std::vector<Span>& vSpans) const {
+	vSpans.clear();
+	y0 = std::max(y0, cRows[0]);
+	y1 = std::min(y1, cRows[1]);
+	if (y0 >= y1) {
+		return;
+	}
+
+	// Edges crossing the band. Edges are sorted by cY0, so stop at the first edge starting below the band.
+	std::vector<const Edge*> vActive;
+	for (const Edge& edge : cvEdges) {
+		if (edge.cY0 >= y1) {
+			break;
+		}
+		if (edge.cY1 > y0) {
+			vActive.push_back(&edge);
+		}
+	}
+
+	std::vector<double> vCrossings;
+	vCrossings.reserve(vActive.size());
+	for (int y = y0; y < y1; ++y) {
+		vCrossings.clear();
+		for (const Edge* pEdge : vActive) {
+			if (pEdge->cY0 <= y && y < pEdge->cY1) {
+				vCrossings.push_back(pEdge->cX0 + (y - pEdge->cY0) * pEdge->cDxDy);
+			}
+		}
+		std::sort(vCrossings.begin(), vCrossings.end());
+		// Pixel x is inside a pair of crossings [xa,xb) if xa <= x < xb
+		for (size_t i = 0; i + 1 < vCrossings.size(); i += 2) {
+			const int x0 = std::max(0, static_cast<int>(std::ceil(std::max(vCrossings[i], -1.0))));
+			const int x1 = std::min(cSize[0], static_cast<int>(std::ceil(std::min(vCrossings[i + 1], static_cast<double>(cSize[0])))));
+			if (x0 < x1) {
+				vSpans.push_back({ y, x0, x1 });
+			}
+		}
+	}
+}
+
+void PolygonRasterizer::AddRing(const std::vector<Geometry::Point>& ring) {
+	const size_t n = ring.size();
+	if (n < 3) {
+		return;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		// Also closes open rings. The closing edge of a closed ring has zero length and is skipped.
+		const Geometry::Point& a = ring[i];
+		const Geometry::Point& b = ring[(i + 1) % n];
+		const double ya = a.get<1>(), yb = b.get<1>();
+		if (ya == yb || !std::isfinite(ya) || !std::isfinite(yb)) {
+			continue;
+		}
+		Edge edge;
+		if (ya < yb) {
+			edge.cY0 = ya;
+			edge.cY1 = yb;
+			edge.cX0 = a.get<0>();
+		} else {
+			edge.cY0 = yb;
+			edge.cY1 = ya;
+			edge.cX0 = b.get<0>();
+		}
+		edge.cDxDy = (b.get<0>() - a.get<0>()) / (yb - ya);
+		cvEdges.push_back(edge);
+	}
+}
@@ -1,12 +1,14 @@
 #include <IconicMeasureCommon/Shape.h>
 #include <IconicMeasureCommon/Geometry.h>
 #include <boost/geometry.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/geometry/geometry.hpp>
 #include <boost/geometry/geometries/point.hpp>
 #include <boost/geometry/geometries/polygon.hpp>
 #include <tesselator.h>
 #include <GL/glew.h>
 #include <IconicGpu/Triangulator.h>
+#include <algorithm>
 
 using namespace iconic;
 
@@ -50,6 +52,12 @@ LineShape::~LineShape() {}
 
 PolygonShape::PolygonShape(wxColour c) :
 	Shape(ShapeType::PolygonType, c),
+	cObjectLength(0),
+	cObjectArea(0),
+	cSurfaceArea(0),
+	cbBoundaryPlane(false),
+	cbMoments(false),
+	cRefinementLevel(0),
 	cpTesselator(nullptr),
 	cRenderCoordinates(new Geometry::Polygon),
 	cCoordinates(new Geometry::Polygon3D) {
@@ -57,6 +65,12 @@ PolygonShape::PolygonShape(wxColour c) :
 }
 PolygonShape::PolygonShape(wxColour c, wxString& wkt) :
 	Shape(ShapeType::PolygonType, c),
+	cObjectLength(0),
+	cObjectArea(0),
+	cSurfaceArea(0),
+	cbBoundaryPlane(false),
+	cbMoments(false),
+	cRefinementLevel(0),
 	cpTesselator(nullptr),
 	cRenderCoordinates(new Geometry::Polygon),
 	cCoordinates(new Geometry::Polygon3D)
@@ -69,6 +83,12 @@ PolygonShape::PolygonShape(wxColour c, wxString& wkt) :
 }
 
 PolygonShape::PolygonShape(Geometry::PolygonPtr pPolygon, wxColour c) : Shape(ShapeType::PolygonType, c),
+cObjectLength(0),
+cObjectArea(0),
+cSurfaceArea(0),
+cbBoundaryPlane(false),
+cbMoments(false),
+cRefinementLevel(0),
 cpTesselator(nullptr) {
 	cRenderCoordinates = pPolygon;
 	cCoordinates = Geometry::Polygon3DPtr(new Geometry::Polygon3D);
@@ -114,6 +134,37 @@ double LineShape::GetLength() {
 double PolygonShape::GetLength() {
 	return cLength;
 }
+// GetObjectArea ------------------------------------------------------------------------
+double PointShape::GetObjectArea() {
+	return -1;
+}
+double LineShape::GetObjectArea() {
+	return -1;
+}
+double PolygonShape::GetObjectArea() {
+	return cObjectArea;
+}
+// GetObjectLength -------------------------------------------------------
+double PointShape::GetObjectLength() {
+	return -1;
+}
+double LineShape::GetObjectLength() {
+	// The line is measured on its object coordinates
+	return cLength;
+}
+double PolygonShape::GetObjectLength() {
+	return cObjectLength;
+}
+// GetSurfaceArea --------------------------------------------------------
+double PointShape::GetSurfaceArea() {
+	return -1;
+}
+double LineShape::GetSurfaceArea() {
+	return -1;
+}
+double PolygonShape::GetSurfaceArea() {
+	return cSurfaceArea;
+}
 // GetVolume -------------------------------------------------------------
 double PointShape::GetVolume() {
 	return -1;
@@ -137,46 +188,47 @@ boost::shared_ptr<Geometry::HeightProfile> PolygonShape::GetHeightProfile() {
 // Select -------------------------------------------------------------
 bool PointShape::Select(Geometry::Point mouseClick) {
 	// Add ImageCanvas::GetScale() as argument?
-	if (boost::geometry::distance(mouseClick, cRenderCoordinate) < 0.005f) { // Should depend on the zoom amount
-		return true;
-	} else {
-		return false;
-	}
+	return ShapeAlgorithms::Select(cRenderCoordinate, mouseClick); // Should depend on the zoom amount
 }
 bool LineShape::Select(Geometry::Point mouseClick) {
-	if (boost::geometry::distance(mouseClick, *cRenderCoordinates) < 0.001f) { // Should depend on the zoom amount
-		return true;
-	} else {
-		return false;
-	}
+	return ShapeAlgorithms::Select(*cRenderCoordinates, mouseClick); // Should depend on the zoom amount
 }
 bool PolygonShape::Select(Geometry::Point mouseClick) {
-	return boost::geometry::within(mouseClick, *cRenderCoordinates);
+	return ShapeAlgorithms::Select(*cRenderCoordinates, mouseClick);
+}
+// GetBoundingBox -------------------------------------------------------
+bool PointShape::GetBoundingBox(Geometry::Box& box) {
+	if (!cIsComplete) return false;
+	return ShapeAlgorithms::GetBoundingBox(cRenderCoordinate, box);
+}
+bool LineShape::GetBoundingBox(Geometry::Box& box) {
+	return ShapeAlgorithms::GetBoundingBox(*cRenderCoordinates, box);
+}
+bool PolygonShape::GetBoundingBox(Geometry::Box& box) {
+	return ShapeAlgorithms::GetBoundingBox(*cRenderCoordinates, box);
 }
 // GetPoint -------------------------------------------------------------
 bool PointShape::GetPoint(Geometry::Point mouseClick) {
 	return boost::geometry::distance(mouseClick, cRenderCoordinate) < 0.005f;
 }
 bool LineShape::GetPoint(Geometry::Point mouseClick) {
-	int i = 0;
-	for (Geometry::Point& p : *cRenderCoordinates) {
-		if (boost::geometry::distance(mouseClick, p) < 0.005f) { // Should depend on the zoom amount
-			cSelectedPointIndex = i;
-			return true;
-		}
-		i++;
+	UpdateVertexIndex();
+	size_t index = 0;
+	double distance = 0.0;
+	if (cVertexIndex.GetNearestVertex(mouseClick, index, distance) && distance < 0.005f) { // Should depend on the zoom amount
+		cSelectedPointIndex = static_cast<int>(index);
+		return true;
 	}
 	return false;
 }
 bool PolygonShape::GetPoint(Geometry::Point mouseClick) {
-	int i = 0;
-	for (Geometry::Point& p : cRenderCoordinates->outer()) {
-		if (boost::geometry::distance(mouseClick, p) < 0.005f) { // Should depend on the zoom amount
-			cSelectedPointIndex = i;
-			wxLogVerbose(_("Selected index: " + std::to_string(cSelectedPointIndex)));
-			return true;
-		}
-		i++;
+	UpdateVertexIndex();
+	size_t index = 0;
+	double distance = 0.0;
+	if (cVertexIndex.GetNearestVertex(mouseClick, index, distance) && distance < 0.005f) { // Should depend on the zoom amount
+		cSelectedPointIndex = static_cast<int>(index);
+		wxLogVerbose(_("Selected index: " + std::to_string(cSelectedPointIndex)));
+		return true;
 	}
 	return false;
 }
@@ -375,6 +427,7 @@ bool LineShape::AddPoint(Geometry::Point newPoint, int index) {
 	} else {
 		cRenderCoordinates->push_back(newPoint);
 		cSelectedPointIndex = GetNumberOfPoints() - 1;
+		cVertexIndex.Append(cRenderCoordinates->data(), cRenderCoordinates->size());
 	}
 	return true;
 }
@@ -405,6 +458,9 @@ bool PolygonShape::AddPoint(Geometry::Point newPoint, int index) {
 	return true;
 }
 //UpdateCalculations -----------------------------------------------------------
+void Shape::UpdateCalculations(Geometry& g, size_t level) {
+	UpdateCalculations(g);
+}
 void PointShape::UpdateCalculations(Geometry& g) {
 	if (!cIsComplete) return;
 	if (!g.ImageToObject(cRenderCoordinate, cCoordinate)) {
@@ -430,23 +486,210 @@ void LineShape::UpdateCalculations(Geometry& g) {
 		cLength += sqrt(currLen);
 	}
 
-	//Code for calculating the heightprofile should go here
+	// The profile is kept until the line or the frame changes
+	const auto equals = [](const Geometry::Point& a, const Geometry::Point& b) { return boost::geometry::equals(a, b); };
+	if (cProfile && cProfileLine.size() == cRenderCoordinates->size() && std::equal(cProfileLine.begin(), cProfileLine.end(), cRenderCoordinates->begin(), equals)
+		&& cpProfileDepthMap.lock() == g.cpDepthMap && cProfileCameraMatrix == g.cCameraMatrix) {
+		return;
+	}
+	cProfile = boost::make_shared<Geometry::HeightProfile>();
+	if (!g.GetHeightProfile(*cRenderCoordinates, *cProfile)) {
+		cProfile.reset();
+		return;
+	}
+	cProfileLine = *cRenderCoordinates;
+	cpProfileDepthMap = g.cpDepthMap;
+	cProfileCameraMatrix = g.cCameraMatrix;
+}
+bool LineShape::GetUncertainty(const Geometry& g, const Uncertainty::Options& options, Uncertainty::Result& result) const {
+	return Uncertainty::Estimate(g, *cRenderCoordinates, options, result);
 }
 void PolygonShape::UpdateCalculations(Geometry& g) {
+	UpdateCalculations(g, 0);
+}
+void PolygonShape::UpdateCalculations(Geometry& g, size_t level) {
 	//boost::geometry::correct(*(cRenderCoordinates));
 
-	cCoordinates->clear();
+	Geometry::Polygon::ring_type& ring = cRenderCoordinates->outer();
+	int moved = -1;
 	Geometry::Point3D objectPt;
+	if (GetMovedVertex(g, moved) && (moved < 0 || g.ImageToObject(ring[moved], objectPt))) {
+		if (moved < 0) {
+			return; // Unchanged
+		}
+		// Only one vertex moved, update the sums by the triangles swept by its edges
+		const Geometry::Point previousPt = cCalculatedRing[moved];
+		const size_t n = ring.size() - (boost::geometry::equals(ring.front(), ring.back()) ? 1 : 0);
+		const Geometry::Point& a = ring[(moved + n - 1) % n];
+		const Geometry::Point& b = ring[(moved + 1) % n];
+		cCoordinates->outer()[moved] = objectPt;
+		if (moved == 0 && cCoordinates->outer().size() > n) {
+			cCoordinates->outer().back() = objectPt;
+		}
+		cObjectVertices.cvX[moved] = objectPt.get<0>();
+		cObjectVertices.cvY[moved] = objectPt.get<1>();
+		cObjectVertices.cvZ[moved] = objectPt.get<2>();
+		if (moved == 0 && cObjectVertices.Size() > n) {
+			cObjectVertices.cvX.back() = objectPt.get<0>();
+			cObjectVertices.cvY.back() = objectPt.get<1>();
+			cObjectVertices.cvZ.back() = objectPt.get<2>();
+		}
+		cObjectLength = PolygonMeasures::GetLength(cObjectVertices, true);
+		cObjectArea = PolygonMeasures::GetArea(cObjectVertices);
+		cLength += boost::geometry::distance(a, ring[moved]) + boost::geometry::distance(ring[moved], b) - boost::geometry::distance(a, previousPt) - boost::geometry::distance(previousPt, b);
+		// Shoelace terms of the two edges
+		cArea += ((a.get<0>() * ring[moved].get<1>() - ring[moved].get<0>() * a.get<1>()) + (ring[moved].get<0>() * b.get<1>() - b.get<0>() * ring[moved].get<1>())
+			- (a.get<0>() * previousPt.get<1>() - previousPt.get<0>() * a.get<1>()) - (previousPt.get<0>() * b.get<1>() - b.get<0>() * previousPt.get<1>())) / 2.0;
+		if (FitReferencePlane(g) && VolumeIntegrator::MoveVertex(g, ring, moved, previousPt, cOrigin, cMoments)) {
+			cVolume = VolumeIntegrator::GetVolume(cMoments, cPlane);
+			cSurfaceArea = cMoments.cSurface;
+			SetCalculated(g, true);
+			return;
+		}
+		// The moments may be partly updated, calculate everything again below
+	}
+
+	cCoordinates->clear();
 	for (int i = 0; i < GetNumberOfPoints(); i++) {
 		if (!g.ImageToObject(cRenderCoordinates->outer().at(i), objectPt)) {
 			wxLogError(_("Could not compute image-to-object coordinates for measured point"));
+			SetCalculated(g, false);
 			return;
 		}
 		cCoordinates->outer().push_back(objectPt);
 	}
 	cLength = boost::geometry::perimeter(cRenderCoordinates->outer());
 	cArea = boost::geometry::area(cRenderCoordinates->outer());
-	cVolume = cArea * 5; // Not a correct solution
+	cObjectVertices.Set(cCoordinates->outer());
+	cObjectLength = PolygonMeasures::GetLength(cObjectVertices, true);
+	cObjectArea = PolygonMeasures::GetArea(cObjectVertices);
+
+	// Volume above the reference plane, integrated over the depth map pixels inside the polygon
+	cVolume = 0.0;
+	cSurfaceArea = 0.0;
+	if (cCoordinates->outer().empty()) {
+		SetCalculated(g, false);
+		return;
+	}
+	const Geometry::Point3D& first = cCoordinates->outer().front();
+	cOrigin = Eigen::Vector3d(first.get<0>(), first.get<1>(), first.get<2>());
+	if (level > 0 && VolumeIntegrator::GetLevel(g, level) == 0) {
+		// No depth pyramid to integrate provisionally, and integrating the pixels here would stall editing. The volume is left to the refinement.
+		const bool bPlane = FitReferencePlane(g);
+		SetCalculated(g, false);
+		if (bPlane) {
+			cRefinementLevel = level;
+		}
+		return;
+	}
+	level = VolumeIntegrator::GetLevel(g, level);
+	if (!FitReferencePlane(g) || !VolumeIntegrator::Integrate(g, *cRenderCoordinates, cOrigin, cMoments, level)) {
+		SetCalculated(g, false);
+		return;
+	}
+	cVolume = VolumeIntegrator::GetVolume(cMoments, cPlane);
+	cSurfaceArea = cMoments.cSurface;
+	SetCalculated(g, level == 0);
+	cRefinementLevel = level;
+}
+size_t Shape::GetRefinementLevel() {
+	return 0;
+}
+size_t PolygonShape::GetRefinementLevel() {
+	return cRefinementLevel;
+}
+void PolygonShape::GetRefinementInput(Geometry::Polygon& polygon, Eigen::Vector3d& origin) const {
+	polygon = *cRenderCoordinates;
+	polygon.outer() = cCalculatedRing;
+	origin = cOrigin;
+}
+bool PolygonShape::SetRefinedMoments(const Geometry& g, const Geometry::Polygon& polygon, const VolumeIntegrator::Moments& moments) {
+	const auto equals = [](const Geometry::Point& a, const Geometry::Point& b) { return boost::geometry::equals(a, b); };
+	if (cRefinementLevel == 0 || polygon.outer().size() != cCalculatedRing.size() || !std::equal(cCalculatedRing.begin(), cCalculatedRing.end(), polygon.outer().begin(), equals)
+		|| !IsCalculatedOn(g)) {
+		return false;
+	}
+	cMoments = moments;
+	cVolume = VolumeIntegrator::GetVolume(cMoments, cPlane);
+	cSurfaceArea = cMoments.cSurface;
+	SetCalculated(g, true);
+	return true;
+}
+bool PolygonShape::IsCalculatedOn(const Geometry& g) const {
+	return cpCalculatedDepthMap.lock() == g.cpDepthMap && cCalculatedCameraMatrix == g.cCameraMatrix;
+}
+void PolygonShape::SetReferencePlane(bool bBoundary, const PlaneFitter::Options& options) {
+	cbBoundaryPlane = bBoundary;
+	cPlaneOptions = options;
+	cbMoments = false; // Calculate everything again
+}
+void PolygonShape::GetRenderPolygon(Geometry::Polygon& polygon) const {
+	polygon = *cRenderCoordinates;
+}
+bool PolygonShape::GetZonalStatistics(const Geometry& g, ZonalStatistics::Statistics& statistics, size_t bins) const {
+	return ZonalStatistics::Compute(g, *cRenderCoordinates, statistics, bins);
+}
+bool PolygonShape::GetUncertainty(const Geometry& g, const Uncertainty::Options& options, Uncertainty::Result& result) const {
+	if (cbBoundaryPlane && !cRenderCoordinates->outer().empty()) {
+		// The boundary plane rests on many samples, so it is kept for all draws
+		Geometry::Point3D first;
+		PlaneFitter::Samples samples;
+		Eigen::Vector3d plane;
+		if (g.ImageToObject(cRenderCoordinates->outer().front(), first) && PlaneFitter::SampleBoundary(g, *cRenderCoordinates, cPlaneOptions.cBandWidth, samples)
+			&& PlaneFitter::Fit(samples, Eigen::Vector3d(first.get<0>(), first.get<1>(), first.get<2>()), cPlaneOptions, plane)) {
+			return Uncertainty::Estimate(g, *cRenderCoordinates, options, result, &plane);
+		}
+		wxLogVerbose(_("Too few valid depth values along the polygon boundary, the reference plane is fitted to the vertices"));
+	}
+	return Uncertainty::Estimate(g, *cRenderCoordinates, options, result);
+}
+bool PolygonShape::GetMovedVertex(const Geometry& g, int& moved) const {
+	moved = -1;
+	const Geometry::Polygon::ring_type& ring = cRenderCoordinates->outer();
+	if (!cbMoments || !cRenderCoordinates->inners().empty() || ring.size() != cCalculatedRing.size() || ring.size() < 4 || !IsCalculatedOn(g)) {
+		return false;
+	}
+	// The closing vertex follows the first one
+	const size_t n = ring.size() - (boost::geometry::equals(ring.front(), ring.back()) ? 1 : 0);
+	for (size_t i = 0; i < n; ++i) {
+		if (!boost::geometry::equals(ring[i], cCalculatedRing[i])) {
+			if (moved >= 0) {
+				return false;
+			}
+			moved = static_cast<int>(i);
+		}
+	}
+	return true;
+}
+void PolygonShape::SetCalculated(const Geometry& g, bool bMoments) {
+	cbMoments = bMoments;
+	cRefinementLevel = 0;
+	cCalculatedRing = cRenderCoordinates->outer();
+	cpCalculatedDepthMap = g.cpDepthMap;
+	cCalculatedCameraMatrix = g.cCameraMatrix;
+}
+bool PolygonShape::FitReferencePlane(const Geometry& g) {
+	if (cbBoundaryPlane) {
+		PlaneFitter::Samples samples;
+		if (PlaneFitter::SampleBoundary(g, *cRenderCoordinates, cPlaneOptions.cBandWidth, samples) && PlaneFitter::Fit(samples, cOrigin, cPlaneOptions, cPlane)) {
+			return true;
+		}
+		wxLogVerbose(_("Too few valid depth values along the polygon boundary, the reference plane is fitted to the vertices"));
+	}
+	return VolumeIntegrator::FitPlane(cCoordinates->outer(), cOrigin, cPlane);
+}
+void LineShape::UpdateVertexIndex() {
+	if (!cVertexIndex.IsValid(cRenderCoordinates->size(), false)) {
+		cVertexIndex.Build(cRenderCoordinates->data(), cRenderCoordinates->size(), false);
+	}
+}
+void PolygonShape::UpdateVertexIndex() {
+	const Geometry::Polygon::ring_type& ring = cRenderCoordinates->outer();
+	const bool bClosed = IsCompleted();
+	const size_t n = ring.size() - (bClosed ? 1 : 0);
+	if (!cVertexIndex.IsValid(n, bClosed)) {
+		cVertexIndex.Build(ring.data(), n, bClosed);
+	}
 }
 void PolygonShape::Tesselate() {
 	if (IsCompleted()) {
@@ -512,72 +755,28 @@ int PointShape::GetPossibleIndex(Geometry::Point mousePoint) {
 int LineShape::GetPossibleIndex(Geometry::Point mousePoint) {
 	if (!IsCompleted()) return 0;
 	if (!cFinished) return cNextInsertIndex = GetNumberOfPoints() + 1;
-	int shortestIndex = 0;
-	double shortestDistance = boost::geometry::distance(cRenderCoordinates->at(0), mousePoint);
-	double currentDistance = 0;
-	for (size_t i = 0; i < cRenderCoordinates->size(); i++) {
-		currentDistance = boost::geometry::distance(cRenderCoordinates->at(i), mousePoint);
-		if (currentDistance < shortestDistance) {
-			shortestDistance = currentDistance;
-			shortestIndex = i;
-		}
-	}
-
-	double preDistance, postDistance = 0;
-	preDistance = boost::geometry::distance(GetRenderingPoint(shortestIndex - 1), mousePoint); // GetRenderPoint loops back to the last element for index -1
-	if (shortestIndex == 0) {
-		Geometry::Point diff1(GetRenderingPoint(1).get<0>() - GetRenderingPoint(0).get<0>(), GetRenderingPoint(1).get<1>() - GetRenderingPoint(0).get<1>());
-		Geometry::Point diff2(mousePoint.get<0>() - GetRenderingPoint(0).get<0>(), mousePoint.get<1>() - GetRenderingPoint(0).get<1>());
-		if (boost::geometry::dot_product(diff1, diff2) > 0) return cNextInsertIndex = shortestIndex + 1;
-		else return cNextInsertIndex = shortestIndex;
-	} else if (shortestIndex == GetNumberOfPoints() - 1) {
-		Geometry::Point diff1(GetRenderingPoint(shortestIndex - 1).get<0>() - GetRenderingPoint(shortestIndex).get<0>(), GetRenderingPoint(shortestIndex - 1).get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		Geometry::Point diff2(mousePoint.get<0>() - GetRenderingPoint(shortestIndex).get<0>(), mousePoint.get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		if (boost::geometry::dot_product(diff1, diff2) > 0) return cNextInsertIndex = shortestIndex;
-		else return cNextInsertIndex = shortestIndex + 1;
-	} else {
-		Geometry::Point diff1(GetRenderingPoint(shortestIndex - 1).get<0>() - GetRenderingPoint(shortestIndex).get<0>(), GetRenderingPoint(shortestIndex - 1).get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		Geometry::Point diff2(GetRenderingPoint(shortestIndex + 1).get<0>() - GetRenderingPoint(shortestIndex).get<0>(), GetRenderingPoint(shortestIndex + 1).get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		Geometry::Point diff3(mousePoint.get<0>() - GetRenderingPoint(shortestIndex).get<0>(), mousePoint.get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		if (boost::geometry::dot_product(diff1, diff3) > boost::geometry::dot_product(diff2, diff3)) return cNextInsertIndex = shortestIndex;
-		else return cNextInsertIndex = shortestIndex + 1;
-	}
+	UpdateVertexIndex();
+	size_t segment = 0;
+	double distance = 0.0;
+	cVertexIndex.GetNearestSegment(mousePoint, segment, distance);
+	// Inserted between the ends of the nearest segment, or before the first or after the last vertex if the mouse is beyond the ends of the line
+	const Geometry::Point& a = cRenderCoordinates->at(segment);
+	const Geometry::Point& b = cRenderCoordinates->at(segment + 1);
+	const double dx = b.get<0>() - a.get<0>(), dy = b.get<1>() - a.get<1>();
+	const double along = (mousePoint.get<0>() - a.get<0>()) * dx + (mousePoint.get<1>() - a.get<1>()) * dy;
+	if (segment == 0 && along <= 0.0) return cNextInsertIndex = 0;
+	if (segment + 2 == cRenderCoordinates->size() && along >= dx * dx + dy * dy) return cNextInsertIndex = GetNumberOfPoints();
+	return cNextInsertIndex = static_cast<int>(segment) + 1;
 }
 int PolygonShape::GetPossibleIndex(Geometry::Point mousePoint) {
 	if (!IsCompleted()) return 0;
 	if (!cFinished) return cNextInsertIndex = GetNumberOfPoints() - 1;
-	int shortestIndex = 0;
-	double shortestDistance = boost::geometry::distance(cRenderCoordinates->outer().at(0), mousePoint);
-	double currentDistance = 0;
-	for (size_t i = 0; i < GetNumberOfPoints(); i++) {
-		currentDistance = boost::geometry::distance(cRenderCoordinates->outer().at(i), mousePoint);
-		if (currentDistance < shortestDistance) {
-			shortestDistance = currentDistance;
-			shortestIndex = i;
-		}
-	}
-	double preDistance, postDistance = 0;
-	preDistance = boost::geometry::distance(GetRenderingPoint(shortestIndex - 1), mousePoint); // GetRenderPoint loops back to the last element for index -1
-	if (shortestIndex == 0) {
-		Geometry::Point diff1(GetRenderingPoint(GetNumberOfPoints() - 2).get<0>() - GetRenderingPoint(shortestIndex).get<0>(), GetRenderingPoint(GetNumberOfPoints() - 2).get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		Geometry::Point diff2(GetRenderingPoint(shortestIndex + 1).get<0>() - GetRenderingPoint(shortestIndex).get<0>(), GetRenderingPoint(shortestIndex + 1).get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		Geometry::Point diff3(mousePoint.get<0>() - GetRenderingPoint(shortestIndex).get<0>(), mousePoint.get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		if (boost::geometry::dot_product(diff1, diff3) > boost::geometry::dot_product(diff2, diff3)) return cNextInsertIndex = shortestIndex;
-		else return cNextInsertIndex = shortestIndex + 1;
-
-	} else if (shortestIndex == GetNumberOfPoints() - 1) {
-		Geometry::Point diff1(GetRenderingPoint(shortestIndex - 1).get<0>() - GetRenderingPoint(shortestIndex).get<0>(), GetRenderingPoint(shortestIndex - 1).get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		Geometry::Point diff2(GetRenderingPoint(1).get<0>() - GetRenderingPoint(shortestIndex).get<0>(), GetRenderingPoint(1).get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		Geometry::Point diff3(mousePoint.get<0>() - GetRenderingPoint(shortestIndex).get<0>(), mousePoint.get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		if (boost::geometry::dot_product(diff1, diff3) > boost::geometry::dot_product(diff2, diff3)) return cNextInsertIndex = shortestIndex;
-		else return cNextInsertIndex = shortestIndex + 1;
-	} else {
-		Geometry::Point diff1(GetRenderingPoint(shortestIndex - 1).get<0>() - GetRenderingPoint(shortestIndex).get<0>(), GetRenderingPoint(shortestIndex - 1).get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		Geometry::Point diff2(GetRenderingPoint(shortestIndex + 1).get<0>() - GetRenderingPoint(shortestIndex).get<0>(), GetRenderingPoint(shortestIndex + 1).get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		Geometry::Point diff3(mousePoint.get<0>() - GetRenderingPoint(shortestIndex).get<0>(), mousePoint.get<1>() - GetRenderingPoint(shortestIndex).get<1>());
-		if (boost::geometry::dot_product(diff1, diff3) > boost::geometry::dot_product(diff2, diff3)) return cNextInsertIndex = shortestIndex;
-		else return cNextInsertIndex = shortestIndex + 1;
-	}
+	UpdateVertexIndex();
+	size_t segment = 0;
+	double distance = 0.0;
+	cVertexIndex.GetNearestSegment(mousePoint, segment, distance);
+	// Inserted between the ends of the nearest edge. The closing edge ends at the closing vertex, so the point goes before it.
+	return cNextInsertIndex = static_cast<int>(segment) + 1;
 }
 // DeselectPoint --------------------------------------------------------------------
 void PointShape::DeselectPoint() {
@@ -596,31 +795,39 @@ void PointShape::MoveSelectedPoint(Geometry::Point mousePoint) {
 }
 void LineShape::MoveSelectedPoint(Geometry::Point mousePoint) {
 	if (cSelectedPointIndex < 0 || !IsCompleted()) return;
+	const Geometry::Point previousPt = cRenderCoordinates->at(cSelectedPointIndex);
 	cRenderCoordinates->at(cSelectedPointIndex) = mousePoint;
+	cVertexIndex.Move(cRenderCoordinates->data(), cRenderCoordinates->size(), cSelectedPointIndex, previousPt);
 }
 void PolygonShape::MoveSelectedPoint(Geometry::Point mousePoint) {
 	if (cSelectedPointIndex < 0) return;
-	cRenderCoordinates->outer().at(cSelectedPointIndex) = mousePoint;
+	Geometry::Polygon::ring_type& ring = cRenderCoordinates->outer();
+	const Geometry::Point previousPt = ring.at(cSelectedPointIndex);
+	ring.at(cSelectedPointIndex) = mousePoint;
 	if (IsCompleted()) {
 		if (cSelectedPointIndex == 0)cRenderCoordinates->outer().back() = mousePoint;
 		if (cSelectedPointIndex == GetNumberOfPoints() - 1)cRenderCoordinates->outer().front() = mousePoint;
+		// The closing vertex is not indexed, it moves with the first
+		cVertexIndex.Move(ring.data(), ring.size() - 1, cSelectedPointIndex % (ring.size() - 1), previousPt);
+	} else {
+		cVertexIndex.Move(ring.data(), ring.size(), cSelectedPointIndex, previousPt);
 	}
 	Tesselate();
 }
 // GetWKT ----------------------------------------------------------------
 bool PointShape::GetWKT(std::string& wkt) {
 	if (!cIsComplete) return false;
-	wkt = boost::geometry::to_wkt(cRenderCoordinate);
+	ShapeAlgorithms::GetWKT(cRenderCoordinate, wkt);
 	return true;
 }
 bool LineShape::GetWKT(std::string& wkt) {
 	if (!IsCompleted()) return false;
-	wkt = boost::geometry::to_wkt(*cRenderCoordinates.get());
+	ShapeAlgorithms::GetWKT(*cRenderCoordinates, wkt);
 	return true;
 }
 bool PolygonShape::GetWKT(std::string& wkt) {
 	if (!IsCompleted()) return false;
-	wkt = boost::geometry::to_wkt(*cRenderCoordinates.get());
+	ShapeAlgorithms::GetWKT(*cRenderCoordinates, wkt);
 	return true;
 }
 
@@ -0,0 +1,57 @@
+#include <IconicMeasureCommon/ShapeAlgorithms.h>
+#include <boost/geometry.hpp>
+#include <sstream>
+
+using namespace iconic;
+
+namespace {
+	const double cPointSelectDistance = 0.005; //!< Largest distance from a point at which it is selected
+	const double cLineSelectDistance = 0.001; //!< Largest distance from a line at which it is selected
+
+	/**
+	 * @brief Write a geometry as WKT
+	 * @param shape The geometry
+	 * @param wkt Gets the WKT
+	*/
+	template<typename T> void ToWKT(const T& shape, std::string& wkt) {
+		std::ostringstream stream;
+		stream << boost::geometry::wkt(shape);
+		wkt = stream.str();
+	}
+}
+
+// Select -------------------------------------------------------------
+bool ShapeAlgorithms::Select(const Geometry::Point& shape, const Geometry::Point& pt) {
+	return boost::geometry::distance(pt, shape) < cPointSelectDistance;
+}
+bool ShapeAlgorithms::Select(const Geometry::VectorTrain& shape, const Geometry::Point& pt) {
+	return !shape.empty() && boost::geometry::distance(pt, shape) < cLineSelectDistance;
+}
+bool ShapeAlgorithms::Select(const Geometry::Polygon& shape, const Geometry::Point& pt) {
+	return boost::geometry::within(pt, shape);
+}
+// GetBoundingBox -------------------------------------------------------
+bool ShapeAlgorithms::GetBoundingBox(const Geometry::Point& shape, Geometry::Box& box) {
+	box = Geometry::Box(shape, shape);
+	return true;
+}
+bool ShapeAlgorithms::GetBoundingBox(const Geometry::VectorTrain& shape, Geometry::Box& box) {
+	if (shape.empty()) return false;
+	boost::geometry::envelope(shape, box);
+	return true;
+}
+bool ShapeAlgorithms::GetBoundingBox(const Geometry::Polygon& shape, Geometry::Box& box) {
+	if (shape.outer().empty()) return false;
+	boost::geometry::envelope(shape.outer(), box);
+	return true;
+}
+// GetWKT ----------------------------------------------------------------
+void ShapeAlgorithms::GetWKT(const Geometry::Point& shape, std::string& wkt) {
+	ToWKT(shape, wkt);
+}
+void ShapeAlgorithms::GetWKT(const Geometry::VectorTrain& shape, std::string& wkt) {
+	ToWKT(shape, wkt);
+}
+void ShapeAlgorithms::GetWKT(const Geometry::Polygon& shape, std::string& wkt) {
+	ToWKT(shape, wkt);
+}
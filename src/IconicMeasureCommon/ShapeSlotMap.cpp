@@ -0,0 +1,128 @@
+#include <IconicMeasureCommon/ShapeSlotMap.h>
+#include <utility>
+
+using namespace iconic;
+
+ShapeHandle::ShapeHandle() : cIndex(0), cGeneration(0) {}
+
+ShapeHandle::ShapeHandle(uint32_t index, uint32_t generation) : cIndex(index), cGeneration(generation) {}
+
+bool ShapeHandle::IsNull() const {
+	return cGeneration == 0;
+}
+
+bool ShapeHandle::operator==(const ShapeHandle& other) const {
+	return cIndex == other.cIndex && cGeneration == other.cGeneration;
+}
+
+bool ShapeHandle::operator!=(const ShapeHandle& other) const {
+	return !(*this == other);
+}
+
+const size_t ShapeSlotMap::npos;
+const uint32_t ShapeSlotMap::cHole;
+
+ShapeSlotMap::ShapeSlotMap() : cHoles(0), cFreeSlot(0) {}
+
+ShapeHandle ShapeSlotMap::Insert(const ShapePtr& pShape) {
+	if (cFreeSlot == cvSlots.size()) {
+		// Generation 0 is the null handle
+		const Slot slot = { static_cast<uint32_t>(cvSlots.size() + 1), 1 };
+		cvSlots.push_back(slot);
+	}
+	const uint32_t index = cFreeSlot;
+	Slot& slot = cvSlots[index];
+	cFreeSlot = slot.cPosition;
+	slot.cPosition = static_cast<uint32_t>(cvShapes.size());
+	cvShapes.push_back(pShape);
+	cvPositionSlots.push_back(index);
+	return ShapeHandle(index, slot.cGeneration);
+}
+
+bool ShapeSlotMap::Erase(const ShapeHandle& handle) {
+	if (!Contains(handle)) {
+		return false;
+	}
+	Slot& slot = cvSlots[handle.cIndex];
+	const uint32_t position = slot.cPosition;
+
+	// Moving the other shapes now would make erasing many shapes quadratic, see Compact
+	cvShapes[position].reset();
+	cvPositionSlots[position] = cHole;
+	++cHoles;
+
+	slot.cPosition = cFreeSlot;
+	slot.cGeneration = slot.cGeneration == std::numeric_limits<uint32_t>::max() ? 1 : slot.cGeneration + 1;
+	cFreeSlot = handle.cIndex;
+	return true;
+}
+
+void ShapeSlotMap::Clear() {
+	for (uint32_t index : cvPositionSlots) {
+		if (index == cHole) {
+			continue;
+		}
+		Slot& slot = cvSlots[index];
+		slot.cGeneration = slot.cGeneration == std::numeric_limits<uint32_t>::max() ? 1 : slot.cGeneration + 1;
+	}
+	for (size_t i = 0; i < cvSlots.size(); ++i) {
+		cvSlots[i].cPosition = static_cast<uint32_t>(i + 1);
+	}
+	cFreeSlot = 0;
+	cvShapes.clear();
+	cvPositionSlots.clear();
+	cHoles = 0;
+}
+
+ShapePtr ShapeSlotMap::Get(const ShapeHandle& handle) const {
+	return Contains(handle) ? cvShapes[cvSlots[handle.cIndex].cPosition] : ShapePtr();
+}
+
+bool ShapeSlotMap::Contains(const ShapeHandle& handle) const {
+	// The generation of a free slot was increased when its shape was erased, so it matches no handle
+	return !handle.IsNull() && handle.cIndex < cvSlots.size() && cvSlots[handle.cIndex].cGeneration == handle.cGeneration;
+}
+
+size_t ShapeSlotMap::GetPosition(const ShapeHandle& handle) const {
+	if (!Contains(handle)) {
+		return npos;
+	}
+	Compact();
+	return cvSlots[handle.cIndex].cPosition;
+}
+
+ShapeHandle ShapeSlotMap::GetHandle(size_t position) const {
+	Compact();
+	const uint32_t index = cvPositionSlots.at(position);
+	return ShapeHandle(index, cvSlots[index].cGeneration);
+}
+
+size_t ShapeSlotMap::Size() const {
+	return cvShapes.size() - cHoles;
+}
+
+const std::vector<ShapePtr>& ShapeSlotMap::GetShapes() const {
+	Compact();
+	return cvShapes;
+}
+
+void ShapeSlotMap::Compact() const {
+	if (!cHoles) {
+		return;
+	}
+	size_t n = 0;
+	for (size_t i = 0; i < cvShapes.size(); ++i) {
+		if (cvPositionSlots[i] == cHole) {
+			continue;
+		}
+		if (n != i) {
+			cvShapes[n] = std::move(cvShapes[i]);
+			cvPositionSlots[n] = cvPositionSlots[i];
+			cvSlots[cvPositionSlots[n]].cPosition = static_cast<uint32_t>(n);
+		}
+		++n;
+	}
+	cvShapes.resize(n);
+	cvPositionSlots.resize(n);
+	cHoles = 0;
+}
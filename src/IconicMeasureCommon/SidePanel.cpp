@@ -11,36 +11,41 @@ iconic::SidePanel::SidePanel(wxWindow* parent) : wxScrolled<wxPanel>(parent, wxI
 	SetSizer(cSizer);
 }
 SidePanel::~SidePanel() {
-	for (wxPanel* p : cvPanels) {
-		p->Destroy();
+	for (const std::pair<ShapeHandle, wxPanel*>& panel : cvPanels) {
+		if (panel.second) {
+			panel.second->Destroy();
+		}
 	}
 }
 
 void SidePanel::Update(DataUpdateEvent& e) {
 	Freeze();
 	ShapePtr shape = e.GetShape();
+	wxPanel* panel = GetPanel(e.GetHandle());
 	if (e.IsDeletionEvent()) {
-		if (e.GetIndex() == -1) {
-			for (wxPanel* p : cvPanels) {
-				p->Destroy();
+		if (e.GetHandle().IsNull()) {
+			for (const std::pair<ShapeHandle, wxPanel*>& p : cvPanels) {
+				if (p.second) {
+					p.second->Destroy();
+				}
 			}
 			cvPanels.clear();
-		} else {
-			cvPanels.at(e.GetIndex())->Destroy();
-			cvPanels.erase(cvPanels.begin() + e.GetIndex());
+		} else if (panel) {
+			panel->Destroy();
+			cvPanels[e.GetHandle().cIndex].second = nullptr;
 		}
-	} else if (!(e.GetIndex() < cvPanels.size())) {
-		CreatePanel(shape);
+	} else if (!panel) {
+		CreatePanel(e.GetHandle(), shape, e.GetRefinementLevel() > 0);
 	} else {
 		switch (shape->GetType()) {
 		case iconic::ShapeType::PointType:
-			UpdatePointPanel(cvPanels.at(e.GetIndex()), shape);
+			UpdatePointPanel(panel, shape);
 			break;
 		case iconic::ShapeType::LineType:
-			UpdateLinePanel(cvPanels.at(e.GetIndex()), shape);
+			UpdateLinePanel(panel, shape);
 			break;
 		case iconic::ShapeType::PolygonType:
-			UpdatePolygonPanel(cvPanels.at(e.GetIndex()), shape);
+			UpdatePolygonPanel(panel, shape, e.GetRefinementLevel() > 0);
 			break;
 		}
 	}
@@ -49,6 +54,13 @@ void SidePanel::Update(DataUpdateEvent& e) {
 	e.Skip(); // Ensures that other handlers gets the event
 }
 
+wxPanel* SidePanel::GetPanel(const ShapeHandle& handle) const {
+	if (handle.IsNull() || handle.cIndex >= cvPanels.size() || cvPanels[handle.cIndex].first != handle) {
+		return nullptr;
+	}
+	return cvPanels[handle.cIndex].second;
+}
+
 void SidePanel::UpdatePointPanel(wxPanel* panel, ShapePtr shape) {
 	Geometry::Point3D p;
 	shape->GetCoordinate(p);
@@ -61,28 +73,43 @@ void SidePanel::UpdateLinePanel(wxPanel* panel, ShapePtr shape) {
 	wxWindow::FindWindowByName(wxString("length_value"), panel)->SetLabel(wxString(std::to_string(shape->GetLength())));
 }
 
-void SidePanel::UpdatePolygonPanel(wxPanel* panel, ShapePtr shape) {
+void SidePanel::UpdatePolygonPanel(wxPanel* panel, ShapePtr shape, bool bProvisional) {
 	wxWindow::FindWindowByName(wxString("length_value"), panel)->SetLabel(wxString(std::to_string(shape->GetLength())));
 	wxWindow::FindWindowByName(wxString("area_value"), panel)->SetLabel(wxString(std::to_string(shape->GetArea())));
-	wxWindow::FindWindowByName(wxString("volume_value"), panel)->SetLabel(wxString(std::to_string(shape->GetVolume())));
+	wxWindow::FindWindowByName(wxString("object_length_value"), panel)->SetLabel(wxString(std::to_string(shape->GetObjectLength())));
+	wxWindow::FindWindowByName(wxString("object_area_value"), panel)->SetLabel(wxString(std::to_string(shape->GetObjectArea())));
+	wxWindow::FindWindowByName(wxString("volume_value"), panel)->SetLabel(wxString(bProvisional ? "~" : "") + wxString(std::to_string(shape->GetVolume())));
+	wxWindow::FindWindowByName(wxString("surface_value"), panel)->SetLabel(wxString(bProvisional ? "~" : "") + wxString(std::to_string(shape->GetSurfaceArea())));
 }
 
-void SidePanel::CreatePanel(ShapePtr shape) {
+void SidePanel::CreatePanel(const ShapeHandle& handle, ShapePtr shape, bool bProvisional) {
+	wxPanel* panel = nullptr;
 	switch (shape->GetType()) {
 	case iconic::ShapeType::PointType:
-		CreatePointPanel(shape);
+		panel = CreatePointPanel(shape);
 		break;
 	case iconic::ShapeType::LineType:
-		CreateLinePanel(shape);
+		panel = CreateLinePanel(shape);
 		break;
 	case iconic::ShapeType::PolygonType:
-		CreatePolygonPanel(shape);
+		panel = CreatePolygonPanel(shape, bProvisional);
 		break;
 	}
+	if (!panel) {
+		return;
+	}
+	if (handle.cIndex >= cvPanels.size()) {
+		cvPanels.resize(handle.cIndex + 1, std::pair<ShapeHandle, wxPanel*>(ShapeHandle(), nullptr));
+	}
+	// A panel left by an erased shape in the same slot is replaced
+	if (cvPanels[handle.cIndex].second) {
+		cvPanels[handle.cIndex].second->Destroy();
+	}
+	cvPanels[handle.cIndex] = std::make_pair(handle, panel);
 }
 
 
-void iconic::SidePanel::CreatePointPanel(ShapePtr shape) {
+wxPanel* iconic::SidePanel::CreatePointPanel(ShapePtr shape) {
 	// Parent window is the sidepanel
 	wxPanel* panel = new wxPanel(this, wxID_ANY, wxDefaultPosition, wxSize(200, 200));
 	panel->SetBackgroundColour(shape->GetColor());
@@ -134,10 +161,10 @@ void iconic::SidePanel::CreatePointPanel(ShapePtr shape) {
 	panel->SetSizerAndFit(sizer);
 	GetSizer()->Add(panel, 0, wxEXPAND | wxALL, 10);
 
-	cvPanels.push_back(panel);
+	return panel;
 }
 
-void iconic::SidePanel::CreateLinePanel(ShapePtr shape) {
+wxPanel* iconic::SidePanel::CreateLinePanel(ShapePtr shape) {
 	// Parent window is the sidepanel
 	wxPanel* panel = new wxPanel(this, wxID_ANY, wxDefaultPosition, wxSize(200, 200));
 	panel->SetBackgroundColour(shape->GetColor());
@@ -166,10 +193,10 @@ void iconic::SidePanel::CreateLinePanel(ShapePtr shape) {
 	panel->SetSizerAndFit(sizer);
 	GetSizer()->Add(panel, 0, wxEXPAND | wxALL, 10);
 
-	cvPanels.push_back(panel);
+	return panel;
 }
 
-void iconic::SidePanel::CreatePolygonPanel(ShapePtr shape) {
+wxPanel* iconic::SidePanel::CreatePolygonPanel(ShapePtr shape, bool bProvisional) {
 	// Parent window is the sidepanel
 	wxPanel* panel = new wxPanel(this, wxID_ANY, wxDefaultPosition, wxSize(200, 200));
 	wxSizer* sizer = new wxBoxSizer(wxVERTICAL);
@@ -198,20 +225,47 @@ void iconic::SidePanel::CreatePolygonPanel(ShapePtr shape) {
 	area_sizer->Add(area_value, 0, wxALIGN_CENTER_VERTICAL);
 	area_panel->SetSizerAndFit(area_sizer);
 
+	wxSizer* object_length_sizer = new wxBoxSizer(wxHORIZONTAL);
+	wxPanel* object_length_panel = new wxPanel(panel, wxID_ANY);
+	wxStaticText* object_length_label = new wxStaticText(object_length_panel, wxID_ANY, wxString("Object perimeter: "));
+	wxStaticText* object_length_value = new wxStaticText(object_length_panel, wxID_ANY, wxString(std::to_string(shape->GetObjectLength())), wxDefaultPosition, wxDefaultSize, 0L, wxString("object_length_value"));
+	object_length_sizer->Add(object_length_label, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+	object_length_sizer->Add(object_length_value, 0, wxALIGN_CENTER_VERTICAL);
+	object_length_panel->SetSizerAndFit(object_length_sizer);
+
+	wxSizer* object_area_sizer = new wxBoxSizer(wxHORIZONTAL);
+	wxPanel* object_area_panel = new wxPanel(panel, wxID_ANY);
+	wxStaticText* object_area_label = new wxStaticText(object_area_panel, wxID_ANY, wxString("Object area: "));
+	wxStaticText* object_area_value = new wxStaticText(object_area_panel, wxID_ANY, wxString(std::to_string(shape->GetObjectArea())), wxDefaultPosition, wxDefaultSize, 0L, wxString("object_area_value"));
+	object_area_sizer->Add(object_area_label, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+	object_area_sizer->Add(object_area_value, 0, wxALIGN_CENTER_VERTICAL);
+	object_area_panel->SetSizerAndFit(object_area_sizer);
+
 	wxSizer* volume_sizer = new wxBoxSizer(wxHORIZONTAL);
 	wxPanel* volume_panel = new wxPanel(panel, wxID_ANY);
 	wxStaticText* volume_label = new wxStaticText(volume_panel, wxID_ANY, wxString("Volume: "));
-	wxStaticText* volume_value = new wxStaticText(volume_panel, wxID_ANY, wxString(std::to_string(shape->GetVolume())), wxDefaultPosition, wxDefaultSize, 0L, wxString("volume_value"));
+	wxStaticText* volume_value = new wxStaticText(volume_panel, wxID_ANY, wxString(bProvisional ? "~" : "") + wxString(std::to_string(shape->GetVolume())), wxDefaultPosition, wxDefaultSize, 0L, wxString("volume_value"));
 	volume_sizer->Add(volume_label, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
 	volume_sizer->Add(volume_value, 0, wxALIGN_CENTER_VERTICAL);
 	volume_panel->SetSizerAndFit(volume_sizer);
 
+	wxSizer* surface_sizer = new wxBoxSizer(wxHORIZONTAL);
+	wxPanel* surface_panel = new wxPanel(panel, wxID_ANY);
+	wxStaticText* surface_label = new wxStaticText(surface_panel, wxID_ANY, wxString("Surface area: "));
+	wxStaticText* surface_value = new wxStaticText(surface_panel, wxID_ANY, wxString(bProvisional ? "~" : "") + wxString(std::to_string(shape->GetSurfaceArea())), wxDefaultPosition, wxDefaultSize, 0L, wxString("surface_value"));
+	surface_sizer->Add(surface_label, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+	surface_sizer->Add(surface_value, 0, wxALIGN_CENTER_VERTICAL);
+	surface_panel->SetSizerAndFit(surface_sizer);
+
 	sizer->Add(label, 0, wxEXPAND | wxALL, 10);
 	sizer->Add(length_panel, 0, wxEXPAND | wxALL, 10);
 	sizer->Add(area_panel, 0, wxEXPAND | wxALL, 10);
+	sizer->Add(object_length_panel, 0, wxEXPAND | wxALL, 10);
+	sizer->Add(object_area_panel, 0, wxEXPAND | wxALL, 10);
 	sizer->Add(volume_panel, 0, wxEXPAND | wxALL, 10);
+	sizer->Add(surface_panel, 0, wxEXPAND | wxALL, 10);
 
 	panel->SetSizerAndFit(sizer);
 	GetSizer()->Add(panel, 0, wxEXPAND | wxALL, 10);
-	cvPanels.push_back(panel);
+	return panel;
 }
\ No newline at end of file
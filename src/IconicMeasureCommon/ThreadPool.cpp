@@ -0,0 +1,112 @@
+#include <IconicMeasureCommon/ThreadPool.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+using namespace iconic;
+
+ThreadPool::ThreadPool(size_t nThreads) : cbStop(false) {
+	for (size_t i = 0; i < nThreads; ++i) {
+		cvThreads.emplace_back(&ThreadPool::Run, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(cMutex);
+		cbStop = true;
+	}
+	cWork.notify_all();
+	for (std::thread& thread : cvThreads) {
+		thread.join();
+	}
+}
+
+ThreadPool& ThreadPool::GetInstance() {
+	static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+	return pool;
+}
+
+size_t ThreadPool::GetNumberOfThreads() const {
+	return cvThreads.size();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> lock(cMutex);
+		cQueue.push_back(std::move(task));
+	}
+	cWork.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t grainSize) {
+	if (end <= begin) {
+		return;
+	}
+	const size_t n = end - begin;
+	grainSize = std::max<size_t>(grainSize, 1);
+	// A few chunks per thread evens out chunks that take different time
+	const size_t maxChunks = std::min((n + grainSize - 1) / grainSize, 4 * (cvThreads.size() + 1));
+	const size_t chunkSize = (n + maxChunks - 1) / maxChunks;
+	const size_t nChunks = (n + chunkSize - 1) / chunkSize; // Rounding up the chunk size may leave fewer chunks, none of them empty
+	if (nChunks == 1) {
+		body(begin, end);
+		return;
+	}
+
+	// Shared with the tasks, since a task may start after all chunks are done and this call has returned
+	struct State {
+		std::atomic<size_t> cNext{ 0 }; // Next chunk to run
+		std::atomic<size_t> cDone{ 0 }; // Number of finished chunks
+		std::exception_ptr cpException; // First exception thrown by body
+		std::mutex cMutex;
+		std::condition_variable cFinished;
+	};
+	std::shared_ptr<State> pState = std::make_shared<State>();
+	const std::function<void(size_t, size_t)>* pBody = &body; // Only used while chunks remain, i.e. before this call returns
+	std::function<void()> work = [pState, pBody, begin, end, nChunks, chunkSize]() {
+		for (size_t chunk = pState->cNext++; chunk < nChunks; chunk = pState->cNext++) {
+			const size_t chunkBegin = begin + chunk * chunkSize;
+			try {
+				(*pBody)(chunkBegin, std::min(end, chunkBegin + chunkSize));
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(pState->cMutex);
+				if (!pState->cpException) {
+					pState->cpException = std::current_exception();
+				}
+			}
+			if (++pState->cDone == nChunks) {
+				std::lock_guard<std::mutex> lock(pState->cMutex);
+				pState->cFinished.notify_all();
+			}
+		}
+	};
+
+	for (size_t i = 0; i < std::min(cvThreads.size(), nChunks - 1); ++i) {
+		Submit(work);
+	}
+	work();
+
+	std::unique_lock<std::mutex> lock(pState->cMutex);
+	pState->cFinished.wait(lock, [&]() { return pState->cDone == nChunks; });
+	if (pState->cpException) {
+		std::rethrow_exception(pState->cpException);
+	}
+}
+
+void ThreadPool::Run() {
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(cMutex);
+			cWork.wait(lock, [this]() { return cbStop || !cQueue.empty(); });
+			if (cQueue.empty()) {
+				return; // Stopped and nothing left to do
+			}
+			task = std::move(cQueue.front());
+			cQueue.pop_front();
+		}
+		task();
+	}
+}
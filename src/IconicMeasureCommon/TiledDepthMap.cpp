@@ -0,0 +1,442 @@
+#include <IconicMeasureCommon/TiledDepthMap.h>
+#include <wx/log.h>
+#include <wx/intl.h>
+#include <wx/ffile.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <cstring>
+
+using namespace iconic;
+
+namespace {
+	const char cMagic[4] = { 'I', 'T', 'D', 'M' }; // Identifies a tiled depth map file
+	const uint32_t cVersion = 2; // File format version. Version 1 files have no depth pyramid.
+
+	// File header, in native byte order. All fields are 32 bit so there is no padding.
+	// The version reads as another number with the other byte order, so such files are rejected.
+	struct TiledHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t tileSize;
+		uint32_t compression;
+	};
+
+	// Shuffle bytes of n floats into four planes (all first bytes, all second bytes...). Neighbouring depth values share exponent and high mantissa bytes, so the planes compress well.
+	void ShuffleBytes(const float* in, size_t n, char* out) {
+		const unsigned char* src = reinterpret_cast<const unsigned char*>(in);
+		for (size_t i = 0; i < n; ++i) {
+			for (size_t b = 0; b < sizeof(float); ++b) {
+				out[b * n + i] = src[i * sizeof(float) + b];
+			}
+		}
+	}
+
+	// Removes a partly written file unless it is kept. Declared before the wxFFile writing it, so the file is closed first.
+	struct TemporaryFile {
+		wxString cFileName;
+		bool cbKeep;
+		explicit TemporaryFile(const wxString& filename) : cFileName(filename), cbKeep(false) {}
+		~TemporaryFile() {
+			if (!cbKeep && wxFileName::FileExists(cFileName)) {
+				wxRemoveFile(cFileName);
+			}
+		}
+	};
+
+	// Compress data of a tile or the depth pyramid. Throws on failure.
+	void Compress(const char* pIn, size_t nIn, TiledDepthMap::ECompression compression, std::vector<char>& vOut) {
+		vOut.clear();
+		boost::iostreams::filtering_ostream out;
+		if (compression == TiledDepthMap::ECompression::ZLIB) {
+			out.push(boost::iostreams::zlib_compressor());
+		} else {
+			out.push(boost::iostreams::bzip2_compressor());
+		}
+		out.push(boost::iostreams::back_inserter(vOut));
+		boost::iostreams::copy(boost::iostreams::array_source(pIn, nIn), out);
+	}
+
+	// Inverse of ShuffleBytes
+	void UnshuffleBytes(const char* in, size_t n, float* out) {
+		unsigned char* dst = reinterpret_cast<unsigned char*>(out);
+		for (size_t b = 0; b < sizeof(float); ++b) {
+			const char* plane = in + b * n;
+			for (size_t i = 0; i < n; ++i) {
+				dst[i * sizeof(float) + b] = plane[i];
+			}
+		}
+	}
+}
+
+TiledDepthMap::TiledDepthMap(size_t maxCachedTiles) :
+	cCompression(ECompression::NONE),
+	cTileSize(0),
+	cMaxCachedTiles(std::max<size_t>(maxCachedTiles, 1)) {
+	cNumberOfTiles[0] = cNumberOfTiles[1] = 0;
+}
+
+TiledDepthMap::~TiledDepthMap() {
+	if (cMappedFile.is_open()) {
+		cMappedFile.close();
+	}
+}
+
+bool TiledDepthMap::Open(const wxString& filename, size_t width, size_t height) {
+	std::lock_guard<std::mutex> lock(cMutex);
+	cmTiles.clear();
+	cLru.clear();
+	cvTileTable.clear();
+	cSize[0] = cSize[1] = 0;
+	if (cMappedFile.is_open()) {
+		cMappedFile.close();
+	}
+
+	try {
+		cMappedFile.open(filename.ToStdString());
+	} catch (const std::exception& e) {
+		wxLogError(_("Could not open %s (%s)"), filename, e.what());
+		return false;
+	}
+
+	TiledHeader header;
+	if (cMappedFile.size() < sizeof(TiledHeader)) {
+		wxLogError(_("Not enough data in %s"), filename);
+		return false;
+	}
+	std::memcpy(&header, cMappedFile.data(), sizeof(TiledHeader));
+	if (std::memcmp(header.magic, cMagic, sizeof(cMagic)) != 0) {
+		wxLogError(_("%s is not a tiled depth map"), filename);
+		return false;
+	}
+	if (header.version != cVersion) {
+		wxLogError(_("%s is a tiled depth map of another version, convert it again"), filename);
+		return false;
+	}
+	if (header.width != width || header.height != height) {
+		wxLogError(_("Tiled depth map %s is %ux%u but image is %zux%zu"), filename, header.width, header.height, width, height);
+		return false;
+	}
+	if (!header.tileSize || header.compression > static_cast<uint32_t>(ECompression::BZIP2)) {
+		wxLogError(_("Invalid header in %s"), filename);
+		return false;
+	}
+	cTileSize = header.tileSize;
+	cCompression = static_cast<ECompression>(header.compression);
+	cNumberOfTiles[0] = (width + cTileSize - 1) / cTileSize;
+	cNumberOfTiles[1] = (height + cTileSize - 1) / cTileSize;
+
+	// The tile table ends with the entry of the depth pyramid
+	const size_t nTiles = cNumberOfTiles[0] * cNumberOfTiles[1];
+	if (cMappedFile.size() < sizeof(TiledHeader) + (nTiles + 1) * sizeof(TileEntry)) {
+		wxLogError(_("Not enough data in %s"), filename);
+		return false;
+	}
+	cvTileTable.resize(nTiles + 1);
+	std::memcpy(cvTileTable.data(), cMappedFile.data() + sizeof(TiledHeader), (nTiles + 1) * sizeof(TileEntry));
+	const uint64_t dataOffset = sizeof(TiledHeader) + (nTiles + 1) * sizeof(TileEntry);
+	for (const TileEntry& entry : cvTileTable) {
+		if (entry.cOffset + entry.cSize > cMappedFile.size()) {
+			wxLogError(_("Tile table in %s points outside of file"), filename);
+			cvTileTable.clear();
+			return false;
+		}
+		// Every tile has data after the tile table, an empty tile is left by an incomplete conversion
+		if (!entry.cSize || entry.cOffset < dataOffset) {
+			wxLogError(_("Invalid tile table in %s"), filename);
+			cvTileTable.clear();
+			return false;
+		}
+	}
+	cPyramidEntry = cvTileTable.back();
+	cvTileTable.pop_back();
+
+	cSize[0] = width;
+	cSize[1] = height;
+	return true;
+}
+
+bool TiledDepthMap::GetZ(const int x, const int y, float& Z) const {
+	if (x < 0 || y < 0 || static_cast<size_t>(x) >= cSize[0] || static_cast<size_t>(y) >= cSize[1]) {
+		return false;
+	}
+	const size_t tx = x / cTileSize, ty = y / cTileSize;
+	std::lock_guard<std::mutex> lock(cMutex);
+	const Tile* pTile = GetTile(ty * cNumberOfTiles[0] + tx);
+	if (!pTile) {
+		return false;
+	}
+	Z = pTile->cvData[(y - ty * cTileSize) * pTile->cWidth + (x - tx * cTileSize)];
+	return true;
+}
+
+bool TiledDepthMap::GetRow(const int y, float* pRow) const {
+	if (y < 0 || static_cast<size_t>(y) >= cSize[1]) {
+		return false;
+	}
+	const size_t ty = y / cTileSize;
+	std::lock_guard<std::mutex> lock(cMutex);
+	for (size_t tx = 0; tx < cNumberOfTiles[0]; ++tx) {
+		const Tile* pTile = GetTile(ty * cNumberOfTiles[0] + tx);
+		if (!pTile) {
+			return false;
+		}
+		std::memcpy(pRow + tx * cTileSize, pTile->cvData.data() + (y - ty * cTileSize) * pTile->cWidth, pTile->cWidth * sizeof(float));
+	}
+	return true;
+}
+
+const float* TiledDepthMap::GetData() const {
+	return nullptr;
+}
+
+size_t TiledDepthMap::GetMemoryUsage() const {
+	std::lock_guard<std::mutex> lock(cMutex);
+	size_t nBytes = cvTileTable.size() * sizeof(TileEntry);
+	for (const std::pair<const size_t, Tile>& tile : cmTiles) {
+		nBytes += tile.second.cvData.size() * sizeof(float);
+	}
+	return nBytes;
+}
+
+DepthPyramidPtr TiledDepthMap::ReadDepthPyramid() const {
+	if (cvTileTable.empty()) {
+		return DepthPyramidPtr();
+	}
+	std::vector<char> vData;
+	const char* pCompressed = cMappedFile.data() + cPyramidEntry.cOffset;
+	if (cCompression == ECompression::NONE) {
+		vData.assign(pCompressed, pCompressed + cPyramidEntry.cSize);
+	} else {
+		try {
+			boost::iostreams::filtering_istreambuf in;
+			if (cCompression == ECompression::ZLIB) {
+				in.push(boost::iostreams::zlib_decompressor());
+			} else {
+				in.push(boost::iostreams::bzip2_decompressor());
+			}
+			in.push(boost::iostreams::array_source(pCompressed, static_cast<size_t>(cPyramidEntry.cSize)));
+			boost::iostreams::copy(in, boost::iostreams::back_inserter(vData));
+		} catch (const std::exception& e) {
+			wxLogError(_("Could not decompress depth pyramid of tiled depth map (%s)"), e.what());
+			return DepthPyramidPtr();
+		}
+	}
+	DepthPyramidPtr pDepthPyramid = boost::make_shared<DepthPyramid>();
+	if (!pDepthPyramid->Read(vData.data(), vData.size(), cSize[0], cSize[1])) {
+		wxLogError(_("Invalid depth pyramid in tiled depth map"));
+		return DepthPyramidPtr();
+	}
+	return pDepthPyramid;
+}
+
+size_t TiledDepthMap::GetTileSize() const {
+	return cTileSize;
+}
+
+size_t TiledDepthMap::GetNumberOfCachedTiles() const {
+	std::lock_guard<std::mutex> lock(cMutex);
+	return cmTiles.size();
+}
+
+const TiledDepthMap::Tile* TiledDepthMap::GetTile(size_t tileIndex) const {
+	std::unordered_map<size_t, Tile>::iterator it = cmTiles.find(tileIndex);
+	if (it != cmTiles.end()) {
+		// Move to front of least recently used list
+		cLru.splice(cLru.begin(), cLru, it->second.cLru);
+		return &(it->second);
+	}
+
+	Tile tile;
+	if (!DecompressTile(tileIndex, tile)) {
+		return nullptr;
+	}
+
+	// Evict least recently used tile if the cache is full
+	if (cmTiles.size() >= cMaxCachedTiles) {
+		cmTiles.erase(cLru.back());
+		cLru.pop_back();
+	}
+	cLru.push_front(tileIndex);
+	tile.cLru = cLru.begin();
+	Tile& inserted = cmTiles[tileIndex];
+	inserted = std::move(tile);
+	return &inserted;
+}
+
+bool TiledDepthMap::DecompressTile(size_t tileIndex, Tile& tile) const {
+	if (tileIndex >= cvTileTable.size()) {
+		return false;
+	}
+	const size_t tx = tileIndex % cNumberOfTiles[0], ty = tileIndex / cNumberOfTiles[0];
+	tile.cWidth = std::min(cTileSize, cSize[0] - tx * cTileSize);
+	const size_t tileHeight = std::min(cTileSize, cSize[1] - ty * cTileSize);
+	const size_t nValues = tile.cWidth * tileHeight;
+	const size_t nBytes = nValues * sizeof(float);
+
+	const TileEntry& entry = cvTileTable[tileIndex];
+	const char* pCompressed = cMappedFile.data() + entry.cOffset;
+	std::vector<char> vShuffled(nBytes);
+	try {
+		if (cCompression == ECompression::NONE) {
+			if (entry.cSize != nBytes) {
+				wxLogError(_("Wrong size of tile %zu in tiled depth map"), tileIndex);
+				return false;
+			}
+			std::memcpy(vShuffled.data(), pCompressed, nBytes);
+		} else {
+			boost::iostreams::filtering_istreambuf in;
+			if (cCompression == ECompression::ZLIB) {
+				in.push(boost::iostreams::zlib_decompressor());
+			} else {
+				in.push(boost::iostreams::bzip2_decompressor());
+			}
+			in.push(boost::iostreams::array_source(pCompressed, static_cast<size_t>(entry.cSize)));
+			std::istream is(&in);
+			is.read(vShuffled.data(), nBytes);
+			if (static_cast<size_t>(is.gcount()) != nBytes) {
+				wxLogError(_("Not enough data in tile %zu of tiled depth map"), tileIndex);
+				return false;
+			}
+		}
+	} catch (const std::exception& e) {
+		wxLogError(_("Could not decompress tile %zu of tiled depth map (%s)"), tileIndex, e.what());
+		return false;
+	}
+	tile.cvData.resize(nValues);
+	UnshuffleBytes(vShuffled.data(), nValues, tile.cvData.data());
+	return true;
+}
+
+bool TiledDepthMap::Convert(const wxString& rawFileName, size_t width, size_t height, const wxString& tiledFileName, ECompression compression, size_t tileSize) {
+	if (!tileSize) {
+		wxLogError(_("Invalid tile size"));
+		return false;
+	}
+	RawDepthMap raw;
+	if (!raw.Open(rawFileName, width, height)) {
+		wxLogError(_("Could not read %s"), rawFileName);
+		return false;
+	}
+
+	// Written to a temporary file that replaces the tiled file when complete, so a failed conversion never leaves a partial tiled file
+	TemporaryFile temporary(tiledFileName + ".tmp");
+	wxFFile file(temporary.cFileName, "wb");
+	if (!file.IsOpened()) {
+		wxLogError(_("Could not create %s"), temporary.cFileName);
+		return false;
+	}
+
+	TiledHeader header;
+	std::memcpy(header.magic, cMagic, sizeof(cMagic));
+	header.version = cVersion;
+	header.width = static_cast<uint32_t>(width);
+	header.height = static_cast<uint32_t>(height);
+	header.tileSize = static_cast<uint32_t>(tileSize);
+	header.compression = static_cast<uint32_t>(compression);
+
+	// One entry per tile and the entry of the depth pyramid
+	const size_t nTilesX = (width + tileSize - 1) / tileSize, nTilesY = (height + tileSize - 1) / tileSize;
+	std::vector<TileEntry> vTileTable(nTilesX * nTilesY + 1);
+
+	// Write header and a placeholder tile table that is rewritten when all tiles are written
+	if (file.Write(&header, sizeof(TiledHeader)) != sizeof(TiledHeader)
+		|| file.Write(vTileTable.data(), vTileTable.size() * sizeof(TileEntry)) != vTileTable.size() * sizeof(TileEntry)) {
+		wxLogError(_("Could not write %s"), tiledFileName);
+		return false;
+	}
+	uint64_t offset = sizeof(TiledHeader) + vTileTable.size() * sizeof(TileEntry);
+
+	const float* pData = raw.GetData();
+	std::vector<float> vTile(tileSize * tileSize);
+	std::vector<char> vShuffled(tileSize * tileSize * sizeof(float));
+	std::vector<char> vCompressed;
+	for (size_t ty = 0; ty < nTilesY; ++ty) {
+		for (size_t tx = 0; tx < nTilesX; ++tx) {
+			const size_t tileWidth = std::min(tileSize, width - tx * tileSize);
+			const size_t tileHeight = std::min(tileSize, height - ty * tileSize);
+			const size_t nValues = tileWidth * tileHeight;
+
+			// Gather tile values row by row
+			for (size_t row = 0; row < tileHeight; ++row) {
+				const float* src = pData + (ty * tileSize + row) * width + tx * tileSize;
+				std::copy(src, src + tileWidth, vTile.begin() + row * tileWidth);
+			}
+			ShuffleBytes(vTile.data(), nValues, vShuffled.data());
+
+			const char* pOut = vShuffled.data();
+			size_t nOut = nValues * sizeof(float);
+			if (compression != ECompression::NONE) {
+				try {
+					Compress(vShuffled.data(), nOut, compression, vCompressed);
+				} catch (const std::exception& e) {
+					wxLogError(_("Could not compress tile (%s)"), e.what());
+					return false;
+				}
+				pOut = vCompressed.data();
+				nOut = vCompressed.size();
+			}
+			if (file.Write(pOut, nOut) != nOut) {
+				wxLogError(_("Could not write %s"), tiledFileName);
+				return false;
+			}
+			TileEntry& entry = vTileTable[ty * nTilesX + tx];
+			entry.cOffset = offset;
+			entry.cSize = nOut;
+			offset += nOut;
+		}
+	}
+
+	// The depth pyramid is built here once, so reading a frame does not have to decompress every tile to build it
+	DepthPyramid pyramid;
+	if (!pyramid.Build(raw)) {
+		wxLogError(_("Could not build depth pyramid of %s"), rawFileName);
+		return false;
+	}
+	std::vector<char> vPyramid;
+	pyramid.Write(vPyramid);
+	const char* pOut = vPyramid.data();
+	size_t nOut = vPyramid.size();
+	if (compression != ECompression::NONE) {
+		try {
+			Compress(vPyramid.data(), vPyramid.size(), compression, vCompressed);
+		} catch (const std::exception& e) {
+			wxLogError(_("Could not compress depth pyramid (%s)"), e.what());
+			return false;
+		}
+		pOut = vCompressed.data();
+		nOut = vCompressed.size();
+	}
+	if (file.Write(pOut, nOut) != nOut) {
+		wxLogError(_("Could not write %s"), tiledFileName);
+		return false;
+	}
+	vTileTable.back().cOffset = offset;
+	vTileTable.back().cSize = nOut;
+	offset += nOut;
+
+	// Rewrite tile table now that offsets are known
+	if (!file.Seek(sizeof(TiledHeader))
+		|| file.Write(vTileTable.data(), vTileTable.size() * sizeof(TileEntry)) != vTileTable.size() * sizeof(TileEntry)
+		|| !file.Close()) {
+		wxLogError(_("Could not write %s"), tiledFileName);
+		return false;
+	}
+	if (!wxRenameFile(temporary.cFileName, tiledFileName, true)) {
+		wxLogError(_("Could not rename %s to %s"), temporary.cFileName, tiledFileName);
+		return false;
+	}
+	temporary.cbKeep = true;
+	wxLogVerbose(_("Converted %s to %s (%.1f%% of original size)"), rawFileName, tiledFileName, 100.0 * offset / (width * height * sizeof(float)));
+	return true;
+}
@@ -0,0 +1,289 @@
+#include <IconicMeasureCommon/Uncertainty.h>
+#include <IconicMeasureCommon/PolygonMeasures.h>
+#include <IconicMeasureCommon/ThreadPool.h>
+#include <IconicMeasureCommon/VolumeIntegrator.h>
+#include <wx/log.h>
+#include <wx/intl.h>
+#include <boost/geometry.hpp>
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+using namespace iconic;
+
+namespace {
+	const size_t cDrawGrain = 8; //!< Draws per parallel chunk, which share buffers
+
+	/**
+	 * @brief Buffers of the draws of a chunk
+	*/
+	struct Draw {
+		std::vector<double> cvImageX;				//!< Image x of the moved vertices
+		std::vector<double> cvImageY;				//!< Image y of the moved vertices
+		std::vector<float> cvZ;						//!< Z of the moved vertices, with depth noise
+		std::vector<Geometry::EPointStatus> cvStatus;	//!< Status of the image to object transformation
+		PolygonMeasures::Vertices cVertices;		//!< Object coordinates of the moved vertices
+		std::vector<Geometry::Point3D> cvPoints;	//!< Object points for the plane fit
+		Geometry::Polygon::ring_type cRing;			//!< Outer ring while the vertices are moved one by one
+	};
+
+	/**
+	 * @brief The vertices of a line or outer ring, without a closing vertex
+	*/
+	struct Nominal {
+		std::vector<double> cvPixelX;	//!< Pixel x of the vertices
+		std::vector<double> cvPixelY;	//!< Pixel y of the vertices
+		Geometry::Polygon::ring_type cRing;	//!< Image coordinates of the vertices
+	};
+
+	/**
+	 * @brief Get the vertices of a line or outer ring in pixels
+	 * @param geometry Camera to pixel transformation
+	 * @param points Image coordinates, may end with a closing vertex
+	 * @param bClosed True to drop a closing vertex
+	 * @param nominal Gets the vertices
+	*/
+	template<typename Points>
+	void SetNominal(const Geometry& geometry, const Points& points, bool bClosed, Nominal& nominal) {
+		size_t n = points.size();
+		if (bClosed && n > 1 && boost::geometry::equals(points.front(), points.back())) {
+			--n;
+		}
+		nominal.cRing.assign(points.begin(), points.begin() + n);
+		nominal.cvPixelX.resize(n);
+		nominal.cvPixelY.resize(n);
+		for (size_t i = 0; i < n; ++i) {
+			Geometry::Point pixelPt;
+			geometry.ImageToPixel(nominal.cRing[i], pixelPt);
+			nominal.cvPixelX[i] = pixelPt.get<0>();
+			nominal.cvPixelY[i] = pixelPt.get<1>();
+		}
+	}
+
+	/**
+	 * @brief Move the vertices and get their object coordinates
+	 * @param geometry Depth map and camera matrix
+	 * @param nominal Vertices without errors
+	 * @param pixelToCamera Inverse of the camera to pixel transformation
+	 * @param vertexSigma Standard deviation of the placement, 0 for none
+	 * @param depthSigma Standard deviation of Z, 0 for none
+	 * @param generator Generator of the draw
+	 * @param draw Gets the moved vertices in cvImageX, cvImageY and cVertices
+	 * @return False if a vertex has no valid Z
+	*/
+	bool MoveVertices(const Geometry& geometry, const Nominal& nominal, const Eigen::Matrix3d& pixelToCamera, double vertexSigma, double depthSigma, std::mt19937& generator, Draw& draw) {
+		const DepthMap& depthMap = *geometry.cpDepthMap;
+		const int width = static_cast<int>(depthMap.GetWidth()), height = static_cast<int>(depthMap.GetHeight());
+		const size_t n = nominal.cvPixelX.size();
+		std::normal_distribution<double> normal;
+		draw.cvImageX.resize(n);
+		draw.cvImageY.resize(n);
+		draw.cvZ.resize(n);
+		draw.cvStatus.resize(n);
+		draw.cVertices.cvX.resize(n);
+		draw.cVertices.cvY.resize(n);
+		draw.cVertices.cvZ.resize(n);
+		for (size_t i = 0; i < n; ++i) {
+			const double px = nominal.cvPixelX[i] + vertexSigma * normal(generator);
+			const double py = nominal.cvPixelY[i] + vertexSigma * normal(generator);
+			const double dz = depthSigma * normal(generator);
+			const int ix = static_cast<int>(std::floor(px + 0.5)), iy = static_cast<int>(std::floor(py + 0.5));
+			float z = std::numeric_limits<float>::max();
+			if (ix < 0 || iy < 0 || ix >= width || iy >= height || !depthMap.GetZ(ix, iy, z) || !DepthMap::IsValid(z)) {
+				return false;
+			}
+			const Eigen::Vector3d pt = pixelToCamera * Eigen::Vector3d(px, py, 1.0);
+			draw.cvImageX[i] = pt[0] / pt[2];
+			draw.cvImageY[i] = pt[1] / pt[2];
+			draw.cvZ[i] = static_cast<float>(z + dz);
+		}
+		geometry.ImageToObject(draw.cvImageX.data(), draw.cvImageY.data(), draw.cvZ.data(), n,
+			draw.cVertices.cvX.data(), draw.cVertices.cvY.data(), draw.cVertices.cvZ.data(), draw.cvStatus.data());
+		return std::all_of(draw.cvStatus.begin(), draw.cvStatus.end(), [](Geometry::EPointStatus status) { return status == Geometry::EPointStatus::OK; });
+	}
+
+	/**
+	 * @brief Summarize the draws of a measurement
+	 * @param vValues Measurement of each accepted draw, reordered
+	 * @param value Measurement without errors
+	 * @param confidence Probability of the interval
+	 * @param interval Gets the distribution
+	*/
+	void Summarize(std::vector<double>& vValues, double value, double confidence, Uncertainty::Interval& interval) {
+		interval = Uncertainty::Interval();
+		interval.cValue = interval.cMean = interval.cLower = interval.cUpper = value;
+		const size_t n = vValues.size();
+		if (!n) {
+			return;
+		}
+		double sum = 0.0;
+		for (double v : vValues) {
+			sum += v - value;
+		}
+		const double mean = sum / n;
+		double sumSq = 0.0;
+		for (double v : vValues) {
+			sumSq += (v - value - mean) * (v - value - mean);
+		}
+		interval.cMean = value + mean;
+		interval.cStdDev = n > 1 ? std::sqrt(sumSq / (n - 1)) : 0.0;
+
+		// Percentiles interpolated between the sorted draws
+		std::sort(vValues.begin(), vValues.end());
+		const double tail = (1.0 - std::min(1.0, std::max(0.0, confidence))) / 2.0;
+		const auto percentile = [&](double p) {
+			const double rank = p * (n - 1);
+			const size_t i = std::min(n - 1, static_cast<size_t>(rank));
+			const size_t j = std::min(n - 1, i + 1);
+			return vValues[i] + (rank - i) * (vValues[j] - vValues[i]);
+		};
+		interval.cLower = percentile(tail);
+		interval.cUpper = percentile(1.0 - tail);
+	}
+}
+
+Uncertainty::Options::Options() : cSamples(1000), cVertexSigma(0.5), cDepthSigma(0.0), cConfidence(0.95), cSeed(1) {}
+
+Uncertainty::Interval::Interval() : cValue(0.0), cMean(0.0), cStdDev(0.0), cLower(0.0), cUpper(0.0) {}
+
+Uncertainty::Result::Result() : cSamples(0), cRejected(0) {}
+
+bool Uncertainty::Estimate(const Geometry& geometry, const Geometry::VectorTrain& imageLine, const Uncertainty::Options& options, Uncertainty::Result& result) {
+	result = Result();
+	if (!geometry.cpDepthMap || geometry.cProjection == Geometry::EProjection::NONE) {
+		wxLogError(_("Uncertainty requires a depth map and a camera matrix"));
+		return false;
+	}
+	Nominal nominal;
+	SetNominal(geometry, imageLine, false, nominal);
+	const Eigen::Matrix3d pixelToCamera = geometry.cCameraToPixelTransform.inverse();
+
+	std::mt19937 generator(options.cSeed);
+	Draw draw;
+	if (!MoveVertices(geometry, nominal, pixelToCamera, 0.0, 0.0, generator, draw)) {
+		wxLogError(_("Could not compute image-to-object coordinates for measured point"));
+		return false;
+	}
+	const double length = PolygonMeasures::GetLength(draw.cVertices, false);
+
+	std::vector<double> vLengths(options.cSamples);
+	std::vector<char> vAccepted(options.cSamples, 0);
+	ThreadPool::GetInstance().ParallelFor(0, options.cSamples, [&](size_t begin, size_t end) {
+		Draw draw;
+		for (size_t i = begin; i < end; ++i) {
+			std::seed_seq sequence{ options.cSeed, static_cast<unsigned int>(i) };
+			std::mt19937 generator(sequence);
+			if (MoveVertices(geometry, nominal, pixelToCamera, options.cVertexSigma, options.cDepthSigma, generator, draw)) {
+				vLengths[i] = PolygonMeasures::GetLength(draw.cVertices, false);
+				vAccepted[i] = 1;
+			}
+		}
+	}, cDrawGrain);
+
+	std::vector<double> vValues;
+	for (size_t i = 0; i < options.cSamples; ++i) {
+		if (vAccepted[i]) {
+			vValues.push_back(vLengths[i]);
+		}
+	}
+	result.cSamples = vValues.size();
+	result.cRejected = options.cSamples - result.cSamples;
+	Summarize(vValues, length, options.cConfidence, result.cLength);
+	return true;
+}
+
+bool Uncertainty::Estimate(const Geometry& geometry, const Geometry::Polygon& imagePolygon, const Uncertainty::Options& options, Uncertainty::Result& result, const Eigen::Vector3d* pPlane) {
+	result = Result();
+	if (!geometry.cpDepthMap || geometry.cProjection == Geometry::EProjection::NONE) {
+		wxLogError(_("Uncertainty requires a depth map and a camera matrix"));
+		return false;
+	}
+	Nominal nominal;
+	SetNominal(geometry, imagePolygon.outer(), true, nominal);
+	const size_t n = nominal.cRing.size();
+	if (n < 3) {
+		wxLogError(_("Uncertainty requires a polygon with at least three vertices"));
+		return false;
+	}
+	const Eigen::Matrix3d pixelToCamera = geometry.cCameraToPixelTransform.inverse();
+
+	// Measurements without errors, and the moments that the draws update
+	std::mt19937 generator(options.cSeed);
+	Draw draw;
+	if (!MoveVertices(geometry, nominal, pixelToCamera, 0.0, 0.0, generator, draw)) {
+		wxLogError(_("Could not compute image-to-object coordinates for measured point"));
+		return false;
+	}
+	const Eigen::Vector3d origin(draw.cVertices.cvX[0], draw.cVertices.cvY[0], draw.cVertices.cvZ[0]);
+	const auto fitPlane = [&](Draw& draw, Eigen::Vector3d& plane) {
+		if (pPlane) {
+			plane = *pPlane;
+			return true;
+		}
+		draw.cvPoints.resize(n);
+		for (size_t i = 0; i < n; ++i) {
+			draw.cvPoints[i] = Geometry::Point3D(draw.cVertices.cvX[i], draw.cVertices.cvY[i], draw.cVertices.cvZ[i]);
+		}
+		return VolumeIntegrator::FitPlane(draw.cvPoints, origin, plane);
+	};
+	VolumeIntegrator::Moments moments;
+	Eigen::Vector3d plane;
+	if (!fitPlane(draw, plane) || !VolumeIntegrator::Integrate(geometry, imagePolygon, origin, moments)) {
+		return false;
+	}
+	const double length = PolygonMeasures::GetLength(draw.cVertices, true);
+	const double area = PolygonMeasures::GetArea(draw.cVertices);
+	const double volume = VolumeIntegrator::GetVolume(moments, plane);
+	// Sum of the depth noise of the pixels weighted by their ground areas, taking the areas as equal
+	const double volumeSigma = moments.cCount ? options.cDepthSigma * moments.cArea / std::sqrt(static_cast<double>(moments.cCount)) : 0.0;
+
+	std::vector<double> vLengths(options.cSamples), vAreas(options.cSamples), vVolumes(options.cSamples);
+	std::vector<char> vAccepted(options.cSamples, 0);
+	ThreadPool::GetInstance().ParallelFor(0, options.cSamples, [&](size_t begin, size_t end) {
+		Draw draw;
+		for (size_t i = begin; i < end; ++i) {
+			std::seed_seq sequence{ options.cSeed, static_cast<unsigned int>(i) };
+			std::mt19937 generator(sequence);
+			if (!MoveVertices(geometry, nominal, pixelToCamera, options.cVertexSigma, options.cDepthSigma, generator, draw)) {
+				continue;
+			}
+			const double pixelNoise = volumeSigma * std::normal_distribution<double>()(generator);
+			Eigen::Vector3d drawPlane;
+			if (!fitPlane(draw, drawPlane)) {
+				continue;
+			}
+			// Move the vertices one at a time, each move sweeps two triangles
+			VolumeIntegrator::Moments drawMoments = moments;
+			draw.cRing = nominal.cRing;
+			bool bMoments = true;
+			for (size_t v = 0; v < n && bMoments; ++v) {
+				draw.cRing[v] = Geometry::Point(draw.cvImageX[v], draw.cvImageY[v]);
+				bMoments = VolumeIntegrator::MoveVertex(geometry, draw.cRing, v, nominal.cRing[v], origin, drawMoments);
+			}
+			if (!bMoments) {
+				continue;
+			}
+			vLengths[i] = PolygonMeasures::GetLength(draw.cVertices, true);
+			vAreas[i] = PolygonMeasures::GetArea(draw.cVertices);
+			vVolumes[i] = VolumeIntegrator::GetVolume(drawMoments, drawPlane) + pixelNoise;
+			vAccepted[i] = 1;
+		}
+	}, cDrawGrain);
+
+	std::vector<double> vValues[3];
+	for (size_t i = 0; i < options.cSamples; ++i) {
+		if (vAccepted[i]) {
+			vValues[0].push_back(vLengths[i]);
+			vValues[1].push_back(vAreas[i]);
+			vValues[2].push_back(vVolumes[i]);
+		}
+	}
+	result.cSamples = vValues[0].size();
+	result.cRejected = options.cSamples - result.cSamples;
+	Summarize(vValues[0], length, options.cConfidence, result.cLength);
+	Summarize(vValues[1], area, options.cConfidence, result.cArea);
+	Summarize(vValues[2], volume, options.cConfidence, result.cVolume);
+	return true;
+}
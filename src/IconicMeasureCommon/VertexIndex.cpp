@@ -0,0 +1,93 @@
+#include <IconicMeasureCommon/VertexIndex.h>
+#include <boost/geometry.hpp>
+#include <iterator>
+#include <vector>
+
+using namespace iconic;
+
+VertexIndex::VertexIndex() : cSize(0), cbClosed(false), cbValid(false) {}
+
+void VertexIndex::Build(const Geometry::Point* pPoints, size_t n, bool bClosed) {
+	cSize = n;
+	cbClosed = bClosed;
+	std::vector<VertexValue> vVertices;
+	std::vector<SegmentValue> vSegments;
+	vVertices.reserve(n);
+	vSegments.reserve(n);
+	for (size_t i = 0; i < n; ++i) {
+		vVertices.push_back(VertexValue(pPoints[i], i));
+		if (i + 1 < n || (bClosed && n > 2)) {
+			vSegments.push_back(GetSegment(pPoints, i));
+		}
+	}
+	// The range constructors pack the trees, which is faster to build and to query than inserting one by one
+	cVertices = decltype(cVertices)(vVertices.begin(), vVertices.end());
+	cSegments = decltype(cSegments)(vSegments.begin(), vSegments.end());
+	cbValid = true;
+}
+
+bool VertexIndex::IsValid(size_t n, bool bClosed) const {
+	return cbValid && cSize == n && cbClosed == bClosed;
+}
+
+void VertexIndex::Invalidate() {
+	cbValid = false;
+}
+
+void VertexIndex::Append(const Geometry::Point* pPoints, size_t n) {
+	if (n == 0 || !IsValid(n - 1, false)) {
+		return;
+	}
+	cSize = n;
+	cVertices.insert(VertexValue(pPoints[n - 1], n - 1));
+	if (n > 1) {
+		cSegments.insert(GetSegment(pPoints, n - 2));
+	}
+}
+
+void VertexIndex::Move(const Geometry::Point* pPoints, size_t n, size_t index, const Geometry::Point& previousPt) {
+	if (!IsValid(n, cbClosed) || index >= n) {
+		return;
+	}
+	cVertices.remove(VertexValue(previousPt, index));
+	cVertices.insert(VertexValue(pPoints[index], index));
+
+	// The segments ending and starting at the vertex
+	const bool bClosed = cbClosed && n > 2;
+	const bool bBefore = index > 0 || bClosed, bAfter = index + 1 < n || bClosed;
+	const size_t before = (index + n - 1) % n, after = (index + 1) % n;
+	if (bBefore) {
+		cSegments.remove(SegmentValue(Segment(pPoints[before], previousPt), before));
+		cSegments.insert(GetSegment(pPoints, before));
+	}
+	if (bAfter) {
+		cSegments.remove(SegmentValue(Segment(previousPt, pPoints[after]), index));
+		cSegments.insert(GetSegment(pPoints, index));
+	}
+}
+
+bool VertexIndex::GetNearestVertex(const Geometry::Point& pt, size_t& index, double& distance) const {
+	std::vector<VertexValue> vNearest;
+	cVertices.query(boost::geometry::index::nearest(pt, 1), std::back_inserter(vNearest));
+	if (vNearest.empty()) {
+		return false;
+	}
+	index = vNearest[0].second;
+	distance = boost::geometry::distance(pt, vNearest[0].first);
+	return true;
+}
+
+bool VertexIndex::GetNearestSegment(const Geometry::Point& pt, size_t& index, double& distance) const {
+	std::vector<SegmentValue> vNearest;
+	cSegments.query(boost::geometry::index::nearest(pt, 1), std::back_inserter(vNearest));
+	if (vNearest.empty()) {
+		return false;
+	}
+	index = vNearest[0].second;
+	distance = boost::geometry::distance(pt, vNearest[0].first);
+	return true;
+}
+
+VertexIndex::SegmentValue VertexIndex::GetSegment(const Geometry::Point* pPoints, size_t index) const {
+	return SegmentValue(Segment(pPoints[index], pPoints[(index + 1) % cSize]), index);
+}
@@ -4,7 +4,10 @@
 #include	<IconicMeasureCommon/OpenCLGrid.h>
 #include	<IconicMeasureCommon/ColorBox.h>
 #include	<IconicMeasureCommon/Shape.h>
+#include	<IconicMeasureCommon/TiledDepthMap.h>
 #include	<wx/filename.h>
+#include	<wx/dir.h>
+#include	<wx/progdlg.h>
 #include	<wx/aboutdlg.h>
 #include	<wx/versioninfo.h>
 #include	<wx/numdlg.h>
@@ -53,6 +56,7 @@ EVT_MENU(ID_TESSELATE_DUMMY_EXAMPLE, VideoPlayerFrame::OnDrawTesselatedPolygon)
 EVT_MENU(ID_CLEAR_ALL_SHAPES, VideoPlayerFrame::OnDeleteAllShapes)
 EVT_TOOL(ID_TOOLBAR_SIDEPANEL, VideoPlayerFrame::OnToolbarCheck)
 EVT_MENU(ID_LOAD_WKT, VideoPlayerFrame::OnLoadMeasurements)
+EVT_MENU(ID_CONVERT_DEPTH_MAPS, VideoPlayerFrame::OnConvertDepthMaps)
 EVT_UPDATE_UI(ID_MOUSE_MODE, VideoPlayerFrame::OnMouseModeUpdate)
 EVT_UPDATE_UI(ID_PAUSE, VideoPlayerFrame::OnUpdatePause)
 EVT_UPDATE_UI(ID_FULLSCREEN, VideoPlayerFrame::OnUpdateFullscreen)
@@ -60,6 +64,7 @@ EVT_UPDATE_UI(ID_VIDEO_USE_TIMER, VideoPlayerFrame::OnUpdateUseTimer)
 EVT_UPDATE_UI(ID_VIDEO_DECODER, VideoPlayerFrame::OnUpdateVideoDecoder)
 EVT_IDLE(VideoPlayerFrame::OnIdle)
 EVT_TIMER(ID_VIDEO_TIMER, VideoPlayerFrame::OnTimer)
+EVT_TIMER(ID_REFINE_TIMER, VideoPlayerFrame::OnRefineTimer)
 EVT_CLOSE(VideoPlayerFrame::OnClose)
 wxEND_EVENT_TABLE()
 
@@ -93,6 +98,7 @@ VideoPlayerFrame::VideoPlayerFrame(wxString const& title, boost::shared_ptr<wxVe
 	Maximize();
 
 	cTimer.SetOwner(this, ID_VIDEO_TIMER);
+	cRefineTimer.SetOwner(this, ID_REFINE_TIMER);
 }
 
 VideoPlayerFrame::~VideoPlayerFrame() {
@@ -133,6 +139,7 @@ void VideoPlayerFrame::CreateMenu() {
 	fileMenu->AppendSubMenu(openMenu, _("Open"), _("Open video, folder or network"));
 	fileMenu->Append(wxID_SAVE, _("Save...\tCtrl+S"), _("Save decoded frames to file or stream"));
 	fileMenu->Append(ID_LOAD_WKT, _("Load measurements"), _("Load measurements from wkt file"));
+	fileMenu->Append(ID_CONVERT_DEPTH_MAPS, _("Convert depth maps..."), _("Convert raw depth maps in a folder to compressed tiled depth maps"));
 	fileMenu->Append(wxID_EXIT, "E&xit\tAlt-X", "Quit this program");
 	menuBar->Append(fileMenu, "&File");
 
@@ -297,6 +304,43 @@ void VideoPlayerFrame::OnLoadMeasurements(wxCommandEvent& WXUNUSED(e)) {
 			ProcessWindowEvent(updateEvent);
 		}
 	}
+
+	// Loaded polygons have provisional measurements
+	if (cpHandler->RefineShapes()) {
+		cRefineTimer.StartOnce(50);
+	}
+}
+
+void VideoPlayerFrame::OnConvertDepthMaps(wxCommandEvent& WXUNUSED(e)) {
+	if (!cpDecoder) {
+		wxLogError(_("Open the image folder first so that the depth map size is known"));
+		return;
+	}
+	wxString dir = wxDirSelector(_("Select folder with depth maps"), wxEmptyString, wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST, wxDefaultPosition, this);
+	if (dir.IsEmpty()) {
+		return;
+	}
+	wxArrayString files;
+	wxDir::GetAllFiles(dir, &files, "*.dmp", wxDIR_FILES);
+	if (files.IsEmpty()) {
+		wxLogWarning(_("No depth maps (*.dmp) in %s"), dir);
+		return;
+	}
+
+	const size_t width = cpDecoder->GetVideoWidth(), height = cpDecoder->GetVideoHeight();
+	wxProgressDialog progress(_("Convert depth maps"), _("Converting depth maps..."), files.GetCount(), this, wxPD_APP_MODAL | wxPD_AUTO_HIDE | wxPD_CAN_ABORT);
+	size_t nConverted = 0;
+	for (size_t i = 0; i < files.GetCount(); ++i) {
+		if (!progress.Update(i, wxFileName(files[i]).GetFullName())) {
+			break; // Aborted by user
+		}
+		wxFileName tiled(files[i]);
+		tiled.SetExt("tdm");
+		if (TiledDepthMap::Convert(files[i], width, height, tiled.GetFullPath())) {
+			++nConverted;
+		}
+	}
+	wxLogMessage(_("Converted %zu of %zu depth maps"), nConverted, files.GetCount());
 }
 
 wxString VideoPlayerFrame::GetVideoFileName() const {
@@ -700,9 +744,9 @@ void VideoPlayerFrame::OnToolbarPress(wxCommandEvent& e) {
 		cpHandler->InstantiateNewShape(iconic::ShapeType::PointType);
 		break;
 	case ID_TOOLBAR_DELETE:
-		int indexToDelete = cpHandler->DeleteSelectedShape();
-		if (indexToDelete < 0) break;
-		DataUpdateEvent updateEvent(GetId(), indexToDelete);
+		const ShapeHandle deleted = cpHandler->DeleteSelectedShape();
+		if (deleted.IsNull()) break;
+		DataUpdateEvent updateEvent(GetId(), deleted);
 		updateEvent.SetEventObject(this);
 		ProcessWindowEvent(updateEvent);
 		break;
@@ -766,7 +810,11 @@ void VideoPlayerFrame::UpdateToolbarMeasurement(DataUpdateEvent& e) {
 	}
 	case iconic::ShapeType::PolygonType:
 	{
-		SetToolbarText(wxString::Format("Selected polygon: perimeter = %.4f, area = %.4f, volume = %.4f", shape->GetLength(), shape->GetArea(), shape->GetVolume()));
+		if (e.GetRefinementLevel() > 0) {
+			SetToolbarText(wxString::Format("Selected polygon: perimeter = %.4f (object %.4f), area = %.4f (object %.4f), volume ~ %.4f, surface ~ %.4f (refining)", shape->GetLength(), shape->GetObjectLength(), shape->GetArea(), shape->GetObjectArea(), shape->GetVolume(), shape->GetSurfaceArea()));
+		} else {
+			SetToolbarText(wxString::Format("Selected polygon: perimeter = %.4f (object %.4f), area = %.4f (object %.4f), volume = %.4f, surface = %.4f", shape->GetLength(), shape->GetObjectLength(), shape->GetArea(), shape->GetObjectArea(), shape->GetVolume(), shape->GetSurfaceArea()));
+		}
 		break;
 	}
 	}
@@ -853,9 +901,32 @@ void VideoPlayerFrame::OnMeasuredPoint(MeasureEvent& e) {
 		ProcessWindowEvent(updateEvent);
 	}
 
+	// Refine provisional measurements once the mouse has rested for a moment. Restarted by every move.
+	if ((callEvent && updateEvent.GetRefinementLevel() > 0) || e.GetAction() == MeasureEvent::EAction::FINISHED) {
+		cRefineTimer.StartOnce(200);
+	}
+
 	cpImageCanvas->Refresh();
 }
 
+void VideoPlayerFrame::OnRefineTimer(wxTimerEvent& WXUNUSED(e)) {
+	if (!cpHandler) {
+		return;
+	}
+	for (;;) {
+		DataUpdateEvent updateEvent(GetId());
+		if (!cpHandler->GetRefinedShape(updateEvent)) {
+			break;
+		}
+		updateEvent.SetEventObject(this);
+		ProcessWindowEvent(updateEvent);
+	}
+	// Poll until the running refinements have finished
+	if (cpHandler->RefineShapes()) {
+		cRefineTimer.StartOnce(50);
+	}
+}
+
 void VideoPlayerFrame::OnDrawTesselatedPolygon(wxCommandEvent& e) {
 	if (!cpHandler) {
 		wxLogError(_("No measurement handler"));
@@ -893,7 +964,7 @@ void VideoPlayerFrame::OnDrawTesselatedPolygon(wxCommandEvent& e) {
 void VideoPlayerFrame::OnDeleteAllShapes(wxCommandEvent& e) {
 	cpHandler->DeleteAllShapes();
 
-	DataUpdateEvent updateEvent(GetId(), -1);
+	DataUpdateEvent updateEvent(GetId(), ShapeHandle());
 	updateEvent.SetEventObject(this);
 	ProcessWindowEvent(updateEvent);
 }
@@ -0,0 +1,518 @@
+#include <IconicMeasureCommon/VolumeIntegrator.h>
+#include <IconicMeasureCommon/PolygonRasterizer.h>
+#include <IconicMeasureCommon/ThreadPool.h>
+#include <boost/geometry.hpp>
+#include <wx/log.h>
+#include <wx/intl.h>
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace iconic;
+
+namespace {
+	const int cBandRows = 16; //!< Rows per parallel band
+
+	/**
+	 * @brief Per pixel terms of the camera matrix, as linear functions of the pixel (or grid cell) coordinates.
+	 *
+	 * With columns c0..c3 of the camera matrix and r the homogeneous image point of a pixel, the object point at height Z is
+	 * \c X=(Z*(c1 x c2).r+(c1 x c3).r)/w and \c Y=(Z*(c2 x c0).r+(c3 x c0).r)/w, where \c w=(c0 x c1).r.
+	 * The ground area of the pixel is the Jacobian determinant of that mapping, \c (Z*det(c0,c1,c2)+det(c0,c1,c3))^2/(|det(T)|*|w|^3),
+	 * where T is the image to pixel transformation.
+	*/
+	struct PixelTerms {
+		Eigen::Vector3d cW, cU1, cV1, cU2, cV2; //!< Coefficients of px, py and 1 of each dot product with r
+		double cDetZ, cDet0; //!< det(c0,c1,c2) and det(c0,c1,c3)
+		double cInvDetT; //!< 1/|det(T)|
+
+		/**
+		 * @brief Constructor
+		 * @param geometry Camera matrix
+		 * @param T Image to grid transformation, e.g. Geometry::cCameraToPixelTransform
+		*/
+		PixelTerms(const Geometry& geometry, const Eigen::Matrix3d& T) {
+			const Geometry::CameraMatrix& P = geometry.cCameraMatrix;
+			const Eigen::Vector3d c0 = P.col(0), c1 = P.col(1), c2 = P.col(2), c3 = P.col(3);
+			const Eigen::Matrix3d pixelToCameraT = T.inverse().transpose();
+			const Eigen::Vector3d n = c0.cross(c1);
+			cW = pixelToCameraT * n;
+			cU1 = pixelToCameraT * c1.cross(c2);
+			cV1 = pixelToCameraT * c1.cross(c3);
+			cU2 = pixelToCameraT * c2.cross(c0);
+			cV2 = pixelToCameraT * c3.cross(c0);
+			cDetZ = n.dot(c2);
+			cDet0 = n.dot(c3);
+			cInvDetT = 1.0 / std::abs(T.determinant());
+		}
+	};
+
+	/**
+	 * @brief Add the moments of the pixels [x0,x1) of a row. Branch free.
+	 * @param terms Per pixel terms of the camera matrix
+	 * @param y Pixel row
+	 * @param pRow Z values of the row
+	 * @param x0 First pixel column
+	 * @param x1 One past the last pixel column
+	 * @param origin Subtracted from the object coordinates
+	 * @param moments Moments to add to
+	*/
+	void IntegrateSpan(const PixelTerms& terms, int y, const float* pRow, int x0, int x1, const Eigen::Vector3d& origin, VolumeIntegrator::Moments& moments) {
+		// Value of each dot product at x=0 of the row, and its change per pixel
+		const double w0 = terms.cW[1] * y + terms.cW[2], wx = terms.cW[0];
+		const double u10 = terms.cU1[1] * y + terms.cU1[2], u1x = terms.cU1[0];
+		const double v10 = terms.cV1[1] * y + terms.cV1[2], v1x = terms.cV1[0];
+		const double u20 = terms.cU2[1] * y + terms.cU2[2], u2x = terms.cU2[0];
+		const double v20 = terms.cV2[1] * y + terms.cV2[2], v2x = terms.cV2[0];
+		const double detZ = terms.cDetZ, det0 = terms.cDet0, invDetT = terms.cInvDetT;
+		const double ox = origin[0], oy = origin[1], oz = origin[2];
+		const double maxValid = DepthMap::cMaxValidZ, minValid = -std::numeric_limits<float>::max();
+
+		double sumA = 0.0, sumX = 0.0, sumY = 0.0, sumZ = 0.0;
+		size_t count = 0;
+		int x = x0;
+#if defined(__AVX2__)
+		const __m256d vW0 = _mm256_set1_pd(w0), vWx = _mm256_set1_pd(wx);
+		const __m256d vU10 = _mm256_set1_pd(u10), vU1x = _mm256_set1_pd(u1x), vV10 = _mm256_set1_pd(v10), vV1x = _mm256_set1_pd(v1x);
+		const __m256d vU20 = _mm256_set1_pd(u20), vU2x = _mm256_set1_pd(u2x), vV20 = _mm256_set1_pd(v20), vV2x = _mm256_set1_pd(v2x);
+		const __m256d vDetZ = _mm256_set1_pd(detZ), vDet0 = _mm256_set1_pd(det0), vInvDetT = _mm256_set1_pd(invDetT);
+		const __m256d vOx = _mm256_set1_pd(ox), vOy = _mm256_set1_pd(oy), vOz = _mm256_set1_pd(oz);
+		const __m256d vMax = _mm256_set1_pd(maxValid), vMin = _mm256_set1_pd(minValid), one = _mm256_set1_pd(1.0);
+		const __m256d signMask = _mm256_set1_pd(-0.0), four = _mm256_set1_pd(4.0);
+		__m256d vX = _mm256_add_pd(_mm256_set1_pd(x), _mm256_set_pd(3.0, 2.0, 1.0, 0.0));
+		__m256d accA = _mm256_setzero_pd(), accX = _mm256_setzero_pd(), accY = _mm256_setzero_pd(), accZ = _mm256_setzero_pd();
+		for (; x + 4 <= x1; x += 4) {
+			const __m256d z = _mm256_cvtps_pd(_mm_loadu_ps(pRow + x));
+			// Ordered compares are false for NaN
+			const __m256d valid = _mm256_and_pd(_mm256_cmp_pd(z, vMax, _CMP_LE_OQ), _mm256_cmp_pd(z, vMin, _CMP_GE_OQ));
+			const __m256d Z = _mm256_and_pd(valid, z);
+			const __m256d invW = _mm256_div_pd(one, _mm256_add_pd(vW0, _mm256_mul_pd(vWx, vX)));
+			const __m256d D = _mm256_add_pd(_mm256_mul_pd(vDetZ, Z), vDet0);
+			const __m256d invW3 = _mm256_andnot_pd(signMask, _mm256_mul_pd(_mm256_mul_pd(invW, invW), invW));
+			const __m256d a = _mm256_and_pd(valid, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(D, D), vInvDetT), invW3));
+			const __m256d X = _mm256_sub_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(Z, _mm256_add_pd(vU10, _mm256_mul_pd(vU1x, vX))), _mm256_add_pd(vV10, _mm256_mul_pd(vV1x, vX))), invW), vOx);
+			const __m256d Y = _mm256_sub_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(Z, _mm256_add_pd(vU20, _mm256_mul_pd(vU2x, vX))), _mm256_add_pd(vV20, _mm256_mul_pd(vV2x, vX))), invW), vOy);
+			accA = _mm256_add_pd(accA, a);
+			accX = _mm256_add_pd(accX, _mm256_mul_pd(a, X));
+			accY = _mm256_add_pd(accY, _mm256_mul_pd(a, Y));
+			accZ = _mm256_add_pd(accZ, _mm256_mul_pd(a, _mm256_sub_pd(Z, vOz)));
+			count += _mm_popcnt_u32(static_cast<unsigned int>(_mm256_movemask_pd(valid)));
+			vX = _mm256_add_pd(vX, four);
+		}
+		double lanes[4];
+		_mm256_storeu_pd(lanes, accA);
+		sumA = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm256_storeu_pd(lanes, accX);
+		sumX = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm256_storeu_pd(lanes, accY);
+		sumY = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm256_storeu_pd(lanes, accZ);
+		sumZ = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+		for (; x < x1; ++x) {
+			const float z = pRow[x];
+			const bool bValid = z <= maxValid && z >= minValid;
+			const double Z = bValid ? z : 0.0;
+			const double invW = 1.0 / (w0 + wx * x);
+			const double D = detZ * Z + det0;
+			const double a = bValid ? D * D * invDetT * std::abs(invW * invW * invW) : 0.0;
+			const double X = (Z * (u10 + u1x * x) + v10 + v1x * x) * invW - ox;
+			const double Y = (Z * (u20 + u2x * x) + v20 + v2x * x) * invW - oy;
+			sumA += a;
+			sumX += a * X;
+			sumY += a * Y;
+			sumZ += a * (Z - oz);
+			count += bValid;
+		}
+		moments.cArea += sumA;
+		moments.cX += sumX;
+		moments.cY += sumY;
+		moments.cZ += sumZ;
+		moments.cCount += count;
+		moments.cInvalidCount += (x1 - x0) - count;
+	}
+
+	/**
+	 * @brief Object coordinates of the grid points [x0,x1) of a row, relative to an origin. Branch free.
+	 * @param terms Per pixel terms of the camera matrix
+	 * @param y Grid row
+	 * @param pRow Z values of the row
+	 * @param x0 First grid column
+	 * @param x1 One past the last grid column
+	 * @param origin Subtracted from the object coordinates
+	 * @param pX Output X of the points, starting at x0. NaN where Z is invalid.
+	 * @param pY Output Y of the points, NaN where Z is invalid
+	 * @param pZ Output Z of the points, NaN where Z is invalid
+	*/
+	void ObjectRow(const PixelTerms& terms, int y, const float* pRow, int x0, int x1, const Eigen::Vector3d& origin, double* pX, double* pY, double* pZ) {
+		const double w0 = terms.cW[1] * y + terms.cW[2], wx = terms.cW[0];
+		const double u10 = terms.cU1[1] * y + terms.cU1[2], u1x = terms.cU1[0];
+		const double v10 = terms.cV1[1] * y + terms.cV1[2], v1x = terms.cV1[0];
+		const double u20 = terms.cU2[1] * y + terms.cU2[2], u2x = terms.cU2[0];
+		const double v20 = terms.cV2[1] * y + terms.cV2[2], v2x = terms.cV2[0];
+		const double ox = origin[0], oy = origin[1], oz = origin[2];
+		const double maxValid = DepthMap::cMaxValidZ, minValid = -std::numeric_limits<float>::max();
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+
+		int x = x0;
+#if defined(__AVX2__)
+		const __m256d vW0 = _mm256_set1_pd(w0), vWx = _mm256_set1_pd(wx);
+		const __m256d vU10 = _mm256_set1_pd(u10), vU1x = _mm256_set1_pd(u1x), vV10 = _mm256_set1_pd(v10), vV1x = _mm256_set1_pd(v1x);
+		const __m256d vU20 = _mm256_set1_pd(u20), vU2x = _mm256_set1_pd(u2x), vV20 = _mm256_set1_pd(v20), vV2x = _mm256_set1_pd(v2x);
+		const __m256d vOx = _mm256_set1_pd(ox), vOy = _mm256_set1_pd(oy), vOz = _mm256_set1_pd(oz);
+		const __m256d vMax = _mm256_set1_pd(maxValid), vMin = _mm256_set1_pd(minValid), vNaN = _mm256_set1_pd(nan), one = _mm256_set1_pd(1.0), four = _mm256_set1_pd(4.0);
+		__m256d vX = _mm256_add_pd(_mm256_set1_pd(x), _mm256_set_pd(3.0, 2.0, 1.0, 0.0));
+		for (; x + 4 <= x1; x += 4) {
+			const __m256d z = _mm256_cvtps_pd(_mm_loadu_ps(pRow + x));
+			// Ordered compares are false for NaN
+			const __m256d valid = _mm256_and_pd(_mm256_cmp_pd(z, vMax, _CMP_LE_OQ), _mm256_cmp_pd(z, vMin, _CMP_GE_OQ));
+			const __m256d Z = _mm256_blendv_pd(vNaN, z, valid);
+			const __m256d invW = _mm256_div_pd(one, _mm256_add_pd(vW0, _mm256_mul_pd(vWx, vX)));
+			const size_t i = x - x0;
+			_mm256_storeu_pd(pX + i, _mm256_sub_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(Z, _mm256_add_pd(vU10, _mm256_mul_pd(vU1x, vX))), _mm256_add_pd(vV10, _mm256_mul_pd(vV1x, vX))), invW), vOx));
+			_mm256_storeu_pd(pY + i, _mm256_sub_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(Z, _mm256_add_pd(vU20, _mm256_mul_pd(vU2x, vX))), _mm256_add_pd(vV20, _mm256_mul_pd(vV2x, vX))), invW), vOy));
+			_mm256_storeu_pd(pZ + i, _mm256_sub_pd(Z, vOz));
+			vX = _mm256_add_pd(vX, four);
+		}
+#endif
+		for (; x < x1; ++x) {
+			const float z = pRow[x];
+			const double Z = (z <= maxValid && z >= minValid) ? z : nan;
+			const double invW = 1.0 / (w0 + wx * x);
+			const size_t i = x - x0;
+			pX[i] = (Z * (u10 + u1x * x) + v10 + v1x * x) * invW - ox;
+			pY[i] = (Z * (u20 + u2x * x) + v20 + v2x * x) * invW - oy;
+			pZ[i] = Z - oz;
+		}
+	}
+
+	/**
+	 * @brief Sum of the 3D areas of the cells between two rows of object points. Each cell is split into two triangles along its diagonal.
+	 * @param pX0 X of the upper row
+	 * @param pY0 Y of the upper row
+	 * @param pZ0 Z of the upper row
+	 * @param pX1 X of the lower row
+	 * @param pY1 Y of the lower row
+	 * @param pZ1 Z of the lower row
+	 * @param n Number of cells, i.e. one less than the number of points per row
+	 * @return The area. Cells with a NaN corner are skipped.
+	*/
+	double SurfaceSpan(const double* pX0, const double* pY0, const double* pZ0, const double* pX1, const double* pY1, const double* pZ1, size_t n) {
+		double area = 0.0;
+		size_t i = 0;
+#if defined(__AVX2__)
+		__m256d acc = _mm256_setzero_pd();
+		for (; i + 4 <= n; i += 4) {
+			// Corners a, b in the upper row and d, c below them, triangles (a,b,c) and (a,c,d)
+			const __m256d ax = _mm256_loadu_pd(pX0 + i), ay = _mm256_loadu_pd(pY0 + i), az = _mm256_loadu_pd(pZ0 + i);
+			const __m256d bx = _mm256_sub_pd(_mm256_loadu_pd(pX0 + i + 1), ax), by = _mm256_sub_pd(_mm256_loadu_pd(pY0 + i + 1), ay), bz = _mm256_sub_pd(_mm256_loadu_pd(pZ0 + i + 1), az);
+			const __m256d cx = _mm256_sub_pd(_mm256_loadu_pd(pX1 + i + 1), ax), cy = _mm256_sub_pd(_mm256_loadu_pd(pY1 + i + 1), ay), cz = _mm256_sub_pd(_mm256_loadu_pd(pZ1 + i + 1), az);
+			const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(pX1 + i), ax), dy = _mm256_sub_pd(_mm256_loadu_pd(pY1 + i), ay), dz = _mm256_sub_pd(_mm256_loadu_pd(pZ1 + i), az);
+			const __m256d n1x = _mm256_sub_pd(_mm256_mul_pd(by, cz), _mm256_mul_pd(bz, cy));
+			const __m256d n1y = _mm256_sub_pd(_mm256_mul_pd(bz, cx), _mm256_mul_pd(bx, cz));
+			const __m256d n1z = _mm256_sub_pd(_mm256_mul_pd(bx, cy), _mm256_mul_pd(by, cx));
+			const __m256d n2x = _mm256_sub_pd(_mm256_mul_pd(cy, dz), _mm256_mul_pd(cz, dy));
+			const __m256d n2y = _mm256_sub_pd(_mm256_mul_pd(cz, dx), _mm256_mul_pd(cx, dz));
+			const __m256d n2z = _mm256_sub_pd(_mm256_mul_pd(cx, dy), _mm256_mul_pd(cy, dx));
+			const __m256d a = _mm256_add_pd(
+				_mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(n1x, n1x), _mm256_mul_pd(n1y, n1y)), _mm256_mul_pd(n1z, n1z))),
+				_mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(n2x, n2x), _mm256_mul_pd(n2y, n2y)), _mm256_mul_pd(n2z, n2z))));
+			// NaN propagates from any invalid corner
+			acc = _mm256_add_pd(acc, _mm256_and_pd(_mm256_cmp_pd(a, a, _CMP_ORD_Q), a));
+		}
+		double lanes[4];
+		_mm256_storeu_pd(lanes, acc);
+		area = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+		for (; i < n; ++i) {
+			const Eigen::Vector3d a(pX0[i], pY0[i], pZ0[i]);
+			const Eigen::Vector3d b = Eigen::Vector3d(pX0[i + 1], pY0[i + 1], pZ0[i + 1]) - a;
+			const Eigen::Vector3d c = Eigen::Vector3d(pX1[i + 1], pY1[i + 1], pZ1[i + 1]) - a;
+			const Eigen::Vector3d d = Eigen::Vector3d(pX1[i], pY1[i], pZ1[i]) - a;
+			const double cell = b.cross(c).norm() + c.cross(d).norm();
+			if (!std::isnan(cell)) {
+				area += cell;
+			}
+		}
+		return area / 2.0;
+	}
+
+	/**
+	 * @brief Signed area of an open ring, positive if counter clockwise with y up
+	*/
+	double SignedArea(const Geometry::Point* pPoints, size_t n) {
+		double area = 0.0;
+		for (size_t i = 0; i < n; ++i) {
+			const Geometry::Point& p = pPoints[i];
+			const Geometry::Point& q = pPoints[(i + 1) % n];
+			area += p.get<0>() * q.get<1>() - q.get<0>() * p.get<1>();
+		}
+		return area / 2.0;
+	}
+}
+
+VolumeIntegrator::Moments::Moments() : cArea(0.0), cX(0.0), cY(0.0), cZ(0.0), cSurface(0.0), cCount(0), cInvalidCount(0) {}
+
+VolumeIntegrator::Moments& VolumeIntegrator::Moments::operator+=(const VolumeIntegrator::Moments& other) {
+	cArea += other.cArea;
+	cX += other.cX;
+	cY += other.cY;
+	cZ += other.cZ;
+	cSurface += other.cSurface;
+	cCount += other.cCount;
+	cInvalidCount += other.cInvalidCount;
+	return *this;
+}
+
+VolumeIntegrator::Moments& VolumeIntegrator::Moments::operator-=(const VolumeIntegrator::Moments& other) {
+	cArea -= other.cArea;
+	cX -= other.cX;
+	cY -= other.cY;
+	cZ -= other.cZ;
+	cSurface -= other.cSurface;
+	cCount -= other.cCount;
+	cInvalidCount -= other.cInvalidCount;
+	return *this;
+}
+
+bool VolumeIntegrator::Integrate(const Geometry& geometry, const Geometry::Polygon& imagePolygon, const Eigen::Vector3d& origin, VolumeIntegrator::Moments& moments, size_t level) {
+	moments = Moments();
+	if (!geometry.cpDepthMap || geometry.cProjection == Geometry::EProjection::NONE) {
+		wxLogError(_("Volume requires a depth map and a camera matrix"));
+		return false;
+	}
+	const DepthMap& depthMap = *geometry.cpDepthMap;
+	level = GetLevel(geometry, level);
+	const DepthPyramid* pPyramid = level > 0 ? geometry.cpDepthPyramid.get() : nullptr;
+
+	// The grid is the pixels or the cells of a pyramid level
+	size_t width = 0, height = 0;
+	Eigen::Matrix3d pixelToGrid;
+	GetGrid(geometry, level, pixelToGrid, width, height);
+	const Eigen::Matrix3d cameraToGrid = pixelToGrid * geometry.cCameraToPixelTransform;
+	Geometry::Polygon gridPolygon;
+	geometry.ImageToPixel(imagePolygon, gridPolygon);
+	if (pPyramid) {
+		auto toCell = [&](Geometry::Point& pt) {
+			pt.set<0>(pixelToGrid(0, 0) * pt.get<0>() + pixelToGrid(0, 2));
+			pt.set<1>(pixelToGrid(1, 1) * pt.get<1>() + pixelToGrid(1, 2));
+		};
+		std::for_each(gridPolygon.outer().begin(), gridPolygon.outer().end(), toCell);
+		for (Geometry::Polygon::ring_type& inner : gridPolygon.inners()) {
+			std::for_each(inner.begin(), inner.end(), toCell);
+		}
+	}
+	const PixelTerms terms(geometry, cameraToGrid);
+	const float* pData = level == 0 ? depthMap.GetData() : nullptr;
+	PolygonRasterizer rasterizer;
+	int y0 = 0, y1 = 0;
+	// No rows if outside the depth map. A thin polygon may also cover cells between the pixels but no pixel centres.
+	if (rasterizer.Create(gridPolygon, width, height)) {
+		rasterizer.GetRows(y0, y1);
+	}
+	const size_t nBands = (y1 - y0 + cBandRows - 1) / cBandRows;
+	std::vector<Moments> vBands(nBands);
+	ThreadPool::GetInstance().ParallelFor(0, nBands, [&](size_t bandBegin, size_t bandEnd) {
+		std::vector<PolygonRasterizer::Span> vSpans;
+		std::vector<float> vRow(pData ? 0 : width);
+		for (size_t band = bandBegin; band < bandEnd; ++band) {
+			const int by0 = y0 + static_cast<int>(band) * cBandRows;
+			rasterizer.GetSpans(by0, std::min(y1, by0 + cBandRows), vSpans);
+			int rowY = -1;
+			bool bRow = false;
+			for (const PolygonRasterizer::Span& span : vSpans) {
+				if (!pData && span.cY != rowY) {
+					rowY = span.cY;
+					bRow = level == 0 ? depthMap.GetRow(rowY, vRow.data()) : pPyramid->GetMeanRow(level - 1, rowY, vRow.data());
+				}
+				if (!pData && !bRow) {
+					vBands[band].cInvalidCount += span.cX1 - span.cX0;
+					continue;
+				}
+				const float* pRow = pData ? pData + span.cY * width : vRow.data();
+				IntegrateSpan(terms, span.cY, pRow, span.cX0, span.cX1, origin, vBands[band]);
+			}
+		}
+	});
+
+	// Same order every time, so the result does not depend on the scheduling
+	for (const Moments& band : vBands) {
+		moments += band;
+	}
+
+	// Draped surface of the cells between four neighbouring grid points. Cell (x,y) has its centre at (x+0.5,y+0.5) and is inside if its centre is.
+	Geometry::Polygon cellPolygon = gridPolygon;
+	auto toCellCorner = [](Geometry::Point& pt) {
+		pt.set<0>(pt.get<0>() - 0.5);
+		pt.set<1>(pt.get<1>() - 0.5);
+	};
+	std::for_each(cellPolygon.outer().begin(), cellPolygon.outer().end(), toCellCorner);
+	for (Geometry::Polygon::ring_type& inner : cellPolygon.inners()) {
+		std::for_each(inner.begin(), inner.end(), toCellCorner);
+	}
+	PolygonRasterizer cellRasterizer;
+	if (width < 2 || height < 2 || !cellRasterizer.Create(cellPolygon, width - 1, height - 1)) {
+		return true;
+	}
+	cellRasterizer.GetRows(y0, y1);
+	const size_t nCellBands = (y1 - y0 + cBandRows - 1) / cBandRows;
+	std::vector<double> vSurfaces(nCellBands, 0.0);
+	ThreadPool::GetInstance().ParallelFor(0, nCellBands, [&](size_t bandBegin, size_t bandEnd) {
+		std::vector<PolygonRasterizer::Span> vSpans;
+		std::vector<float> vRows(pData ? 0 : 2 * width);
+		std::vector<double> vPoints(6 * width);
+		double* pX0 = vPoints.data(), *pY0 = pX0 + width, *pZ0 = pY0 + width, *pX1 = pZ0 + width, *pY1 = pX1 + width, *pZ1 = pY1 + width;
+		for (size_t band = bandBegin; band < bandEnd; ++band) {
+			const int by0 = y0 + static_cast<int>(band) * cBandRows;
+			cellRasterizer.GetSpans(by0, std::min(y1, by0 + cBandRows), vSpans);
+			int rowY = -1;
+			bool bRows = false;
+			for (const PolygonRasterizer::Span& span : vSpans) {
+				if (!pData && span.cY != rowY) {
+					rowY = span.cY;
+					bRows = level == 0 ? depthMap.GetRow(rowY, vRows.data()) && depthMap.GetRow(rowY + 1, vRows.data() + width)
+						: pPyramid->GetMeanRow(level - 1, rowY, vRows.data()) && pPyramid->GetMeanRow(level - 1, rowY + 1, vRows.data() + width);
+				}
+				if (!pData && !bRows) {
+					continue;
+				}
+				const float* pRow0 = pData ? pData + span.cY * width : vRows.data();
+				const float* pRow1 = pData ? pData + (span.cY + 1) * width : vRows.data() + width;
+				ObjectRow(terms, span.cY, pRow0, span.cX0, span.cX1 + 1, origin, pX0, pY0, pZ0);
+				ObjectRow(terms, span.cY + 1, pRow1, span.cX0, span.cX1 + 1, origin, pX1, pY1, pZ1);
+				vSurfaces[band] += SurfaceSpan(pX0, pY0, pZ0, pX1, pY1, pZ1, span.cX1 - span.cX0);
+			}
+		}
+	});
+	for (double surface : vSurfaces) {
+		moments.cSurface += surface;
+	}
+	return true;
+}
+
+size_t VolumeIntegrator::GetLevel(const Geometry& geometry, size_t level) {
+	if (level == 0 || !geometry.cpDepthPyramid || geometry.cpDepthPyramid->GetNumberOfLevels() == 0) {
+		return 0;
+	}
+	return std::min(level, geometry.cpDepthPyramid->GetNumberOfLevels());
+}
+
+void VolumeIntegrator::GetGrid(const Geometry& geometry, size_t level, Eigen::Matrix3d& pixelToGrid, size_t& width, size_t& height) {
+	level = GetLevel(geometry, level);
+	pixelToGrid.setIdentity();
+	width = geometry.cpDepthMap ? geometry.cpDepthMap->GetWidth() : 0;
+	height = geometry.cpDepthMap ? geometry.cpDepthMap->GetHeight() : 0;
+	if (level > 0) {
+		// Cell (x,y) is centred at pixel (s*x+(s-1)/2,s*y+(s-1)/2)
+		const double cellSize = static_cast<double>(geometry.cpDepthPyramid->GetCellSize(level - 1));
+		const double offset = (cellSize - 1.0) / 2.0;
+		geometry.cpDepthPyramid->GetSize(level - 1, width, height);
+		pixelToGrid << 1.0 / cellSize, 0.0, -offset / cellSize, 0.0, 1.0 / cellSize, -offset / cellSize, 0.0, 0.0, 1.0;
+	}
+}
+
+bool VolumeIntegrator::GetObjectRow(const Geometry& geometry, const Eigen::Matrix3d& cameraToGrid, int y, const float* pRow, int x0, int x1, double* pX, double* pY, double* pArea) {
+	if (geometry.cProjection == Geometry::EProjection::NONE) {
+		return false;
+	}
+	const PixelTerms terms(geometry, cameraToGrid);
+	const double w0 = terms.cW[1] * y + terms.cW[2], wx = terms.cW[0];
+	const double u10 = terms.cU1[1] * y + terms.cU1[2], u1x = terms.cU1[0];
+	const double v10 = terms.cV1[1] * y + terms.cV1[2], v1x = terms.cV1[0];
+	const double u20 = terms.cU2[1] * y + terms.cU2[2], u2x = terms.cU2[0];
+	const double v20 = terms.cV2[1] * y + terms.cV2[2], v2x = terms.cV2[0];
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	for (int x = x0; x < x1; ++x) {
+		const size_t i = x - x0;
+		const float z = pRow[x];
+		if (!DepthMap::IsValid(z)) {
+			pX[i] = pY[i] = nan;
+			pArea[i] = 0.0;
+			continue;
+		}
+		const double invW = 1.0 / (w0 + wx * x);
+		const double D = terms.cDetZ * z + terms.cDet0;
+		pX[i] = (z * (u10 + u1x * x) + v10 + v1x * x) * invW;
+		pY[i] = (z * (u20 + u2x * x) + v20 + v2x * x) * invW;
+		pArea[i] = D * D * terms.cInvDetT * std::abs(invW * invW * invW);
+	}
+	return true;
+}
+
+bool VolumeIntegrator::MoveVertex(const Geometry& geometry, const Geometry::Polygon::ring_type& imageRing, size_t index, const Geometry::Point& previousPt, const Eigen::Vector3d& origin, VolumeIntegrator::Moments& moments) {
+	size_t n = imageRing.size();
+	if (n > 1 && boost::geometry::equals(imageRing.front(), imageRing.back())) {
+		--n; // Closing vertex
+	}
+	if (n < 3 || index >= n) {
+		return false;
+	}
+
+	// Orientations are taken in pixels, as the rasterization, since the image to pixel transformation may mirror
+	std::vector<Geometry::Point> vPixels(n);
+	for (size_t i = 0; i < n; ++i) {
+		geometry.ImageToPixel(imageRing[i], vPixels[i]);
+	}
+	Geometry::Point previousPixel;
+	geometry.ImageToPixel(previousPt, previousPixel);
+	const double ringArea = SignedArea(vPixels.data(), n);
+	if (ringArea == 0.0) {
+		return false;
+	}
+
+	const size_t a = (index + n - 1) % n, b = (index + 1) % n;
+	const Geometry::Point triangles[2][3] = {
+		{ imageRing[a], imageRing[index], previousPt },
+		{ previousPt, imageRing[index], imageRing[b] } };
+	const Geometry::Point pixelTriangles[2][3] = {
+		{ vPixels[a], vPixels[index], previousPixel },
+		{ previousPixel, vPixels[index], vPixels[b] } };
+	for (int i = 0; i < 2; ++i) {
+		const double area = SignedArea(pixelTriangles[i], 3);
+		if (area == 0.0) {
+			continue;
+		}
+		Geometry::Polygon triangle;
+		triangle.outer().assign(triangles[i], triangles[i] + 3);
+		Moments triangleMoments;
+		if (!Integrate(geometry, triangle, origin, triangleMoments)) {
+			return false;
+		}
+		if ((area > 0.0) == (ringArea > 0.0)) {
+			moments += triangleMoments;
+		} else {
+			moments -= triangleMoments;
+		}
+	}
+	return true;
+}
+
+bool VolumeIntegrator::FitPlane(const std::vector<Geometry::Point3D>& vPoints, const Eigen::Vector3d& origin, Eigen::Vector3d& plane) {
+	if (vPoints.empty()) {
+		return false;
+	}
+	Eigen::MatrixXd A(vPoints.size(), 3);
+	Eigen::VectorXd b(vPoints.size());
+	for (size_t i = 0; i < vPoints.size(); ++i) {
+		A(i, 0) = vPoints[i].get<0>() - origin[0];
+		A(i, 1) = vPoints[i].get<1>() - origin[1];
+		A(i, 2) = 1.0;
+		b[i] = vPoints[i].get<2>() - origin[2];
+	}
+	Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(A);
+	qr.setThreshold(1.0e-9);
+	if (qr.rank() < 3) {
+		plane = Eigen::Vector3d(0.0, 0.0, b.mean());
+		return true;
+	}
+	plane = qr.solve(b);
+	return true;
+}
+
+double VolumeIntegrator::GetVolume(const VolumeIntegrator::Moments& moments, const Eigen::Vector3d& plane) {
+	return moments.cZ - plane[0] * moments.cX - plane[1] * moments.cY - plane[2] * moments.cArea;
+}
@@ -0,0 +1,270 @@
+#include <IconicMeasureCommon/ZonalStatistics.h>
+#include <IconicMeasureCommon/PolygonRasterizer.h>
+#include <IconicMeasureCommon/ThreadPool.h>
+#include <wx/log.h>
+#include <wx/intl.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+
+using namespace iconic;
+
+namespace {
+	const int cBandRows = 16; //!< Rows per parallel band
+
+	/**
+	 * @brief Sums of the Z values of a zone in a band, relative to the shift of the zone
+	*/
+	struct Accumulator {
+		size_t cCount;			//!< Number of valid pixels
+		size_t cInvalidCount;	//!< Number of pixels without valid Z
+		float cMin;				//!< Smallest Z
+		float cMax;				//!< Largest Z
+		double cSum;			//!< Sum of Z-shift
+		double cSumSq;			//!< Sum of (Z-shift)^2
+
+		Accumulator() : cCount(0), cInvalidCount(0), cMin(std::numeric_limits<float>::max()), cMax(-std::numeric_limits<float>::max()), cSum(0.0), cSumSq(0.0) {}
+
+		Accumulator& operator+=(const Accumulator& other) {
+			cCount += other.cCount;
+			cInvalidCount += other.cInvalidCount;
+			cMin = std::min(cMin, other.cMin);
+			cMax = std::max(cMax, other.cMax);
+			cSum += other.cSum;
+			cSumSq += other.cSumSq;
+			return *this;
+		}
+	};
+
+	/**
+	 * @brief A rasterized polygon and its histogram range
+	*/
+	struct Zone {
+		PolygonRasterizer cRasterizer;	//!< Pixels of the polygon
+		int cRows[2];					//!< First and one past the last row with pixels
+		bool cbRange;					//!< True if cMin and cMax contain all Z of the polygon
+		double cMin;					//!< Lower edge of the histogram
+		double cMax;					//!< Upper edge of the histogram
+		double cShift;					//!< Subtracted from Z in the sums, which keeps the variance accurate
+		double cInvBinWidth;			//!< Bins per unit Z
+	};
+
+	/**
+	 * @brief Add the pixels [x0,x1) of a row
+	 * @param pRow Z values of the row
+	 * @param x0 First pixel column
+	 * @param x1 One past the last pixel column
+	 * @param zone Shift and histogram range
+	 * @param accumulator Sums to add to
+	 * @param pHistogram Histogram to add to, or null
+	 * @param bins Number of bins of the histogram
+	*/
+	void AddSpan(const float* pRow, int x0, int x1, const Zone& zone, Accumulator& accumulator, size_t* pHistogram, size_t bins) {
+		const double shift = zone.cShift, histogramMin = zone.cMin, invBinWidth = zone.cInvBinWidth;
+		const double lastBin = static_cast<double>(bins - 1);
+		float zMin = accumulator.cMin, zMax = accumulator.cMax;
+		double sum = 0.0, sumSq = 0.0;
+		size_t count = 0;
+		for (int x = x0; x < x1; ++x) {
+			const float z = pRow[x];
+			if (!DepthMap::IsValid(z)) {
+				continue;
+			}
+			const double d = z - shift;
+			zMin = std::min(zMin, z);
+			zMax = std::max(zMax, z);
+			sum += d;
+			sumSq += d * d;
+			++count;
+			if (pHistogram) {
+				++pHistogram[static_cast<size_t>(std::min(lastBin, std::max(0.0, (z - histogramMin) * invBinWidth)))];
+			}
+		}
+		accumulator.cMin = zMin;
+		accumulator.cMax = zMax;
+		accumulator.cSum += sum;
+		accumulator.cSumSq += sumSq;
+		accumulator.cCount += count;
+		accumulator.cInvalidCount += (x1 - x0) - count;
+	}
+
+	/**
+	 * @brief Sweep the depth map once for all zones
+	 * @param depthMap Depth map
+	 * @param vZones Zones
+	 * @param y0 First row of any zone
+	 * @param y1 One past the last row of any zone
+	 * @param bins Number of histogram bins, 0 to skip the histograms
+	 * @param vTotals Gets the sums of each zone
+	 * @param vHistograms Gets the histograms of the zones, \c bins per zone
+	*/
+	void Sweep(const DepthMap& depthMap, const std::vector<Zone>& vZones, int y0, int y1, size_t bins, std::vector<Accumulator>& vTotals, std::vector<size_t>& vHistograms) {
+		const size_t nZones = vZones.size();
+		const size_t nBands = y0 < y1 ? (y1 - y0 + cBandRows - 1) / cBandRows : 0;
+		const size_t width = depthMap.GetWidth();
+		const float* pData = depthMap.GetData();
+		std::vector<Accumulator> vBands(nBands * nZones);
+		vHistograms.assign(nZones * bins, 0);
+		std::mutex mutex;
+		ThreadPool::GetInstance().ParallelFor(0, nBands, [&](size_t bandBegin, size_t bandEnd) {
+			std::vector<PolygonRasterizer::Span> vSpans;
+			// Rows of the band are read once, for all zones, if the depth map is not contiguous
+			std::vector<float> vRows(pData ? 0 : cBandRows * width);
+			std::vector<int> vRowStatus(cBandRows);
+			// Counts do not depend on the order of addition, so the histograms are summed per chunk
+			std::vector<size_t> vHistogram(nZones * bins, 0);
+			for (size_t band = bandBegin; band < bandEnd; ++band) {
+				const int by0 = y0 + static_cast<int>(band) * cBandRows, by1 = std::min(y1, by0 + cBandRows);
+				std::fill(vRowStatus.begin(), vRowStatus.end(), -1);
+				for (size_t z = 0; z < nZones; ++z) {
+					const Zone& zone = vZones[z];
+					if (zone.cRows[1] <= by0 || zone.cRows[0] >= by1) {
+						continue;
+					}
+					zone.cRasterizer.GetSpans(by0, by1, vSpans);
+					Accumulator& accumulator = vBands[band * nZones + z];
+					for (const PolygonRasterizer::Span& span : vSpans) {
+						const float* pRow = nullptr;
+						if (pData) {
+							pRow = pData + span.cY * width;
+						} else {
+							const int row = span.cY - by0;
+							if (vRowStatus[row] < 0) {
+								vRowStatus[row] = depthMap.GetRow(span.cY, vRows.data() + row * width) ? 1 : 0;
+							}
+							if (!vRowStatus[row]) {
+								accumulator.cInvalidCount += span.cX1 - span.cX0;
+								continue;
+							}
+							pRow = vRows.data() + row * width;
+						}
+						AddSpan(pRow, span.cX0, span.cX1, zone, accumulator, bins ? vHistogram.data() + z * bins : nullptr, bins);
+					}
+				}
+			}
+			if (bins) {
+				std::lock_guard<std::mutex> lock(mutex);
+				std::transform(vHistograms.begin(), vHistograms.end(), vHistogram.begin(), vHistograms.begin(), std::plus<size_t>());
+			}
+		});
+
+		// Same order every time, so the result does not depend on the scheduling
+		vTotals.assign(nZones, Accumulator());
+		for (size_t band = 0; band < nBands; ++band) {
+			for (size_t z = 0; z < nZones; ++z) {
+				vTotals[z] += vBands[band * nZones + z];
+			}
+		}
+	}
+}
+
+ZonalStatistics::Statistics::Statistics() :
+	cCount(0),
+	cInvalidCount(0),
+	cMin(std::numeric_limits<float>::max()),
+	cMax(-std::numeric_limits<float>::max()),
+	cMean(0.0),
+	cStdDev(0.0),
+	cHistogramMin(0.0),
+	cBinWidth(0.0)
+{}
+
+double ZonalStatistics::Statistics::GetPercentile(double percent) const {
+	if (!cCount || cvHistogram.empty()) {
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+	const double rank = std::min(100.0, std::max(0.0, percent)) / 100.0 * cCount;
+	double cumulative = 0.0;
+	size_t bin = 0;
+	for (; bin + 1 < cvHistogram.size() && cumulative + cvHistogram[bin] < rank; ++bin) {
+		cumulative += cvHistogram[bin];
+	}
+	const double fraction = cvHistogram[bin] ? (rank - cumulative) / cvHistogram[bin] : 0.0;
+	const double z = cHistogramMin + (bin + std::min(1.0, fraction)) * cBinWidth;
+	return std::min(static_cast<double>(cMax), std::max(static_cast<double>(cMin), z));
+}
+
+bool ZonalStatistics::Compute(const Geometry& geometry, const Geometry::Polygon& imagePolygon, ZonalStatistics::Statistics& statistics, size_t bins) {
+	std::vector<Statistics> vStatistics;
+	if (!Compute(geometry, std::vector<Geometry::Polygon>(1, imagePolygon), vStatistics, bins)) {
+		return false;
+	}
+	statistics = vStatistics[0];
+	return true;
+}
+
+bool ZonalStatistics::Compute(const Geometry& geometry, const std::vector<Geometry::Polygon>& vImagePolygons, std::vector<ZonalStatistics::Statistics>& vStatistics, size_t bins) {
+	vStatistics.assign(vImagePolygons.size(), Statistics());
+	if (!geometry.cpDepthMap) {
+		wxLogError(_("Zonal statistics require a depth map"));
+		return false;
+	}
+	if (bins == 0) {
+		wxLogError(_("Zonal statistics require at least one histogram bin"));
+		return false;
+	}
+	const DepthMap& depthMap = *geometry.cpDepthMap;
+
+	std::vector<Zone> vZones(vImagePolygons.size());
+	int y0 = std::numeric_limits<int>::max(), y1 = std::numeric_limits<int>::min();
+	bool bRanges = true;
+	for (size_t i = 0; i < vImagePolygons.size(); ++i) {
+		Zone& zone = vZones[i];
+		Geometry::Polygon pixelPolygon;
+		geometry.ImageToPixel(vImagePolygons[i], pixelPolygon);
+		zone.cRows[0] = zone.cRows[1] = 0;
+		if (zone.cRasterizer.Create(pixelPolygon, depthMap.GetWidth(), depthMap.GetHeight())) {
+			zone.cRasterizer.GetRows(zone.cRows[0], zone.cRows[1]);
+			y0 = std::min(y0, zone.cRows[0]);
+			y1 = std::max(y1, zone.cRows[1]);
+		}
+		DepthPyramid::Range range;
+		zone.cbRange = geometry.GetHeightRange(vImagePolygons[i], range);
+		zone.cMin = zone.cbRange ? range.cMin : 0.0;
+		zone.cMax = zone.cbRange ? range.cMax : 0.0;
+		zone.cShift = zone.cbRange ? range.cMean : 0.0;
+		zone.cInvBinWidth = 0.0;
+		bRanges = bRanges && (zone.cbRange || zone.cRows[0] == zone.cRows[1]);
+	}
+
+	std::vector<Accumulator> vTotals;
+	std::vector<size_t> vHistograms;
+	if (!bRanges) {
+		// No depth pyramid, find the ranges first
+		Sweep(depthMap, vZones, y0, y1, 0, vTotals, vHistograms);
+		for (size_t i = 0; i < vZones.size(); ++i) {
+			if (!vZones[i].cbRange && vTotals[i].cCount) {
+				vZones[i].cMin = vTotals[i].cMin;
+				vZones[i].cMax = vTotals[i].cMax;
+				vZones[i].cShift = (vZones[i].cMin + vZones[i].cMax) / 2.0;
+			}
+		}
+	}
+	for (Zone& zone : vZones) {
+		if (!(zone.cMax > zone.cMin)) {
+			zone.cMax = zone.cMin + 1.0; // All pixels in the first bin
+		}
+		zone.cInvBinWidth = bins / (zone.cMax - zone.cMin);
+	}
+	Sweep(depthMap, vZones, y0, y1, bins, vTotals, vHistograms);
+
+	for (size_t i = 0; i < vZones.size(); ++i) {
+		Statistics& statistics = vStatistics[i];
+		const Accumulator& total = vTotals[i];
+		statistics.cCount = total.cCount;
+		statistics.cInvalidCount = total.cInvalidCount;
+		statistics.cMin = total.cMin;
+		statistics.cMax = total.cMax;
+		statistics.cHistogramMin = vZones[i].cMin;
+		statistics.cBinWidth = 1.0 / vZones[i].cInvBinWidth;
+		statistics.cvHistogram.assign(vHistograms.begin() + i * bins, vHistograms.begin() + (i + 1) * bins);
+		if (total.cCount) {
+			const double mean = total.cSum / total.cCount;
+			statistics.cMean = vZones[i].cShift + mean;
+			statistics.cStdDev = std::sqrt(std::max(0.0, total.cSumSq / total.cCount - mean * mean));
+		}
+	}
+	return true;
+}
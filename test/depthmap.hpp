@@ -0,0 +1,526 @@
+#pragma once
+
+#include <IconicMeasureCommon/DepthMap.h>
+#include <IconicMeasureCommon/CompactDepthMap.h>
+#include <IconicMeasureCommon/FrameCache.h>
+#include <IconicMeasureCommon/FramePrefetcher.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <IconicMeasureCommon/MeasureHandler.h>
+#include <IconicMeasureCommon/TiledDepthMap.h>
+#include <testdepthmap.hpp>
+#include <boost/make_shared.hpp>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(iconic_compact_depthmap_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// A sloping terrain between Z=20 and Z=120 with a few invalid values
+	const size_t width = 1023, height = 517;
+	TestDepthMap depthMap(width, height, [&](size_t x, size_t y) {
+		if (x == 5 && y == 0) {
+			return 1.0e10f;
+		}
+		if (x == 3 && y == 7) {
+			return std::nanf("");
+		}
+		// Just above the valid range, which is within half float rounding of a valid value. In the vectorized part and in the scalar tail of a row.
+		if (y == 9 && (x == 6 || x == width - 1)) {
+			return iconic::DepthMap::cMaxValidZ + 0.1f;
+		}
+		return 20.0f + 100.0f * x / width + 0.37f * std::sin(0.1f * y);
+	});
+	const std::vector<float>& vZ = depthMap.cvZ;
+	const iconic::RawDepthMap& raw = *depthMap.cpDepthMap;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	iconic::HalfDepthMap half;
+	BOOST_REQUIRE(half.Create(raw));
+	iconic::QuantizedDepthMap quantized;
+	BOOST_REQUIRE(quantized.Create(raw));
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Converted " << width << "x" << height << " depth map twice, wall time " << elapsed.count() << " s" << std::endl;
+	std::cerr << "Max error half float " << half.GetMaxError() << ", fixed point " << quantized.GetMaxError() << std::endl;
+
+	BOOST_TEST(half.GetMemoryUsage() == raw.GetMemoryUsage() / 2);
+	BOOST_TEST(quantized.GetMemoryUsage() == raw.GetMemoryUsage() / 2);
+	BOOST_TEST(half.GetMaxError() <= 120.0f / 2048.0f); // Half of the half float precision at Z=120
+	BOOST_TEST(quantized.GetMaxError() <= 0.5f * quantized.GetScale() * 1.01f);
+
+	// Reported error must match what GetZ and GetRow return, and invalid values must stay invalid
+	std::vector<float> vRow(width);
+	float maxError = 0.0f;
+	for (int y = 0; y < static_cast<int>(height); ++y) {
+		BOOST_REQUIRE(quantized.GetRow(y, vRow.data()));
+		for (int x = 0; x < static_cast<int>(width); ++x) {
+			const float Z = vZ[y * width + x];
+			float Zq = 0.0f;
+			BOOST_REQUIRE(quantized.GetZ(x, y, Zq));
+			BOOST_REQUIRE(Zq == vRow[x]);
+			if (Z <= iconic::DepthMap::cMaxValidZ) {
+				maxError = std::max(maxError, std::abs(Zq - Z));
+			} else {
+				BOOST_TEST(Zq > iconic::DepthMap::cMaxValidZ);
+			}
+		}
+	}
+	BOOST_TEST(maxError == quantized.GetMaxError());
+
+	float Z = 0.0f;
+	BOOST_TEST(half.GetZ(5, 0, Z));
+	BOOST_TEST(Z > iconic::DepthMap::cMaxValidZ);
+	BOOST_TEST(half.GetZ(3, 7, Z));
+	BOOST_TEST(!iconic::DepthMap::IsValid(Z));
+	BOOST_TEST(half.GetZ(6, 9, Z));
+	BOOST_TEST(!iconic::DepthMap::IsValid(Z));
+	BOOST_TEST(half.GetZ(static_cast<int>(width) - 1, 9, Z));
+	BOOST_TEST(!iconic::DepthMap::IsValid(Z));
+	BOOST_REQUIRE(half.GetRow(9, vRow.data()));
+	BOOST_TEST(!iconic::DepthMap::IsValid(vRow[6]));
+	BOOST_TEST(!iconic::DepthMap::IsValid(vRow[width - 1]));
+	BOOST_TEST(!half.GetZ(static_cast<int>(width), 0, Z));
+
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_depth_pyramid_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	const size_t width = 4000, height = 3000;
+	TestDepthMap depthMap(width, height, [&](size_t x, size_t y) {
+		return (x == 567 && y == 1234) ? 1.0e10f : 10.0f + 0.01f * x + 5.0f * std::sin(0.003f * x * y / height); // One invalid value
+	});
+	const std::vector<float>& vZ = depthMap.cvZ;
+	iconic::Geometry geometry;
+	geometry.cpDepthMap = depthMap.cpDepthMap; // Pixel and image coordinates are the same since cCameraToPixelTransform is identity
+
+	BOOST_REQUIRE(geometry.BuildDepthPyramid()); // Page in the mapped file
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE(geometry.BuildDepthPyramid());
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Built depth pyramid of " << width << "x" << height << " depth map with " << geometry.cpDepthPyramid->GetNumberOfLevels() << " levels, wall time " << elapsed.count() << " s" << std::endl;
+
+	// Whole depth map from the top level must match brute force
+	float minZ = std::numeric_limits<float>::max(), maxZ = -minZ;
+	double sum = 0.0;
+	size_t count = 0;
+	for (float Z : vZ) {
+		if (iconic::DepthMap::IsValid(Z)) {
+			minZ = std::min(minZ, Z);
+			maxZ = std::max(maxZ, Z);
+			sum += Z;
+			++count;
+		}
+	}
+	iconic::DepthPyramid::Range range;
+	BOOST_REQUIRE(geometry.cpDepthPyramid->GetCell(geometry.cpDepthPyramid->GetNumberOfLevels() - 1, 0, 0, range));
+	BOOST_TEST(range.cMin == minZ);
+	BOOST_TEST(range.cMax == maxZ);
+	BOOST_TEST(range.cCount == count);
+	BOOST_TEST(std::abs(range.cMean - sum / count) < 1.0e-3);
+
+	// Ranges of regions contain the true range
+	iconic::Geometry::Polygon triangle;
+	boost::geometry::read_wkt("POLYGON((100 100,1100 2900,3900 400,100 100))", triangle);
+	boost::geometry::correct(triangle);
+	BOOST_REQUIRE(geometry.GetHeightRange(triangle, range));
+	minZ = std::numeric_limits<float>::max();
+	maxZ = -minZ;
+	for (size_t y = 0; y < height; ++y) {
+		for (size_t x = 0; x < width; ++x) {
+			if (iconic::DepthMap::IsValid(vZ[y * width + x]) && boost::geometry::within(iconic::Geometry::Point(x, y), triangle)) {
+				minZ = std::min(minZ, vZ[y * width + x]);
+				maxZ = std::max(maxZ, vZ[y * width + x]);
+			}
+		}
+	}
+	std::cerr << "Height range under triangle " << range.cMin << " - " << range.cMax << ", true range " << minZ << " - " << maxZ << std::endl;
+	BOOST_TEST(range.cMin <= minZ);
+	BOOST_TEST(range.cMax >= maxZ);
+	BOOST_TEST(maxZ - minZ > 0.9f * (range.cMax - range.cMin));
+
+	BOOST_REQUIRE(geometry.GetDepthRange(iconic::Geometry::Box(iconic::Geometry::Point(10, 20), iconic::Geometry::Point(13, 21)), range));
+	BOOST_TEST(range.cMin <= *std::min_element(&vZ[20 * width + 10], &vZ[20 * width + 14]));
+	BOOST_TEST(range.cMax >= *std::max_element(&vZ[21 * width + 10], &vZ[21 * width + 14]));
+
+	// Summed-area tables give exact statistics of a box
+	start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE(geometry.BuildDepthIntegral());
+	elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Built depth integral, wall time " << elapsed.count() << " s" << std::endl;
+	iconic::DepthIntegral::Statistics statistics;
+	BOOST_REQUIRE(geometry.GetDepthStatistics(iconic::Geometry::Box(iconic::Geometry::Point(500, 1000), iconic::Geometry::Point(1999, 2499)), statistics));
+	sum = 0.0;
+	double sum2 = 0.0;
+	count = 0;
+	for (size_t y = 1000; y < 2500; ++y) {
+		for (size_t x = 500; x < 2000; ++x) {
+			const float Z = vZ[y * width + x];
+			if (iconic::DepthMap::IsValid(Z)) {
+				sum += Z;
+				sum2 += static_cast<double>(Z) * Z;
+				++count;
+			}
+		}
+	}
+	BOOST_TEST(statistics.cCount == count);
+	BOOST_TEST(std::abs(statistics.cMean - sum / count) < 1.0e-6);
+	BOOST_TEST(std::abs(statistics.cVariance - (sum2 / count - (sum / count) * (sum / count))) < 1.0e-4);
+
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_tiled_depthmap_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// Not a multiple of the tile size, so the border tiles are smaller
+	const size_t width = 301, height = 203, tileSize = 64;
+	TestDepthMap depthMap(width, height, [](size_t x, size_t y) { return (x == 200 && y == 100) ? 1.0e10f : 50.0f + 0.1f * x + 2.0f * std::sin(0.05f * y); });
+	const std::vector<float>& vZ = depthMap.cvZ;
+	const wxString& rawFileName = depthMap.cFileName;
+
+	const iconic::TiledDepthMap::ECompression compressions[] = { iconic::TiledDepthMap::ECompression::NONE, iconic::TiledDepthMap::ECompression::ZLIB, iconic::TiledDepthMap::ECompression::BZIP2 };
+	const wxString tiledFileName = wxFileName::CreateTempFileName("tdm");
+	std::vector<float> vRow(width);
+	for (iconic::TiledDepthMap::ECompression compression : compressions) {
+		BOOST_REQUIRE(iconic::TiledDepthMap::Convert(rawFileName, width, height, tiledFileName, compression, tileSize));
+		BOOST_TEST(!wxFFile(tiledFileName + ".tmp", "rb").IsOpened()); // Renamed when complete
+
+		iconic::TiledDepthMap tiled(4);
+		BOOST_REQUIRE(tiled.Open(tiledFileName, width, height));
+		BOOST_TEST(tiled.GetTileSize() == tileSize);
+		for (int y = 0; y < static_cast<int>(height); ++y) {
+			BOOST_REQUIRE(tiled.GetRow(y, vRow.data()));
+			BOOST_REQUIRE(std::equal(vRow.begin(), vRow.end(), vZ.begin() + y * width));
+		}
+		BOOST_TEST(tiled.GetNumberOfCachedTiles() <= 4);
+		float Z = 0.0f;
+		BOOST_TEST(tiled.GetZ(static_cast<int>(width) - 1, static_cast<int>(height) - 1, Z));
+		BOOST_TEST(Z == vZ.back());
+		BOOST_TEST(tiled.GetZ(200, 100, Z));
+		BOOST_TEST(!iconic::DepthMap::IsValid(Z));
+		BOOST_TEST(!tiled.GetZ(static_cast<int>(width), 0, Z));
+
+		// The stored depth pyramid is the one built from the raw depth map
+		iconic::DepthPyramid built;
+		BOOST_REQUIRE(built.Build(*depthMap.cpDepthMap));
+		const iconic::DepthPyramidPtr pStored = tiled.ReadDepthPyramid();
+		BOOST_REQUIRE(pStored);
+		BOOST_REQUIRE(pStored->GetNumberOfLevels() == built.GetNumberOfLevels());
+		for (size_t level = 0; level < built.GetNumberOfLevels(); ++level) {
+			size_t levelWidth = 0, levelHeight = 0;
+			built.GetSize(level, levelWidth, levelHeight);
+			for (size_t cy = 0; cy < levelHeight; ++cy) {
+				for (size_t cx = 0; cx < levelWidth; ++cx) {
+					iconic::DepthPyramid::Range builtCell, storedCell;
+					BOOST_REQUIRE(built.GetCell(level, cx, cy, builtCell));
+					BOOST_REQUIRE(pStored->GetCell(level, cx, cy, storedCell));
+					BOOST_REQUIRE((builtCell.cMin == storedCell.cMin && builtCell.cMax == storedCell.cMax && builtCell.cMean == storedCell.cMean && builtCell.cCount == storedCell.cCount));
+				}
+			}
+		}
+		BOOST_TEST(!tiled.Open(tiledFileName, width + 1, height));
+	}
+
+	// A file with the tile table not yet written, as left by an incomplete conversion, is rejected
+	std::vector<char> vFile;
+	{
+		wxFFile file(tiledFileName, "rb");
+		BOOST_REQUIRE(file.IsOpened());
+		char buffer[4096];
+		for (size_t n; (n = file.Read(buffer, sizeof(buffer))) > 0;) {
+			vFile.insert(vFile.end(), buffer, buffer + n);
+		}
+	}
+	const size_t headerSize = 24, nTiles = ((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+	BOOST_REQUIRE(vFile.size() > headerSize + nTiles * 16);
+	std::fill(vFile.begin() + headerSize, vFile.begin() + headerSize + nTiles * 16, 0);
+	{
+		wxFFile file(tiledFileName, "wb");
+		BOOST_REQUIRE(file.IsOpened());
+		BOOST_REQUIRE(file.Write(vFile.data(), vFile.size()) == vFile.size());
+	}
+	iconic::TiledDepthMap tiled;
+	BOOST_TEST(!tiled.Open(tiledFileName, width, height));
+
+	wxRemoveFile(tiledFileName);
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_tiled_frame_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// 4x3 tiles of 256x256 pixels
+	const size_t width = 1024, height = 768;
+	TestDepthMap depthMap(width, height, [](size_t x, size_t y) { return 10.0f + 0.01f * x; });
+	wxFileName fn(depthMap.cFileName);
+	fn.SetExt("tdm");
+	const wxString tiledFileName = fn.GetFullPath();
+	BOOST_REQUIRE(iconic::TiledDepthMap::Convert(depthMap.cFileName, width, height, tiledFileName));
+
+	const double nadir[12] = {
+		1000.0, 0.0, 0.0, -20000.0,
+		0.0, 1000.0, 0.0, -10000.0,
+		0.0, 0.0, -1.0, 300.0 };
+	const wxString cameraFileName = wxFileName::CreateTempFileName("cam");
+	{
+		wxFFile file(cameraFileName, "wb");
+		BOOST_REQUIRE(file.IsOpened());
+		BOOST_REQUIRE(file.Write(nadir, sizeof(nadir)) == sizeof(nadir));
+	}
+
+	// Reading the frame decompresses no tiles, the depth pyramid is read from the file
+	iconic::Geometry geometry;
+	geometry.cImageSize[0] = width;
+	geometry.cImageSize[1] = height;
+	BOOST_REQUIRE(iconic::MeasureHandler::ReadFrame(tiledFileName, cameraFileName, geometry));
+	const iconic::TiledDepthMap* pTiled = dynamic_cast<const iconic::TiledDepthMap*>(geometry.cpDepthMap.get());
+	BOOST_REQUIRE(pTiled);
+	BOOST_REQUIRE(geometry.cpDepthPyramid);
+	iconic::DepthPyramid::Range range;
+	BOOST_REQUIRE(geometry.cpDepthPyramid->GetRange(0, 0, static_cast<int>(width), static_cast<int>(height), range));
+	BOOST_TEST(range.cCount == width * height);
+	BOOST_TEST(std::abs(range.cMin - 10.0f) < 1.0e-4f);
+	BOOST_TEST(std::abs(range.cMax - (10.0f + 0.01f * (width - 1))) < 1.0e-4f);
+	BOOST_TEST(pTiled->GetNumberOfCachedTiles() == 0);
+
+	// A measurement decompresses the tiles it touches
+	const Eigen::Vector3d imagePt = geometry.cCameraToPixelTransform.inverse() * Eigen::Vector3d(600.0, 300.0, 1.0);
+	iconic::Geometry::Point3D objectPt;
+	BOOST_REQUIRE(geometry.ImageToObject(iconic::Geometry::Point(imagePt[0] / imagePt[2], imagePt[1] / imagePt[2]), objectPt));
+	BOOST_TEST(std::abs(objectPt.get<2>() - 16.0) < 0.02);
+	BOOST_TEST(pTiled->GetNumberOfCachedTiles() == 1);
+
+	geometry.cpDepthMap.reset();
+	wxRemoveFile(tiledFileName);
+	wxRemoveFile(cameraFileName);
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_frame_cache_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// Four frames of the same size that share a camera file
+	const size_t width = 64, height = 48, frameBytes = width * height * sizeof(float);
+	TestDepthMap a(width, height, [](size_t x, size_t y) { return 10.0f; });
+	TestDepthMap b(width, height, [](size_t x, size_t y) { return 20.0f; });
+	TestDepthMap c(width, height, [](size_t x, size_t y) { return 30.0f; });
+	TestDepthMap d(width, height, [](size_t x, size_t y) { return 40.0f; });
+	const wxString cameraFileName = wxFileName::CreateTempFileName("cam");
+	BOOST_REQUIRE(wxFileName::FileExists(cameraFileName));
+
+	iconic::FrameCache cache(3 * frameBytes);
+	iconic::Geometry geometry;
+	BOOST_TEST(!cache.Get(a.cFileName, cameraFileName, geometry));
+	BOOST_TEST(cache.GetMisses() == 1);
+	cache.Put(a.cFileName, iconic::FrameCache::GetFileTimes(a.cFileName, cameraFileName), a.GetGeometry());
+	cache.Put(b.cFileName, iconic::FrameCache::GetFileTimes(b.cFileName, cameraFileName), b.GetGeometry());
+	cache.Put(c.cFileName, iconic::FrameCache::GetFileTimes(c.cFileName, cameraFileName), c.GetGeometry());
+	BOOST_TEST(cache.GetNumberOfFrames() == 3);
+	BOOST_TEST(cache.GetMemoryUsage() == 3 * frameBytes);
+
+	// A hit returns the cached depth map and makes the frame the most recently used
+	BOOST_REQUIRE(cache.Get(a.cFileName, cameraFileName, geometry));
+	BOOST_TEST(geometry.cpDepthMap == a.cpDepthMap);
+	BOOST_TEST(cache.GetHits() == 1);
+	BOOST_TEST(cache.GetMisses() == 1);
+
+	// Least recently used first: b, since a was used after c was added
+	cache.Put(d.cFileName, iconic::FrameCache::GetFileTimes(d.cFileName, cameraFileName), d.GetGeometry());
+	BOOST_TEST(cache.GetNumberOfFrames() == 3);
+	BOOST_TEST(!cache.Contains(b.cFileName, cameraFileName));
+	BOOST_TEST(cache.Contains(a.cFileName, cameraFileName));
+	BOOST_TEST(cache.Contains(c.cFileName, cameraFileName));
+	BOOST_TEST(cache.Contains(d.cFileName, cameraFileName));
+
+	// A smaller budget evicts until it is met, Contains does not count or reorder
+	cache.SetMemoryBudget(2 * frameBytes);
+	BOOST_TEST(cache.GetNumberOfFrames() == 2);
+	BOOST_TEST(cache.GetMemoryUsage() <= cache.GetMemoryBudget());
+	BOOST_TEST(!cache.Contains(c.cFileName, cameraFileName));
+	BOOST_TEST(cache.GetHits() == 1);
+	BOOST_TEST(cache.GetMisses() == 1);
+
+	// The most recently added frame is kept even if it alone exceeds the budget
+	cache.SetMemoryBudget(frameBytes / 2);
+	BOOST_TEST(cache.GetNumberOfFrames() == 1);
+	cache.Put(b.cFileName, iconic::FrameCache::GetFileTimes(b.cFileName, cameraFileName), b.GetGeometry());
+	BOOST_TEST(cache.GetNumberOfFrames() == 1);
+	BOOST_TEST(cache.Contains(b.cFileName, cameraFileName));
+
+	// A frame whose depth map file has changed since it was cached is a miss and is dropped
+	cache.SetMemoryBudget(3 * frameBytes);
+	BOOST_REQUIRE(cache.Get(b.cFileName, cameraFileName, geometry));
+	const wxDateTime modified = wxFileName(b.cFileName).GetModificationTime() + wxTimeSpan::Hour();
+	BOOST_REQUIRE(wxFileName(b.cFileName).SetTimes(nullptr, &modified, nullptr));
+	BOOST_TEST(!cache.Contains(b.cFileName, cameraFileName));
+	BOOST_TEST(!cache.Get(b.cFileName, cameraFileName, geometry));
+	BOOST_TEST(cache.GetNumberOfFrames() == 0);
+	BOOST_TEST(cache.GetHits() == 2);
+	BOOST_TEST(cache.GetMisses() == 2);
+
+	// So is a frame whose camera file has changed
+	cache.Put(a.cFileName, iconic::FrameCache::GetFileTimes(a.cFileName, cameraFileName), a.GetGeometry());
+	BOOST_TEST(cache.Contains(a.cFileName, cameraFileName));
+	const wxDateTime cameraModified = wxFileName(cameraFileName).GetModificationTime() + wxTimeSpan::Hour();
+	BOOST_REQUIRE(wxFileName(cameraFileName).SetTimes(nullptr, &cameraModified, nullptr));
+	BOOST_TEST(!cache.Get(a.cFileName, cameraFileName, geometry));
+	BOOST_TEST(cache.GetMisses() == 3);
+
+	// A depth map file rewritten while the frame was read is not served from the cache, its time is the one from before the read
+	const iconic::FrameCache::FileTimes times = iconic::FrameCache::GetFileTimes(c.cFileName, cameraFileName);
+	const wxDateTime rewritten = times.cDepthMapTime + wxTimeSpan::Hour();
+	BOOST_REQUIRE(wxFileName(c.cFileName).SetTimes(nullptr, &rewritten, nullptr));
+	cache.Put(c.cFileName, times, c.GetGeometry());
+	BOOST_TEST(!cache.Contains(c.cFileName, cameraFileName));
+	BOOST_TEST(!cache.Get(c.cFileName, cameraFileName, geometry));
+	BOOST_TEST(cache.GetMisses() == 4);
+
+	cache.Clear();
+	BOOST_TEST(cache.GetNumberOfFrames() == 0);
+	BOOST_TEST(cache.GetHits() == 0);
+	BOOST_TEST(cache.GetMisses() == 0);
+
+	wxRemoveFile(cameraFileName);
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_frame_prefetcher_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	const size_t width = 64, height = 48;
+	TestDepthMap depthMap(width, height, [](size_t x, size_t y) { return 10.0f + 0.1f * x; });
+	const wxString cameraFileName = wxFileName::CreateTempFileName("cam");
+
+	// The loader just hands out the depth map and counts the reads
+	std::atomic<size_t> nLoads(0);
+	iconic::FrameCache cache;
+	{
+		iconic::FramePrefetcher prefetcher(cache, [&](const iconic::FramePrefetcher::Request& request, iconic::Geometry& geometry) {
+			geometry.cpDepthMap = depthMap.cpDepthMap;
+			++nLoads;
+			return true;
+		});
+		iconic::FramePrefetcher::Request request;
+		request.cDepthMapFileName = depthMap.cFileName;
+		request.cCameraFileName = cameraFileName;
+		request.cImageSize[0] = width;
+		request.cImageSize[1] = height;
+		request.cStorage = iconic::DepthMap::EStorage::FLOAT32;
+		request.cbDepthIntegral = false;
+		prefetcher.Prefetch({ request });
+		prefetcher.Wait(depthMap.cFileName);
+
+		// Parsing the frame is now a cache hit
+		iconic::Geometry geometry;
+		BOOST_REQUIRE(cache.Get(depthMap.cFileName, cameraFileName, geometry));
+		BOOST_TEST(geometry.cpDepthMap == depthMap.cpDepthMap);
+		BOOST_TEST(geometry.cImageSize[0] == width);
+		BOOST_TEST(geometry.cImageSize[1] == height);
+		BOOST_TEST(cache.GetHits() == 1);
+		BOOST_TEST(cache.GetMisses() == 0);
+		BOOST_TEST(nLoads == 1);
+
+		// A cached frame is not read again
+		prefetcher.Prefetch({ request });
+		prefetcher.Cancel();
+		prefetcher.Wait(depthMap.cFileName);
+		BOOST_TEST(nLoads == 1);
+	}
+
+	wxRemoveFile(cameraFileName);
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_frame_prefetcher_cancel_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	const size_t width = 64, height = 48;
+	TestDepthMap first(width, height, [](size_t x, size_t y) { return 10.0f; });
+	TestDepthMap second(width, height, [](size_t x, size_t y) { return 20.0f; });
+	const wxString cameraFileName = wxFileName::CreateTempFileName("cam");
+
+	// One worker, held in the first frame until released, so the second frame is still queued when cancelled
+	std::atomic<bool> bLoading(false), bRelease(false);
+	std::atomic<size_t> nSecondLoads(0);
+	iconic::FrameCache cache;
+	{
+		iconic::FramePrefetcher prefetcher(cache, [&](const iconic::FramePrefetcher::Request& request, iconic::Geometry& geometry) {
+			if (request.cDepthMapFileName == second.cFileName) {
+				++nSecondLoads;
+				geometry.cpDepthMap = second.cpDepthMap;
+				return true;
+			}
+			bLoading = true;
+			while (!bRelease) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			geometry.cpDepthMap = first.cpDepthMap;
+			return true;
+		}, 1);
+		std::vector<iconic::FramePrefetcher::Request> vRequests(2);
+		for (size_t i = 0; i < vRequests.size(); ++i) {
+			vRequests[i].cDepthMapFileName = i ? second.cFileName : first.cFileName;
+			vRequests[i].cCameraFileName = cameraFileName;
+			vRequests[i].cImageSize[0] = width;
+			vRequests[i].cImageSize[1] = height;
+			vRequests[i].cStorage = iconic::DepthMap::EStorage::FLOAT32;
+			vRequests[i].cbDepthIntegral = false;
+		}
+		prefetcher.Prefetch(vRequests);
+		while (!bLoading) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		// Release the first frame while Cancel waits for it
+		std::thread releaser([&]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			bRelease = true;
+		});
+		prefetcher.Cancel();
+		prefetcher.Wait(second.cFileName);
+		releaser.join();
+
+		// The frame being read is finished and published, the queued frame is neither read nor published
+		BOOST_TEST(cache.Contains(first.cFileName, cameraFileName));
+		BOOST_TEST(!cache.Contains(second.cFileName, cameraFileName));
+		BOOST_TEST(nSecondLoads == 0);
+		BOOST_TEST(cache.GetNumberOfFrames() == 1);
+	}
+
+	wxRemoveFile(cameraFileName);
+	delete wxLog::SetActiveTarget(nullptr);
+}
@@ -0,0 +1,928 @@
+#pragma once
+
+#include <IconicMeasureCommon/ChangeDetection.h>
+#include <IconicMeasureCommon/DepthMap.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <IconicMeasureCommon/PlaneFitter.h>
+#include <IconicMeasureCommon/PolygonMeasures.h>
+#include <IconicMeasureCommon/ShapeAlgorithms.h>
+#include <IconicMeasureCommon/ShapeSlotMap.h>
+#include <IconicMeasureCommon/ThreadPool.h>
+#include <IconicMeasureCommon/Uncertainty.h>
+#include <IconicMeasureCommon/VertexIndex.h>
+#include <IconicMeasureCommon/VolumeIntegrator.h>
+#include <IconicMeasureCommon/ZonalStatistics.h>
+#include <IconicSensor/Camera.h>
+#include <boost/make_shared.hpp>
+#include <testdepthmap.hpp>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(iconic_image_to_object_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// Terrain between Z=10 and Z=30 with a stripe of invalid values
+	const size_t width = 1600, height = 1200;
+	TestDepthMap depthMap(width, height, [&](size_t x, size_t y) { return (x >= 100 && x < 110) ? 1.0e10f : 10.0f + 20.0f * y / height + std::sin(0.01f * x); });
+
+	// Tilted camera 300 m above ground and a camera looking straight down, row by row as in a camera file
+	const double projective[12] = {
+		1000.0, 0.0, 200.0, -20000.0,
+		0.0, 940.0, 342.0, -60000.0,
+		0.0, 0.34, -0.94, 300.0 };
+	const double nadir[12] = {
+		1000.0, 0.0, 0.0, -20000.0,
+		0.0, 1000.0, 0.0, -10000.0,
+		0.0, 0.0, -1.0, 300.0 };
+
+	// Image points inside the depth map, some of them on the invalid stripe
+	const size_t n = 200000;
+	std::vector<double> vx(n), vy(n);
+
+	for (const double* pMatrix : { projective, nadir }) {
+		iconic::GpuCamera gpuCamera;
+		std::memcpy(&gpuCamera, pMatrix, sizeof(gpuCamera));
+		iconic::Geometry geometry = depthMap.GetGeometry(pMatrix);
+		geometry.cpCamera = boost::make_shared<iconic::Camera>();
+		*geometry.cpCamera = gpuCamera;
+		geometry.cCameraType = geometry.cpCamera->ClassifyCamera();
+		BOOST_TEST((geometry.cProjection == (pMatrix == nadir ? iconic::Geometry::EProjection::NADIR : iconic::Geometry::EProjection::PROJECTIVE)));
+
+		const Eigen::Matrix3d pixelToCamera = geometry.cCameraToPixelTransform.inverse();
+		for (size_t i = 0; i < n; ++i) {
+			const Eigen::Vector3d pt = pixelToCamera * Eigen::Vector3d((i * 7919) % width, (i * 104729) % height, 1.0);
+			vx[i] = pt[0] / pt[2];
+			vy[i] = pt[1] / pt[2];
+		}
+
+		std::vector<double> vX(n), vY(n), vZ3(n);
+		std::vector<iconic::Geometry::EPointStatus> vStatus(n);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const size_t nSpecialized = geometry.ImageToObject(vx.data(), vy.data(), n, vX.data(), vY.data(), vZ3.data(), vStatus.data());
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cerr << "Transformed " << n << " points with " << (pMatrix == nadir ? "nadir" : "projective") << " kernel, wall time " << elapsed.count() << " s" << std::endl;
+		BOOST_TEST(nSpecialized > n / 2);
+		BOOST_TEST(nSpecialized < n);
+
+		// Object points must project back to the image points
+		for (size_t i = 0; i < n; ++i) {
+			if (vStatus[i] != iconic::Geometry::EPointStatus::OK) {
+				continue;
+			}
+			const Eigen::Vector3d pt = geometry.cCameraMatrix * Eigen::Vector4d(vX[i], vY[i], vZ3[i], 1.0);
+			BOOST_REQUIRE_SMALL(pt[0] / pt[2] - vx[i], 1.0e-9);
+			BOOST_REQUIRE_SMALL(pt[1] / pt[2] - vy[i], 1.0e-9);
+		}
+
+		// Generic path through Camera::Image2Object must agree
+		geometry.cProjection = iconic::Geometry::EProjection::NONE;
+		std::vector<double> vXGeneric(n), vYGeneric(n), vZGeneric(n);
+		std::vector<iconic::Geometry::EPointStatus> vStatusGeneric(n);
+		start = std::chrono::steady_clock::now();
+		const size_t nGeneric = geometry.ImageToObject(vx.data(), vy.data(), n, vXGeneric.data(), vYGeneric.data(), vZGeneric.data(), vStatusGeneric.data());
+		elapsed = std::chrono::steady_clock::now() - start;
+		std::cerr << "Transformed " << n << " points with Camera::Image2Object, wall time " << elapsed.count() << " s" << std::endl;
+		BOOST_TEST(nGeneric == nSpecialized);
+		for (size_t i = 0; i < n; ++i) {
+			BOOST_REQUIRE(vStatus[i] == vStatusGeneric[i]);
+			if (vStatus[i] == iconic::Geometry::EPointStatus::OK) {
+				BOOST_REQUIRE_SMALL(vX[i] - vXGeneric[i], 1.0e-6);
+				BOOST_REQUIRE_SMALL(vY[i] - vYGeneric[i], 1.0e-6);
+				BOOST_REQUIRE_SMALL(vZ3[i] - vZGeneric[i], 1.0e-6);
+			}
+		}
+	}
+
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_polygon_volume_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// Flat ground at Z=10 with a 200x200 pixel box of height 10 and a stripe of invalid values
+	const size_t width = 1600, height = 1200;
+	TestDepthMap depthMap(width, height, [](size_t x, size_t y) { return (x >= 1100 && x < 1110) ? 1.0e10f : (x >= 400 && x < 600 && y >= 300 && y < 500) ? 20.0f : 10.0f; });
+
+	const double nadir[12] = {
+		1000.0, 0.0, 0.0, -20000.0,
+		0.0, 1000.0, 0.0, -10000.0,
+		0.0, 0.0, -1.0, 300.0 };
+	const double projective[12] = {
+		1000.0, 0.0, 200.0, -20000.0,
+		0.0, 940.0, 342.0, -60000.0,
+		0.0, 0.34, -0.94, 300.0 };
+	for (const double* pMatrix : { nadir, projective }) {
+		iconic::Geometry geometry = depthMap.GetGeometry(pMatrix);
+
+		// Polygon with vertices on the ground and a hole over the right half of the box, given in pixels
+		const Eigen::Matrix3d pixelToCamera = geometry.cCameraToPixelTransform.inverse();
+		auto pixelToImage = [&](double x, double y) {
+			const Eigen::Vector3d pt = pixelToCamera * Eigen::Vector3d(x, y, 1.0);
+			return iconic::Geometry::Point(pt[0] / pt[2], pt[1] / pt[2]);
+		};
+		iconic::Geometry::Polygon polygon;
+		const double outer[4][2] = { { 199.5, 99.5 }, { 199.5, 799.5 }, { 1299.5, 799.5 }, { 1299.5, 99.5 } };
+		const double inner[4][2] = { { 499.5, 299.5 }, { 599.5, 299.5 }, { 599.5, 499.5 }, { 499.5, 499.5 } };
+		polygon.inners().resize(1);
+		for (int i = 0; i < 4; ++i) {
+			polygon.outer().push_back(pixelToImage(outer[i][0], outer[i][1]));
+			polygon.inners()[0].push_back(pixelToImage(inner[i][0], inner[i][1]));
+		}
+
+		std::vector<iconic::Geometry::Point3D> vVertices;
+		iconic::Geometry::Point3D vertex;
+		for (const iconic::Geometry::Point& pt : polygon.outer()) {
+			BOOST_REQUIRE(geometry.ImageToObject(pt, vertex));
+			vVertices.push_back(vertex);
+		}
+		const Eigen::Vector3d origin(vVertices[0].get<0>(), vVertices[0].get<1>(), vVertices[0].get<2>());
+		Eigen::Vector3d plane;
+		BOOST_REQUIRE(iconic::VolumeIntegrator::FitPlane(vVertices, origin, plane));
+		BOOST_TEST(std::abs(plane[0]) < 1.0e-9);
+		BOOST_TEST(std::abs(plane[1]) < 1.0e-9);
+		BOOST_TEST(std::abs(plane[2]) < 1.0e-6);
+
+		iconic::VolumeIntegrator::Moments moments;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		BOOST_REQUIRE(iconic::VolumeIntegrator::Integrate(geometry, polygon, origin, moments));
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cerr << "Integrated " << moments.cCount << " pixels with " << (pMatrix == nadir ? "nadir" : "projective") << " camera, wall time " << elapsed.count() << " s" << std::endl;
+		BOOST_TEST(moments.cCount == 1100 * 700 - 100 * 200 - 10 * 700);
+		BOOST_TEST(moments.cInvalidCount == 10 * 700);
+
+		// Box pixels outside the hole, 10 m above the ground. At a fixed Z the pixel to object mapping is a homography, so the box maps to a quadrilateral.
+		const double xCorners[4] = { 399.5, 499.5, 499.5, 399.5 }, yCorners[4] = { 299.5, 299.5, 499.5, 499.5 };
+		double x[4], y[4], X[4], Y[4], Z[4];
+		const float z[4] = { 20.0f, 20.0f, 20.0f, 20.0f };
+		iconic::Geometry::EPointStatus status[4];
+		for (int i = 0; i < 4; ++i) {
+			const iconic::Geometry::Point pt = pixelToImage(xCorners[i], yCorners[i]);
+			x[i] = pt.get<0>();
+			y[i] = pt.get<1>();
+		}
+		BOOST_REQUIRE(geometry.ImageToObject(x, y, z, 4, X, Y, Z, status) == 4);
+		double boxArea = 0.0;
+		for (int i = 0; i < 4; ++i) {
+			boxArea += X[i] * Y[(i + 1) % 4] - X[(i + 1) % 4] * Y[i];
+		}
+		boxArea = std::abs(boxArea) / 2.0;
+		const double volume = iconic::VolumeIntegrator::GetVolume(moments, plane);
+		std::cerr << "Volume " << volume << ", expected " << 10.0 * boxArea << std::endl;
+		BOOST_TEST(std::abs(volume - 10.0 * boxArea) < 1.0e-4 * 10.0 * boxArea);
+
+		// The box walls add to the draped surface. Flat ground away from the box and the invalid stripe has the same surface as ground area.
+		BOOST_TEST(moments.cSurface > moments.cArea);
+		iconic::Geometry::Polygon flat;
+		const double flatCorners[4][2] = { { 699.5, 99.5 }, { 699.5, 249.5 }, { 1049.5, 249.5 }, { 1049.5, 99.5 } };
+		for (int i = 0; i < 4; ++i) {
+			flat.outer().push_back(pixelToImage(flatCorners[i][0], flatCorners[i][1]));
+		}
+		iconic::VolumeIntegrator::Moments flatMoments;
+		BOOST_REQUIRE(iconic::VolumeIntegrator::Integrate(geometry, flat, origin, flatMoments));
+		BOOST_TEST(std::abs(flatMoments.cSurface - flatMoments.cArea) < 1.0e-2 * flatMoments.cArea);
+
+		// Provisional volume from the depth pyramid, whose 4x4 cells are aligned with the box
+		BOOST_REQUIRE(geometry.BuildDepthPyramid());
+		iconic::VolumeIntegrator::Moments coarse;
+		BOOST_REQUIRE(iconic::VolumeIntegrator::Integrate(geometry, polygon, origin, coarse, 1));
+		BOOST_TEST(coarse.cCount + coarse.cInvalidCount < moments.cCount / 10);
+		BOOST_TEST(std::abs(iconic::VolumeIntegrator::GetVolume(coarse, plane) - volume) < 1.0e-3 * volume);
+
+		// Moving a vertex updates the moments by the swept triangles only, the result must match integrating again
+		polygon.inners().clear();
+		BOOST_REQUIRE(iconic::VolumeIntegrator::Integrate(geometry, polygon, origin, moments));
+		for (const double* pt : { outer[1], inner[2] }) {
+			const iconic::Geometry::Point previousPt = polygon.outer()[2];
+			polygon.outer()[2] = pixelToImage(pt[0] + 0.3, pt[1] + 0.2);
+			start = std::chrono::steady_clock::now();
+			BOOST_REQUIRE(iconic::VolumeIntegrator::MoveVertex(geometry, polygon.outer(), 2, previousPt, origin, moments));
+			elapsed = std::chrono::steady_clock::now() - start;
+			std::cerr << "Moved a vertex, wall time " << elapsed.count() << " s" << std::endl;
+			iconic::VolumeIntegrator::Moments expected;
+			BOOST_REQUIRE(iconic::VolumeIntegrator::Integrate(geometry, polygon, origin, expected));
+			BOOST_TEST(moments.cCount == expected.cCount);
+			BOOST_TEST(moments.cInvalidCount == expected.cInvalidCount);
+			BOOST_TEST(std::abs(moments.cArea - expected.cArea) < 1.0e-9 * expected.cArea);
+			BOOST_TEST(std::abs(moments.cSurface - expected.cSurface) < 1.0e-9 * expected.cSurface);
+			BOOST_TEST(std::abs(iconic::VolumeIntegrator::GetVolume(moments, plane) - iconic::VolumeIntegrator::GetVolume(expected, plane)) < 1.0e-9);
+		}
+	}
+
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_height_profile_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// Slope along x with a stripe of invalid values
+	const size_t width = 4000, height = 1000;
+	TestDepthMap depthMap(width, height, [](size_t x, size_t y) { return (x >= 2000 && x < 2010) ? 1.0e10f : 10.0f + 0.01f * x; });
+
+	const double nadir[12] = {
+		1000.0, 0.0, 0.0, -20000.0,
+		0.0, 1000.0, 0.0, -10000.0,
+		0.0, 0.0, -1.0, 300.0 };
+	iconic::Geometry geometry = depthMap.GetGeometry(nadir);
+	BOOST_REQUIRE(geometry.cProjection == iconic::Geometry::EProjection::NADIR);
+
+	// A long horizontal segment across the stripe and a short vertical one, given in pixels
+	const Eigen::Matrix3d pixelToCamera = geometry.cCameraToPixelTransform.inverse();
+	iconic::Geometry::VectorTrain line;
+	for (const Eigen::Vector3d& pixelPt : { Eigen::Vector3d(100.0, 100.0, 1.0), Eigen::Vector3d(3900.0, 100.0, 1.0), Eigen::Vector3d(3900.0, 600.0, 1.0) }) {
+		const Eigen::Vector3d pt = pixelToCamera * pixelPt;
+		line.push_back(iconic::Geometry::Point(pt[0] / pt[2], pt[1] / pt[2]));
+	}
+
+	iconic::Geometry::HeightProfile profile;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE(geometry.GetHeightProfile(line, profile));
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Sampled " << profile.cSize << " heights, wall time " << elapsed.count() << " s" << std::endl;
+	BOOST_TEST(profile.cSize == 3801 + 500);
+	BOOST_TEST(profile.cvSegments.size() == 3);
+	BOOST_TEST(profile.cvSegments[1] == 3801);
+
+	size_t nValid = 0;
+	for (size_t i = 0; i < profile.cSize; ++i) {
+		nValid += profile.GetValid()[i];
+		const size_t x = i < 3801 ? 100 + i : 3900;
+		if (profile.GetValid()[i]) {
+			BOOST_REQUIRE_SMALL(profile.GetHeights()[i] - (10.0f + 0.01f * x), 1.0e-4f);
+		} else {
+			BOOST_REQUIRE(x >= 2000 && x < 2010);
+		}
+		if (i > 0) {
+			BOOST_REQUIRE(profile.GetDistances()[i] > profile.GetDistances()[i - 1]);
+		}
+	}
+	BOOST_TEST(nValid == profile.cSize - 10);
+
+	// Pixels are smaller on higher ground. The vertical segment is at Z=49.
+	const double lastPixel = (300.0 - 49.0) / 1000.0 * pixelToCamera(0, 0);
+	BOOST_TEST(std::abs(profile.GetDistances()[profile.cSize - 1] - profile.GetDistances()[3800] - 500 * lastPixel) < 1.0e-9);
+
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_polygon_measures_test)
+{
+	// Circle with 100k vertices on a tilted plane, far from the origin like map coordinates
+	const size_t n = 100000;
+	const double pi = std::acos(-1.0), radius = 50.0, cx = 6.5e6, cy = 1.5e5, a = 0.5, b = 0.25;
+	iconic::Geometry::Polygon3D polygon;
+	for (size_t i = 0; i <= n; ++i) {
+		const double t = 2.0 * pi * (i % n) / n;
+		const double x = radius * std::cos(t), y = radius * std::sin(t);
+		polygon.outer().push_back(iconic::Geometry::Point3D(cx + x, cy + y, 100.0 + a * x + b * y));
+	}
+	iconic::PolygonMeasures::Vertices vertices;
+	vertices.Set(polygon.outer());
+	BOOST_TEST(vertices.Size() == n + 1);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const double length = iconic::PolygonMeasures::GetLength(vertices, true);
+	const double area = iconic::PolygonMeasures::GetArea(vertices);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Measured " << n << " vertices, wall time " << elapsed.count() << " s" << std::endl;
+
+	start = std::chrono::steady_clock::now();
+	const double boostLength = boost::geometry::perimeter(polygon);
+	elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Measured " << n << " vertices with boost::geometry::perimeter, wall time " << elapsed.count() << " s" << std::endl;
+	BOOST_TEST(std::abs(length - boostLength) < 1.0e-9 * boostLength);
+
+	// The projected area of a regular polygon, scaled by the tilt of the plane
+	const double expectedArea = n / 2.0 * radius * radius * std::sin(2.0 * pi / n) * std::sqrt(1.0 + a * a + b * b);
+	BOOST_TEST(std::abs(area - expectedArea) < 1.0e-9 * expectedArea);
+	const Eigen::Vector3d normal = iconic::PolygonMeasures::GetNormal(vertices.cvX.data(), vertices.cvY.data(), vertices.cvZ.data(), vertices.Size()).normalized();
+	BOOST_TEST(std::abs(normal.dot(Eigen::Vector3d(-a, -b, 1.0).normalized()) - 1.0) < 1.0e-12);
+
+	// Without the closing vertex and with too few vertices
+	BOOST_TEST(std::abs(iconic::PolygonMeasures::GetLength(vertices.cvX.data(), vertices.cvY.data(), vertices.cvZ.data(), n, true) - length) < 1.0e-9 * length);
+	BOOST_TEST(std::abs(iconic::PolygonMeasures::GetArea(vertices.cvX.data(), vertices.cvY.data(), vertices.cvZ.data(), n) - area) < 1.0e-9 * area);
+	BOOST_TEST(iconic::PolygonMeasures::GetLength(vertices.cvX.data(), vertices.cvY.data(), vertices.cvZ.data(), 1, true) == 0.0);
+	BOOST_TEST(iconic::PolygonMeasures::GetArea(vertices.cvX.data(), vertices.cvY.data(), vertices.cvZ.data(), 2) == 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_zonal_statistics_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// Sawtooth terrain with a stripe of invalid values
+	const size_t width = 1600, height = 1200;
+	TestDepthMap depthMap(width, height, [](size_t x, size_t y) { return (x >= 300 && x < 310) ? 1.0e10f : 10.0f + 0.1f * (x % 100) + 0.01f * y; });
+
+	iconic::Geometry geometry = depthMap.GetGeometry();
+	const Eigen::Matrix3d pixelToCamera = geometry.cCameraToPixelTransform.inverse();
+
+	// Overlapping regions given in pixels, as if loaded from a WKT file
+	const std::vector<std::vector<std::pair<double, double>>> vRegions = {
+		{ { 99.5, 49.5 }, { 99.5, 449.5 }, { 499.5, 449.5 }, { 499.5, 49.5 } },
+		{ { 100.5, 50.5 }, { 250.9, 400.2 }, { 400.3, 80.7 } },
+		{ { 1200.5, 900.5 }, { 1200.5, 1400.5 }, { 1700.5, 1400.5 }, { 1700.5, 900.5 } } };
+	std::vector<iconic::Geometry::Polygon> vPolygons(vRegions.size());
+	std::vector<iconic::Geometry::Polygon> vPixelPolygons(vRegions.size());
+	for (size_t i = 0; i < vRegions.size(); ++i) {
+		for (const std::pair<double, double>& pt : vRegions[i]) {
+			const Eigen::Vector3d image = pixelToCamera * Eigen::Vector3d(pt.first, pt.second, 1.0);
+			vPolygons[i].outer().push_back(iconic::Geometry::Point(image[0] / image[2], image[1] / image[2]));
+			vPixelPolygons[i].outer().push_back(iconic::Geometry::Point(pt.first, pt.second));
+		}
+		boost::geometry::correct(vPixelPolygons[i]);
+	}
+
+	for (bool bPyramid : { false, true }) {
+		if (bPyramid) {
+			BOOST_REQUIRE(geometry.BuildDepthPyramid());
+		}
+		std::vector<iconic::ZonalStatistics::Statistics> vStatistics;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		BOOST_REQUIRE(iconic::ZonalStatistics::Compute(geometry, vPolygons, vStatistics, 32));
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cerr << "Computed statistics of " << vPolygons.size() << " regions " << (bPyramid ? "with" : "without") << " depth pyramid, wall time " << elapsed.count() << " s" << std::endl;
+		BOOST_REQUIRE(vStatistics.size() == vPolygons.size());
+
+		for (size_t i = 0; i < vPolygons.size(); ++i) {
+			// Pixel centres inside the region
+			std::vector<float> vInside;
+			size_t nInvalid = 0;
+			for (size_t y = 0; y < height; ++y) {
+				for (size_t x = 0; x < width; ++x) {
+					if (boost::geometry::within(iconic::Geometry::Point(x, y), vPixelPolygons[i])) {
+						const float z = depthMap.cvZ[y * width + x];
+						if (iconic::DepthMap::IsValid(z)) {
+							vInside.push_back(z);
+						} else {
+							++nInvalid;
+						}
+					}
+				}
+			}
+			const iconic::ZonalStatistics::Statistics& statistics = vStatistics[i];
+			BOOST_TEST(statistics.cCount == vInside.size());
+			BOOST_TEST(statistics.cInvalidCount == nInvalid);
+			BOOST_TEST(statistics.cMin == *std::min_element(vInside.begin(), vInside.end()));
+			BOOST_TEST(statistics.cMax == *std::max_element(vInside.begin(), vInside.end()));
+			double sum = 0.0, sumSq = 0.0;
+			for (float z : vInside) {
+				sum += z;
+			}
+			const double mean = sum / vInside.size();
+			for (float z : vInside) {
+				sumSq += (z - mean) * (z - mean);
+			}
+			BOOST_TEST(std::abs(statistics.cMean - mean) < 1.0e-9);
+			BOOST_TEST(std::abs(statistics.cStdDev - std::sqrt(sumSq / vInside.size())) < 1.0e-9);
+			size_t histogramCount = 0;
+			for (size_t count : statistics.cvHistogram) {
+				histogramCount += count;
+			}
+			BOOST_TEST(statistics.cvHistogram.size() == 32);
+			BOOST_TEST(histogramCount == vInside.size());
+			std::sort(vInside.begin(), vInside.end());
+			for (double percent : { 5.0, 50.0, 95.0 }) {
+				const double exact = vInside[std::min(vInside.size() - 1, static_cast<size_t>(percent / 100.0 * vInside.size()))];
+				BOOST_TEST(std::abs(statistics.GetPercentile(percent) - exact) <= statistics.cBinWidth);
+			}
+			BOOST_TEST(statistics.GetPercentile(0.0) == statistics.cMin);
+			BOOST_TEST(statistics.GetPercentile(100.0) == statistics.cMax);
+		}
+	}
+
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_plane_fitter_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// Tilted plane with 30% gross outliers
+	const Eigen::Vector3d truth(0.02, -0.01, 3.0);
+	iconic::PlaneFitter::Samples samples;
+	std::mt19937 generator(7);
+	std::uniform_real_distribution<double> coordinate(-500.0, 500.0), noise(-0.01, 0.01), outlier(1.0, 20.0);
+	for (size_t i = 0; i < 100000; ++i) {
+		const double X = coordinate(generator), Y = coordinate(generator);
+		samples.cvX.push_back(6.5e6 + X);
+		samples.cvY.push_back(6.5e6 + Y);
+		samples.cvZ.push_back(100.0 + truth[0] * X + truth[1] * Y + truth[2] + (i % 10 < 3 ? outlier(generator) : noise(generator)));
+	}
+	const Eigen::Vector3d origin(6.5e6, 6.5e6, 100.0);
+	iconic::PlaneFitter::Options options;
+	Eigen::Vector3d plane;
+	size_t inliers = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE(iconic::PlaneFitter::Fit(samples, origin, options, plane, &inliers));
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Fitted " << options.cIterations << " hypotheses to " << samples.cvX.size() << " samples, " << inliers << " inliers, wall time " << elapsed.count() << " s" << std::endl;
+	BOOST_TEST(inliers == 70000);
+	BOOST_TEST((plane - truth).norm() < 1.0e-3);
+	Eigen::Vector3d repeated;
+	BOOST_REQUIRE(iconic::PlaneFitter::Fit(samples, origin, options, repeated));
+	BOOST_TEST(repeated == plane);
+
+	// Flat ground at Z=10 with a box of height 10 across the right edge of the polygon
+	const size_t width = 1600, height = 1200;
+	TestDepthMap depthMap(width, height, [](size_t x, size_t y) { return (x >= 1200 && x < 1400 && y >= 200 && y < 600) ? 20.0f : 10.0f; });
+
+	const double nadir[12] = {
+		1000.0, 0.0, 0.0, -20000.0,
+		0.0, 1000.0, 0.0, -10000.0,
+		0.0, 0.0, -1.0, 300.0 };
+	iconic::Geometry geometry = depthMap.GetGeometry(nadir);
+	const Eigen::Matrix3d pixelToCamera = geometry.cCameraToPixelTransform.inverse();
+	iconic::Geometry::Polygon polygon;
+	const double corners[4][2] = { { 199.5, 99.5 }, { 199.5, 799.5 }, { 1299.5, 799.5 }, { 1299.5, 99.5 } };
+	for (int i = 0; i < 4; ++i) {
+		const Eigen::Vector3d pt = pixelToCamera * Eigen::Vector3d(corners[i][0], corners[i][1], 1.0);
+		polygon.outer().push_back(iconic::Geometry::Point(pt[0] / pt[2], pt[1] / pt[2]));
+	}
+	iconic::Geometry::Point3D vertex;
+	BOOST_REQUIRE(geometry.ImageToObject(polygon.outer()[0], vertex));
+	const Eigen::Vector3d groundOrigin(vertex.get<0>(), vertex.get<1>(), vertex.get<2>());
+
+	for (size_t bandWidth : { 1, 5 }) {
+		BOOST_REQUIRE(iconic::PlaneFitter::SampleBoundary(geometry, polygon, bandWidth, samples));
+		BOOST_TEST(samples.cvX.size() >= 2 * (1100 + 700) * bandWidth);
+
+		// The box tilts the least squares plane, RANSAC finds the ground
+		options.cIterations = 0;
+		size_t leastSquaresInliers = 0;
+		BOOST_REQUIRE(iconic::PlaneFitter::Fit(samples, groundOrigin, options, plane, &leastSquaresInliers));
+		BOOST_TEST(std::abs(plane[2]) > 0.1);
+		options.cIterations = 64;
+		BOOST_REQUIRE(iconic::PlaneFitter::Fit(samples, groundOrigin, options, plane, &inliers));
+		BOOST_TEST(std::abs(plane[0]) < 1.0e-9);
+		BOOST_TEST(std::abs(plane[1]) < 1.0e-9);
+		BOOST_TEST(std::abs(plane[2]) < 1.0e-6);
+		BOOST_TEST(inliers > leastSquaresInliers);
+		BOOST_TEST(inliers < samples.cvX.size());
+	}
+
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_change_detection_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// Ground at Z=10. Between the frames a box of height 10 is removed and a Gaussian pile of height 5 is added. The second camera is shifted.
+	const size_t width = 1600, height = 1200;
+	const double matrices[2][12] = {
+		{ 1000.0, 0.0, 0.0, -20000.0, 0.0, 1000.0, 0.0, -10000.0, 0.0, 0.0, -1.0, 300.0 },
+		{ 1000.0, 0.0, 0.0, -19950.0, 0.0, 1000.0, 0.0, -10030.0, 0.0, 0.0, -1.0, 300.0 } };
+	TestDepthMap boxDepthMap(width, height, [](size_t x, size_t y) { return (x >= 400 && x < 600 && y >= 300 && y < 500) ? 20.0f : 10.0f; });
+	// The second frame has the first depth map until its own is made, it is only transformed with given Z values
+	iconic::Geometry geometries[2] = { boxDepthMap.GetGeometry(matrices[0]), boxDepthMap.GetGeometry(matrices[1]) };
+	const Eigen::Matrix3d pixelToCamera = geometries[0].cCameraToPixelTransform.inverse();
+	auto pixelToObject = [&](const iconic::Geometry& geometry, double x, double y, float z, double& X, double& Y) {
+		const Eigen::Vector3d pt = pixelToCamera * Eigen::Vector3d(x, y, 1.0);
+		const double xi = pt[0] / pt[2], yi = pt[1] / pt[2];
+		double Z = 0.0;
+		iconic::Geometry::EPointStatus status;
+		return geometry.ImageToObject(&xi, &yi, &z, 1, &X, &Y, &Z, &status) == 1;
+	};
+
+	// The box covers pixels [400,600)x[300,500) of the first frame. The pile is centred under pixel (1000,700) with a sigma of 30 pixels.
+	double box[4], pile[2], corner[2];
+	BOOST_REQUIRE(pixelToObject(geometries[0], 399.5, 299.5, 20.0f, box[0], box[1]));
+	BOOST_REQUIRE(pixelToObject(geometries[0], 599.5, 499.5, 20.0f, box[2], box[3]));
+	BOOST_REQUIRE(pixelToObject(geometries[0], 1000.0, 700.0, 10.0f, pile[0], pile[1]));
+	BOOST_REQUIRE(pixelToObject(geometries[0], 1030.0, 700.0, 10.0f, corner[0], corner[1]));
+	const double boxArea = std::abs((box[2] - box[0]) * (box[3] - box[1]));
+	const double sigma = std::abs(corner[0] - pile[0]), pileHeight = 5.0;
+	const double pileVolume = pileHeight * 2.0 * std::acos(-1.0) * sigma * sigma;
+	auto pileZ = [&](double X, double Y) {
+		const double dx = X - pile[0], dy = Y - pile[1];
+		return 10.0 + pileHeight * std::exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+	};
+
+	// The first frame sees the box, the second the pile, where each ray meets the pile is found by fixed point iteration
+	TestDepthMap pileDepthMap(width, height, [&](size_t x, size_t y) {
+		float z = 10.0f;
+		double X = 0.0, Y = 0.0;
+		for (int iteration = 0; iteration < 20; ++iteration) {
+			BOOST_REQUIRE(pixelToObject(geometries[1], static_cast<double>(x), static_cast<double>(y), z, X, Y));
+			z = static_cast<float>(pileZ(X, Y));
+		}
+		return z;
+	});
+	geometries[1] = pileDepthMap.GetGeometry(matrices[1]);
+	for (int i = 0; i < 2; ++i) {
+		BOOST_REQUIRE(geometries[i].BuildDepthPyramid());
+	}
+
+	// Polygon around both, in the first frame
+	iconic::Geometry::Polygon polygon;
+	const double corners[4][2] = { { 299.5, 199.5 }, { 299.5, 899.5 }, { 1199.5, 899.5 }, { 1199.5, 199.5 } };
+	for (int i = 0; i < 4; ++i) {
+		const Eigen::Vector3d pt = pixelToCamera * Eigen::Vector3d(corners[i][0], corners[i][1], 1.0);
+		polygon.outer().push_back(iconic::Geometry::Point(pt[0] / pt[2], pt[1] / pt[2]));
+	}
+	iconic::ChangeDetection::Options options;
+	iconic::ChangeDetection::Result result;
+	iconic::ChangeDetection::Raster difference;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE(iconic::ChangeDetection::Compute(geometries[0], geometries[1], polygon, options, result, &difference));
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Compared " << result.cCount << " pixels, cut " << result.cCutVolume << " (expected " << 10.0 * boxArea << "), fill " << result.cFillVolume
+		<< " (expected " << pileVolume << "), wall time " << elapsed.count() << " s" << std::endl;
+	BOOST_TEST(result.cCount == 900 * 700);
+	BOOST_TEST(result.cInvalidCount == 0);
+	BOOST_TEST(std::abs(result.cCutVolume - 10.0 * boxArea) < 1.0e-3 * 10.0 * boxArea);
+	BOOST_TEST(std::abs(result.cFillVolume - pileVolume) < 1.0e-2 * pileVolume);
+	BOOST_TEST(std::abs(result.GetNetVolume() - (pileVolume - 10.0 * boxArea)) < 1.0e-2 * pileVolume);
+	BOOST_TEST(result.cMin == -10.0f);
+	BOOST_TEST(result.cMax > 0.99 * pileHeight);
+	BOOST_TEST(result.cMax <= pileHeight);
+	BOOST_TEST(difference.cWidth == width);
+	BOOST_TEST(difference.cHeight == height);
+	BOOST_TEST(difference.cvValues[400 * width + 500] == -10.0f);
+	BOOST_TEST(difference.cvValues[300 * width + 1000] == 0.0f);
+	BOOST_TEST(std::isnan(difference.cvValues[100 * width + 100]));
+
+	// The difference raster is a depth map
+	const wxString differenceFilename = wxFileName::CreateTempFileName("dmp");
+	BOOST_REQUIRE(difference.Write(differenceFilename));
+	{
+		iconic::RawDepthMap differenceMap;
+		BOOST_REQUIRE(differenceMap.Open(differenceFilename, width, height));
+		float z = 0.0f;
+		BOOST_REQUIRE(differenceMap.GetZ(1000, 700, z));
+		BOOST_TEST(z > 0.99f * pileHeight);
+	}
+	wxRemoveFile(differenceFilename);
+
+	// Whole overlap. The first frame sees more than the second.
+	iconic::ChangeDetection::Result overlap;
+	BOOST_REQUIRE(iconic::ChangeDetection::Compute(geometries[0], geometries[1], options, overlap));
+	BOOST_TEST(overlap.cInvalidCount > 0);
+	BOOST_TEST(overlap.cCount + overlap.cInvalidCount == width * height);
+	BOOST_TEST(std::abs(overlap.cCutVolume - result.cCutVolume) < 1.0e-9 * result.cCutVolume);
+	BOOST_TEST(std::abs(overlap.cFillVolume - result.cFillVolume) < 1.0e-6 * result.cFillVolume);
+
+	// Fast preview on the depth pyramid
+	options.cLevel = 1;
+	iconic::ChangeDetection::Result preview;
+	start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE(iconic::ChangeDetection::Compute(geometries[0], geometries[1], polygon, options, preview));
+	elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Compared " << preview.cCount << " depth pyramid cells, cut " << preview.cCutVolume << ", fill " << preview.cFillVolume << ", wall time " << elapsed.count() << " s" << std::endl;
+	BOOST_TEST(preview.cCount < result.cCount / 10);
+	BOOST_TEST(std::abs(preview.cCutVolume - result.cCutVolume) < 5.0e-2 * result.cCutVolume);
+	BOOST_TEST(std::abs(preview.cFillVolume - result.cFillVolume) < 5.0e-2 * result.cFillVolume);
+
+	geometries[1].cpDepthMap.reset(); // Declared after the geometries, so unmapped here before its file is removed
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_uncertainty_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	wxLog::SetActiveTarget(new wxLogStderr); // Log to console
+	wxLog::SetVerbose(true); // Log wxLogVerbose in additions to errors, warning, messages
+
+	// Flat ground at Z=10 with a 200x200 pixel box of height 10 and a stripe of invalid values
+	const size_t width = 1600, height = 1200;
+	TestDepthMap depthMap(width, height, [](size_t x, size_t y) { return (x >= 1100 && x < 1110) ? 1.0e10f : (x >= 400 && x < 600 && y >= 300 && y < 500) ? 20.0f : 10.0f; });
+
+	const double nadir[12] = {
+		1000.0, 0.0, 0.0, -20000.0,
+		0.0, 1000.0, 0.0, -10000.0,
+		0.0, 0.0, -1.0, 300.0 };
+	iconic::Geometry geometry = depthMap.GetGeometry(nadir);
+
+	// Polygon with vertices on the ground around the box, across the invalid stripe
+	const Eigen::Matrix3d pixelToCamera = geometry.cCameraToPixelTransform.inverse();
+	auto pixelToImage = [&](double x, double y) {
+		const Eigen::Vector3d pt = pixelToCamera * Eigen::Vector3d(x, y, 1.0);
+		return iconic::Geometry::Point(pt[0] / pt[2], pt[1] / pt[2]);
+	};
+	const double W = 1100.0, H = 700.0;
+	iconic::Geometry::Polygon polygon;
+	const double outer[4][2] = { { 199.5, 99.5 }, { 199.5, 99.5 + H }, { 199.5 + W, 99.5 + H }, { 199.5 + W, 99.5 } };
+	for (int i = 0; i < 4; ++i) {
+		polygon.outer().push_back(pixelToImage(outer[i][0], outer[i][1]));
+	}
+	polygon.outer().push_back(polygon.outer().front());
+
+	// Without errors every draw is the measurement
+	iconic::Uncertainty::Options options;
+	options.cSamples = 100;
+	options.cVertexSigma = 0.0;
+	iconic::Uncertainty::Result exact;
+	BOOST_REQUIRE(iconic::Uncertainty::Estimate(geometry, polygon, options, exact));
+	BOOST_TEST(exact.cSamples == 100);
+	BOOST_TEST(exact.cVolume.cStdDev == 0.0);
+	BOOST_TEST(exact.cVolume.cLower == exact.cVolume.cValue);
+	BOOST_TEST(exact.cArea.cUpper == exact.cArea.cValue);
+	const double pixelArea = exact.cArea.cValue / (W * H);
+	std::cerr << "Perimeter " << exact.cLength.cValue << ", area " << exact.cArea.cValue << ", volume " << exact.cVolume.cValue << std::endl;
+	std::vector<iconic::Geometry::Point3D> vVertices;
+	iconic::Geometry::Point3D vertex;
+	for (const iconic::Geometry::Point& pt : polygon.outer()) {
+		BOOST_REQUIRE(geometry.ImageToObject(pt, vertex));
+		vVertices.push_back(vertex);
+	}
+	const Eigen::Vector3d origin(vVertices[0].get<0>(), vVertices[0].get<1>(), vVertices[0].get<2>());
+	Eigen::Vector3d plane;
+	iconic::VolumeIntegrator::Moments moments;
+	BOOST_REQUIRE(iconic::VolumeIntegrator::FitPlane(vVertices, origin, plane));
+	BOOST_REQUIRE(iconic::VolumeIntegrator::Integrate(geometry, polygon, origin, moments));
+	BOOST_TEST(exact.cVolume.cValue == iconic::VolumeIntegrator::GetVolume(moments, plane));
+
+	// Vertex placement only. The vertices stay on flat ground, so the volume does not change, and each vertex changes the area by half the cross product with its neighbours.
+	options.cSamples = 1000;
+	options.cVertexSigma = 0.5;
+	iconic::Uncertainty::Result placement;
+	BOOST_REQUIRE(iconic::Uncertainty::Estimate(geometry, polygon, options, placement));
+	std::cerr << "Placement: area " << placement.cArea.cMean << " +- " << placement.cArea.cStdDev << ", volume " << placement.cVolume.cMean << " +- " << placement.cVolume.cStdDev << std::endl;
+	const double areaSigma = options.cVertexSigma * std::sqrt(W * W + H * H) * pixelArea;
+	BOOST_TEST(std::abs(placement.cArea.cStdDev - areaSigma) < 0.1 * areaSigma);
+	BOOST_TEST(placement.cArea.cLower < placement.cArea.cValue);
+	BOOST_TEST(placement.cArea.cUpper > placement.cArea.cValue);
+	BOOST_TEST(placement.cVolume.cStdDev < 1.0e-6 * placement.cVolume.cValue);
+
+	// Depth noise only. The plane through four vertices moves by sigma/2 at the centroid, and the pixels add their own noise.
+	options.cVertexSigma = 0.0;
+	options.cDepthSigma = 0.1;
+	iconic::Uncertainty::Result depth;
+	BOOST_REQUIRE(iconic::Uncertainty::Estimate(geometry, polygon, options, depth));
+	const size_t count = static_cast<size_t>(W * H) - 10 * static_cast<size_t>(H);
+	const double volumeSigma = options.cDepthSigma * exact.cArea.cValue * std::sqrt(0.25 + 1.0 / count);
+	std::cerr << "Depth: volume " << depth.cVolume.cMean << " +- " << depth.cVolume.cStdDev << ", expected +- " << volumeSigma << std::endl;
+	BOOST_TEST(std::abs(depth.cVolume.cStdDev - volumeSigma) < 0.1 * volumeSigma);
+	BOOST_TEST(std::abs(depth.cVolume.cMean - depth.cVolume.cValue) < 4.0 * volumeSigma / std::sqrt(1000.0));
+
+	// Both, timed and repeatable
+	options.cVertexSigma = 0.5;
+	iconic::Uncertainty::Result both;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE(iconic::Uncertainty::Estimate(geometry, polygon, options, both));
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Estimated " << both.cSamples << " draws, volume " << both.cVolume.cValue << " [" << both.cVolume.cLower << "," << both.cVolume.cUpper << "], wall time " << elapsed.count() << " s" << std::endl;
+	BOOST_TEST(both.cSamples == 1000);
+	BOOST_TEST(both.cRejected == 0);
+	iconic::Uncertainty::Result repeated;
+	BOOST_REQUIRE(iconic::Uncertainty::Estimate(geometry, polygon, options, repeated));
+	BOOST_TEST(repeated.cVolume.cMean == both.cVolume.cMean);
+	BOOST_TEST(repeated.cVolume.cUpper == both.cVolume.cUpper);
+
+	// A line along the pixel rows changes length with the difference of its end points
+	iconic::Geometry::VectorTrain line;
+	line.push_back(pixelToImage(199.5, 99.5));
+	line.push_back(pixelToImage(199.5 + W, 99.5));
+	options.cDepthSigma = 0.0;
+	iconic::Uncertainty::Result length;
+	BOOST_REQUIRE(iconic::Uncertainty::Estimate(geometry, line, options, length));
+	const double lengthSigma = options.cVertexSigma * std::sqrt(2.0 * pixelArea);
+	BOOST_TEST(std::abs(length.cLength.cValue - W * std::sqrt(pixelArea)) < 1.0e-9 * length.cLength.cValue);
+	BOOST_TEST(std::abs(length.cLength.cStdDev - lengthSigma) < 0.1 * lengthSigma);
+
+	delete wxLog::SetActiveTarget(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_vertex_index_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	// Random walk as traced along an edge
+	std::mt19937 generator(3);
+	std::normal_distribution<double> step(0.0, 1.0e-3);
+	std::uniform_real_distribution<double> coordinate(-0.5, 0.5);
+	iconic::Geometry::VectorTrain line;
+	line.push_back(iconic::Geometry::Point(0.0, 0.0));
+	for (size_t i = 1; i < 20000; ++i) {
+		line.push_back(iconic::Geometry::Point(line.back().get<0>() + step(generator), line.back().get<1>() + step(generator)));
+	}
+	iconic::VertexIndex index;
+	BOOST_TEST(!index.IsValid(line.size(), false));
+	index.Build(line.data(), line.size() - 100, false);
+	for (size_t n = line.size() - 99; n <= line.size(); ++n) {
+		index.Append(line.data(), n);
+	}
+	BOOST_REQUIRE(index.IsValid(line.size(), false));
+	for (size_t i = 0; i < 100; ++i) {
+		const size_t moved = std::uniform_int_distribution<size_t>(0, line.size() - 1)(generator);
+		const iconic::Geometry::Point previousPt = line[moved];
+		line[moved] = iconic::Geometry::Point(coordinate(generator), coordinate(generator));
+		index.Move(line.data(), line.size(), moved, previousPt);
+	}
+
+	// Same distances as a linear scan
+	const auto check = [&](const iconic::Geometry::Point* pPoints, size_t n, bool bClosed, size_t queries) {
+		for (size_t q = 0; q < queries; ++q) {
+			const iconic::Geometry::Point pt(coordinate(generator), coordinate(generator));
+			double vertexDistance = std::numeric_limits<double>::max(), segmentDistance = std::numeric_limits<double>::max();
+			for (size_t i = 0; i < n; ++i) {
+				vertexDistance = std::min(vertexDistance, boost::geometry::distance(pt, pPoints[i]));
+				if (i + 1 < n || bClosed) {
+					segmentDistance = std::min(segmentDistance, boost::geometry::distance(pt, iconic::VertexIndex::Segment(pPoints[i], pPoints[(i + 1) % n])));
+				}
+			}
+			size_t vertex = 0, segment = 0;
+			double distance = 0.0;
+			BOOST_REQUIRE(index.GetNearestVertex(pt, vertex, distance));
+			BOOST_TEST(distance == vertexDistance);
+			BOOST_TEST(boost::geometry::distance(pt, pPoints[vertex]) == distance);
+			BOOST_REQUIRE(index.GetNearestSegment(pt, segment, distance));
+			BOOST_TEST(std::abs(distance - segmentDistance) < 1.0e-12);
+			BOOST_TEST(std::abs(boost::geometry::distance(pt, iconic::VertexIndex::Segment(pPoints[segment], pPoints[(segment + 1) % n])) - distance) < 1.0e-12);
+		}
+	};
+	check(line.data(), line.size(), false, 200);
+
+	const size_t queries = 10000;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t vertex = 0, segment = 0, sum = 0;
+	double distance = 0.0;
+	for (size_t q = 0; q < queries; ++q) {
+		const iconic::Geometry::Point pt(coordinate(generator), coordinate(generator));
+		index.GetNearestVertex(pt, vertex, distance);
+		index.GetNearestSegment(pt, segment, distance);
+		sum += vertex + segment;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Found " << queries << " nearest vertices and segments among " << line.size() << " vertices, wall time " << elapsed.count() << " s" << std::endl;
+	BOOST_TEST(sum > 0);
+
+	// A ring connects its last vertex to the first
+	iconic::Geometry::Polygon::ring_type ring;
+	for (int i = 0; i < 50; ++i) {
+		const double angle = 2.0 * std::acos(-1.0) * i / 50;
+		ring.push_back(iconic::Geometry::Point(0.4 * std::cos(angle), 0.4 * std::sin(angle)));
+	}
+	index.Build(ring.data(), ring.size(), true);
+	BOOST_TEST(!index.IsValid(ring.size(), false));
+	const iconic::Geometry::Point previousPt = ring[0];
+	ring[0] = iconic::Geometry::Point(0.45, 0.01);
+	index.Move(ring.data(), ring.size(), 0, previousPt);
+	check(ring.data(), ring.size(), true, 200);
+	BOOST_REQUIRE(index.GetNearestSegment(iconic::Geometry::Point(0.4, -0.02), segment, distance));
+	BOOST_TEST(segment == ring.size() - 1);
+}
+
+BOOST_AUTO_TEST_CASE(iconic_shape_algorithms_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	const iconic::Geometry::Point point(0.1, 0.2);
+	iconic::Geometry::VectorTrain line;
+	for (int j = 0; j < 4; ++j) {
+		line.push_back(iconic::Geometry::Point(0.3 + 0.002 * j, 0.2 + 0.001 * (j % 2)));
+	}
+	iconic::Geometry::Polygon polygon;
+	boost::geometry::read_wkt("POLYGON((0.5 0.5,0.503 0.5,0.503 0.503,0.5 0.503,0.5 0.5))", polygon);
+	boost::geometry::correct(polygon);
+
+	// Points within 0.005, lines within 0.001 and the inside of polygons are hit
+	BOOST_TEST(iconic::ShapeAlgorithms::Select(point, iconic::Geometry::Point(0.104, 0.2)));
+	BOOST_TEST(!iconic::ShapeAlgorithms::Select(point, iconic::Geometry::Point(0.106, 0.2)));
+	BOOST_TEST(iconic::ShapeAlgorithms::Select(line, iconic::Geometry::Point(0.301, 0.2009)));
+	BOOST_TEST(!iconic::ShapeAlgorithms::Select(line, iconic::Geometry::Point(0.301, 0.2025)));
+	BOOST_TEST(!iconic::ShapeAlgorithms::Select(iconic::Geometry::VectorTrain(), point));
+	BOOST_TEST(iconic::ShapeAlgorithms::Select(polygon, iconic::Geometry::Point(0.501, 0.502)));
+	BOOST_TEST(!iconic::ShapeAlgorithms::Select(polygon, iconic::Geometry::Point(0.504, 0.502)));
+
+	iconic::Geometry::Box box;
+	BOOST_TEST(iconic::ShapeAlgorithms::GetBoundingBox(point, box));
+	BOOST_TEST(boost::geometry::equals(box, iconic::Geometry::Box(point, point)));
+	BOOST_TEST(iconic::ShapeAlgorithms::GetBoundingBox(line, box));
+	BOOST_TEST(boost::geometry::equals(box, iconic::Geometry::Box(iconic::Geometry::Point(0.3, 0.2), iconic::Geometry::Point(0.306, 0.201))));
+	BOOST_TEST(iconic::ShapeAlgorithms::GetBoundingBox(polygon, box));
+	BOOST_TEST(boost::geometry::equals(box, iconic::Geometry::Box(iconic::Geometry::Point(0.5, 0.5), iconic::Geometry::Point(0.503, 0.503))));
+	BOOST_TEST(!iconic::ShapeAlgorithms::GetBoundingBox(iconic::Geometry::VectorTrain(), box));
+	BOOST_TEST(!iconic::ShapeAlgorithms::GetBoundingBox(iconic::Geometry::Polygon(), box));
+
+	// WKT reads back to the same shape
+	std::string wkt;
+	iconic::ShapeAlgorithms::GetWKT(point, wkt);
+	BOOST_TEST(wkt.compare(0, 6, "POINT(") == 0);
+	iconic::ShapeAlgorithms::GetWKT(line, wkt);
+	BOOST_TEST(wkt.compare(0, 11, "LINESTRING(") == 0);
+	iconic::ShapeAlgorithms::GetWKT(polygon, wkt);
+	BOOST_TEST(wkt.compare(0, 9, "POLYGON((") == 0);
+	iconic::Geometry::Polygon read;
+	boost::geometry::read_wkt(wkt, read);
+	BOOST_REQUIRE(read.outer().size() == polygon.outer().size());
+	for (size_t i = 0; i < read.outer().size(); ++i) {
+		BOOST_TEST(boost::geometry::distance(read.outer()[i], polygon.outer()[i]) < 1.0e-5);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(iconic_shape_slot_map_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	// The map only stores and returns the pointers, so they need not point to constructed shapes
+	const size_t n = 100000;
+	std::vector<char> vStorage(n);
+	const auto shape = [&](size_t i) { return iconic::ShapePtr(iconic::ShapePtr(), reinterpret_cast<iconic::Shape*>(&vStorage[i])); };
+
+	iconic::ShapeSlotMap map;
+	std::vector<iconic::ShapeHandle> vHandles;
+	for (size_t i = 0; i < n; ++i) {
+		vHandles.push_back(map.Insert(shape(i)));
+	}
+	BOOST_TEST(map.Size() == n);
+	BOOST_TEST(iconic::ShapeHandle().IsNull());
+	BOOST_TEST(!map.Contains(iconic::ShapeHandle()));
+	BOOST_TEST(map.Get(vHandles[1234]) == shape(1234));
+	BOOST_TEST(map.GetPosition(vHandles[1234]) == 1234);
+
+	// Erase every other shape from the front, the handles of the others stay valid
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < n; i += 2) {
+		BOOST_REQUIRE(map.Erase(vHandles[i]));
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Erased " << n / 2 << " of " << n << " shapes, wall time " << elapsed.count() << " s" << std::endl;
+	BOOST_TEST(map.Size() == n / 2);
+	for (size_t i = 0; i < n; ++i) {
+		if (i % 2) {
+			BOOST_REQUIRE(map.Get(vHandles[i]) == shape(i));
+			BOOST_REQUIRE((map.GetHandle(map.GetPosition(vHandles[i])) == vHandles[i]));
+		} else {
+			BOOST_REQUIRE(!map.Contains(vHandles[i]));
+			BOOST_REQUIRE(!map.Get(vHandles[i]));
+			BOOST_REQUIRE(map.GetPosition(vHandles[i]) == iconic::ShapeSlotMap::npos);
+		}
+	}
+	BOOST_TEST(!map.Erase(vHandles[0]));
+
+	// The shapes keep the order of insertion, e.g. the first hit of a selection
+	for (size_t i = 0; i < map.Size(); ++i) {
+		BOOST_REQUIRE(map.GetShapes()[i] == shape(2 * i + 1));
+	}
+	BOOST_TEST(map.GetPosition(vHandles[1235]) == 617);
+
+	// Erased slots are reused with a new generation, so the old handles do not find the new shapes
+	const iconic::ShapeHandle reused = map.Insert(shape(0));
+	BOOST_TEST(reused.cIndex == vHandles[n - 2].cIndex);
+	BOOST_TEST((reused != vHandles[n - 2]));
+	BOOST_TEST(!map.Contains(vHandles[n - 2]));
+	BOOST_TEST(map.Get(reused) == shape(0));
+	BOOST_TEST(map.GetShapes().back() == shape(0));
+
+	// Clear makes all handles stale
+	map.Clear();
+	BOOST_TEST(map.Size() == 0);
+	BOOST_TEST(!map.Contains(reused));
+	BOOST_TEST(!map.Contains(vHandles[1]));
+	const iconic::ShapeHandle handle = map.Insert(shape(1));
+	BOOST_TEST(map.Get(handle) == shape(1));
+	BOOST_TEST(!map.Contains(vHandles[handle.cIndex]));
+}
+
+BOOST_AUTO_TEST_CASE(iconic_parallel_for_test)
+{
+	std::cerr << "\nRunning test case: " << boost::unit_test::framework::current_test_case().p_name << std::endl;
+
+	// Every index is visited once and no chunk is empty, also when the chunk size is rounded up. Which sizes round up depends on the number of threads.
+	for (size_t n = 1; n < 300; ++n) {
+		for (size_t grain : { size_t(1), size_t(3) }) {
+			std::vector<int> vVisits(n, 0);
+			std::mutex mutex;
+			bool bEmpty = false;
+			iconic::ThreadPool::GetInstance().ParallelFor(10, 10 + n, [&](size_t begin, size_t end) {
+				std::lock_guard<std::mutex> lock(mutex);
+				bEmpty = bEmpty || begin >= end || end > 10 + n;
+				for (size_t i = begin; i < end && i < 10 + n; ++i) {
+					++vVisits[i - 10];
+				}
+			}, grain);
+			BOOST_TEST(!bEmpty);
+			BOOST_TEST(std::all_of(vVisits.begin(), vVisits.end(), [](int visits) { return visits == 1; }));
+		}
+	}
+}
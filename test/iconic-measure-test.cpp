@@ -6,4 +6,6 @@
 
 #include <triangulate.hpp>
 #include <polygon.hpp>
+#include <depthmap.hpp>
+#include <geometry.hpp>
 
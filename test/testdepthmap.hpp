@@ -0,0 +1,73 @@
+#pragma once
+
+#include <IconicMeasureCommon/DepthMap.h>
+#include <IconicMeasureCommon/Geometry.h>
+#include <IconicSensor/Camera.h>
+#include <boost/make_shared.hpp>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Depth map of a test case, written to a temporary raw depth map file and memory mapped.
+ *
+ * The file is removed on destruction, so declare it before the geometries using it.
+*/
+struct TestDepthMap {
+	const size_t cWidth;				//!< Width of the depth map and the image
+	const size_t cHeight;				//!< Height of the depth map and the image
+	std::vector<float> cvZ;				//!< The Z values, row by row
+	wxString cFileName;					//!< Temporary \c .dmp file
+	iconic::RawDepthMapPtr cpDepthMap;	//!< The mapped file
+
+	/**
+	 * @brief Write and open the depth map
+	 * @param width Width in pixels
+	 * @param height Height in pixels
+	 * @param getZ Z value of pixel (x, y)
+	*/
+	TestDepthMap(size_t width, size_t height, const std::function<float(size_t x, size_t y)>& getZ) :
+		cWidth(width),
+		cHeight(height),
+		cvZ(width * height),
+		cFileName(wxFileName::CreateTempFileName("dmp")) {
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				cvZ[y * width + x] = getZ(x, y);
+			}
+		}
+		{
+			wxFFile file(cFileName, "wb");
+			BOOST_REQUIRE(file.IsOpened());
+			BOOST_REQUIRE(file.Write(cvZ.data(), cvZ.size() * sizeof(float)) == cvZ.size() * sizeof(float));
+		}
+		cpDepthMap = boost::make_shared<iconic::RawDepthMap>();
+		BOOST_REQUIRE(cpDepthMap->Open(cFileName, width, height));
+	}
+
+	/**
+	 * @brief Unmap and remove the file
+	*/
+	~TestDepthMap() {
+		cpDepthMap.reset();
+		wxRemoveFile(cFileName);
+	}
+
+	/**
+	 * @brief Get a geometry of the depth map and a camera, as read for a frame
+	 * @param pMatrix 3x4 camera matrix, row by row as in a camera file, or nullptr for no camera. See Geometry::cProjection for how it was classified.
+	 * @return The geometry
+	*/
+	iconic::Geometry GetGeometry(const double* pMatrix = nullptr) const {
+		iconic::Geometry geometry;
+		geometry.cpDepthMap = cpDepthMap;
+		geometry.cImageSize[0] = cWidth;
+		geometry.cImageSize[1] = cHeight;
+		iconic::Camera::Camera2PixelMatrix(cWidth, cHeight, geometry.cCameraToPixelTransform);
+		if (pMatrix) {
+			BOOST_REQUIRE(geometry.SetCameraMatrix(pMatrix) != iconic::Geometry::EProjection::NONE);
+		}
+		return geometry;
+	}
+};